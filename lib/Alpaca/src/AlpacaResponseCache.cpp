@@ -0,0 +1,146 @@
+#include "AlpacaResponseCache.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char HEAD[] = "{\"ErrorNumber\":0,\"ErrorMessage\":\"\",\"Value\":";
+static const char CLIENT_ID[] = ",\"ClientTransactionID\":";
+static const char SERVER_ID[] = ",\"ServerTransactionID\":";
+
+AlpacaResponseCache::AlpacaResponseCache() : count(0) {}
+
+// FNV-1a, so most lookups only compare a word per entry
+uint32_t AlpacaResponseCache::hashMember(const char *member) {
+  uint32_t hash = 2166136261u;
+  while (*member) {
+    hash ^= (uint8_t)*member++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+const AlpacaResponseCache::Entry *
+AlpacaResponseCache::find(const char *member, uint32_t hash) const {
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].hash == hash && strcmp(entries[i].member, member) == 0) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+AlpacaResponseCache::Entry *AlpacaResponseCache::findOrAdd(const char *member) {
+  uint32_t hash = hashMember(member);
+  Entry *entry = const_cast<Entry *>(find(member, hash));
+  if (entry) {
+    return entry;
+  }
+  if (count == ALPACA_CACHE_CAPACITY ||
+      strlen(member) >= ALPACA_CACHE_MEMBER_SIZE) {
+    return nullptr;
+  }
+  entry = &entries[count++];
+  entry->hash = hash;
+  strcpy(entry->member, member);
+  return entry;
+}
+
+bool AlpacaResponseCache::putRaw(const char *member, const char *json,
+                                 uint32_t version) {
+  size_t length = strlen(json);
+  if (length >= ALPACA_CACHE_VALUE_SIZE) {
+    return false;
+  }
+  Entry *entry = findOrAdd(member);
+  if (!entry) {
+    return false;
+  }
+  memcpy(entry->value, json, length + 1);
+  entry->valueLength = length;
+  entry->version = version;
+  return true;
+}
+
+bool AlpacaResponseCache::putBool(const char *member, bool value,
+                                  uint32_t version) {
+  return putRaw(member, value ? "true" : "false", version);
+}
+
+bool AlpacaResponseCache::putInteger(const char *member, long value,
+                                     uint32_t version) {
+  char json[ALPACA_CACHE_VALUE_SIZE];
+  snprintf(json, sizeof(json), "%ld", value);
+  return putRaw(member, json, version);
+}
+
+bool AlpacaResponseCache::putDouble(const char *member, double value,
+                                    uint32_t version) {
+  char json[ALPACA_CACHE_VALUE_SIZE];
+  snprintf(json, sizeof(json), "%lf", value);
+  return putRaw(member, json, version);
+}
+
+// Alpaca strings here are our own constants, so no escaping is done.
+bool AlpacaResponseCache::putString(const char *member, const char *value,
+                                    uint32_t version) {
+  char json[ALPACA_CACHE_VALUE_SIZE];
+  int n = snprintf(json, sizeof(json), "\"%s\"", value);
+  if (n < 0 || n >= (int)sizeof(json)) {
+    return false;
+  }
+  return putRaw(member, json, version);
+}
+
+void AlpacaResponseCache::clear() { count = 0; }
+
+// Appends value in decimal, returning chars written. Cheaper than snprintf,
+// which is most of the cost of formatting these replies.
+static size_t appendLong(char *out, long value) {
+  char digits[24];
+  size_t n = 0;
+  unsigned long magnitude =
+      value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+  do {
+    digits[n++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  size_t written = 0;
+  if (value < 0) {
+    out[written++] = '-';
+  }
+  while (n) {
+    out[written++] = digits[--n];
+  }
+  return written;
+}
+
+size_t AlpacaResponseCache::render(const char *member, uint32_t version,
+                                   long clientTransactionID,
+                                   long serverTransactionID, char *buffer,
+                                   size_t bufferSize) const {
+  const Entry *entry = find(member, hashMember(member));
+  if (!entry ||
+      (entry->version != ALPACA_CACHE_STATIC && entry->version != version)) {
+    return 0;
+  }
+  // worst case: two 20 char longs, a closing brace and the terminator
+  if (sizeof(HEAD) + entry->valueLength + sizeof(CLIENT_ID) +
+          sizeof(SERVER_ID) + 42 >
+      bufferSize) {
+    return 0;
+  }
+
+  char *out = buffer;
+  memcpy(out, HEAD, sizeof(HEAD) - 1);
+  out += sizeof(HEAD) - 1;
+  memcpy(out, entry->value, entry->valueLength);
+  out += entry->valueLength;
+  memcpy(out, CLIENT_ID, sizeof(CLIENT_ID) - 1);
+  out += sizeof(CLIENT_ID) - 1;
+  out += appendLong(out, clientTransactionID);
+  memcpy(out, SERVER_ID, sizeof(SERVER_ID) - 1);
+  out += sizeof(SERVER_ID) - 1;
+  out += appendLong(out, serverTransactionID);
+  *out++ = '}';
+  *out = 0;
+  return out - buffer;
+}
@@ -0,0 +1,79 @@
+#ifndef ALPACA_RESPONSE_CACHE_H
+#define ALPACA_RESPONSE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ALPACA_CACHE_CAPACITY 64
+#define ALPACA_CACHE_MEMBER_SIZE 32 // longest ITelescopeV3 member + 1
+#define ALPACA_CACHE_VALUE_SIZE 32  // rendered json value
+// Large enough for the envelope, the longest value and two longs
+#define ALPACA_CACHE_BODY_SIZE 192
+
+// Entries stored with this version never go stale
+#define ALPACA_CACHE_STATIC 0xffffffff
+
+/**
+ * Pre-rendered Alpaca GET responses, keyed by member name (eg "canslew").
+ *
+ * Clients like N.I.N.A poll dozens of members every second, most of which
+ * never change. Rather than formatting each reply from scratch, the JSON
+ * value is rendered once when the entry is stored, and a hit only splices
+ * the transaction IDs into the fixed envelope.
+ *
+ * Entries for members that do change (tracking, slewing) are stored with
+ * the version of the state they were rendered from. The caller passes the
+ * current version on lookup and a mismatch is a miss, which the caller
+ * answers by rendering and putting the entry again. That's the only way
+ * an entry goes stale: nothing is removed, short of clear().
+ *
+ * Not thread safe. On the device it's only used by the async_tcp task.
+ */
+class AlpacaResponseCache {
+public:
+  AlpacaResponseCache();
+
+  // Store a value. Returns false if the cache is full or the member or
+  // value is too long.
+  bool putBool(const char *member, bool value,
+               uint32_t version = ALPACA_CACHE_STATIC);
+  bool putInteger(const char *member, long value,
+                  uint32_t version = ALPACA_CACHE_STATIC);
+  bool putDouble(const char *member, double value,
+                 uint32_t version = ALPACA_CACHE_STATIC);
+  bool putString(const char *member, const char *value,
+                 uint32_t version = ALPACA_CACHE_STATIC);
+  // value must already be valid json, eg "[]"
+  bool putRaw(const char *member, const char *json,
+              uint32_t version = ALPACA_CACHE_STATIC);
+
+  /**
+   * Writes the full response body for member into buffer. Returns its
+   * length, or 0 on a miss (unknown member, stale version, or buffer too
+   * small).
+   */
+  size_t render(const char *member, uint32_t version, long clientTransactionID,
+                long serverTransactionID, char *buffer,
+                size_t bufferSize) const;
+
+  void clear();
+  size_t size() const { return count; }
+
+private:
+  struct Entry {
+    uint32_t hash;
+    uint32_t version;
+    char member[ALPACA_CACHE_MEMBER_SIZE];
+    char value[ALPACA_CACHE_VALUE_SIZE];
+    uint8_t valueLength;
+  };
+
+  static uint32_t hashMember(const char *member);
+  const Entry *find(const char *member, uint32_t hash) const;
+  Entry *findOrAdd(const char *member);
+
+  Entry entries[ALPACA_CACHE_CAPACITY];
+  size_t count;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "ClientLatency.h"
+
+ClientLatency::ClientLatency()
+    : fixedSeconds(-1), roundTripSeconds(0), pollSeconds(0), polled(false) {}
+
+void ClientLatency::setFixed(double seconds) { fixedSeconds = seconds; }
+
+static double smooth(double average, double sample) {
+  if (average == 0) {
+    return sample;
+  }
+  return average + CLIENT_LATENCY_SMOOTHING * (sample - average);
+}
+
+void ClientLatency::addRoundTrip(double seconds) {
+  if (seconds <= 0 || seconds > CLIENT_LATENCY_MAX_ROUND_TRIP_SECONDS) {
+    return;
+  }
+  roundTripSeconds = smooth(roundTripSeconds, seconds);
+}
+
+void ClientLatency::addPoll(TimePoint time) {
+  if (polled) {
+    double seconds = differenceInSeconds(lastPoll, time);
+    if (seconds > 0 && seconds <= CLIENT_LATENCY_MAX_POLL_SECONDS) {
+      pollSeconds = smooth(pollSeconds, seconds);
+    }
+  }
+  polled = true;
+  lastPoll = time;
+}
+
+double ClientLatency::getSeconds() const {
+  double seconds = fixedSeconds;
+  if (isAutomatic()) {
+    if (roundTripSeconds == 0 && pollSeconds == 0) {
+      return CLIENT_LATENCY_DEFAULT_SECONDS;
+    }
+    seconds = roundTripSeconds / 2 + pollSeconds / 2;
+  }
+  return seconds < MOTION_MAX_LEAD_SECONDS ? seconds : MOTION_MAX_LEAD_SECONDS;
+}
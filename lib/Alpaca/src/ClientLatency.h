@@ -0,0 +1,50 @@
+#ifndef ALPACA_CLIENT_LATENCY_H
+#define ALPACA_CLIENT_LATENCY_H
+
+#include "EncoderMotion.h"
+#include "TimePoint.h"
+
+// until anything's been measured
+#define CLIENT_LATENCY_DEFAULT_SECONDS 0.1
+// weight of each new sample, as TCP smooths its round trip time
+#define CLIENT_LATENCY_SMOOTHING 0.125
+// longer is a broken sample or a paused client, not the network
+#define CLIENT_LATENCY_MAX_ROUND_TRIP_SECONDS 5.0
+#define CLIENT_LATENCY_MAX_POLL_SECONDS 5.0
+
+/**
+ * How long after the model's position is read a client shows it: the reply
+ * has to get there (half a round trip), then it stays on screen until the
+ * next poll (on average, half the poll interval later). Fixed by the user,
+ * or learned: round trips as the WebUI measures them on the same WiFi, and
+ * the poll interval from ra requests as they arrive.
+ *
+ * With several clients polling ra the poll interval comes out shorter
+ * than any one of theirs, so the lead is a little less. Not thread safe,
+ * web handlers only.
+ */
+class ClientLatency {
+public:
+  ClientLatency();
+
+  // negative for automatic
+  void setFixed(double seconds);
+  bool isAutomatic() const { return fixedSeconds < 0; }
+
+  void addRoundTrip(double seconds);
+  void addPoll(TimePoint time);
+
+  double getRoundTripSeconds() const { return roundTripSeconds; }
+  double getPollSeconds() const { return pollSeconds; }
+  // what to lead the position by, at most MOTION_MAX_LEAD_SECONDS
+  double getSeconds() const;
+
+private:
+  double fixedSeconds;
+  double roundTripSeconds; // 0 until measured
+  double pollSeconds;
+  bool polled;
+  TimePoint lastPoll;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "MountState.h"
+#include <stdio.h>
+
+size_t renderMountState(const MountState &state, char *buffer,
+                        size_t bufferSize) {
+  int n = snprintf(
+      buffer, bufferSize,
+      "{\"rightascension\":%.6f,\"declination\":%.5f,\"altitude\":%.4f,"
+      "\"azimuth\":%.4f,\"siderealtime\":%.6f,\"tracking\":%s,"
+      "\"slewing\":%s,\"ispulseguiding\":%s,\"utcdate\":\"%s\","
+      "\"platformconnected\":%s,\"timetocenter\":%.1f,\"timetoend\":%.1f,"
+      "\"platformip\":\"%s\",\"calculatedaltsteps\":%ld,"
+      "\"calculatedazsteps\":%ld,\"altsteps\":%ld,\"azsteps\":%ld,"
+      "\"alignmentversion\":%lu,\"modelupdate\":%lu,\"moving\":%s,"
+      "\"leadseconds\":%.3f}",
+      state.rightAscension, state.declination, state.altitude, state.azimuth,
+      state.siderealTime, state.tracking ? "true" : "false",
+      state.slewing ? "true" : "false",
+      state.isPulseGuiding ? "true" : "false", state.utcDate,
+      state.platformConnected ? "true" : "false", state.timeToCenter,
+      state.timeToEnd, state.platformIP, state.calculatedAltEncoderSteps,
+      state.calculatedAzEncoderSteps, state.altEncoderSteps,
+      state.azEncoderSteps, (unsigned long)state.alignmentVersion,
+      (unsigned long)state.modelUpdate, state.moving ? "true" : "false",
+      state.leadSeconds);
+  if (n < 0 || (size_t)n >= bufferSize) {
+    return 0;
+  }
+  return n;
+}
+
+size_t renderMountStateAction(const MountState &state,
+                              long clientTransactionID,
+                              long serverTransactionID, char *buffer,
+                              size_t bufferSize) {
+  char json[MOUNT_STATE_BUFFER_SIZE];
+  if (renderMountState(state, json, sizeof(json)) == 0) {
+    return 0;
+  }
+
+  int n = snprintf(buffer, bufferSize,
+                   "{\"ErrorNumber\":0,\"ErrorMessage\":\"\",\"Value\":\"");
+  if (n < 0 || (size_t)n >= bufferSize) {
+    return 0;
+  }
+  size_t written = n;
+  // the state only ever contains quotes that need escaping
+  for (const char *c = json; *c; c++) {
+    if (*c == '"') {
+      if (written + 1 >= bufferSize) {
+        return 0;
+      }
+      buffer[written++] = '\\';
+    }
+    if (written + 1 >= bufferSize) {
+      return 0;
+    }
+    buffer[written++] = *c;
+  }
+  n = snprintf(buffer + written, bufferSize - written,
+               "\",\"ClientTransactionID\":%ld,\"ServerTransactionID\":%ld}",
+               clientTransactionID, serverTransactionID);
+  if (n < 0 || written + n >= bufferSize) {
+    return 0;
+  }
+  return written + n;
+}
@@ -0,0 +1,60 @@
+#ifndef ALPACA_MOUNT_STATE_H
+#define ALPACA_MOUNT_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOUNT_STATE_ACTION "getstate"
+#define MOUNT_STATE_BUFFER_SIZE 640
+// escaped state plus the Alpaca envelope
+#define MOUNT_STATE_ACTION_BUFFER_SIZE 800
+
+/**
+ * Every dynamic property of the mount, gathered at one instant so a client
+ * (or the WebUI) gets a consistent picture in a single round trip instead
+ * of polling rightascension, declination, tracking, slewing, ... one GET
+ * at a time.
+ */
+struct MountState {
+  double rightAscension; // hours
+  double declination;    // degrees
+  double altitude;       // degrees
+  double azimuth;        // degrees, north through east
+  double siderealTime;   // local, hours
+  bool tracking;
+  bool slewing;
+  bool isPulseGuiding;
+  char utcDate[24]; // ISO 8601, eg 2023-09-16T06:39:00Z
+
+  bool platformConnected;
+  double timeToCenter; // seconds
+  double timeToEnd;    // seconds
+  char platformIP[16];
+
+  long calculatedAltEncoderSteps;
+  long calculatedAzEncoderSteps;
+  long altEncoderSteps;
+  long azEncoderSteps;
+  uint32_t alignmentVersion; // changes whenever the alignment does
+  uint32_t modelUpdate;      // model task tick the position came from
+  bool moving;               // being pushed, see EncoderMotion
+  double leadSeconds;        // ra/dec given to clients are ahead by, if moving
+};
+
+/**
+ * Renders state as a compact JSON object. Returns the length, or 0 if it
+ * didn't fit.
+ */
+size_t renderMountState(const MountState &state, char *buffer,
+                        size_t bufferSize);
+
+/**
+ * Renders the reply to the Alpaca "getstate" action. Actions return a
+ * string, so the state JSON is escaped into the Value.
+ */
+size_t renderMountStateAction(const MountState &state,
+                              long clientTransactionID,
+                              long serverTransactionID, char *buffer,
+                              size_t bufferSize);
+
+#endif
@@ -0,0 +1,312 @@
+#include "Catalogue.h"
+#include "Logging.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TURN 4294967296.0 // 2^32, a full circle in file units
+
+static const char *typeNames[] = {
+    "star",         "double star",      "galaxy",
+    "open cluster", "globular cluster", "planetary nebula",
+    "nebula",       "supernova remnant", "asterism",
+    "other"};
+
+const char *catalogueTypeName(uint8_t type) {
+  if (type > CATALOGUE_OTHER) {
+    type = CATALOGUE_OTHER;
+  }
+  return typeNames[type];
+}
+
+static uint16_t readU16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t readU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static double turnsToRadians(double units) { return units * 2 * M_PI / TURN; }
+
+bool MemoryCatalogueSource::read(uint32_t offset, void *buffer,
+                                 size_t length) {
+  if (offset > size || length > size - offset) {
+    return false;
+  }
+  memcpy(buffer, data + offset, length);
+  return true;
+}
+
+CatalogueReader::CatalogueReader()
+    : source(nullptr), bandCount(0), objectCount(0), recordsOffset(0),
+      namesOffset(0), namesSize(0), pageIndex(UINT32_MAX) {
+  memset(bands, 0, sizeof(bands));
+  memset(&lastQuery, 0, sizeof(lastQuery));
+}
+
+bool CatalogueReader::open(CatalogueSource *newSource) {
+  source = nullptr;
+  pageIndex = UINT32_MAX;
+  uint8_t header[CATALOGUE_HEADER_SIZE];
+  if (!newSource->read(0, header, sizeof(header))) {
+    log("Catalogue: can't read header");
+    return false;
+  }
+  if (memcmp(header, CATALOGUE_MAGIC, 4) != 0 ||
+      readU16(header + 4) != CATALOGUE_VERSION) {
+    log("Catalogue: not a version %d catalogue", CATALOGUE_VERSION);
+    return false;
+  }
+  bandCount = readU16(header + 6);
+  objectCount = readU32(header + 8);
+  uint32_t bandsOffset = readU32(header + 12);
+  recordsOffset = readU32(header + 16);
+  namesOffset = readU32(header + 20);
+  namesSize = readU32(header + 24);
+  if (bandCount == 0 || bandCount > CATALOGUE_MAX_BANDS) {
+    log("Catalogue: %lu bands, at most %d supported", (unsigned long)bandCount,
+        CATALOGUE_MAX_BANDS);
+    return false;
+  }
+
+  uint8_t entry[4];
+  for (uint32_t b = 0; b <= bandCount; b++) {
+    if (!newSource->read(bandsOffset + b * 4, entry, sizeof(entry))) {
+      log("Catalogue: can't read band index");
+      return false;
+    }
+    bands[b] = readU32(entry);
+    if ((b > 0 && bands[b] < bands[b - 1]) || bands[b] > objectCount) {
+      log("Catalogue: band index is corrupt");
+      return false;
+    }
+  }
+  if (bands[0] != 0 || bands[bandCount] != objectCount) {
+    log("Catalogue: band index doesn't cover the records");
+    return false;
+  }
+  source = newSource;
+  return true;
+}
+
+bool CatalogueReader::readRecord(uint32_t index, Record &record) {
+  if (index >= objectCount) {
+    return false;
+  }
+  uint32_t wanted = index / CATALOGUE_PAGE_RECORDS;
+  if (wanted != pageIndex) {
+    uint32_t first = wanted * CATALOGUE_PAGE_RECORDS;
+    uint32_t count = objectCount - first;
+    if (count > CATALOGUE_PAGE_RECORDS) {
+      count = CATALOGUE_PAGE_RECORDS;
+    }
+    if (!source->read(recordsOffset + first * CATALOGUE_RECORD_SIZE, page,
+                      count * CATALOGUE_RECORD_SIZE)) {
+      pageIndex = UINT32_MAX;
+      return false;
+    }
+    pageIndex = wanted;
+    lastQuery.pagesRead++;
+  }
+  const uint8_t *p =
+      page + (index % CATALOGUE_PAGE_RECORDS) * CATALOGUE_RECORD_SIZE;
+  record.ra = readU32(p);
+  record.dec = (int32_t)readU32(p + 4);
+  record.magnitude = (int16_t)readU16(p + 8);
+  record.type = p[10];
+  record.size = p[11];
+  record.nameOffset = readU32(p + 12);
+  return true;
+}
+
+// first record in [first, last) with ra >= the given ra
+uint32_t CatalogueReader::lowerBound(uint32_t first, uint32_t last,
+                                     uint32_t ra) {
+  Record record;
+  while (first < last) {
+    uint32_t middle = first + (last - first) / 2;
+    if (!readRecord(middle, record)) {
+      return last;
+    }
+    if (record.ra < ra) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first;
+}
+
+bool CatalogueReader::fillMatch(const Record &record, CatalogueMatch &match) {
+  match.raHours = record.ra * 24.0 / TURN;
+  match.decDegrees = record.dec * 360.0 / TURN;
+  match.magnitude = record.magnitude / 100.0f;
+  match.type = record.type;
+  match.sizeArcmin = record.size;
+  match.name[0] = 0;
+  if (record.nameOffset >= namesSize) {
+    return false;
+  }
+  size_t length = namesSize - record.nameOffset;
+  if (length > CATALOGUE_NAME_SIZE - 1) {
+    length = CATALOGUE_NAME_SIZE - 1;
+  }
+  if (!source->read(namesOffset + record.nameOffset, match.name, length)) {
+    return false;
+  }
+  match.name[length] = 0;
+  return true;
+}
+
+void CatalogueReader::scan(uint32_t first, uint32_t last, uint32_t raStart,
+                           uint32_t raEnd, double sinDec, double cosDec,
+                           double raRadians, double cosRadius,
+                           CatalogueMatch *matches, size_t maxMatches,
+                           size_t &count) {
+  Record record;
+  for (uint32_t i = lowerBound(first, last, raStart); i < last; i++) {
+    if (!readRecord(i, record) || record.ra > raEnd) {
+      return;
+    }
+    lastQuery.recordsScanned++;
+    double dec = turnsToRadians(record.dec);
+    double cosDistance =
+        sinDec * sin(dec) +
+        cosDec * cos(dec) * cos(turnsToRadians(record.ra) - raRadians);
+    if (cosDistance < cosRadius) {
+      continue;
+    }
+    lastQuery.candidates++;
+    float distance =
+        (float)(acos(cosDistance > 1 ? 1 : cosDistance) * 180 / M_PI);
+    if (count == maxMatches && distance >= matches[count - 1].distanceDegrees) {
+      continue;
+    }
+    // insertion into the nearest-first list, the furthest drops off the end
+    size_t j = count < maxMatches ? count++ : count - 1;
+    while (j > 0 && matches[j - 1].distanceDegrees > distance) {
+      matches[j] = matches[j - 1];
+      j--;
+    }
+    // the rest is read once the list is final
+    matches[j].distanceDegrees = distance;
+    matches[j].index = i;
+  }
+}
+
+size_t CatalogueReader::findNear(double raHours, double decDegrees,
+                                 double radiusDegrees, CatalogueMatch *matches,
+                                 size_t maxMatches) {
+  memset(&lastQuery, 0, sizeof(lastQuery));
+  if (!isOpen() || maxMatches == 0 || radiusDegrees <= 0) {
+    return 0;
+  }
+  if (radiusDegrees > 180) {
+    radiusDegrees = 180;
+  }
+  raHours = fmod(raHours, 24);
+  if (raHours < 0) {
+    raHours += 24;
+  }
+  double decRadians = decDegrees * M_PI / 180;
+  double radiusRadians = radiusDegrees * M_PI / 180;
+  double raRadians = raHours * M_PI / 12;
+
+  double low = decDegrees - radiusDegrees;
+  double high = decDegrees + radiusDegrees;
+  long firstBand = (long)floor((low + 90) * bandCount / 180);
+  long lastBand = (long)floor((high + 90) * bandCount / 180);
+  if (firstBand < 0) {
+    firstBand = 0;
+  }
+  if (lastBand >= (long)bandCount) {
+    lastBand = bandCount - 1;
+  }
+
+  // ra either side of the centre that the cone reaches. Over a pole, or
+  // close enough that the cone wraps round it, that's everything.
+  bool allRA = low <= -90 || high >= 90;
+  double halfWidth = 0;
+  if (!allRA) {
+    double s = sin(radiusRadians) / cos(decRadians);
+    allRA = s >= 1;
+    halfWidth = allRA ? 0 : asin(s);
+  }
+  uint32_t centre = (uint32_t)(uint64_t)(raHours / 24 * TURN);
+  // a couple of units of slack for rounding
+  double halfWidthUnits = halfWidth / (2 * M_PI) * TURN + 2;
+  allRA = allRA || halfWidthUnits >= TURN / 2;
+  uint32_t raStart = allRA ? 0 : centre - (uint32_t)halfWidthUnits;
+  uint32_t raEnd = allRA ? UINT32_MAX : centre + (uint32_t)halfWidthUnits;
+
+  size_t count = 0;
+  double sinDec = sin(decRadians);
+  double cosDec = cos(decRadians);
+  double cosRadius = cos(radiusRadians);
+  for (long b = firstBand; b <= lastBand; b++) {
+    if (raStart <= raEnd) {
+      scan(bands[b], bands[b + 1], raStart, raEnd, sinDec, cosDec, raRadians,
+           cosRadius, matches, maxMatches, count);
+    } else {
+      // across 0h
+      scan(bands[b], bands[b + 1], raStart, UINT32_MAX, sinDec, cosDec,
+           raRadians, cosRadius, matches, maxMatches, count);
+      scan(bands[b], bands[b + 1], 0, raEnd, sinDec, cosDec, raRadians,
+           cosRadius, matches, maxMatches, count);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    Record record;
+    if (!readRecord(matches[i].index, record) ||
+        !fillMatch(record, matches[i])) {
+      log("Catalogue: can't read object %lu", (unsigned long)matches[i].index);
+    }
+  }
+  return count;
+}
+
+bool CatalogueReader::readObject(uint32_t index, CatalogueMatch &match) {
+  Record record;
+  if (!isOpen() || !readRecord(index, record)) {
+    return false;
+  }
+  match.distanceDegrees = 0;
+  match.index = index;
+  return fillMatch(record, match);
+}
+
+size_t renderNearbyObjects(const NearbyObjects &nearby, char *buffer,
+                           size_t bufferSize) {
+  size_t written = 0;
+#define APPEND(...)                                                            \
+  do {                                                                         \
+    int n = snprintf(buffer + written, bufferSize - written, __VA_ARGS__);     \
+    if (n < 0 || (size_t)n >= bufferSize - written) {                          \
+      return 0;                                                                \
+    }                                                                          \
+    written += n;                                                              \
+  } while (0)
+
+  APPEND("{\"available\":%s,\"ra\":%.4f,\"dec\":%.4f,\"radius\":%.2f,"
+         "\"micros\":%lu,\"objects\":[",
+         nearby.available ? "true" : "false", nearby.raHours,
+         nearby.decDegrees, nearby.radiusDegrees,
+         (unsigned long)nearby.queryMicros);
+  for (uint32_t i = 0; i < nearby.count && i < CATALOGUE_NEARBY_MAX; i++) {
+    const CatalogueMatch &match = nearby.matches[i];
+    APPEND("%s{\"name\":\"%s\",\"type\":\"%s\",\"ra\":%.4f,\"dec\":%.4f,"
+           "\"size\":%u,\"distance\":%.3f,\"mag\":",
+           i == 0 ? "" : ",", match.name, catalogueTypeName(match.type),
+           match.raHours, match.decDegrees, (unsigned)match.sizeArcmin,
+           match.distanceDegrees);
+    if (match.magnitude * 100 >= CATALOGUE_UNKNOWN_MAGNITUDE - 0.5f) {
+      APPEND("null}");
+    } else {
+      APPEND("%.2f}", match.magnitude);
+    }
+  }
+  APPEND("]}");
+#undef APPEND
+  return written;
+}
@@ -0,0 +1,170 @@
+#ifndef CATALOGUE_H
+#define CATALOGUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATALOGUE_MAGIC "DSCC"
+#define CATALOGUE_VERSION 1
+#define CATALOGUE_HEADER_SIZE 32
+#define CATALOGUE_RECORD_SIZE 16
+#define CATALOGUE_MAX_BANDS 180
+// records read from the file at a time (512 bytes)
+#define CATALOGUE_PAGE_RECORDS 32
+#define CATALOGUE_NAME_SIZE 32
+#define CATALOGUE_UNKNOWN_MAGNITUDE 9999 // centimag
+
+// what the WebUI shows around the current position
+#define CATALOGUE_NEARBY_MAX 10
+#define CATALOGUE_NEARBY_RADIUS_DEGREES 3.0
+#define CATALOGUE_NEARBY_PERIOD_MS 100 // 10Hz
+#define CATALOGUE_NEARBY_BUFFER_SIZE 1600
+
+enum CatalogueObjectType {
+  CATALOGUE_STAR = 0,
+  CATALOGUE_DOUBLE_STAR = 1,
+  CATALOGUE_GALAXY = 2,
+  CATALOGUE_OPEN_CLUSTER = 3,
+  CATALOGUE_GLOBULAR_CLUSTER = 4,
+  CATALOGUE_PLANETARY_NEBULA = 5,
+  CATALOGUE_NEBULA = 6,
+  CATALOGUE_SUPERNOVA_REMNANT = 7,
+  CATALOGUE_ASTERISM = 8,
+  CATALOGUE_OTHER = 9
+};
+
+const char *catalogueTypeName(uint8_t type);
+
+/**
+ * Where the catalogue bytes come from. On the ESP32 that's a LittleFS file
+ * read a page at a time (see src/SkyCatalogue.cpp), natively it's a file or
+ * a buffer: the format is the same either way.
+ */
+class CatalogueSource {
+public:
+  virtual ~CatalogueSource() {}
+  virtual bool read(uint32_t offset, void *buffer, size_t length) = 0;
+};
+
+// A catalogue already in memory, e.g. mapped flash or a test buffer.
+class MemoryCatalogueSource : public CatalogueSource {
+public:
+  MemoryCatalogueSource(const uint8_t *data, size_t size)
+      : data(data), size(size) {}
+  bool read(uint32_t offset, void *buffer, size_t length) override;
+
+private:
+  const uint8_t *data;
+  size_t size;
+};
+
+struct CatalogueMatch {
+  char name[CATALOGUE_NAME_SIZE];
+  double raHours; // J2000
+  double decDegrees;
+  float magnitude; // CATALOGUE_UNKNOWN_MAGNITUDE / 100 if not known
+  float distanceDegrees;
+  uint8_t type;
+  uint8_t sizeArcmin; // 0 for stars, capped at 255
+  uint32_t index;     // record number, for readObject
+};
+
+// Published by the catalogue task for the WebUI
+struct NearbyObjects {
+  bool available; // catalogue opened
+  double raHours; // where the query was centred
+  double decDegrees;
+  double radiusDegrees;
+  uint32_t queryMicros;
+  uint32_t count;
+  CatalogueMatch matches[CATALOGUE_NEARBY_MAX];
+};
+
+struct CatalogueQueryStats {
+  uint32_t pagesRead;
+  uint32_t recordsScanned;
+  uint32_t candidates; // within radius, before keeping the nearest
+};
+
+/**
+ * Deep sky objects and named stars, in a packed binary file built by
+ * tools/build_catalogue.py. Nothing is parsed into RAM: the reader keeps
+ * the header, the declination band index and one page of records, and
+ * reads everything else from the source as a query needs it.
+ *
+ * File layout, little endian:
+ * - header, CATALOGUE_HEADER_SIZE bytes: magic "DSCC", uint16 version,
+ *   uint16 bandCount, uint32 objectCount, then uint32 offsets of the band
+ *   index, the records and the names, uint32 names size, uint32 reserved
+ * - band index: bandCount + 1 uint32 record numbers. Band b covers
+ *   declinations from -90 + b * 180 / bandCount up to the next band, and
+ *   its records are [index[b], index[b + 1]).
+ * - records, CATALOGUE_RECORD_SIZE bytes each, sorted by band and then by
+ *   ra: uint32 ra and int32 dec as fractions of a turn (2^32 is 360
+ *   degrees, so about 0.0003" resolution), int16 magnitude in centimag,
+ *   uint8 type, uint8 size in arcmin, uint32 offset of the name
+ * - names: nul terminated, at most CATALOGUE_NAME_SIZE - 1 characters
+ *
+ * A cone query only visits the bands the cone overlaps, binary searches
+ * each band for the start of the cone's ra range and reads forward until
+ * the end of it, so the work is proportional to the objects near the
+ * cone rather than the size of the catalogue.
+ */
+class CatalogueReader {
+public:
+  CatalogueReader();
+
+  // Reads the header and band index. False (and logged) if the source
+  // isn't a catalogue this reader understands.
+  bool open(CatalogueSource *source);
+  bool isOpen() const { return source != nullptr; }
+  uint32_t getObjectCount() const { return objectCount; }
+  uint32_t getBandCount() const { return bandCount; }
+
+  /**
+   * Objects within radiusDegrees of ra/dec, nearest first. Returns how
+   * many were written to matches, at most maxMatches.
+   */
+  size_t findNear(double raHours, double decDegrees, double radiusDegrees,
+                  CatalogueMatch *matches, size_t maxMatches);
+
+  // Reads one object by record number, for listings
+  bool readObject(uint32_t index, CatalogueMatch &match);
+
+  CatalogueQueryStats getLastQueryStats() const { return lastQuery; }
+
+private:
+  struct Record {
+    uint32_t ra;
+    int32_t dec;
+    int16_t magnitude;
+    uint8_t type;
+    uint8_t size;
+    uint32_t nameOffset;
+  };
+
+  bool readRecord(uint32_t index, Record &record);
+  uint32_t lowerBound(uint32_t first, uint32_t last, uint32_t ra);
+  void scan(uint32_t first, uint32_t last, uint32_t raStart, uint32_t raEnd,
+            double sinDec, double cosDec, double raRadians, double cosRadius,
+            CatalogueMatch *matches, size_t maxMatches, size_t &count);
+  bool fillMatch(const Record &record, CatalogueMatch &match);
+
+  CatalogueSource *source;
+  uint32_t bandCount;
+  uint32_t objectCount;
+  uint32_t recordsOffset;
+  uint32_t namesOffset;
+  uint32_t namesSize;
+  uint32_t bands[CATALOGUE_MAX_BANDS + 1];
+  uint32_t pageIndex; // page held in page, or UINT32_MAX
+  uint8_t page[CATALOGUE_PAGE_RECORDS * CATALOGUE_RECORD_SIZE];
+  CatalogueQueryStats lastQuery;
+};
+
+// NearbyObjects as json for the WebUI. Returns the length, 0 if it didn't
+// fit.
+size_t renderNearbyObjects(const NearbyObjects &nearby, char *buffer,
+                           size_t bufferSize);
+
+#endif
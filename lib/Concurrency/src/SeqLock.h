@@ -0,0 +1,91 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// how many times tryRead looks before giving up on a write in progress
+#define SEQLOCK_TRY_READ_ATTEMPTS 4
+
+/**
+ * Single writer sequence lock for publishing small, trivially copyable
+ * snapshots (position, platform telemetry) to any number of readers.
+ *
+ * The writer never waits. Readers copy the value and retry if the writer
+ * was part way through an update, so they always get a consistent copy
+ * and never a torn mix of old and new fields.
+ *
+ * read() spins while a write is in progress, so no reader may run at a
+ * higher priority than the writer on the writer's core: if it preempted
+ * the writer part way through, nothing would ever finish the write. A
+ * reader on another core, or below the writer on its core, only ever
+ * waits for a memcpy (one at the same priority, for a time slice). Readers
+ * that can't promise that use tryRead instead. See src/Tasks.cpp for the
+ * tasks' cores and priorities.
+ */
+template <typename T> class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock copies values with memcpy");
+
+public:
+  SeqLock() : sequence(0), value() {}
+  explicit SeqLock(const T &initial) : sequence(0), value(initial) {}
+
+  void write(const T &newValue) {
+    uint32_t s = sequence.load(std::memory_order_relaxed);
+    sequence.store(s + 1, std::memory_order_relaxed); // odd: write started
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(static_cast<void *>(&value), &newValue, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_release);
+    sequence.store(s + 2, std::memory_order_relaxed); // even: done
+  }
+
+  T read() const {
+    T copy;
+    while (!tryReadOnce(copy)) {
+    }
+    return copy;
+  }
+
+  /**
+   * A consistent copy, unless the writer was part way through an update
+   * every time of SEQLOCK_TRY_READ_ATTEMPTS: then false and copy is left
+   * as it was, so a reader can carry on with the last one it got.
+   */
+  bool tryRead(T &copy) const {
+    for (int i = 0; i < SEQLOCK_TRY_READ_ATTEMPTS; i++) {
+      if (tryReadOnce(copy)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Number of completed writes, handy for readers to spot a change.
+  uint32_t version() const {
+    return sequence.load(std::memory_order_acquire) >> 1;
+  }
+
+private:
+  bool tryReadOnce(T &copy) const {
+    uint32_t before = sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      return false;
+    }
+    T attempt;
+    memcpy(static_cast<void *>(&attempt), &value, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) != before) {
+      return false;
+    }
+    copy = attempt;
+    return true;
+  }
+
+  std::atomic<uint32_t> sequence;
+  T value;
+};
+
+#endif
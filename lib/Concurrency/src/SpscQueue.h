@@ -0,0 +1,57 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Bounded lock-free single producer / single consumer queue.
+ *
+ * Used to hand work between the pinned tasks (eg HTTP handlers on the
+ * network core posting syncs to the model task) without taking a lock
+ * on either side. Exactly one thread may push, and exactly one may pop.
+ *
+ * Capacity must be a power of two. Storage is inline so nothing is
+ * allocated after construction.
+ */
+template <typename T, size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  // Producer side. Returns false (and drops value) if full.
+  bool push(const T &value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    items[t & (Capacity - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if empty.
+  bool pop(T &value) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = items[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+private:
+  T items[Capacity];
+  std::atomic<size_t> head; // next to pop, written by consumer
+  std::atomic<size_t> tail; // next to push, written by producer
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "CommandChannel.h"
+#include "Logging.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+CommandChannel::CommandChannel() : nextSeq(1), platformAcks(false) {
+  memset(&stats, 0, sizeof(stats));
+  for (Slot &slot : slots) {
+    slot.inUse = false;
+  }
+}
+
+/**
+ * Free slot, or the oldest one (lowest seq, allowing for wrap) if the
+ * window is full.
+ */
+CommandChannel::Slot *CommandChannel::freeSlot() {
+  Slot *oldest = nullptr;
+  for (Slot &slot : slots) {
+    if (!slot.inUse) {
+      return &slot;
+    }
+    if (oldest == nullptr || (int32_t)(slot.seq - oldest->seq) < 0) {
+      oldest = &slot;
+    }
+  }
+  log("Command window full, dropping seq %lu", (unsigned long)oldest->seq);
+  stats.evicted++;
+  return oldest;
+}
+
+uint32_t CommandChannel::queue(const char *command, double parameter1,
+                               double parameter2, const char *key,
+                               TimePoint now) {
+  return queueSlot(command, parameter1, parameter2, key, false, now);
+}
+
+uint32_t CommandChannel::queueTimed(const char *command, double millis1,
+                                    double millis2, const char *key,
+                                    TimePoint now) {
+  return queueSlot(command, millis1, millis2, key, true, now);
+}
+
+uint32_t CommandChannel::queueSlot(const char *command, double parameter1,
+                                   double parameter2, const char *key,
+                                   bool timed, TimePoint now) {
+  if (key != nullptr) {
+    for (Slot &slot : slots) {
+      if (slot.inUse && strncmp(slot.key, key, COMMAND_KEY_SIZE) == 0) {
+        slot.inUse = false;
+        stats.superseded++;
+      }
+    }
+  }
+  Slot *slot = freeSlot();
+  uint32_t seq = nextSeq++;
+  if (nextSeq == 0) {
+    nextSeq = 1; // 0 is never used, so an ack of 0 is no ack
+  }
+  slot->seq = seq;
+  strncpy(slot->command, command, COMMAND_NAME_SIZE - 1);
+  slot->command[COMMAND_NAME_SIZE - 1] = 0;
+  slot->parameters[0] = parameter1;
+  slot->parameters[1] = parameter2;
+  slot->timed = timed;
+  slot->queued = now;
+  if (strlen(command) >= COMMAND_NAME_SIZE || !render(*slot, now)) {
+    log("Command %s too long to send", command);
+    slot->inUse = false;
+    return 0;
+  }
+  slot->inUse = true;
+  slot->sent = false;
+  strncpy(slot->key, key != nullptr ? key : "", COMMAND_KEY_SIZE - 1);
+  slot->key[COMMAND_KEY_SIZE - 1] = 0;
+  slot->due = now;
+  slot->attempts = 0;
+
+  size_t flying = inFlight();
+  if (flying > stats.maxInFlight) {
+    stats.maxInFlight = flying;
+  }
+  return seq;
+}
+
+// a signed duration, elapsed millis of it gone
+static double remainingMillis(double millis, double elapsed) {
+  return millis > 0 ? fmax(millis - elapsed, 0) : fmin(millis + elapsed, 0);
+}
+
+bool CommandChannel::render(Slot &slot, TimePoint now) {
+  double parameters[2] = {slot.parameters[0], slot.parameters[1]};
+  if (slot.timed) {
+    double elapsed = differenceInSeconds(slot.queued, now) * 1000;
+    bool wasDoing = parameters[0] != 0 || parameters[1] != 0;
+    for (double &parameter : parameters) {
+      parameter = remainingMillis(parameter, elapsed);
+    }
+    // a stop (all 0) always goes; anything else only while some is left
+    if (wasDoing && parameters[0] == 0 && parameters[1] == 0) {
+      return false;
+    }
+  }
+  int length = snprintf(slot.packet, sizeof(slot.packet),
+                        "EQ:{\"command\":\"%s\",\"parameter1\":%.6f,"
+                        "\"parameter2\":%.6f,\"seq\":%lu}",
+                        slot.command, parameters[0], parameters[1],
+                        (unsigned long)slot.seq);
+  if (length <= 0 || length >= (int)sizeof(slot.packet)) {
+    return false;
+  }
+  slot.length = length;
+  return true;
+}
+
+bool CommandChannel::nextPacket(TimePoint now, char *buffer,
+                                size_t bufferSize, size_t &length) {
+  // oldest due first, so a resend doesn't wait behind a burst of new ones
+  Slot *next = nullptr;
+  for (Slot &slot : slots) {
+    if (slot.inUse && slot.due <= now &&
+        (next == nullptr || (int32_t)(slot.seq - next->seq) < 0)) {
+      next = &slot;
+    }
+  }
+  if (next == nullptr) {
+    return false;
+  }
+  if (next->sent && next->attempts >= COMMAND_MAX_ATTEMPTS) {
+    log("Platform never acked seq %lu", (unsigned long)next->seq);
+    stats.expired++;
+    next->inUse = false;
+    return nextPacket(now, buffer, bufferSize, length);
+  }
+  if (next->timed && !render(*next, now)) {
+    // too late to be worth doing
+    stats.lapsed++;
+    next->inUse = false;
+    return nextPacket(now, buffer, bufferSize, length);
+  }
+  if (next->length >= bufferSize) {
+    next->inUse = false;
+    return false;
+  }
+  memcpy(buffer, next->packet, next->length + 1);
+  length = next->length;
+  if (next->sent) {
+    stats.retransmitted++;
+  } else {
+    stats.sent++;
+  }
+  next->sent = true;
+  next->attempts++;
+  next->due = addMillisToTime(now, COMMAND_RETRANSMIT_MILLIS);
+  if (!platformAcks) {
+    // can't know if it got there, send once as before
+    next->inUse = false;
+  }
+  return true;
+}
+
+bool CommandChannel::isAcked(uint32_t seq, uint32_t ack, uint32_t ackBits) {
+  uint32_t behind = ack - seq;
+  if (behind == 0) {
+    return true;
+  }
+  return behind <= 32 && (ackBits & (1UL << (behind - 1))) != 0;
+}
+
+void CommandChannel::onAck(uint32_t ack, uint32_t ackBits) {
+  if (ack == 0) {
+    return;
+  }
+  for (Slot &slot : slots) {
+    if (slot.inUse && slot.sent && isAcked(slot.seq, ack, ackBits)) {
+      slot.inUse = false;
+      stats.acked++;
+    }
+  }
+}
+
+size_t CommandChannel::inFlight() const {
+  size_t count = 0;
+  for (const Slot &slot : slots) {
+    if (slot.inUse) {
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,113 @@
+#ifndef COMMAND_CHANNEL_H
+#define COMMAND_CHANNEL_H
+
+#include "TimePoint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// commands that can be waiting for an ack at once. Acks cover the latest
+// seq and the 32 before it, so no more than 32.
+#define COMMAND_WINDOW_SIZE 16
+#define COMMAND_RETRANSMIT_MILLIS 250
+#define COMMAND_MAX_ATTEMPTS 8 // 2s of tries
+#define COMMAND_PACKET_SIZE 128
+#define COMMAND_KEY_SIZE 16
+#define COMMAND_NAME_SIZE 24
+
+struct CommandChannelStats {
+  uint32_t sent; // first transmissions
+  uint32_t retransmitted;
+  uint32_t acked;
+  uint32_t superseded; // replaced by a newer command with the same key
+  uint32_t expired;    // gave up after COMMAND_MAX_ATTEMPTS
+  uint32_t lapsed;     // timed, and ran out before it was acked
+  uint32_t evicted;    // pushed out of a full window
+  uint32_t maxInFlight;
+};
+
+/**
+ * Sequence numbered commands to the EQ platform, with retransmission until
+ * acked.
+ *
+ * Each command packet carries a seq. The platform acks in its telemetry
+ * packets (sent straight back after a command, as well as every second):
+ * "ack" is the latest seq it has received and "ackBits" has bit n set if
+ * it also has ack - n - 1. Anything not acked within
+ * COMMAND_RETRANSMIT_MILLIS is sent again, up to COMMAND_MAX_ATTEMPTS.
+ *
+ * Many commands can be in flight at once; nothing waits for the previous
+ * ack. Commands that set state (an axis rate, tracking) are queued with a
+ * key, and a newer command with the same key replaces an older one that
+ * hasn't been acked, so a burst of moveaxis never resends stale rates. The
+ * platform should likewise ignore a command older than the last it applied
+ * for the same thing.
+ *
+ * Timed commands (a pulse guide) are in millis from when they were queued.
+ * Every send carries only what's left, so a resend ends when the first
+ * would have, not a whole pulse late, and one that's run out is dropped.
+ *
+ * Until the platform's telemetry shows it acks (older platforms don't),
+ * commands are sent once, as before.
+ *
+ * Pull based, like the other schedulers: queue() formats a command,
+ * nextPacket() hands back whatever is due to go out. Not thread safe, see
+ * EQPlatform for the lock.
+ */
+class CommandChannel {
+public:
+  CommandChannel();
+
+  /**
+   * Returns the command's seq. key may be null for commands that never
+   * replace each other (park, home). If the window is full the oldest
+   * command loses its place (it has had the most chances).
+   */
+  uint32_t queue(const char *command, double parameter1, double parameter2,
+                 const char *key, TimePoint now);
+  // the same, for parameters that are millis to do something for, signed
+  uint32_t queueTimed(const char *command, double millis1, double millis2,
+                      const char *key, TimePoint now);
+
+  // Next packet due now, new or resent. False if nothing is due.
+  bool nextPacket(TimePoint now, char *buffer, size_t bufferSize,
+                  size_t &length);
+
+  void onAck(uint32_t ack, uint32_t ackBits);
+  void setPlatformAcks(bool acks) { platformAcks = acks; }
+  bool getPlatformAcks() const { return platformAcks; }
+
+  size_t inFlight() const;
+  CommandChannelStats getStats() const { return stats; }
+
+private:
+  struct Slot {
+    bool inUse;
+    bool sent; // at least once
+    uint32_t seq;
+    char key[COMMAND_KEY_SIZE];
+    char command[COMMAND_NAME_SIZE];
+    double parameters[2];
+    bool timed;
+    TimePoint queued;
+    char packet[COMMAND_PACKET_SIZE];
+    uint16_t length;
+    TimePoint due;
+    uint8_t attempts;
+  };
+
+  Slot *freeSlot();
+  uint32_t queueSlot(const char *command, double parameter1,
+                     double parameter2, const char *key, bool timed,
+                     TimePoint now);
+  // the slot's packet, with what's left of a timed one as of now. False
+  // if it doesn't fit, or there's nothing left
+  bool render(Slot &slot, TimePoint now);
+  static bool isAcked(uint32_t seq, uint32_t ack, uint32_t ackBits);
+
+  Slot slots[COMMAND_WINDOW_SIZE];
+  uint32_t nextSeq;
+  bool platformAcks;
+  CommandChannelStats stats;
+};
+
+#endif
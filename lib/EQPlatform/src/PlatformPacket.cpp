@@ -0,0 +1,55 @@
+#include "PlatformPacket.h"
+#include "Logging.h"
+#include <ArduinoJson.h>
+#include <string.h>
+
+#define PLATFORM_PACKET_PREFIX "DSC:"
+
+bool parsePlatformPacket(const uint8_t *data, size_t length, TimePoint arrived,
+                         PlatformPacket &packet) {
+  size_t prefix = strlen(PLATFORM_PACKET_PREFIX);
+  if (length < prefix || memcmp(data, PLATFORM_PACKET_PREFIX, prefix) != 0) {
+    log("Message has bad starting chars");
+    return false;
+  }
+  StaticJsonDocument<PLATFORM_PACKET_JSON_SIZE> doc;
+  DeserializationError error =
+      deserializeJson(doc, (const char *)data + prefix, length - prefix);
+  if (error) {
+    log("Failed to parse payload with error %s", error.c_str());
+    return false;
+  }
+
+  if (!(doc.containsKey("timeToCenter") && doc.containsKey("timeToEnd") &&
+        doc.containsKey("axisMoveRateMax") &&
+        doc.containsKey("axisMoveRateMin") &&
+        doc.containsKey("guideMoveRate") && doc.containsKey("trackingRate") &&
+        doc.containsKey("slewing") && doc.containsKey("isTracking") &&
+        doc["timeToCenter"].is<double>() && doc["guideMoveRate"].is<double>() &&
+        doc["axisMoveRateMax"].is<double>() &&
+        doc["axisMoveRateMin"].is<double>() &&
+        doc["trackingRate"].is<double>() && doc["timeToEnd"].is<double>())) {
+    log("Payload missing required fields.");
+    return false;
+  }
+  PlatformTelemetry &parsed = packet.telemetry;
+  parsed = PlatformTelemetry();
+  parsed.runtimeFromCenterSeconds = doc["timeToCenter"];
+  parsed.timeToEnd = doc["timeToEnd"];
+  parsed.currentlyRunning = doc["isTracking"];
+  parsed.slewing = doc["slewing"];
+  parsed.pulseGuideRate = doc["guideMoveRate"];
+  parsed.axisMoveRateMax = doc["axisMoveRateMax"];
+  parsed.axisMoveRateMin = doc["axisMoveRateMin"];
+  parsed.trackingRate = doc["trackingRate"];
+  // optional, only sent by platforms with a dec axis
+  parsed.decAxisDegrees = doc["decAxisAngle"] | 0.0;
+  parsed.hasDecAxis = doc.containsKey("decAxisAngle");
+  // optional, from platforms on our clock (see Sntp)
+  parsed.receivedTime = platformPacketTime(doc["utc"] | 0.0, arrived);
+  // optional, from platforms that ack (see CommandChannel)
+  packet.acks = doc.containsKey("ack");
+  packet.ack = doc["ack"] | 0UL;
+  packet.ackBits = doc["ackBits"] | 0UL;
+  return true;
+}
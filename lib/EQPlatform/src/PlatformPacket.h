@@ -0,0 +1,35 @@
+#ifndef PLATFORM_PACKET_H
+#define PLATFORM_PACKET_H
+
+#include "PlatformTelemetry.h"
+#include "TimePoint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Every key is copied into the document (the payload isn't writable):
+ * 12 slots for the 8 required keys, decAxisAngle, ack, ackBits and utc,
+ * at 16 bytes on the ESP32, plus about 130 bytes of keys. Rounded up, so a
+ * platform sending every optional key still parses.
+ */
+#define PLATFORM_PACKET_JSON_SIZE 512
+
+/**
+ * One status packet from the platform, "DSC:" then its JSON. Telemetry
+ * has everything but the sender's address and the packet count.
+ */
+struct PlatformPacket {
+  PlatformTelemetry telemetry;
+  bool acks; // platforms that ack say so in every packet
+  uint32_t ack;
+  uint32_t ackBits;
+};
+
+/**
+ * False (logged) for anything that isn't a whole status packet. arrived
+ * is our clock, for platforms that don't stamp utc.
+ */
+bool parsePlatformPacket(const uint8_t *data, size_t length, TimePoint arrived,
+                         PlatformPacket &packet);
+
+#endif
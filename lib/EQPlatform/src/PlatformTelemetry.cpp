@@ -0,0 +1,57 @@
+#include "PlatformTelemetry.h"
+#include <math.h>
+
+#define STALE_EQ_WARNING_THRESHOLD_SECONDS 10 // used to detect packet loss
+
+/**
+ * The platform emits runtimeFromCenterSeconds, which is how many
+ * seconds the platform will take to reach the center (reference)
+ * point. It tracks at the sidereal rate, so that's also how far the ra
+ * axis is turned from center. When the platform is running, this number
+ * is reducing at the same rate the sky turns, so the scope keeps pointing
+ * at the same ra if alt/azi do not change.
+ *
+ * When the platform stops, this number stays static but time moves
+ * on, so ra changes over time.
+ *
+ * As the platform emits position periodically, we interpolate values for
+ * runtimeFromCenterSeconds here to try to get sub second accuracy.
+ * (If we don't do this, we see drift that resets pericodically as
+ * platform pulses an update.)
+ *
+ * The dec axis only moves when told to, so isn't interpolated.
+ */
+PlatformState calculatePlatformState(const PlatformTelemetry &telemetry,
+                                     TimePoint now) {
+  // if platform is running, then it has moved on since packet
+  // recieved. The time since the packet received needs to be taken off
+  // the timeToCenter.
+  // eg if time to center is 100s, and packet was received a second ago,
+  // time to center should be considered as 99s.
+  double interpolationTimeSeconds = 0;
+  if (telemetry.currentlyRunning) {
+    interpolationTimeSeconds = differenceInSeconds(telemetry.receivedTime, now);
+  }
+  return PlatformState(
+      (telemetry.runtimeFromCenterSeconds - interpolationTimeSeconds) *
+          SIDEREAL_DEGREES_PER_SECOND,
+      telemetry.decAxisDegrees,
+      telemetry.currentlyRunning ? -SIDEREAL_DEGREES_PER_SECOND : 0);
+}
+
+TimePoint platformPacketTime(double utcSeconds, TimePoint arrived) {
+  if (utcSeconds <= 0) {
+    return arrived;
+  }
+  TimePoint stamped = addSecondsToTime(TimePoint(), utcSeconds);
+  if (fabs(differenceInSeconds(stamped, arrived)) >
+      PLATFORM_CLOCK_TOLERANCE_SECONDS) {
+    return arrived;
+  }
+  return stamped;
+}
+
+bool isPlatformConnected(const PlatformTelemetry &telemetry, TimePoint now) {
+  return differenceInSeconds(telemetry.receivedTime, now) <=
+         STALE_EQ_WARNING_THRESHOLD_SECONDS;
+}
@@ -0,0 +1,60 @@
+#ifndef PLATFORM_TELEMETRY_H
+#define PLATFORM_TELEMETRY_H
+
+#include "PlatformKinematics.h"
+#include "TimePoint.h"
+#include <stdint.h>
+
+#define PLATFORM_IP_LENGTH 16 // "255.255.255.255" plus terminator
+// a platform timestamp further out than this isn't on our clock (it hasn't
+// synced to our SNTP yet), so the arrival time is used instead
+#define PLATFORM_CLOCK_TOLERANCE_SECONDS 1.0
+
+/**
+ * Everything we know about the EQ platform, as of its last status packet.
+ *
+ * EQPlatform publishes a whole new one of these (through a SeqLock) for
+ * each packet, so readers on other tasks always see the fields of a
+ * single packet together: never runtimeFromCenterSeconds from one packet
+ * with the receive time of the next.
+ */
+struct PlatformTelemetry {
+  double runtimeFromCenterSeconds;
+  double timeToEnd;
+  bool currentlyRunning;
+  bool slewing;
+  double pulseGuideRate; // degrees/sec
+  double axisMoveRateMax;
+  double axisMoveRateMin;
+  double trackingRate;
+  double decAxisDegrees; // 0 for platforms that don't report a dec axis
+  bool hasDecAxis;
+  // when this packet's values were true, by our clock: see
+  // platformPacketTime
+  TimePoint receivedTime;
+  uint32_t packetCount;
+  char ip[PLATFORM_IP_LENGTH]; // empty until the first packet
+};
+
+/**
+ * Platform axis angles for model calculations, given the telemetry and the
+ * current time. See EQPlatform::calculatePlatformState.
+ */
+PlatformState calculatePlatformState(const PlatformTelemetry &telemetry,
+                                     TimePoint now);
+
+/**
+ * When a packet's values were true. A platform keeping to the DSC's clock
+ * over SNTP (see Sntp) stamps its packets with it, as utc: seconds since
+ * 1970, 0 if it doesn't. That's better than when the packet arrived, which
+ * is late by however long WiFi took, and by a varying amount.
+ */
+TimePoint platformPacketTime(double utcSeconds, TimePoint arrived);
+
+/**
+ * False if no packet has arrived for a while (the platform sends them
+ * every second or so).
+ */
+bool isPlatformConnected(const PlatformTelemetry &telemetry, TimePoint now);
+
+#endif
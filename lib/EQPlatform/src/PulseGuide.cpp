@@ -0,0 +1,121 @@
+#include "PulseGuide.h"
+#include "Logging.h"
+
+PulseGuideScheduler::PulseGuideScheduler() : pushed(0), applied(0) {
+  current = PulseGuideStatus();
+  for (Axis &axis : axes) {
+    axis.sign = 0;
+    axis.end = current.guidingUntil;
+  }
+  status.write(current);
+}
+
+bool PulseGuideScheduler::requestPulse(int direction, long durationMillis,
+                                       TimePoint now) {
+  if (direction < GUIDE_NORTH || direction > GUIDE_WEST || durationMillis < 0) {
+    log("Bad pulse guide direction %d duration %ld", direction,
+        durationMillis);
+    return false;
+  }
+  Request request;
+  request.direction = direction;
+  request.durationMillis = durationMillis;
+  request.requested = now;
+  // counted first, so applied never gets ahead of pushed
+  pushed.fetch_add(1, std::memory_order_acq_rel);
+  if (!requests.push(request)) {
+    pushed.fetch_sub(1, std::memory_order_acq_rel);
+    log("Pulse guide queue full, dropping pulse");
+    return false;
+  }
+  return true;
+}
+
+bool PulseGuideScheduler::isPulseGuiding(TimePoint now) const {
+  if (pushed.load(std::memory_order_acquire) !=
+      applied.load(std::memory_order_acquire)) {
+    return true;
+  }
+  return now < status.read().guidingUntil;
+}
+
+long PulseGuideScheduler::remainingMillis(const Axis &axis,
+                                          TimePoint now) const {
+  if (axis.sign == 0 || axis.end <= now) {
+    return 0;
+  }
+  return (long)std::chrono::duration_cast<std::chrono::milliseconds>(axis.end -
+                                                                     now)
+      .count();
+}
+
+void PulseGuideScheduler::apply(const Request &request, TimePoint now) {
+  bool dec = request.direction == GUIDE_NORTH ||
+             request.direction == GUIDE_SOUTH;
+  int sign = (request.direction == GUIDE_NORTH ||
+              request.direction == GUIDE_EAST)
+                 ? 1
+                 : -1;
+  Axis &axis = axes[dec ? 1 : 0];
+  long remaining = remainingMillis(axis, now);
+
+  long latency = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                     now - request.requested)
+                     .count();
+  current.requests++;
+  current.lastLatencyMillis = latency;
+  if (latency > current.maxLatencyMillis) {
+    current.maxLatencyMillis = latency;
+  }
+
+  if (remaining == 0) {
+    axis.sign = sign;
+    axis.end = addMillisToTime(now, request.durationMillis);
+  } else if (axis.sign == sign) {
+    current.coalesced++;
+    TimePoint end = addMillisToTime(now, request.durationMillis);
+    if (end > axis.end) {
+      axis.end = end;
+    }
+  } else {
+    current.cancelled++;
+    long net = request.durationMillis - remaining;
+    if (net > 0) {
+      axis.sign = sign;
+    }
+    axis.end = addMillisToTime(now, net > 0 ? net : -net);
+  }
+  if (axis.end <= now) {
+    axis.sign = 0;
+  }
+}
+
+bool PulseGuideScheduler::tick(TimePoint now, PulseGuideCommand &command) {
+  uint32_t count = 0;
+  Request request;
+  while (requests.pop(request)) {
+    apply(request, now);
+    count++;
+  }
+
+  TimePoint until = now;
+  for (Axis &axis : axes) {
+    if (axis.sign != 0 && axis.end <= now) {
+      // finished on the platform by itself, nothing to send
+      axis.sign = 0;
+    }
+    if (axis.sign != 0 && axis.end > until) {
+      until = axis.end;
+    }
+  }
+  if (count > 0) {
+    command.raMillis = axes[0].sign * remainingMillis(axes[0], now);
+    command.decMillis = axes[1].sign * remainingMillis(axes[1], now);
+    current.packets++;
+    current.guidingUntil = until;
+    status.write(current);
+  }
+  // only once the new end time is visible
+  applied.fetch_add(count, std::memory_order_acq_rel);
+  return count > 0;
+}
@@ -0,0 +1,104 @@
+#ifndef PULSE_GUIDE_H
+#define PULSE_GUIDE_H
+
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include "TimePoint.h"
+#include <atomic>
+#include <stdint.h>
+
+#define PULSE_GUIDE_QUEUE_SIZE 16
+
+// ASCOM GuideDirections
+enum GuideDirection {
+  GUIDE_NORTH = 0,
+  GUIDE_SOUTH = 1,
+  GUIDE_EAST = 2,
+  GUIDE_WEST = 3
+};
+
+/**
+ * What to send to the platform: the pulse each axis should be doing from
+ * now, in millis. Replaces whatever the axis was doing; 0 stops it.
+ * Positive is east (ra) or north (dec), negative west or south.
+ */
+struct PulseGuideCommand {
+  long raMillis;
+  long decMillis;
+};
+
+struct PulseGuideStatus {
+  TimePoint guidingUntil; // end of the last pulse on either axis
+  uint32_t requests;
+  uint32_t coalesced; // same direction, overlapping a pulse in progress
+  uint32_t cancelled; // opposing a pulse in progress
+  uint32_t packets;
+  long lastLatencyMillis; // request to packet
+  long maxLatencyMillis;
+};
+
+/**
+ * Schedules ASCOM pulse guides onto the platform's two axes.
+ *
+ * PHD2 and friends send a pulse, then poll ispulseguiding until it's
+ * done. Pulses used to be forwarded one UDP packet each, with nothing
+ * tracking when they finished. Here each axis keeps the pulse it's doing
+ * and when it ends, so ispulseguiding is true from the moment a request
+ * is made until the last pulse is due to finish.
+ *
+ * A request for an axis that's already pulsing:
+ * - the same direction is merged: the pulse runs until whichever ends
+ *   later, rather than applying the overlapping part twice
+ * - the opposite direction cancels against what's left: the two
+ *   corrections net out, and the axis carries on in whichever direction
+ *   had more time
+ *
+ * Everything requested between ticks goes to the platform in one packet,
+ * with both axes in it.
+ *
+ * Same shape as ModelRunner: handlers post requests (single producer),
+ * one task ticks, status is published through a SeqLock.
+ */
+class PulseGuideScheduler {
+public:
+  PulseGuideScheduler();
+
+  // handler side
+  bool requestPulse(int direction, long durationMillis, TimePoint now);
+
+  // any task
+  bool isPulseGuiding(TimePoint now) const;
+  PulseGuideStatus getStatus() const { return status.read(); }
+
+  /**
+   * From the network task, every iteration. Returns true if command should
+   * be sent to the platform.
+   */
+  bool tick(TimePoint now, PulseGuideCommand &command);
+
+private:
+  struct Request {
+    int direction;
+    long durationMillis;
+    TimePoint requested;
+  };
+  struct Axis {
+    int sign; // +1 east/north, -1 west/south, 0 idle
+    TimePoint end;
+  };
+
+  void apply(const Request &request, TimePoint now);
+  long remainingMillis(const Axis &axis, TimePoint now) const;
+
+  SpscQueue<Request, PULSE_GUIDE_QUEUE_SIZE> requests;
+  SeqLock<PulseGuideStatus> status;
+  // requests not yet applied are pushed - applied
+  std::atomic<uint32_t> pushed;
+  std::atomic<uint32_t> applied;
+
+  // ticking task only
+  PulseGuideStatus current;
+  Axis axes[2]; // ra, dec
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "SlewController.h"
+#include "Logging.h"
+#include <math.h>
+
+SlewController::SlewController(const SlewSettings &s)
+    : settings(s), phase(SLEW_IDLE), phaseVersion(0), historyCount(0),
+      ratesChanged(false) {
+  current.phase = SLEW_IDLE;
+  current.targetRAHours = 0;
+  current.targetDecDegrees = 0;
+  current.raErrorDegrees = 0;
+  current.decErrorDegrees = 0;
+  current.rates.ra = 0;
+  current.rates.dec = 0;
+  current.timedOut = false;
+  status.write(current);
+}
+
+bool SlewController::requestSlew(double raHours, double decDegrees) {
+  SlewRequest request;
+  request.abort = false;
+  request.stopAxes = false;
+  request.raHours = raHours;
+  request.decDegrees = decDegrees;
+  if (!requests.push(request)) {
+    log("Slew queue full, dropping slew");
+    return false;
+  }
+  return true;
+}
+
+bool SlewController::requestAbort(bool stopAxes) {
+  SlewRequest request;
+  request.abort = true;
+  request.stopAxes = stopAxes;
+  request.raHours = 0;
+  request.decDegrees = 0;
+  if (!requests.push(request)) {
+    log("Slew queue full, dropping abort");
+    return false;
+  }
+  return true;
+}
+
+void SlewController::setPhase(SlewPhase newPhase) {
+  current.phase = newPhase;
+}
+
+void SlewController::setRates(double ra, double dec, TimePoint now) {
+  if (ra == current.rates.ra && dec == current.rates.dec) {
+    return;
+  }
+  current.rates.ra = ra;
+  current.rates.dec = dec;
+  RateChange &change = history[historyCount % SLEW_RATE_HISTORY_SIZE];
+  change.time = now;
+  change.rates = current.rates;
+  historyCount++;
+  ratesChanged = true;
+}
+
+/**
+ * Degrees an axis has been moved by our rates between a platform packet
+ * and now: what the model position doesn't know about yet.
+ */
+double SlewController::movedSince(TimePoint since, TimePoint now,
+                                  bool raAxis) const {
+  double moved = 0;
+  TimePoint end = now;
+  uint32_t remembered = historyCount < SLEW_RATE_HISTORY_SIZE
+                            ? historyCount
+                            : SLEW_RATE_HISTORY_SIZE;
+  for (uint32_t k = 0; k < remembered; k++) {
+    const RateChange &change =
+        history[(historyCount - 1 - k) % SLEW_RATE_HISTORY_SIZE];
+    TimePoint begin = change.time < since ? since : change.time;
+    if (end > begin) {
+      double rate = raAxis ? change.rates.ra : change.rates.dec;
+      moved += rate * differenceInSeconds(begin, end);
+    }
+    if (change.time <= since) {
+      break;
+    }
+    end = change.time;
+  }
+  return moved;
+}
+
+/**
+ * Rate for one axis: the fastest that can still stop within the error,
+ * proportional near the end, capped at maxRate, and at most one
+ * acceleration step from the current rate.
+ *
+ * Stopping is planned at half the acceleration. That leaves headroom for
+ * tick timing and latency, and means the proportional approach never
+ * needs to slow faster than the acceleration allows.
+ */
+double SlewController::axisRate(double error, double rate, double maxRate,
+                                double dt) const {
+  double distance = fabs(error);
+  double desired = sqrt(settings.acceleration * distance);
+  desired = fmin(desired, distance * SLEW_FINAL_APPROACH_GAIN);
+  desired = fmin(desired, maxRate);
+  desired = error < 0 ? -desired : desired;
+  double step = settings.acceleration * dt;
+  if (desired > rate + step) {
+    return rate + step;
+  }
+  if (desired < rate - step) {
+    return rate - step;
+  }
+  return desired;
+}
+
+void SlewController::apply(const SlewRequest &request, TimePoint now) {
+  if (request.abort) {
+    if (current.phase != SLEW_IDLE) {
+      log("Slew aborted");
+    }
+    setRates(0, 0, now);
+    setPhase(SLEW_IDLE);
+    if (!request.stopAxes) {
+      ratesChanged = false;
+    }
+    return;
+  }
+  current.targetRAHours = request.raHours;
+  current.targetDecDegrees = request.decDegrees;
+  current.timedOut = false;
+  slewStart = now;
+  setPhase(SLEW_MOVING);
+}
+
+void SlewController::control(const SlewFeedback &feedback, TimePoint now,
+                             double dt) {
+  if (!feedback.connected) {
+    log("Platform not connected, slew stopped");
+    setRates(0, 0, now);
+    setPhase(SLEW_IDLE);
+    return;
+  }
+  double ra =
+      feedback.raHours * 15.0 + movedSince(feedback.platformTime, now, true);
+  double dec =
+      feedback.decDegrees + movedSince(feedback.platformTime, now, false);
+  // short way round in ra
+  double raError = fmod(current.targetRAHours * 15.0 - ra, 360.0);
+  if (raError > 180) {
+    raError -= 360;
+  } else if (raError < -180) {
+    raError += 360;
+  }
+  double decError =
+      feedback.hasDecAxis ? current.targetDecDegrees - dec : 0;
+  current.raErrorDegrees = raError;
+  current.decErrorDegrees = decError;
+  bool onTarget = fabs(raError) <= settings.toleranceDegrees &&
+                  fabs(decError) <= settings.toleranceDegrees;
+
+  double maxRate = feedback.maxRate > 0 ? feedback.maxRate : settings.maxRate;
+  if (onTarget) {
+    // ramp down (at most a tick at the approach speed) and wait
+    setRates(axisRate(0, current.rates.ra, maxRate, dt),
+             axisRate(0, current.rates.dec, maxRate, dt), now);
+    if (current.phase != SLEW_SETTLING) {
+      settleStart = now;
+      setPhase(SLEW_SETTLING);
+    } else if (current.rates.ra == 0 && current.rates.dec == 0 &&
+               differenceInSeconds(settleStart, now) >=
+                   settings.settleSeconds) {
+      setPhase(SLEW_IDLE);
+    }
+    return;
+  }
+  setPhase(SLEW_MOVING);
+  if (differenceInSeconds(slewStart, now) > settings.timeoutSeconds) {
+    log("Slew timed out %lf degrees from target in ra, %lf in dec", raError,
+        decError);
+    current.timedOut = true;
+    setRates(0, 0, now);
+    setPhase(SLEW_IDLE);
+    return;
+  }
+  setRates(axisRate(raError, current.rates.ra, maxRate, dt),
+           axisRate(decError, current.rates.dec, maxRate, dt), now);
+}
+
+bool SlewController::tick(const SlewFeedback &feedback, TimePoint now,
+                          SlewRates &rates) {
+  double dt = SLEW_CONTROL_PERIOD_MS / 1000.0;
+  if (historyCount > 0 || current.phase != SLEW_IDLE) {
+    // a late tick mustn't turn into a big jump in rate
+    dt = fmin(fmax(differenceInSeconds(lastTick, now), 0.0), 2 * dt);
+  }
+  lastTick = now;
+  ratesChanged = false;
+
+  SlewRequest request;
+  while (requests.pop(request)) {
+    apply(request, now);
+  }
+  if (current.phase != SLEW_IDLE) {
+    control(feedback, now, dt);
+  }
+  status.write(current);
+  // the version only once the phase it's for can be read
+  if (phase.load() != current.phase) {
+    phase.store(current.phase);
+    phaseVersion++;
+  }
+
+  rates = current.rates;
+  return ratesChanged;
+}
@@ -0,0 +1,155 @@
+#ifndef SLEW_CONTROLLER_H
+#define SLEW_CONTROLLER_H
+
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include "TimePoint.h"
+#include <atomic>
+#include <stdint.h>
+
+#define SLEW_CONTROL_PERIOD_MS 100
+#define SLEW_COMMAND_QUEUE_SIZE 4
+// rate changes remembered for dead reckoning between platform packets
+#define SLEW_RATE_HISTORY_SIZE 32
+
+#define SLEW_DEFAULT_MAX_RATE 1.0     // degrees/sec, if the platform hasn't said
+#define SLEW_DEFAULT_ACCELERATION 0.5 // degrees/sec^2
+#define SLEW_DEFAULT_TOLERANCE 0.05   // degrees
+#define SLEW_DEFAULT_SETTLE_SECONDS 1 // Alpaca slewsettletime
+#define SLEW_DEFAULT_TIMEOUT_SECONDS 120
+// below this error the approach is proportional (1/s), so the last few
+// ticks don't overshoot
+#define SLEW_FINAL_APPROACH_GAIN 1.0
+
+struct SlewSettings {
+  double maxRate;      // degrees/sec per axis, when the platform doesn't say
+  double acceleration; // degrees/sec^2 per axis
+  double toleranceDegrees;
+  double settleSeconds; // must stay within tolerance this long
+  double timeoutSeconds;
+
+  SlewSettings()
+      : maxRate(SLEW_DEFAULT_MAX_RATE), acceleration(SLEW_DEFAULT_ACCELERATION),
+        toleranceDegrees(SLEW_DEFAULT_TOLERANCE),
+        settleSeconds(SLEW_DEFAULT_SETTLE_SECONDS),
+        timeoutSeconds(SLEW_DEFAULT_TIMEOUT_SECONDS) {}
+};
+
+/**
+ * What the controller sees each tick: the latest model position, and the
+ * platform packet the platform state behind it came from.
+ */
+struct SlewFeedback {
+  double raHours;
+  double decDegrees;
+  TimePoint platformTime; // when that platform packet arrived
+  double maxRate;         // platform's axisMoveRateMax, 0 if unknown
+  bool hasDecAxis;        // otherwise dec is left to push-to
+  bool connected;
+};
+
+// Axis move rates in degrees/sec, on top of tracking. Signs as
+// PlatformState: positive ra turns the base east (ra increases), positive
+// dec tilts it north.
+struct SlewRates {
+  double ra;
+  double dec;
+};
+
+enum SlewPhase { SLEW_IDLE, SLEW_MOVING, SLEW_SETTLING };
+
+struct SlewRequest {
+  bool abort;
+  bool stopAxes;
+  double raHours;
+  double decDegrees;
+};
+
+struct SlewStatus {
+  SlewPhase phase;
+  double targetRAHours;
+  double targetDecDegrees;
+  double raErrorDegrees;
+  double decErrorDegrees;
+  SlewRates rates;
+  bool timedOut; // last slew gave up before settling
+};
+
+/**
+ * Closed loop slew: drives the platform's axes with moveAxis rates until
+ * the model position is on the target, rather than asking for a slew by
+ * some degrees and hoping.
+ *
+ * Each tick compares the target with the model position and picks a rate
+ * per axis: as fast as the platform allows, but never faster than it can
+ * stop from within the remaining distance, and proportional for the last
+ * bit. Rates ramp at the set acceleration. Once both axes are within
+ * tolerance it stops and waits out the settle time before reporting the
+ * slew done; drifting out again while settling goes back to moving.
+ *
+ * Platform packets only arrive every second or so, so the model position
+ * lags what the platform has been told. The controller remembers the
+ * rates it asked for and adds the movement since the last packet to the
+ * measured position (dead reckoning), which keeps the loop stable.
+ *
+ * Same shape as ModelRunner: web handlers post requests (single
+ * producer), one task ticks the controller, status is published through
+ * a SeqLock. The phase is also published on its own, as an atomic: the
+ * web handlers poll it, and they run above the slew task on its core, so
+ * mustn't wait on a status write (see SeqLock).
+ */
+class SlewController {
+public:
+  explicit SlewController(const SlewSettings &settings = SlewSettings());
+
+  // handler side
+  bool requestSlew(double raHours, double decDegrees);
+  // stopAxes false when something else (a manual move) is taking over the
+  // axes, so the controller doesn't send its own stop after it
+  bool requestAbort(bool stopAxes = true);
+
+  // the slew task, or a task no higher than it on core 0
+  SlewStatus getStatus() const { return status.read(); }
+  // any task
+  bool isSlewing() const { return phase.load() != SLEW_IDLE; }
+  // bumped when the phase changes, for cached slewing replies
+  uint32_t getPhaseVersion() const { return phaseVersion; }
+  const SlewSettings &getSettings() const { return settings; }
+
+  /**
+   * One control step, every SLEW_CONTROL_PERIOD_MS. Returns true if the
+   * rates changed and should be sent to the platform.
+   */
+  bool tick(const SlewFeedback &feedback, TimePoint now, SlewRates &rates);
+
+private:
+  struct RateChange {
+    TimePoint time;
+    SlewRates rates;
+  };
+
+  void setRates(double ra, double dec, TimePoint now);
+  void setPhase(SlewPhase newPhase);
+  void apply(const SlewRequest &request, TimePoint now);
+  void control(const SlewFeedback &feedback, TimePoint now, double dt);
+  double movedSince(TimePoint since, TimePoint now, bool raAxis) const;
+  double axisRate(double error, double current, double maxRate,
+                  double dt) const;
+
+  SlewSettings settings;
+  SpscQueue<SlewRequest, SLEW_COMMAND_QUEUE_SIZE> requests;
+  SeqLock<SlewStatus> status;
+  std::atomic<SlewPhase> phase;
+  std::atomic<uint32_t> phaseVersion;
+
+  // controller task only
+  SlewStatus current;
+  RateChange history[SLEW_RATE_HISTORY_SIZE];
+  uint32_t historyCount;
+  bool ratesChanged; // since the start of this tick
+  TimePoint lastTick;
+  TimePoint slewStart;
+  TimePoint settleStart;
+};
+
+#endif
@@ -75,11 +75,18 @@
 
 #define T_WITH_JD(day, time) ((day - 2451545.0 + time) / 36525)
 
-// Observer's coordinates on Earth
-static FLOAT latitudeOnEarth = NAN;
-static FLOAT longitudeOnEarth = NAN;
-static FLOAT longitudeOnEarthSign = -1;
-static int altitudeOnEarth = NAN;
+// Observer's coordinates on Earth. Off the device they're per thread, so
+// models for different sites can run side by side (tools/replay sweeps
+// them across every core); each TelescopeModel sets them before use.
+#ifdef ARDUINO
+#define EPHEMERIS_OBSERVER static
+#else
+#define EPHEMERIS_OBSERVER static thread_local
+#endif
+EPHEMERIS_OBSERVER FLOAT latitudeOnEarth = NAN;
+EPHEMERIS_OBSERVER FLOAT longitudeOnEarth = NAN;
+EPHEMERIS_OBSERVER FLOAT longitudeOnEarthSign = -1;
+EPHEMERIS_OBSERVER int altitudeOnEarth = NAN;
 
 void Ephemeris::floatingHoursToHoursMinutesSeconds(FLOAT floatingHours,
                                                    int *hours, int *minutes,
@@ -4,6 +4,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <iostream>
+#include <mutex>
 // #include <WebSerial.h>
 
 #ifdef ARDUINO
@@ -12,17 +13,41 @@
 
 // bool webSerialReady;
 // void setWebSerialReady() { webSerialReady = true; }
+static bool loggingEnabled = true;
+static LogSink logSink = nullptr;
+
+#define LOG_BUFFER_SIZE 1024
+/**
+ * One line at a time, formatted here rather than on the caller's stack:
+ * every task logs, and most have small stacks. The sink copies the line
+ * before the lock is let go.
+ */
+static char logBuffer[LOG_BUFFER_SIZE];
+static std::mutex logLock;
+
+void setLogSink(LogSink sink) { logSink = sink; }
+
+void setLoggingEnabled(bool enabled) { loggingEnabled = enabled; }
+bool isLoggingEnabled() { return loggingEnabled; }
+
 void log(const char *fmt, ...) {
-  const int BUFFER_SIZE = 1024;
-  char buffer[BUFFER_SIZE];
+  if (!loggingEnabled) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(logLock);
+  char *buffer = logBuffer;
 
   va_list args;
   va_start(args, fmt);
 
-  vsnprintf(buffer, BUFFER_SIZE, fmt, args); // Format the string
+  vsnprintf(buffer, LOG_BUFFER_SIZE, fmt, args); // Format the string
 
   va_end(args);
 
+  if (logSink) {
+    logSink(buffer);
+    return;
+  }
 #ifdef ARDUINO
   // If we're on an Arduino (or compatible) platform
   Serial.println(buffer);
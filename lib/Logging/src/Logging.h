@@ -2,5 +2,16 @@
 #define LOGGING_H
 
 void log(const char *fmt, ...);
+
+// Logging can be switched off at runtime. Callers that have to do real work
+// to build log arguments (eg formatting times) should check this first.
+void setLoggingEnabled(bool enabled);
+bool isLoggingEnabled();
+
+// By default log lines go straight to Serial (or stdout on native). Once the
+// logging task is running, a sink hands them to it instead so slow serial
+// writes don't stall the caller.
+typedef void (*LogSink)(const char *line);
+void setLogSink(LogSink sink);
 // void setWebSerialReady();
 #endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "BootTimeline.h"
+#include "Logging.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+static const char *phaseNames[BOOT_PHASE_COUNT] = {
+    "serial",  "preferences", "filesystem",     "encoders",
+    "servers", "tasks",       "first position", "wifi"};
+
+const char *bootPhaseName(BootPhase phase) { return phaseNames[phase]; }
+
+BootTimeline::BootTimeline() {
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    times[i] = 0;
+  }
+}
+
+bool BootTimeline::mark(BootPhase phase, uint32_t micros) {
+  if (times[phase] != 0) {
+    return false;
+  }
+  times[phase] = micros == 0 ? 1 : micros;
+  return isComplete();
+}
+
+uint32_t BootTimeline::getMicros(BootPhase phase) const {
+  return times[phase];
+}
+
+bool BootTimeline::isComplete() const {
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    if (times[i] == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t BootTimeline::render(char *buffer, size_t bufferSize) const {
+  uint32_t snapshot[BOOT_PHASE_COUNT];
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    snapshot[i] = times[i];
+  }
+  if (bufferSize > 0) {
+    buffer[0] = 0;
+  }
+  size_t written = 0;
+  uint32_t previous = 0;
+  bool done[BOOT_PHASE_COUNT] = {};
+  // a few phases, so pick the earliest left each time
+  for (;;) {
+    int next = -1;
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+      if (snapshot[i] != 0 && !done[i] &&
+          (next < 0 || snapshot[i] < snapshot[next])) {
+        next = i;
+      }
+    }
+    if (next < 0) {
+      return written;
+    }
+    done[next] = true;
+    int n = snprintf(buffer + written, bufferSize - written,
+                     "%s%s %.1fms (+%.1f)", written ? ", " : "",
+                     phaseNames[next], snapshot[next] / 1000.0,
+                     (snapshot[next] - previous) / 1000.0);
+    if (n < 0 || written + n >= bufferSize) {
+      // only whole phases
+      if (bufferSize > 0) {
+        buffer[written] = 0;
+      }
+      return written;
+    }
+    written += n;
+    previous = snapshot[next];
+  }
+}
+
+static BootTimeline timeline;
+
+BootTimeline &bootTimeline() { return timeline; }
+
+#ifdef ARDUINO
+static uint32_t bootMicros() { return (uint32_t)esp_timer_get_time(); }
+#else
+static uint32_t bootMicros() {
+  static std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+#endif
+
+void markBootPhase(BootPhase phase) {
+  if (timeline.mark(phase, bootMicros())) {
+    char report[512]; // all the phases, with room
+    timeline.render(report, sizeof(report));
+    log("Boot: %s", report);
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * When each part of startup finished, in microseconds since boot, so the
+ * time to the first position (and to WiFi, which comes up alongside the
+ * rest rather than before it) can be seen on every boot.
+ */
+enum BootPhase {
+  BOOT_SERIAL,
+  BOOT_PREFERENCES,
+  BOOT_FILESYSTEM, // LittleFS, catalogue and session recording
+  BOOT_ENCODERS,
+  BOOT_SERVERS, // UDP listeners and the web server, with the model's prefs
+  BOOT_TASKS,
+  BOOT_FIRST_POSITION, // the model task's first RA/Dec
+  BOOT_WIFI_CONNECTED,
+  BOOT_PHASE_COUNT
+};
+
+const char *bootPhaseName(BootPhase phase);
+
+/**
+ * Each phase is marked once, by whichever task finishes it: they're all
+ * different slots, each written once, so no locking.
+ */
+class BootTimeline {
+public:
+  BootTimeline();
+
+  // the first mark of a phase counts, later ones are ignored. True if
+  // this one completed the timeline.
+  bool mark(BootPhase phase, uint32_t micros);
+  bool isMarked(BootPhase phase) const { return times[phase] != 0; }
+  uint32_t getMicros(BootPhase phase) const;
+  bool isComplete() const;
+
+  /**
+   * "name at ms (+ms since the one before)" for each phase so far, in the
+   * order they happened. Returns number of chars written, dropping whole
+   * phases if the buffer is too small.
+   */
+  size_t render(char *buffer, size_t bufferSize) const;
+
+private:
+  // 0 is not yet, so a mark at 0 is taken as 1
+  volatile uint32_t times[BOOT_PHASE_COUNT];
+};
+
+// the device's, marked from setup() and the tasks
+BootTimeline &bootTimeline();
+// marks the phase now, logging the whole timeline once it's complete
+void markBootPhase(BootPhase phase);
+
+#endif
@@ -0,0 +1,197 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+void LatencyHistogram::reset() {
+  memset(buckets, 0, sizeof(buckets));
+  count = 0;
+  sum = 0;
+  min = UINT32_MAX;
+  max = 0;
+}
+
+static int mostSignificantBit(uint32_t value) {
+  return 31 - __builtin_clz(value);
+}
+
+size_t LatencyHistogram::bucketForValue(uint32_t value) {
+  if (value < METRICS_SUB_BUCKET_COUNT) {
+    return value;
+  }
+  int msb = mostSignificantBit(value);
+  int shift = msb - METRICS_SUB_BUCKET_BITS;
+  size_t group = shift + 1;
+  return group * METRICS_SUB_BUCKET_COUNT +
+         ((value >> shift) & (METRICS_SUB_BUCKET_COUNT - 1));
+}
+
+uint32_t LatencyHistogram::lowestValueInBucket(size_t bucket) {
+  if (bucket < METRICS_SUB_BUCKET_COUNT) {
+    return bucket;
+  }
+  size_t group = bucket / METRICS_SUB_BUCKET_COUNT;
+  uint64_t sub = bucket % METRICS_SUB_BUCKET_COUNT;
+  return (uint32_t)((METRICS_SUB_BUCKET_COUNT + sub) << (group - 1));
+}
+
+uint32_t LatencyHistogram::highestValueInBucket(size_t bucket) {
+  if (bucket < METRICS_SUB_BUCKET_COUNT) {
+    return bucket;
+  }
+  size_t group = bucket / METRICS_SUB_BUCKET_COUNT;
+  uint64_t width = (uint64_t)1 << (group - 1);
+  return (uint32_t)(lowestValueInBucket(bucket) + width - 1);
+}
+
+void LatencyHistogram::record(uint32_t value) {
+  buckets[bucketForValue(value)]++;
+  count++;
+  sum += value;
+  if (value < min)
+    min = value;
+  if (value > max)
+    max = value;
+}
+
+uint32_t LatencyHistogram::valueAtPercentile(double percentile) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t target = (uint64_t)(percentile / 100.0 * count + 0.999999);
+  if (target < 1)
+    target = 1;
+  if (target > count)
+    target = count;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < METRICS_BUCKET_COUNT; i++) {
+    seen += buckets[i];
+    if (seen >= target) {
+      uint32_t highest = highestValueInBucket(i);
+      return highest < max ? highest : max;
+    }
+  }
+  return max;
+}
+
+void renderPrometheusHistogram(const char *name, const char *help,
+                               const LatencyHistogram &histogram,
+                               double secondsPerTick, MetricsLineSink sink,
+                               void *context) {
+  char line[128];
+
+// a line that didn't fit in line is dropped, as is everything after it
+#define APPEND_LINE(...)                                                       \
+  do {                                                                         \
+    int n = snprintf(line, sizeof(line), __VA_ARGS__);                         \
+    if (n < 0 || n >= (int)sizeof(line) || !sink(line, context))               \
+      return;                                                                  \
+  } while (0)
+
+  APPEND_LINE("# HELP %s %s\n", name, help);
+  APPEND_LINE("# TYPE %s histogram\n", name);
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < METRICS_BUCKET_COUNT; i++) {
+    uint32_t inBucket = histogram.getBucketCount(i);
+    if (inBucket == 0)
+      continue;
+    cumulative += inBucket;
+    APPEND_LINE("%s_bucket{le=\"%.9g\"} %llu\n", name,
+                LatencyHistogram::highestValueInBucket(i) * secondsPerTick,
+                (unsigned long long)cumulative);
+  }
+  APPEND_LINE("%s_bucket{le=\"+Inf\"} %lu\n", name,
+              (unsigned long)histogram.getCount());
+  APPEND_LINE("%s_sum %.9g\n", name, histogram.getSum() * secondsPerTick);
+  APPEND_LINE("%s_count %lu\n", name, (unsigned long)histogram.getCount());
+#undef APPEND_LINE
+}
+
+namespace {
+struct LineBuffer {
+  char *buffer;
+  size_t size;
+  size_t written;
+};
+} // namespace
+
+// append a line only if all of it fits
+static bool appendLine(const char *line, void *context) {
+  LineBuffer *out = static_cast<LineBuffer *>(context);
+  size_t n = strlen(line);
+  if (out->written + n >= out->size) {
+    return false;
+  }
+  memcpy(out->buffer + out->written, line, n + 1);
+  out->written += n;
+  return true;
+}
+
+size_t renderPrometheusHistogram(const char *name, const char *help,
+                                 const LatencyHistogram &histogram,
+                                 double secondsPerTick, char *buffer,
+                                 size_t bufferSize) {
+  if (bufferSize > 0)
+    buffer[0] = 0;
+  LineBuffer out = {buffer, bufferSize, 0};
+  renderPrometheusHistogram(name, help, histogram, secondsPerTick, appendLine,
+                            &out);
+  return out.written;
+}
+
+static LatencyHistogram stageHistograms[METRIC_STAGE_COUNT];
+
+static const char *stageNames[METRIC_STAGE_COUNT] = {
+    "frankendob_alpaca_get_seconds",
+    "frankendob_update_position_seconds",
+    "frankendob_encoder_read_seconds",
+    "frankendob_model_calculate_seconds",
+    "frankendob_json_format_seconds",
+    "frankendob_http_send_seconds",
+    "frankendob_eq_packet_seconds",
+    "frankendob_catalogue_query_seconds"};
+
+static const char *stageHelp[METRIC_STAGE_COUNT] = {
+    "Alpaca GET handler total (route dispatch is this minus nested stages)",
+    "Model task iteration: encoder read plus model",
+    "Reading alt and az encoder counts",
+    "TelescopeModel and Ephemeris position calculation",
+    "Formatting Alpaca JSON responses",
+    "Handing responses to AsyncWebServer",
+    "Processing an EQ platform telemetry packet",
+    "Catalogue lookup of objects near the current position"};
+
+LatencyHistogram &metricsHistogram(MetricStage stage) {
+  return stageHistograms[stage];
+}
+const char *metricsStageName(MetricStage stage) { return stageNames[stage]; }
+const char *metricsStageHelp(MetricStage stage) { return stageHelp[stage]; }
+
+#ifdef ARDUINO
+uint32_t metricsTicks() { return ESP.getCycleCount(); }
+double metricsSecondsPerTick() {
+  return 1.0 / (getCpuFrequencyMhz() * 1000000.0);
+}
+int64_t metricsMicros() { return esp_timer_get_time(); }
+#else
+uint32_t metricsTicks() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+double metricsSecondsPerTick() { return 1e-9; }
+int64_t metricsMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
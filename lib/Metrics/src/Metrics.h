@@ -0,0 +1,156 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lightweight latency instrumentation for the hot paths (Alpaca GETs and
+ * EQ platform UDP packets).
+ *
+ * Each stage has a fixed-bucket, HDR-style histogram: values below
+ * 2^METRICS_SUB_BUCKET_BITS get a bucket each, above that every power of two
+ * is split into 2^METRICS_SUB_BUCKET_BITS linear sub-buckets. That gives a
+ * bounded relative error (12.5% with 3 bits) over the full 32 bit range in
+ * about 1KB per stage, with recording costing a count-leading-zeros and an
+ * increment.
+ *
+ * Values are recorded in ticks of the cycle counter on the ESP32 (CPU
+ * cycles), or nanoseconds on native. They're converted to seconds when
+ * rendered. Each core has its own cycle counter, so code on a task that
+ * isn't pinned to a core uses METRICS_SCOPE_UNPINNED instead.
+ *
+ * Scopes are compiled out unless ENABLE_METRICS is defined (see
+ * platformio.ini), so by default there is zero overhead. The histogram
+ * itself always compiles so it can be tested natively.
+ */
+
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_SUB_BUCKET_COUNT (1 << METRICS_SUB_BUCKET_BITS)
+// linear buckets for values < SUB_BUCKET_COUNT*2, then one group per
+// remaining power of two up to 2^32
+#define METRICS_BUCKET_COUNT                                                   \
+  ((32 - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKET_COUNT)
+
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  void record(uint32_t value);
+  void reset();
+
+  uint32_t getCount() const { return count; }
+  uint64_t getSum() const { return sum; }
+  uint32_t getMin() const { return count ? min : 0; }
+  uint32_t getMax() const { return max; }
+
+  /**
+   * Value at the given percentile (0-100). Returns the highest value that
+   * falls into the same bucket, so is an upper bound within the bucket's
+   * relative error.
+   */
+  uint32_t valueAtPercentile(double percentile) const;
+
+  uint32_t getBucketCount(size_t bucket) const { return buckets[bucket]; }
+
+  static size_t bucketForValue(uint32_t value);
+  static uint32_t lowestValueInBucket(size_t bucket);
+  static uint32_t highestValueInBucket(size_t bucket);
+
+private:
+  uint32_t buckets[METRICS_BUCKET_COUNT];
+  uint32_t count;
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+};
+
+/**
+ * Writes the histogram in Prometheus text exposition format, as a
+ * histogram type with cumulative le buckets (only buckets that have values
+ * are emitted). secondsPerTick converts recorded ticks to seconds.
+ * Returns number of chars written, truncating whole lines if the buffer
+ * is too small.
+ */
+size_t renderPrometheusHistogram(const char *name, const char *help,
+                                 const LatencyHistogram &histogram,
+                                 double secondsPerTick, char *buffer,
+                                 size_t bufferSize);
+
+// takes each line, newline included; false stops the rendering
+typedef bool (*MetricsLineSink)(const char *line, void *context);
+
+/**
+ * The same, a line at a time, so a response can take every bucket
+ * without a buffer sized for all METRICS_BUCKET_COUNT of them.
+ */
+void renderPrometheusHistogram(const char *name, const char *help,
+                               const LatencyHistogram &histogram,
+                               double secondsPerTick, MetricsLineSink sink,
+                               void *context);
+
+enum MetricStage {
+  METRIC_ALPACA_GET,       // whole GET handler, including dispatch
+  METRIC_UPDATE_POSITION,  // model task tick: encoder read + model
+  METRIC_ENCODER_READ,     // reading both encoders
+  METRIC_MODEL_CALCULATE,  // TelescopeModel/Ephemeris maths
+  METRIC_JSON_FORMAT,      // rendering the alpaca response
+  METRIC_HTTP_SEND,        // handing response to AsyncWebServer
+  METRIC_EQ_PACKET,        // EQPlatform::processPacket
+  METRIC_CATALOGUE_QUERY,  // objects near the current position
+  METRIC_STAGE_COUNT
+};
+
+LatencyHistogram &metricsHistogram(MetricStage stage);
+const char *metricsStageName(MetricStage stage);
+const char *metricsStageHelp(MetricStage stage);
+
+uint32_t metricsTicks();
+double metricsSecondsPerTick();
+// the same on every core (esp_timer on the ESP32), coarser than ticks
+int64_t metricsMicros();
+
+/**
+ * Records elapsed ticks for a stage when it goes out of scope.
+ */
+class MetricsScope {
+public:
+  explicit MetricsScope(MetricStage s) : stage(s), start(metricsTicks()) {}
+  ~MetricsScope() { metricsHistogram(stage).record(metricsTicks() - start); }
+
+private:
+  MetricStage stage;
+  uint32_t start;
+};
+
+/**
+ * The same for code that can move between cores mid-scope (the AsyncUDP
+ * callbacks): timed in micros, recorded in ticks.
+ */
+class MetricsUnpinnedScope {
+public:
+  explicit MetricsUnpinnedScope(MetricStage s)
+      : stage(s), start(metricsMicros()) {}
+  ~MetricsUnpinnedScope() {
+    metricsHistogram(stage).record((uint32_t)(
+        (metricsMicros() - start) * 1e-6 / metricsSecondsPerTick()));
+  }
+
+private:
+  MetricStage stage;
+  int64_t start;
+};
+
+#ifdef ENABLE_METRICS
+#define METRICS_CONCAT_INNER(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_INNER(a, b)
+#define METRICS_SCOPE(stage)                                                   \
+  MetricsScope METRICS_CONCAT(metricsScope, __LINE__)(stage)
+#define METRICS_SCOPE_UNPINNED(stage)                                          \
+  MetricsUnpinnedScope METRICS_CONCAT(metricsScope, __LINE__)(stage)
+#else
+#define METRICS_SCOPE(stage)
+#define METRICS_SCOPE_UNPINNED(stage)
+#endif
+
+#endif
@@ -0,0 +1,589 @@
+#include "SessionRecorder.h"
+#include "Logging.h"
+#include "Metrics.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NEVER INT64_MAX // for "last recorded" times
+
+SessionRecord::SessionRecord()
+    : type(RECORD_FILE_START), timeMillis(0), altEncoder(0), azEncoder(0),
+      raHours(0), decDegrees(0), altDegrees(0), azDegrees(0),
+      runtimeFromCenterSeconds(0), decAxisDegrees(0), platformRunning(false),
+      platformSlewing(false), hasDecAxis(false), packetCount(0),
+      query(RECORDER_QUERY_RA), value(0), latitude(0), longitude(0),
+      altStepsPerRevolution(0), azStepsPerRevolution(0),
+      doesRefraction(false), temperatureCelsius(0), pressureMillibars(0),
+      syncPoints(0), version(0) {}
+
+RecorderStats::RecorderStats()
+    : records(0), bytes(0), flashWrites(0), files(0), failures(0),
+      droppedBytes(0), suppressedQueries(0), recordTicks(0), flushTicks(0),
+      bufferedBytes(0), firstMillis(0), lastMillis(0) {}
+
+double RecorderStats::hours() const {
+  return (lastMillis - firstMillis) / 3600000.0;
+}
+
+int64_t recorderMillis(TimePoint time) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+TimePoint recorderTime(int64_t millis) {
+  return TimePoint(std::chrono::duration_cast<Clock::duration>(
+      std::chrono::milliseconds(millis)));
+}
+
+static int64_t toUnits(double value, double unitsPerValue) {
+  return isfinite(value) ? (int64_t)llround(value * unitsPerValue) : 0;
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint8_t *putVarint(uint8_t *out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+static uint8_t *putSigned(uint8_t *out, int64_t value) {
+  return putVarint(out, zigzag(value));
+}
+
+static int64_t queryUnits(RecorderQuery query, double value) {
+  return toUnits(value, query == RECORDER_QUERY_RA
+                            ? RECORDER_RA_UNITS_PER_HOUR
+                            : RECORDER_ANGLE_UNITS_PER_DEGREE);
+}
+
+// true if period has passed since, or the clock has gone backwards
+static bool elapsed(int64_t since, int64_t now, int64_t period) {
+  return since == NEVER || now < since || now - since >= period;
+}
+
+SessionRecorder::SessionRecorder(RecorderSink &sink)
+    : sink(sink), used(0), fileOpen(false), fileBytes(0), lastFlushMillis(0),
+      timeSeen(false), loggedFailure(false), lastModelMillis(NEVER) {
+  memset(&state, 0, sizeof(state));
+  for (int i = 0; i < RECORDER_QUERY_COUNT; i++) {
+    lastQueryMillis[i] = NEVER;
+  }
+}
+
+void SessionRecorder::recordPosition(const PositionSnapshot &position) {
+  if (position.updateCount == 0) {
+    return; // the model hasn't run yet
+  }
+  int64_t millis = recorderMillis(position.time);
+  bool moved = lastEncoders.type != RECORD_ENCODERS ||
+               position.altEncoder != lastEncoders.altEncoder ||
+               position.azEncoder != lastEncoders.azEncoder;
+  if (moved && (lastEncoders.type != RECORD_ENCODERS ||
+                elapsed(lastEncoders.timeMillis, millis,
+                        RECORDER_ENCODER_PERIOD_MS))) {
+    SessionRecord record;
+    record.type = RECORD_ENCODERS;
+    record.timeMillis = millis;
+    record.altEncoder = position.altEncoder;
+    record.azEncoder = position.azEncoder;
+    write(record);
+    lastEncoders = record;
+  }
+  if (elapsed(lastModelMillis, millis, RECORDER_MODEL_PERIOD_MS)) {
+    SessionRecord record;
+    record.type = RECORD_MODEL;
+    record.timeMillis = millis;
+    record.raHours = position.raHours;
+    record.decDegrees = position.decDegrees;
+    record.altDegrees = position.altDegrees;
+    record.azDegrees = position.azDegrees;
+    write(record);
+    lastModelMillis = millis;
+  }
+}
+
+void SessionRecorder::recordPlatform(const PlatformTelemetry &telemetry) {
+  if (telemetry.packetCount == 0 ||
+      (lastPlatform.type == RECORD_PLATFORM &&
+       telemetry.packetCount == lastPlatform.packetCount)) {
+    return;
+  }
+  SessionRecord record;
+  record.type = RECORD_PLATFORM;
+  record.timeMillis = recorderMillis(telemetry.receivedTime);
+  record.runtimeFromCenterSeconds = telemetry.runtimeFromCenterSeconds;
+  record.decAxisDegrees = telemetry.decAxisDegrees;
+  record.platformRunning = telemetry.currentlyRunning;
+  record.platformSlewing = telemetry.slewing;
+  record.hasDecAxis = telemetry.hasDecAxis;
+  record.packetCount = telemetry.packetCount;
+  write(record);
+  lastPlatform = record;
+}
+
+void SessionRecorder::recordAlignment(TimePoint time,
+                                      const AlignmentSnapshot &alignment) {
+  SessionRecord record;
+  record.type = RECORD_SETTINGS;
+  record.timeMillis = recorderMillis(time);
+  record.latitude = alignment.latitude;
+  record.longitude = alignment.longitude;
+  record.altStepsPerRevolution = alignment.altEncoderStepsPerRevolution;
+  record.azStepsPerRevolution = alignment.azEncoderStepsPerRevolution;
+  record.doesRefraction = alignment.doesRefraction;
+  record.temperatureCelsius = alignment.temperatureCelsius;
+  record.pressureMillibars = alignment.pressureMillibars;
+  record.syncPoints = alignment.baseAlignmentSynchPoints.size();
+  if (lastSettings.type == RECORD_SETTINGS &&
+      record.latitude == lastSettings.latitude &&
+      record.longitude == lastSettings.longitude &&
+      record.altStepsPerRevolution == lastSettings.altStepsPerRevolution &&
+      record.azStepsPerRevolution == lastSettings.azStepsPerRevolution &&
+      record.doesRefraction == lastSettings.doesRefraction &&
+      record.temperatureCelsius == lastSettings.temperatureCelsius &&
+      record.pressureMillibars == lastSettings.pressureMillibars &&
+      record.syncPoints == lastSettings.syncPoints) {
+    return;
+  }
+  write(record);
+  lastSettings = record;
+}
+
+void SessionRecorder::recordQuery(TimePoint time, RecorderQuery query,
+                                  double value) {
+  if (query < 0 || query >= RECORDER_QUERY_COUNT) {
+    return;
+  }
+  int64_t millis = recorderMillis(time);
+  if (!elapsed(lastQueryMillis[query], millis, RECORDER_QUERY_PERIOD_MS)) {
+    stats.suppressedQueries++;
+    return;
+  }
+  SessionRecord record;
+  record.type = RECORD_QUERY;
+  record.timeMillis = millis;
+  record.query = query;
+  record.value = value;
+  write(record);
+  lastQueryMillis[query] = millis;
+}
+
+void SessionRecorder::recordSync(TimePoint time, double raHours,
+                                 double decDegrees, EncoderCount altEncoder,
+                                 EncoderCount azEncoder,
+                                 const PlatformState &platform) {
+  SessionRecord record;
+  record.type = RECORD_SYNC;
+  record.timeMillis = recorderMillis(time);
+  record.raHours = raHours;
+  record.decDegrees = decDegrees;
+  record.altEncoder = altEncoder;
+  record.azEncoder = azEncoder;
+  record.platform = platform;
+  write(record);
+}
+
+void SessionRecorder::service(TimePoint now) {
+  int64_t millis = recorderMillis(now);
+  seen(millis);
+  if (used > 0 &&
+      elapsed(lastFlushMillis, millis, RECORDER_FLUSH_SECONDS * 1000LL)) {
+    flush();
+  }
+}
+
+bool SessionRecorder::flush() {
+  lastFlushMillis = stats.lastMillis;
+  if (used == 0) {
+    return true;
+  }
+  uint32_t start = metricsTicks();
+  bool written = sink.append(buffer, used);
+  stats.flushTicks += metricsTicks() - start;
+  stats.flashWrites++;
+  if (written) {
+    fileBytes += used;
+    stats.bytes += used;
+    loggedFailure = false;
+  } else {
+    // the deltas in the next buffer would be against these, so start over
+    // in a new file
+    stats.failures++;
+    stats.droppedBytes += used;
+    fileOpen = false;
+    if (!loggedFailure) {
+      log("Session recorder: write failed, dropped %u bytes", (unsigned)used);
+      loggedFailure = true;
+    }
+  }
+  used = 0;
+  stats.bufferedBytes = 0;
+  return written;
+}
+
+void SessionRecorder::seen(int64_t timeMillis) {
+  if (!timeSeen) {
+    stats.firstMillis = timeMillis;
+    timeSeen = true;
+  }
+  if (timeMillis > stats.lastMillis) {
+    stats.lastMillis = timeMillis;
+  }
+}
+
+/**
+ * Encodes against the delta state and buffers the record, flushing when
+ * the buffer is full and moving on to a new file when this one is. A record
+ * that still can't be written (the sink is failing) is dropped.
+ */
+void SessionRecorder::write(const SessionRecord &record) {
+  uint32_t start = metricsTicks();
+  uint64_t flushTicksBefore = stats.flushTicks;
+  seen(record.timeMillis);
+  size_t length = 0;
+  bool written = false;
+  for (int attempt = 0; attempt < 2 && !written; attempt++) {
+    if (!fileOpen && !startFile(record.timeMillis)) {
+      break;
+    }
+    DeltaState next = state;
+    uint8_t scratch[RECORDER_MAX_RECORD_BYTES];
+    length = encode(record, next, scratch);
+    if (fileBytes + used + length > RECORDER_FILE_BYTES) {
+      flush();
+      fileOpen = false;
+      continue;
+    }
+    if (used + length > RECORDER_BUFFER_BYTES && !flush()) {
+      continue;
+    }
+    memcpy(buffer + used, scratch, length);
+    used += length;
+    state = next;
+    stats.records++;
+    written = true;
+  }
+  if (!written) {
+    stats.droppedBytes += length;
+  }
+  stats.bufferedBytes = used;
+  stats.recordTicks +=
+      (metricsTicks() - start) - (stats.flushTicks - flushTicksBefore);
+}
+
+bool SessionRecorder::startFile(int64_t timeMillis) {
+  if (used > 0) {
+    stats.droppedBytes += used; // belonged to a file that failed
+    used = 0;
+  }
+  if (!sink.startFile()) {
+    stats.failures++;
+    if (!loggedFailure) {
+      log("Session recorder: can't start a file");
+      loggedFailure = true;
+    }
+    return false;
+  }
+  stats.files++;
+  fileOpen = true;
+  fileBytes = 0;
+  lastFlushMillis = timeMillis;
+  memset(&state, 0, sizeof(state));
+  state.timeMillis = timeMillis;
+
+  memcpy(buffer, RECORDER_MAGIC, RECORDER_MAGIC_SIZE);
+  buffer[RECORDER_MAGIC_SIZE] = RECORDER_VERSION;
+  used = putSigned(buffer + RECORDER_MAGIC_SIZE + 1, timeMillis) - buffer;
+  // so the file makes sense without the ones before it
+  if (lastSettings.type == RECORD_SETTINGS) {
+    append(lastSettings);
+  }
+  if (lastPlatform.type == RECORD_PLATFORM) {
+    append(lastPlatform);
+  }
+  if (lastEncoders.type == RECORD_ENCODERS) {
+    append(lastEncoders);
+  }
+  return true;
+}
+
+// a fresh file has room for these, no checks needed
+void SessionRecorder::append(const SessionRecord &record) {
+  used += encode(record, state, buffer + used);
+  stats.records++;
+}
+
+size_t SessionRecorder::encode(const SessionRecord &record, DeltaState &state,
+                               uint8_t *out) {
+  uint8_t *p = putVarint(out, record.type);
+  p = putSigned(p, record.timeMillis - state.timeMillis);
+  state.timeMillis = record.timeMillis;
+  switch (record.type) {
+  case RECORD_ENCODERS:
+    p = putSigned(p, record.altEncoder - state.altEncoder);
+    p = putSigned(p, record.azEncoder - state.azEncoder);
+    state.altEncoder = record.altEncoder;
+    state.azEncoder = record.azEncoder;
+    break;
+  case RECORD_MODEL: {
+    int64_t ra = toUnits(record.raHours, RECORDER_RA_UNITS_PER_HOUR);
+    int64_t dec = toUnits(record.decDegrees, RECORDER_ANGLE_UNITS_PER_DEGREE);
+    int64_t alt = toUnits(record.altDegrees, RECORDER_ANGLE_UNITS_PER_DEGREE);
+    int64_t az = toUnits(record.azDegrees, RECORDER_ANGLE_UNITS_PER_DEGREE);
+    p = putSigned(p, ra - state.ra);
+    p = putSigned(p, dec - state.dec);
+    p = putSigned(p, alt - state.alt);
+    p = putSigned(p, az - state.az);
+    state.ra = ra;
+    state.dec = dec;
+    state.alt = alt;
+    state.az = az;
+    break;
+  }
+  case RECORD_PLATFORM: {
+    int64_t runtime = toUnits(record.runtimeFromCenterSeconds, 1000);
+    int64_t decAxis =
+        toUnits(record.decAxisDegrees, RECORDER_ANGLE_UNITS_PER_DEGREE);
+    p = putSigned(p, runtime - state.runtimeMillis);
+    p = putSigned(p, decAxis - state.decAxis);
+    p = putVarint(p, (record.platformRunning ? RECORDER_PLATFORM_RUNNING : 0) |
+                         (record.platformSlewing ? RECORDER_PLATFORM_SLEWING
+                                                 : 0) |
+                         (record.hasDecAxis ? RECORDER_PLATFORM_HAS_DEC_AXIS
+                                            : 0));
+    p = putVarint(p, (uint32_t)(record.packetCount - state.packetCount));
+    state.runtimeMillis = runtime;
+    state.decAxis = decAxis;
+    state.packetCount = record.packetCount;
+    break;
+  }
+  case RECORD_SYNC:
+    p = putSigned(p, toUnits(record.raHours, RECORDER_RA_UNITS_PER_HOUR));
+    p = putSigned(p,
+                  toUnits(record.decDegrees, RECORDER_ANGLE_UNITS_PER_DEGREE));
+    p = putSigned(p, record.altEncoder);
+    p = putSigned(p, record.azEncoder);
+    p = putSigned(p, toUnits(record.platform.raAxisDegrees,
+                             RECORDER_ANGLE_UNITS_PER_DEGREE));
+    p = putSigned(p, toUnits(record.platform.decAxisDegrees,
+                             RECORDER_ANGLE_UNITS_PER_DEGREE));
+    p = putSigned(p, toUnits(record.platform.raAxisDegreesPerSecond,
+                             RECORDER_ANGLE_UNITS_PER_DEGREE));
+    break;
+  case RECORD_QUERY: {
+    // clients mostly ask for what the model last said, so the answer is
+    // a small delta from it
+    int64_t model[RECORDER_QUERY_COUNT] = {state.ra, state.dec, state.alt,
+                                           state.az};
+    p = putVarint(p, record.query);
+    p = putSigned(p, queryUnits(record.query, record.value) -
+                         model[record.query]);
+    break;
+  }
+  case RECORD_SETTINGS:
+    p = putSigned(p, toUnits(record.latitude, RECORDER_ANGLE_UNITS_PER_DEGREE));
+    p = putSigned(p,
+                  toUnits(record.longitude, RECORDER_ANGLE_UNITS_PER_DEGREE));
+    p = putSigned(p, record.altStepsPerRevolution);
+    p = putSigned(p, record.azStepsPerRevolution);
+    p = putVarint(p, record.doesRefraction ? RECORDER_SETTINGS_REFRACTION : 0);
+    p = putSigned(p, toUnits(record.temperatureCelsius, RECORDER_TENTHS));
+    p = putSigned(p, toUnits(record.pressureMillibars, RECORDER_TENTHS));
+    p = putVarint(p, record.syncPoints);
+    break;
+  default:
+    break;
+  }
+  return p - out;
+}
+
+SessionReader::SessionReader(const uint8_t *data, size_t size)
+    : data(data), size(size), offset(0), error(false), started(false), ra(0),
+      dec(0), alt(0), az(0), runtimeMillis(0), decAxis(0),
+      altEncoder(0), azEncoder(0) {}
+
+bool SessionReader::readVarint(uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (offset >= size) {
+      return false;
+    }
+    uint8_t byte = data[offset++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SessionReader::readSigned(int64_t &value) {
+  uint64_t raw;
+  if (!readVarint(raw)) {
+    return false;
+  }
+  value = unzigzag(raw);
+  return true;
+}
+
+bool SessionReader::next(SessionRecord &record) {
+  if (error || offset >= size) {
+    return false;
+  }
+  if (size - offset >= RECORDER_MAGIC_SIZE &&
+      memcmp(data + offset, RECORDER_MAGIC, RECORDER_MAGIC_SIZE) == 0) {
+    offset += RECORDER_MAGIC_SIZE;
+    if (offset >= size || data[offset] != RECORDER_VERSION) {
+      error = true;
+      return false;
+    }
+    offset++;
+    int64_t start;
+    if (!readSigned(start)) {
+      error = true;
+      return false;
+    }
+    current = SessionRecord();
+    ra = dec = alt = az = runtimeMillis = decAxis = 0;
+    altEncoder = azEncoder = 0;
+    current.type = RECORD_FILE_START;
+    current.timeMillis = start;
+    current.version = RECORDER_VERSION;
+    started = true;
+    record = current;
+    return true;
+  }
+
+  uint64_t type;
+  int64_t delta;
+  if (!started || !readVarint(type) || type == RECORD_FILE_START ||
+      type >= RECORD_TYPE_COUNT || !readSigned(delta)) {
+    error = true;
+    return false;
+  }
+  current.type = (RecordType)type;
+  current.timeMillis += delta;
+  int64_t f[8];
+  bool ok = true;
+  switch (current.type) {
+  case RECORD_ENCODERS:
+    ok = readSigned(f[0]) && readSigned(f[1]);
+    altEncoder += f[0];
+    azEncoder += f[1];
+    current.altEncoder = altEncoder;
+    current.azEncoder = azEncoder;
+    break;
+  case RECORD_MODEL:
+    ok = readSigned(f[0]) && readSigned(f[1]) && readSigned(f[2]) &&
+         readSigned(f[3]);
+    ra += f[0];
+    dec += f[1];
+    alt += f[2];
+    az += f[3];
+    current.raHours = ra / RECORDER_RA_UNITS_PER_HOUR;
+    current.decDegrees = dec / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.altDegrees = alt / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.azDegrees = az / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    break;
+  case RECORD_PLATFORM: {
+    uint64_t flags;
+    uint64_t packets;
+    ok = readSigned(f[0]) && readSigned(f[1]) && readVarint(flags) &&
+         readVarint(packets);
+    runtimeMillis += f[0];
+    decAxis += f[1];
+    current.runtimeFromCenterSeconds = runtimeMillis / 1000.0;
+    current.decAxisDegrees = decAxis / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.platformRunning = flags & RECORDER_PLATFORM_RUNNING;
+    current.platformSlewing = flags & RECORDER_PLATFORM_SLEWING;
+    current.hasDecAxis = flags & RECORDER_PLATFORM_HAS_DEC_AXIS;
+    current.packetCount += (uint32_t)packets;
+    break;
+  }
+  case RECORD_SYNC:
+    for (int i = 0; ok && i < 7; i++) {
+      ok = readSigned(f[i]);
+    }
+    current.raHours = f[0] / RECORDER_RA_UNITS_PER_HOUR;
+    current.decDegrees = f[1] / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.altEncoder = f[2];
+    current.azEncoder = f[3];
+    current.platform =
+        PlatformState(f[4] / RECORDER_ANGLE_UNITS_PER_DEGREE,
+                      f[5] / RECORDER_ANGLE_UNITS_PER_DEGREE,
+                      f[6] / RECORDER_ANGLE_UNITS_PER_DEGREE);
+    break;
+  case RECORD_QUERY: {
+    uint64_t query;
+    ok = readVarint(query) && query < RECORDER_QUERY_COUNT && readSigned(f[0]);
+    if (ok) {
+      int64_t model[RECORDER_QUERY_COUNT] = {ra, dec, alt, az};
+      current.query = (RecorderQuery)query;
+      current.value = (model[query] + f[0]) /
+                      (current.query == RECORDER_QUERY_RA
+                           ? RECORDER_RA_UNITS_PER_HOUR
+                           : RECORDER_ANGLE_UNITS_PER_DEGREE);
+    }
+    break;
+  }
+  case RECORD_SETTINGS: {
+    uint64_t flags;
+    uint64_t syncPoints;
+    ok = readSigned(f[0]) && readSigned(f[1]) && readSigned(f[2]) &&
+         readSigned(f[3]) && readVarint(flags) && readSigned(f[4]) &&
+         readSigned(f[5]) && readVarint(syncPoints);
+    current.latitude = f[0] / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.longitude = f[1] / RECORDER_ANGLE_UNITS_PER_DEGREE;
+    current.altStepsPerRevolution = f[2];
+    current.azStepsPerRevolution = f[3];
+    current.doesRefraction = flags & RECORDER_SETTINGS_REFRACTION;
+    current.temperatureCelsius = f[4] / RECORDER_TENTHS;
+    current.pressureMillibars = f[5] / RECORDER_TENTHS;
+    current.syncPoints = syncPoints;
+    break;
+  }
+  default:
+    break;
+  }
+  if (!ok) {
+    error = true;
+    return false;
+  }
+  record = current;
+  return true;
+}
+
+bool formatRecorderFileName(uint32_t sequence, char *out, size_t outSize) {
+  int length = snprintf(out, outSize, "%08lu" RECORDER_FILE_EXTENSION,
+                        (unsigned long)sequence);
+  return length > 0 && (size_t)length < outSize;
+}
+
+bool parseRecorderFileName(const char *name, uint32_t &sequence) {
+  if (name == nullptr ||
+      strlen(name) != RECORDER_FILE_NAME_SIZE - 1 ||
+      strcmp(name + 8, RECORDER_FILE_EXTENSION) != 0) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    if (name[i] < '0' || name[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (name[i] - '0');
+  }
+  sequence = value;
+  return true;
+}
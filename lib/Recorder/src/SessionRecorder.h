@@ -0,0 +1,293 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include "ModelRunner.h"
+#include "PlatformTelemetry.h"
+#include "TimePoint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Session flight recorder: a compact binary log of what the scope saw
+ * during a night, so a bad night can be replayed afterwards.
+ *
+ * File format (tools/decode_session.py reads the same, keep them in step):
+ *
+ *   header: "EQRC", version byte, zigzag varint start time (ms since 1970)
+ *   records: varint type, zigzag varint time delta (ms), then the fields
+ *
+ * Every number after the magic is a LEB128 varint; signed values are
+ * zigzag encoded first. Times are deltas from the previous record (signed,
+ * since platform packets are stamped when they arrived). Encoder, model
+ * and platform fields are deltas from the previous record of the same type
+ * in the same file, query answers are deltas from the latest model record's
+ * value of the same thing, and syncs and settings are absolute.
+ *
+ *   RECORD_ENCODERS  alt, az (counts)
+ *   RECORD_MODEL     ra (RECORDER_RA_UNITS_PER_HOUR), dec, alt, az
+ *                    (RECORDER_ANGLE_UNITS_PER_DEGREE)
+ *   RECORD_PLATFORM  runtime from center (ms), dec axis (angle units),
+ *                    flags (RECORDER_PLATFORM_*), packets since the last
+ *   RECORD_SYNC      ra, dec, alt encoder, az encoder, platform ra axis,
+ *                    dec axis (angle units), ra axis rate (angle units/s)
+ *   RECORD_QUERY     RecorderQuery, answer (ra units for ra, else angle)
+ *   RECORD_SETTINGS  latitude, longitude (angle units), alt steps, az
+ *                    steps, flags (RECORDER_SETTINGS_*), temperature,
+ *                    pressure (tenths), sync points in the alignment
+ *
+ * A file starts with its own header and repeats the latest settings,
+ * platform and encoder values, so each one decodes on its own and losing
+ * the oldest to rotation loses nothing else. None of the record types
+ * encode as 'E', so files can also be decoded back to back.
+ */
+#define RECORDER_MAGIC "EQRC"
+#define RECORDER_MAGIC_SIZE 4
+#define RECORDER_VERSION 1
+#define RECORDER_RA_UNITS_PER_HOUR 36000000.0    // 1ms of time, 0.015"
+#define RECORDER_ANGLE_UNITS_PER_DEGREE 3600000.0 // milliarcseconds
+#define RECORDER_TENTHS 10.0
+#define RECORDER_MAX_RECORD_BYTES 96 // type and up to 9 varints of 10 bytes
+
+/**
+ * Budget. Samples are rate limited so the worst case is bounded whatever
+ * the clients do: an encoder record at most every
+ * RECORDER_ENCODER_PERIOD_MS (and only if the scope moved), a model record
+ * every RECORDER_MODEL_PERIOD_MS, a platform record per packet (about 1Hz)
+ * and each kind of query at most every RECORDER_QUERY_PERIOD_MS. That's
+ * under 400KB an hour with the scope moving and polled the whole time, and
+ * more like 130KB a typical hour, so the files kept hold a whole night.
+ *
+ * Records collect in a RECORDER_BUFFER_BYTES RAM buffer (one flash block)
+ * and go to flash when it fills or after RECORDER_FLUSH_SECONDS, so there
+ * are a couple of hundred writes an hour and a reset loses at most that
+ * much. RECORDER_FILE_COUNT files of RECORDER_FILE_BYTES are kept.
+ */
+#define RECORDER_ENCODER_PERIOD_MS 100
+#define RECORDER_MODEL_PERIOD_MS 1000
+#define RECORDER_QUERY_PERIOD_MS 1000
+#define RECORDER_BUFFER_BYTES 4096
+#define RECORDER_FLUSH_SECONDS 30
+#define RECORDER_FILE_BYTES (256 * 1024)
+#define RECORDER_FILE_COUNT 4
+
+// flags in RECORD_PLATFORM
+#define RECORDER_PLATFORM_RUNNING 1
+#define RECORDER_PLATFORM_SLEWING 2
+#define RECORDER_PLATFORM_HAS_DEC_AXIS 4
+// flags in RECORD_SETTINGS
+#define RECORDER_SETTINGS_REFRACTION 1
+
+// "00000012.rec": sequence numbers go up by one per file, boots included
+#define RECORDER_FILE_EXTENSION ".rec"
+#define RECORDER_FILE_NAME_SIZE 13
+
+enum RecordType {
+  RECORD_FILE_START = 0, // the header, only ever returned by SessionReader
+  RECORD_ENCODERS = 1,
+  RECORD_MODEL = 2,
+  RECORD_PLATFORM = 3,
+  RECORD_SYNC = 4,
+  RECORD_QUERY = 5,
+  RECORD_SETTINGS = 6,
+  RECORD_TYPE_COUNT
+};
+
+// Alpaca reads worth recording: what the client was told the scope is at,
+// in the equatorial system it asked for (see /equatorialSystem)
+enum RecorderQuery {
+  RECORDER_QUERY_RA,
+  RECORDER_QUERY_DEC,
+  RECORDER_QUERY_ALTITUDE,
+  RECORDER_QUERY_AZIMUTH,
+  RECORDER_QUERY_COUNT
+};
+
+/**
+ * One record, with the deltas undone. Only the fields of its type are
+ * meaningful, apart from SessionReader carrying the latest encoder, model
+ * and platform values along (so a reader can just look at the fields).
+ */
+struct SessionRecord {
+  RecordType type;
+  int64_t timeMillis; // since 1970
+  // RECORD_ENCODERS, RECORD_SYNC
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  // RECORD_MODEL, RECORD_SYNC (the sync target)
+  double raHours;
+  double decDegrees;
+  // RECORD_MODEL
+  double altDegrees;
+  double azDegrees;
+  // RECORD_PLATFORM
+  double runtimeFromCenterSeconds;
+  double decAxisDegrees;
+  bool platformRunning;
+  bool platformSlewing;
+  bool hasDecAxis;
+  uint32_t packetCount;
+  // RECORD_SYNC
+  PlatformState platform;
+  // RECORD_QUERY
+  RecorderQuery query;
+  double value;
+  // RECORD_SETTINGS
+  double latitude;
+  double longitude;
+  long altStepsPerRevolution;
+  long azStepsPerRevolution;
+  bool doesRefraction;
+  double temperatureCelsius;
+  double pressureMillibars;
+  uint32_t syncPoints; // fewer than before means the alignment was cleared
+  // RECORD_FILE_START
+  uint8_t version;
+
+  SessionRecord();
+};
+
+/**
+ * Where the recorder's bytes go: on the device, rotating files on LittleFS.
+ */
+class RecorderSink {
+public:
+  virtual ~RecorderSink() {}
+  // Starts a new file, dropping the oldest beyond RECORDER_FILE_COUNT.
+  virtual bool startFile() = 0;
+  // Appends to the current file. When it returns the bytes are on flash.
+  virtual bool append(const uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * What the recorder has cost so far. Ticks are metricsTicks(), so CPU
+ * cycles on the device.
+ */
+struct RecorderStats {
+  uint32_t records;
+  uint64_t bytes;            // made it to the sink
+  uint32_t flashWrites;      // sink appends
+  uint32_t files;            // started
+  uint32_t failures;         // sink calls that failed
+  uint64_t droppedBytes;     // lost to failures
+  uint32_t suppressedQueries; // rate limited
+  uint64_t recordTicks;      // encoding
+  uint64_t flushTicks;       // writing to the sink
+  uint32_t bufferedBytes;    // not on flash yet
+  int64_t firstMillis;       // first and latest time seen
+  int64_t lastMillis;
+
+  RecorderStats();
+  double hours() const;
+};
+
+/**
+ * Encodes samples into the RAM buffer and hands full buffers to a sink.
+ *
+ * Not thread safe: on the device the housekeeping task owns it, sampling
+ * the snapshots itself and taking syncs and queries from the web handlers
+ * through a queue, so the model task pays nothing for it.
+ */
+class SessionRecorder {
+public:
+  explicit SessionRecorder(RecorderSink &sink);
+
+  // Samples, rate limited as above. Call as often as you like.
+  void recordPosition(const PositionSnapshot &position);
+  void recordPlatform(const PlatformTelemetry &telemetry);
+  void recordAlignment(TimePoint time, const AlignmentSnapshot &alignment);
+  void recordQuery(TimePoint time, RecorderQuery query, double value);
+  // Always recorded
+  void recordSync(TimePoint time, double raHours, double decDegrees,
+                  EncoderCount altEncoder, EncoderCount azEncoder,
+                  const PlatformState &platform);
+
+  // Flushes if the buffer has waited RECORDER_FLUSH_SECONDS.
+  void service(TimePoint now);
+  bool flush();
+
+  const RecorderStats &getStats() const { return stats; }
+
+private:
+  struct DeltaState {
+    int64_t timeMillis;
+    int64_t altEncoder;
+    int64_t azEncoder;
+    int64_t ra;
+    int64_t dec;
+    int64_t alt;
+    int64_t az;
+    int64_t runtimeMillis;
+    int64_t decAxis;
+    uint32_t packetCount;
+  };
+
+  void write(const SessionRecord &record);
+  bool startFile(int64_t timeMillis);
+  void append(const SessionRecord &record);
+  static size_t encode(const SessionRecord &record, DeltaState &state,
+                       uint8_t *out);
+  void seen(int64_t timeMillis);
+
+  RecorderSink &sink;
+  uint8_t buffer[RECORDER_BUFFER_BYTES];
+  size_t used;
+  bool fileOpen;
+  size_t fileBytes;
+  DeltaState state;
+  int64_t lastFlushMillis;
+  bool timeSeen;
+  bool loggedFailure;
+
+  // the latest of each, for rate limiting and to start new files with
+  SessionRecord lastEncoders;
+  SessionRecord lastPlatform;
+  SessionRecord lastSettings;
+  int64_t lastModelMillis;
+  int64_t lastQueryMillis[RECORDER_QUERY_COUNT];
+
+  RecorderStats stats;
+};
+
+/**
+ * Reads recorder files back, one record at a time. Several files back to
+ * back are fine, each header gives a RECORD_FILE_START. Stops at the first
+ * thing that doesn't decode (say a file cut off by a reset).
+ */
+class SessionReader {
+public:
+  SessionReader(const uint8_t *data, size_t size);
+
+  // false at the end or on bad data, see hasError()
+  bool next(SessionRecord &record);
+  bool hasError() const { return error; }
+  size_t getOffset() const { return offset; }
+
+private:
+  bool readVarint(uint64_t &value);
+  bool readSigned(int64_t &value);
+
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  bool error;
+  bool started;
+  SessionRecord current; // carries the delta state
+  int64_t ra;            // model values in units, so deltas stay exact
+  int64_t dec;
+  int64_t alt;
+  int64_t az;
+  int64_t runtimeMillis;
+  int64_t decAxis;
+  int64_t altEncoder; // apart from current's, which syncs overwrite
+  int64_t azEncoder;
+};
+
+// "%08lu.rec"; false if it doesn't fit
+bool formatRecorderFileName(uint32_t sequence, char *out, size_t outSize);
+// true only for names formatRecorderFileName makes, so safe to put in a path
+bool parseRecorderFileName(const char *name, uint32_t &sequence);
+
+int64_t recorderMillis(TimePoint time);
+TimePoint recorderTime(int64_t millis);
+
+#endif
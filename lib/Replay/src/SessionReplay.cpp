@@ -0,0 +1,416 @@
+#include "SessionReplay.h"
+#include "ModelPreferences.h"
+#include "ModelRunner.h"
+#include "PlatformTelemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static const char *const parameterNames[REPLAY_PARAMETER_COUNT] = {
+    "altSteps",   "azSteps",     "latitude", "longitude",
+    "refraction", "temperature", "pressure"};
+
+const char *replayParameterName(ReplayParameter parameter) {
+  if (parameter < 0 || parameter >= REPLAY_PARAMETER_COUNT) {
+    return "?";
+  }
+  return parameterNames[parameter];
+}
+
+bool parseReplayParameter(const char *name, ReplayParameter &parameter) {
+  for (int i = 0; i < REPLAY_PARAMETER_COUNT; i++) {
+    if (strcmp(name, parameterNames[i]) == 0) {
+      parameter = (ReplayParameter)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+ReplaySettings::ReplaySettings()
+    : latitude(0), longitude(0), altStepsPerRevolution(0),
+      azStepsPerRevolution(0), doesRefraction(false), temperatureCelsius(0),
+      pressureMillibars(0) {}
+
+ReplaySettings::ReplaySettings(const SessionRecord &settings)
+    : latitude(settings.latitude), longitude(settings.longitude),
+      altStepsPerRevolution(settings.altStepsPerRevolution),
+      azStepsPerRevolution(settings.azStepsPerRevolution),
+      doesRefraction(settings.doesRefraction),
+      temperatureCelsius(settings.temperatureCelsius),
+      pressureMillibars(settings.pressureMillibars) {}
+
+ReplayConfig::ReplayConfig() {
+  for (int i = 0; i < REPLAY_PARAMETER_COUNT; i++) {
+    overridden[i] = false;
+    value[i] = 0;
+  }
+}
+
+void ReplayConfig::set(ReplayParameter parameter, double parameterValue) {
+  overridden[parameter] = true;
+  value[parameter] = parameterValue;
+}
+
+ReplaySettings ReplayConfig::applyTo(const ReplaySettings &recorded) const {
+  ReplaySettings settings = recorded;
+  if (overridden[REPLAY_ALT_STEPS]) {
+    settings.altStepsPerRevolution = lround(value[REPLAY_ALT_STEPS]);
+  }
+  if (overridden[REPLAY_AZ_STEPS]) {
+    settings.azStepsPerRevolution = lround(value[REPLAY_AZ_STEPS]);
+  }
+  if (overridden[REPLAY_LATITUDE]) {
+    settings.latitude = value[REPLAY_LATITUDE];
+  }
+  if (overridden[REPLAY_LONGITUDE]) {
+    settings.longitude = value[REPLAY_LONGITUDE];
+  }
+  if (overridden[REPLAY_REFRACTION]) {
+    settings.doesRefraction = value[REPLAY_REFRACTION] != 0;
+  }
+  if (overridden[REPLAY_TEMPERATURE]) {
+    settings.temperatureCelsius = value[REPLAY_TEMPERATURE];
+  }
+  if (overridden[REPLAY_PRESSURE]) {
+    settings.pressureMillibars = value[REPLAY_PRESSURE];
+  }
+  return settings;
+}
+
+ReplayResult::ReplayResult()
+    : syncs(0), predictions(0), meanErrorDegrees(0), rmsErrorDegrees(0),
+      medianErrorDegrees(0), p90ErrorDegrees(0), maxErrorDegrees(0),
+      modelSamples(0), meanModelDivergenceDegrees(0),
+      maxModelDivergenceDegrees(0) {}
+
+ReplaySession::ReplaySession()
+    : syncs(0), truncated(false), hasSettings(false) {}
+
+bool loadSessionFile(const uint8_t *data, size_t size,
+                     ReplaySession &session) {
+  SessionReader reader(data, size);
+  SessionRecord record;
+  bool any = false;
+  while (reader.next(record)) {
+    any = true;
+    if (record.type == RECORD_FILE_START) {
+      continue;
+    }
+    if (record.type == RECORD_SYNC) {
+      session.syncs++;
+    } else if (record.type == RECORD_SETTINGS) {
+      session.hasSettings = true;
+      session.lastSettings = ReplaySettings(record);
+    }
+    session.records.push_back(record);
+  }
+  if (reader.hasError()) {
+    session.truncated = true;
+  }
+  return any;
+}
+
+// great circle, in doubles: EqCoord's is float and can't say 0. A
+// position that couldn't be worked out (NAN) is the far side of the sky.
+static double separationDegrees(double raHours1, double dec1, double raHours2,
+                                double dec2) {
+  const double toRadians = M_PI / 180;
+  double halfDec = (dec2 - dec1) * toRadians / 2;
+  double halfRa = (raHours2 - raHours1) * 15 * toRadians / 2;
+  double a = sin(halfDec) * sin(halfDec) + cos(dec1 * toRadians) *
+                                               cos(dec2 * toRadians) *
+                                               sin(halfRa) * sin(halfRa);
+  return 2 * asin(sqrt(a < 1 ? a : 1.0)) / toRadians;
+}
+
+// posts what's different from applied (everything if there's nothing yet)
+static void requestSettings(ModelRunner &runner, const ReplaySettings &settings,
+                            const ReplaySettings *applied) {
+  if (!applied || settings.latitude != applied->latitude) {
+    runner.requestLatitude(settings.latitude);
+  }
+  if (!applied || settings.longitude != applied->longitude) {
+    runner.requestLongitude(settings.longitude);
+  }
+  if (!applied ||
+      settings.altStepsPerRevolution != applied->altStepsPerRevolution) {
+    runner.requestAltEncoderStepsPerRevolution(settings.altStepsPerRevolution);
+  }
+  if (!applied ||
+      settings.azStepsPerRevolution != applied->azStepsPerRevolution) {
+    runner.requestAzEncoderStepsPerRevolution(settings.azStepsPerRevolution);
+  }
+  if (!applied || settings.doesRefraction != applied->doesRefraction) {
+    runner.requestDoesRefraction(settings.doesRefraction);
+  }
+  if (!applied ||
+      settings.temperatureCelsius != applied->temperatureCelsius ||
+      settings.pressureMillibars != applied->pressureMillibars) {
+    runner.requestRefractionConditions(settings.temperatureCelsius,
+                                       settings.pressureMillibars);
+  }
+}
+
+static void summarise(std::vector<double> &errors, ReplayResult &result) {
+  result.predictions = errors.size();
+  if (errors.empty()) {
+    return;
+  }
+  std::sort(errors.begin(), errors.end());
+  double sum = 0;
+  double squares = 0;
+  for (double error : errors) {
+    sum += error;
+    squares += error * error;
+  }
+  size_t n = errors.size();
+  result.meanErrorDegrees = sum / n;
+  result.rmsErrorDegrees = sqrt(squares / n);
+  result.medianErrorDegrees =
+      n % 2 ? errors[n / 2] : (errors[n / 2 - 1] + errors[n / 2]) / 2;
+  // nearest rank
+  result.p90ErrorDegrees = errors[(size_t)ceil(0.9 * n) - 1];
+  result.maxErrorDegrees = errors[n - 1];
+}
+
+ReplayResult replaySession(const ReplaySession &session,
+                           const ReplayConfig &config, bool trace) {
+  ReplayResult result;
+  TelescopeModel model; // on this thread, see Ephemeris' observer
+  ModelRunner runner(model);
+  PlatformTelemetry telemetry = PlatformTelemetry();
+  ReplaySettings applied;
+  bool haveSettings = false;
+  uint32_t syncPoints = 0;
+  EncoderCount altEncoder = 0;
+  EncoderCount azEncoder = 0;
+  int syncsSinceClear = 0;
+  double divergence = 0;
+  std::vector<double> errors;
+  errors.reserve(session.syncs);
+
+  for (const SessionRecord &record : session.records) {
+    if (!haveSettings && record.type != RECORD_SETTINGS) {
+      // every file starts with them, so this is only a damaged start
+      continue;
+    }
+    TimePoint time = recorderTime(record.timeMillis);
+    switch (record.type) {
+    case RECORD_SETTINGS: {
+      ReplaySettings settings = config.applyTo(ReplaySettings(record));
+      if (haveSettings && record.syncPoints < syncPoints) {
+        // cleared on the device (or it restarted)
+        runner.requestClearAlignment();
+        syncsSinceClear = 0;
+      }
+      syncPoints = record.syncPoints;
+      requestSettings(runner, settings, haveSettings ? &applied : nullptr);
+      applied = settings;
+      haveSettings = true;
+      runner.tick(altEncoder, azEncoder,
+                  calculatePlatformState(telemetry, time), time);
+      break;
+    }
+    case RECORD_PLATFORM:
+      telemetry.runtimeFromCenterSeconds = record.runtimeFromCenterSeconds;
+      telemetry.decAxisDegrees = record.decAxisDegrees;
+      telemetry.currentlyRunning = record.platformRunning;
+      telemetry.slewing = record.platformSlewing;
+      telemetry.hasDecAxis = record.hasDecAxis;
+      telemetry.packetCount = record.packetCount;
+      telemetry.receivedTime = time;
+      break;
+    case RECORD_ENCODERS:
+      altEncoder = record.altEncoder;
+      azEncoder = record.azEncoder;
+      break;
+    case RECORD_SYNC: {
+      result.syncs++;
+      if (syncsSinceClear >= REPLAY_WARMUP_SYNCS) {
+        runner.tick(record.altEncoder, record.azEncoder, record.platform,
+                    time);
+        PositionSnapshot predicted = runner.getPosition();
+        errors.push_back(separationDegrees(predicted.raHours,
+                                           predicted.decDegrees,
+                                           record.raHours, record.decDegrees));
+      }
+      runner.requestSync(record.raHours, record.decDegrees, record.altEncoder,
+                         record.azEncoder, time, record.platform);
+      runner.tick(record.altEncoder, record.azEncoder, record.platform, time);
+      syncsSinceClear++;
+      break;
+    }
+    case RECORD_MODEL:
+      if (trace) {
+        runner.tick(altEncoder, azEncoder,
+                    calculatePlatformState(telemetry, time), time);
+        PositionSnapshot replayed = runner.getPosition();
+        double degrees =
+            separationDegrees(replayed.raHours, replayed.decDegrees,
+                              record.raHours, record.decDegrees);
+        result.modelSamples++;
+        divergence += degrees;
+        result.maxModelDivergenceDegrees =
+            std::max(result.maxModelDivergenceDegrees, degrees);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  summarise(errors, result);
+  if (result.modelSamples > 0) {
+    result.meanModelDivergenceDegrees = divergence / result.modelSamples;
+  }
+  result.finalSettings = applied;
+  return result;
+}
+
+bool parseReplayRange(const char *text, ReplayRange &range) {
+  const char *equals = strchr(text, '=');
+  if (!equals) {
+    return false;
+  }
+  char name[16];
+  size_t length = equals - text;
+  if (length >= sizeof(name)) {
+    return false;
+  }
+  memcpy(name, text, length);
+  name[length] = 0;
+  if (!parseReplayParameter(name, range.parameter)) {
+    return false;
+  }
+  char *end;
+  range.start = strtod(equals + 1, &end);
+  if (end == equals + 1) {
+    return false;
+  }
+  range.stop = range.start;
+  range.step = 0;
+  if (*end == 0) {
+    return true;
+  }
+  const char *next = end + 1;
+  if (*end != ':') {
+    return false;
+  }
+  range.stop = strtod(next, &end);
+  if (end == next || *end != ':') {
+    return false;
+  }
+  next = end + 1;
+  range.step = strtod(next, &end);
+  return end != next && *end == 0;
+}
+
+// values in a range, 0 if it's backwards
+static size_t rangeCount(const ReplayRange &range) {
+  if (range.stop < range.start || range.step < 0) {
+    return 0;
+  }
+  if (range.step == 0) {
+    return 1;
+  }
+  // a little slack so 0:1:0.1 ends on 1 despite rounding
+  double steps = floor((range.stop - range.start) / range.step + 1e-9);
+  if (steps >= REPLAY_MAX_CONFIGS) {
+    return REPLAY_MAX_CONFIGS + 1;
+  }
+  return (size_t)steps + 1;
+}
+
+bool buildReplayGrid(const ReplayRange *ranges, size_t count,
+                     const ReplayConfig &base,
+                     std::vector<ReplayConfig> &configs) {
+  configs.clear();
+  size_t total = 1;
+  for (size_t i = 0; i < count; i++) {
+    size_t values = rangeCount(ranges[i]);
+    if (values == 0 || values > REPLAY_MAX_CONFIGS / total) {
+      return false;
+    }
+    total *= values;
+  }
+  configs.reserve(total);
+  for (size_t index = 0; index < total; index++) {
+    ReplayConfig config = base;
+    // last range changes fastest
+    size_t rest = index;
+    for (size_t i = count; i-- > 0;) {
+      size_t values = rangeCount(ranges[i]);
+      config.set(ranges[i].parameter,
+                 ranges[i].start + (rest % values) * ranges[i].step);
+      rest /= values;
+    }
+    configs.push_back(config);
+  }
+  return true;
+}
+
+void runReplaySweep(const ReplaySession &session,
+                    const std::vector<ReplayConfig> &configs, unsigned threads,
+                    std::vector<ReplayResult> &results) {
+  results.assign(configs.size(), ReplayResult());
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    size_t i;
+    while ((i = next.fetch_add(1)) < configs.size()) {
+      results[i] = replaySession(session, configs[i]);
+    }
+  };
+  threads = std::max(1u, std::min<unsigned>(threads, configs.size()));
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; i++) {
+    workers.push_back(std::thread(work));
+  }
+  work();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+int bestReplayResult(const std::vector<ReplayResult> &results) {
+  int most = 0;
+  for (const ReplayResult &result : results) {
+    most = std::max(most, result.predictions);
+  }
+  int best = -1;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (most > 0 && results[i].predictions == most &&
+        (best < 0 || results[i].rmsErrorDegrees < results[best].rmsErrorDegrees)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+size_t formatPreferencesCsv(const ReplaySettings &settings, char *out,
+                            size_t outSize) {
+  int length = snprintf(
+      out, outSize,
+      "# latitude %.6f, longitude %.6f: the Alpaca client sets these\n"
+      "key,type,encoding,value\n"
+      "%s,namespace,,\n"
+      "%s,data,i32,%ld\n"
+      "%s,data,i32,%ld\n"
+      "%s,data,i32,%d\n"
+      "%s,data,i32,%ld\n"
+      "%s,data,i32,%ld\n",
+      settings.latitude, settings.longitude, PREFERENCES_NAMESPACE,
+      PREF_ALT_STEPS_KEY, settings.altStepsPerRevolution, PREF_AZ_STEPS_KEY,
+      settings.azStepsPerRevolution, PREF_REFRACTION_KEY,
+      settings.doesRefraction ? 1 : 0, PREF_TEMPERATURE_KEY,
+      lround(settings.temperatureCelsius * 10), PREF_PRESSURE_KEY,
+      lround(settings.pressureMillibars * 10));
+  if (length < 0 || (size_t)length >= outSize) {
+    return 0;
+  }
+  return length;
+}
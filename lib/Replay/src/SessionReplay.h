@@ -0,0 +1,174 @@
+#ifndef SESSION_REPLAY_H
+#define SESSION_REPLAY_H
+
+#include "SessionRecorder.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Offline replay of a recorded session (lib/Recorder) through the model,
+ * for the host tool in tools/replay. Not built for the device.
+ *
+ * A replay feeds the records, in the order they were recorded, to a fresh
+ * TelescopeModel behind a ModelRunner, the same way the device did: settings
+ * become model requests, syncs are synced against the encoders and
+ * platform state they were recorded with, and platform packets and encoder
+ * samples are kept for working out where the model pointed in between.
+ * Records before the first RECORD_SETTINGS are skipped (every file starts
+ * with one, so that's a damaged file). Nothing reads the clock or shares
+ * state between replays, so the same session and config always give the
+ * same numbers, on any thread.
+ *
+ * Pointing error is measured at each sync, before it's applied: the
+ * model as it stood is asked where the sync's encoders point, and that's
+ * compared to where the user said the star was. So each error is how far
+ * off the scope would have been on that star had it not been synced, which
+ * is what changing a setting can improve. The first REPLAY_WARMUP_SYNCS
+ * after the alignment is cleared build the alignment and aren't scored.
+ */
+#define REPLAY_WARMUP_SYNCS 2
+// a bigger grid is almost certainly a typo in a step
+#define REPLAY_MAX_CONFIGS 1000000
+
+// What a ReplayConfig can set, in place of what was recorded.
+enum ReplayParameter {
+  REPLAY_ALT_STEPS,
+  REPLAY_AZ_STEPS,
+  REPLAY_LATITUDE,
+  REPLAY_LONGITUDE,
+  REPLAY_REFRACTION, // 0 or 1
+  REPLAY_TEMPERATURE,
+  REPLAY_PRESSURE,
+  REPLAY_PARAMETER_COUNT
+};
+
+// "altSteps", "azSteps", "latitude", "longitude", "refraction",
+// "temperature", "pressure"
+const char *replayParameterName(ReplayParameter parameter);
+bool parseReplayParameter(const char *name, ReplayParameter &parameter);
+
+/**
+ * Model settings as the device had them, from RECORD_SETTINGS (or with a
+ * config's overrides on top).
+ */
+struct ReplaySettings {
+  double latitude;
+  double longitude;
+  long altStepsPerRevolution;
+  long azStepsPerRevolution;
+  bool doesRefraction;
+  double temperatureCelsius;
+  double pressureMillibars;
+
+  ReplaySettings();
+  explicit ReplaySettings(const SessionRecord &settings);
+};
+
+/**
+ * Which settings to replay with: as recorded, except the overridden ones.
+ */
+struct ReplayConfig {
+  bool overridden[REPLAY_PARAMETER_COUNT];
+  double value[REPLAY_PARAMETER_COUNT];
+
+  ReplayConfig();
+  void set(ReplayParameter parameter, double parameterValue);
+  ReplaySettings applyTo(const ReplaySettings &recorded) const;
+};
+
+struct ReplayResult {
+  int syncs;       // all of them
+  int predictions; // syncs scored, see REPLAY_WARMUP_SYNCS
+  // pointing error at the scored syncs, degrees
+  double meanErrorDegrees;
+  double rmsErrorDegrees;
+  double medianErrorDegrees;
+  double p90ErrorDegrees;
+  double maxErrorDegrees;
+  // replayed position against the device's RECORD_MODEL samples, when
+  // traced: near 0 when replay does what the device did (a little more
+  // while the scope moves, encoders being sampled less often)
+  int modelSamples;
+  double meanModelDivergenceDegrees;
+  double maxModelDivergenceDegrees;
+  ReplaySettings finalSettings; // as replayed, at the end
+
+  ReplayResult();
+};
+
+/**
+ * The records of one or more files, oldest first.
+ */
+struct ReplaySession {
+  std::vector<SessionRecord> records;
+  size_t syncs;
+  bool truncated; // a file was cut short, what was before the damage is kept
+  bool hasSettings;
+  ReplaySettings lastSettings; // as recorded
+
+  ReplaySession();
+};
+
+/**
+ * Appends a recorder file's records to session. Returns false if nothing
+ * at all could be read from it.
+ */
+bool loadSessionFile(const uint8_t *data, size_t size, ReplaySession &session);
+
+/**
+ * Replays the whole session with config. With trace, the position is also
+ * worked out at each RECORD_MODEL sample and compared, which is slower.
+ */
+ReplayResult replaySession(const ReplaySession &session,
+                           const ReplayConfig &config, bool trace = false);
+
+/**
+ * The values to sweep one parameter over: start to stop (inclusive) in
+ * steps of step. A step of 0 means just start.
+ */
+struct ReplayRange {
+  ReplayParameter parameter;
+  double start;
+  double stop;
+  double step;
+};
+
+// "azSteps=108000:109000:50" or "refraction=0:1:1"
+bool parseReplayRange(const char *text, ReplayRange &range);
+
+/**
+ * Every combination of the ranges (the first changing slowest) on top of
+ * base. False, and configs left empty, if a range is backwards or there
+ * would be more than REPLAY_MAX_CONFIGS.
+ */
+bool buildReplayGrid(const ReplayRange *ranges, size_t count,
+                     const ReplayConfig &base,
+                     std::vector<ReplayConfig> &configs);
+
+/**
+ * Replays every config on threads threads (at least one), results[i] for
+ * configs[i]. Each thread takes the next config not yet done, so the
+ * results don't depend on the thread count.
+ */
+void runReplaySweep(const ReplaySession &session,
+                    const std::vector<ReplayConfig> &configs, unsigned threads,
+                    std::vector<ReplayResult> &results);
+
+/**
+ * Index of the lowest RMS pointing error, the earliest on a tie. Configs
+ * with fewer predictions than the most any config made don't count (a
+ * setting that lost syncs isn't a better fit). -1 if none made any.
+ */
+int bestReplayResult(const std::vector<ReplayResult> &results);
+
+/**
+ * Settings in the device's Preferences keys (see ModelPreferences.h), as
+ * an NVS partition CSV for ESP-IDF's nvs_partition_gen.py. Latitude and
+ * longitude aren't kept on the device (the Alpaca client sends them) so
+ * they go in a comment. Returns the length, or 0 if it didn't fit.
+ */
+size_t formatPreferencesCsv(const ReplaySettings &settings, char *out,
+                            size_t outSize);
+
+#endif
@@ -0,0 +1,137 @@
+#include "Sntp.h"
+#include <string.h>
+
+// 1900 to 1970
+#define NTP_UNIX_OFFSET_SECONDS 2208988800ULL
+#define SNTP_VERSION 4
+#define SNTP_MODE_CLIENT 3
+#define SNTP_MODE_SERVER 4
+// 2^-20 seconds, about the microsecond the TimeService has
+#define SNTP_PRECISION -20
+
+#define SNTP_ORIGINATE_OFFSET 24
+#define SNTP_RECEIVE_OFFSET 32
+#define SNTP_TRANSMIT_OFFSET 40
+#define SNTP_REFERENCE_OFFSET 16
+
+static void putTimestamp(uint8_t *out, uint64_t timestamp) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = (uint8_t)(timestamp >> (56 - 8 * i));
+  }
+}
+
+static uint64_t getTimestamp(const uint8_t *in) {
+  uint64_t timestamp = 0;
+  for (int i = 0; i < 8; i++) {
+    timestamp = (timestamp << 8) | in[i];
+  }
+  return timestamp;
+}
+
+uint64_t toNtpTimestamp(TimePoint time) {
+  int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                       time.time_since_epoch())
+                       .count();
+  if (micros < 0) {
+    return 0;
+  }
+  uint64_t seconds = micros / 1000000 + NTP_UNIX_OFFSET_SECONDS;
+  uint64_t fraction = ((uint64_t)(micros % 1000000) << 32) / 1000000;
+  return (seconds << 32) | (fraction & 0xffffffff);
+}
+
+TimePoint fromNtpTimestamp(uint64_t timestamp) {
+  uint64_t seconds = timestamp >> 32;
+  // era 1 starts in 2036
+  if (seconds < 0x80000000ULL) {
+    seconds += 0x100000000ULL;
+  }
+  uint64_t micros = ((timestamp & 0xffffffff) * 1000000 + 0x80000000) >> 32;
+  return TimePoint(std::chrono::duration_cast<Clock::duration>(
+      std::chrono::microseconds(
+          (int64_t)((seconds - NTP_UNIX_OFFSET_SECONDS) * 1000000 + micros))));
+}
+
+bool sntpServerReply(const uint8_t *request, size_t size, TimePoint received,
+                     TimePoint transmit, bool synchronised,
+                     TimePoint referenced, uint8_t *reply) {
+  if (size < SNTP_PACKET_SIZE) {
+    return false;
+  }
+  int version = (request[0] >> 3) & 7;
+  int mode = request[0] & 7;
+  if (mode != SNTP_MODE_CLIENT || version < 1 || version > 4) {
+    return false;
+  }
+  memset(reply, 0, SNTP_PACKET_SIZE);
+  // the client's version, and no leap second warning once synchronised
+  int leap = synchronised ? 0 : SNTP_LEAP_UNSYNCHRONISED;
+  reply[0] = (uint8_t)((leap << 6) | (version << 3) | SNTP_MODE_SERVER);
+  reply[1] = synchronised ? SNTP_STRATUM : SNTP_STRATUM_UNSYNCHRONISED;
+  reply[2] = request[2]; // poll, as asked
+  reply[3] = (uint8_t)(int8_t)SNTP_PRECISION;
+  // root delay and dispersion 0: nothing further up
+  memcpy(reply + 12, "LOCL", 4);
+  if (synchronised) {
+    // otherwise 0, never set
+    putTimestamp(reply + SNTP_REFERENCE_OFFSET, toNtpTimestamp(referenced));
+  }
+  memcpy(reply + SNTP_ORIGINATE_OFFSET, request + SNTP_TRANSMIT_OFFSET, 8);
+  putTimestamp(reply + SNTP_RECEIVE_OFFSET, toNtpTimestamp(received));
+  putTimestamp(reply + SNTP_TRANSMIT_OFFSET, toNtpTimestamp(transmit));
+  return true;
+}
+
+void sntpClientRequest(TimePoint sent, uint8_t *request) {
+  memset(request, 0, SNTP_PACKET_SIZE);
+  request[0] = (SNTP_VERSION << 3) | SNTP_MODE_CLIENT;
+  putTimestamp(request + SNTP_TRANSMIT_OFFSET, toNtpTimestamp(sent));
+}
+
+bool sntpParseReply(const uint8_t *reply, size_t size, TimePoint sent,
+                    TimePoint arrived, SntpSample &sample) {
+  if (size < SNTP_PACKET_SIZE || (reply[0] & 7) != SNTP_MODE_SERVER ||
+      reply[1] == 0 ||
+      getTimestamp(reply + SNTP_ORIGINATE_OFFSET) != toNtpTimestamp(sent) ||
+      getTimestamp(reply + SNTP_TRANSMIT_OFFSET) == 0) {
+    return false;
+  }
+  // the server's clock at t2 and t3
+  TimePoint serverReceived =
+      fromNtpTimestamp(getTimestamp(reply + SNTP_RECEIVE_OFFSET));
+  TimePoint serverSent =
+      fromNtpTimestamp(getTimestamp(reply + SNTP_TRANSMIT_OFFSET));
+  double out = differenceInSeconds(sent, serverReceived);
+  double back = differenceInSeconds(arrived, serverSent);
+  sample.offsetSeconds = (out + back) / 2;
+  sample.delaySeconds = out - back;
+  sample.time = arrived;
+  return true;
+}
+
+SntpFilter::SntpFilter() : next(0), count(0) {}
+
+bool SntpFilter::add(const SntpSample &sample) {
+  if (sample.delaySeconds > SNTP_MAX_DELAY_SECONDS) {
+    return false;
+  }
+  samples[next] = sample;
+  next = (next + 1) % SNTP_FILTER_SIZE;
+  if (count < SNTP_FILTER_SIZE) {
+    count++;
+  }
+  return true;
+}
+
+bool SntpFilter::getBest(SntpSample &best) const {
+  if (count == 0) {
+    return false;
+  }
+  best = samples[0];
+  for (int i = 1; i < count; i++) {
+    if (samples[i].delaySeconds < best.delaySeconds) {
+      best = samples[i];
+    }
+  }
+  return true;
+}
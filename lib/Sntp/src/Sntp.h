@@ -0,0 +1,85 @@
+#ifndef SNTP_H
+#define SNTP_H
+
+#include "TimePoint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SNTP (RFC 4330) between the devices in the field, with no internet: the
+ * DSC serves its TimeService (src/TimeServer.cpp), and the platform and
+ * focuser keep to it with sntpClientRequest/sntpParseReply and an
+ * SntpFilter. They then stamp what they send with that time (see
+ * platformPacketTime), so a platform's timeToCenter is taken as of when it
+ * was true rather than when it arrived.
+ */
+#define SNTP_PORT 123
+#define SNTP_PACKET_SIZE 48
+// a local clock nobody should mistake for a reference
+#define SNTP_STRATUM 10
+// before any client has set it: alarm, and no stratum at all
+#define SNTP_LEAP_UNSYNCHRONISED 3
+#define SNTP_STRATUM_UNSYNCHRONISED 16
+// a round trip longer than this over the local WiFi was queued somewhere,
+// and its offset could be out by half of it
+#define SNTP_MAX_DELAY_SECONDS 0.1
+// the best of how many recent samples, as NTP's clock filter
+#define SNTP_FILTER_SIZE 8
+
+// NTP's 32.32 seconds since 1900, wrapping in 2036 (era 1 is taken to
+// follow era 0, as RFC 4330 suggests)
+uint64_t toNtpTimestamp(TimePoint time);
+TimePoint fromNtpTimestamp(uint64_t timestamp);
+
+/**
+ * The server's answer to a request that arrived at received, sent at
+ * transmit. Until synchronised (a client has set the clock) it says so,
+ * with the alarm leap indicator and stratum 16; after, referenced is when
+ * the clock was last set. False (nothing to send) for anything but an
+ * SNTP client request.
+ *
+ * Our own clients still take an unsynchronised reply: all they need is to
+ * agree with the DSC.
+ */
+bool sntpServerReply(const uint8_t *request, size_t size, TimePoint received,
+                     TimePoint transmit, bool synchronised,
+                     TimePoint referenced, uint8_t *reply);
+
+// a client request, sent at (our clock) sent
+void sntpClientRequest(TimePoint sent, uint8_t *request);
+
+struct SntpSample {
+  double offsetSeconds; // server's clock minus ours
+  double delaySeconds;  // round trip, less the time in the server
+  TimePoint time;       // ours, when the reply arrived
+};
+
+/**
+ * The reply to the request sent at sent, arriving at arrived. False if it
+ * isn't one (another request's, a kiss of death, not a server).
+ */
+bool sntpParseReply(const uint8_t *reply, size_t size, TimePoint sent,
+                    TimePoint arrived, SntpSample &sample);
+
+/**
+ * Keeps the last SNTP_FILTER_SIZE samples and picks the one with the
+ * least delay: its offset can only be out by half its delay, where one
+ * that sat in a queue could be out by anything up to half of that.
+ */
+class SntpFilter {
+public:
+  SntpFilter();
+
+  // false if refused, for a delay over SNTP_MAX_DELAY_SECONDS
+  bool add(const SntpSample &sample);
+  // false before the first sample
+  bool getBest(SntpSample &best) const;
+  int getCount() const { return count; }
+
+private:
+  SntpSample samples[SNTP_FILTER_SIZE];
+  int next;
+  int count;
+};
+
+#endif
@@ -164,10 +164,14 @@ void CoordConv::setT(float m11, float m12, float m13, float m21, float m22,
 void CoordConv::setTinvFromT() { invert(Tinv, T); }
 
 void CoordConv::addReferenceCoord(HorizCoord h, EqCoord e) {
-  addReference(TakiHorizCoord(h, isNorthernHemisphere), e);
+  addReference(toTaki(h), e);
 }
 
-void CoordConv::setNorthernHemisphere(bool b) { isNorthernHemisphere = b; }
+// picks the conversion once, rather than branching on it for every one
+void CoordConv::setNorthernHemisphere(bool b) {
+  isNorthernHemisphere = b;
+  toTaki = b ? TakiHorizCoord::from<true> : TakiHorizCoord::from<false>;
+}
 void CoordConv::addReference(TakiHorizCoord t, EqCoord e) {
 
   addReferenceDeg(e.getRAInDegrees(), e.getDecInDegrees(), t.aziAngle,
@@ -213,7 +217,7 @@ HorizCoord CoordConv::toInstrumentCoord(EqCoord eq) {
 }
 
 EqCoord CoordConv::toReferenceCoord(HorizCoord h) {
-  TakiHorizCoord taki = TakiHorizCoord(h, isNorthernHemisphere);
+  TakiHorizCoord taki = toTaki(h);
   return toReferenceCoord(taki);
 }
 
@@ -227,6 +231,21 @@ EqCoord CoordConv::toReferenceCoord(TakiHorizCoord h) {
   return out;
 }
 
+EqCoord CoordConv::toReferenceCoord(HorizCoord h,
+                                    const double (&transform)[3][3]) const {
+  TakiHorizCoord taki = toTaki(h);
+  double dcAA[3], dcHD[3];
+  toDirCos(dcAA, toRad(taki.altAngle), toRad(taki.aziAngle));
+  multiply(dcHD, transform, dcAA);
+  normalize(dcHD, dcHD);
+  double ra, dec;
+  toAngles(dec, ra, dcHD);
+  EqCoord out;
+  out.setDecInDegrees(toDeg(dec));
+  out.setRAInDegrees(toDeg(ra));
+  return out;
+}
+
 // add reference star (all values in radians). adding more than three has no
 // effect
 void CoordConv::addReference(double angle1, double angle2, double axis1,
@@ -111,6 +111,7 @@ public:
   CoordConv() {
     reset();
     isready = false;
+    setNorthernHemisphere(false);
   }
 
   // resets reference stars
@@ -138,12 +139,18 @@ public:
 
   void setTinvFromT();
 
+  // get the inverse transformation, eg to compose with a platform rotation
+  void getTinv(double (&out)[3][3]) const { copy(out, Tinv); }
+
   // Calculate third reference star from two provided ones. Returns false if
   // more or less than two provided
   bool calculateThirdReference();
 
   HorizCoord toInstrumentCoord(EqCoord eq);
   EqCoord toReferenceCoord(HorizCoord h);
+  // as above, with transform used in place of Tinv
+  EqCoord toReferenceCoord(HorizCoord h,
+                           const double (&transform)[3][3]) const;
 
   double polErrorDeg(double lat, Err sel);
   unsigned char refs = 0; // number of reference stars
@@ -194,6 +201,7 @@ protected:
 
   bool isready = false;
   bool isNorthernHemisphere;
+  TakiConversion toTaki; // for isNorthernHemisphere
 };
 
 #endif // __CoordConv_hpp__
@@ -0,0 +1,49 @@
+#ifndef TELESCOPE_MODEL_ENCODER_AXIS_H
+#define TELESCOPE_MODEL_ENCODER_AXIS_H
+
+#include "EncoderScale.h"
+
+/**
+ * One encoder axis as built: the pins it's wired to, which way its raw
+ * count runs, and its resolution, all fixed at compile time. The device
+ * declares one per axis (see src/encoders.h) and everything that used to
+ * repeat the numbers reads them from there.
+ *
+ * Direction is applied to the raw count as it's sampled (1 or -1, so the
+ * multiply is folded into a negate or nothing). StepsPerRevolution is the
+ * model's default: signed, negative where the sampled count goes down as
+ * the angle goes up. The conversion is EncoderScale's with the reciprocal
+ * a constant, for code that only ever sees the built-in resolution; the
+ * model itself keeps an EncoderScale, as Preferences and calibration
+ * change the resolution at run time.
+ */
+template <int PinA, int PinB, int Direction, long StepsPerRevolution>
+struct EncoderAxis {
+  static_assert(Direction == 1 || Direction == -1, "Direction is 1 or -1");
+
+  static constexpr int pinA = PinA;
+  static constexpr int pinB = PinB;
+  static constexpr long stepsPerRevolution = StepsPerRevolution;
+  // unsigned, as SkySafari's encoder protocol wants it
+  static constexpr long resolution =
+      StepsPerRevolution < 0 ? -StepsPerRevolution : StepsPerRevolution;
+  static constexpr uint64_t turnsPerCount =
+      encoderTurnsPerCount(encoderRevolution(StepsPerRevolution));
+
+  static constexpr EncoderCount sample(int64_t raw) {
+    return Direction < 0 ? -raw : raw;
+  }
+  static constexpr uint32_t toTurns(EncoderCount counts) {
+    return encoderCountsToTurns(counts, turnsPerCount, StepsPerRevolution < 0);
+  }
+  // 0 to 360
+  static constexpr double toDegrees(EncoderCount counts) {
+    return toTurns(counts) * DEGREES_PER_TURN_UNIT;
+  }
+  // -180 to 180
+  static constexpr double toSignedDegrees(EncoderCount counts) {
+    return (int32_t)toTurns(counts) * DEGREES_PER_TURN_UNIT;
+  }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "EncoderHistory.h"
+#include <math.h>
+
+EncoderHistory::EncoderHistory() : count(0) {}
+
+void EncoderHistory::add(EncoderCount altEncoder, EncoderCount azEncoder,
+                         TimePoint time) {
+  uint32_t n = count.load(std::memory_order_relaxed);
+  // a tick a hair early (rounding) still counts, or every other interval
+  // would be a tick long
+  if (n > 0 && time >= lastAdded &&
+      differenceInSeconds(lastAdded, time) <
+          ENCODER_HISTORY_INTERVAL_SECONDS - 0.001) {
+    return;
+  }
+  EncoderSample sample;
+  sample.time = time;
+  sample.altEncoder = altEncoder;
+  sample.azEncoder = azEncoder;
+  slots[n % ENCODER_HISTORY_SIZE].write(sample);
+  count.store(n + 1, std::memory_order_release);
+  lastAdded = time;
+}
+
+bool EncoderHistory::summarise(TimePoint start, TimePoint end,
+                               EncoderWindow &window) const {
+  TimePoint earliest =
+      addSecondsToTime(end, -ENCODER_HISTORY_INTERVAL_SECONDS);
+  if (start > earliest) {
+    start = earliest;
+  }
+  uint32_t n = count.load(std::memory_order_acquire);
+  uint32_t available = n < ENCODER_HISTORY_SIZE ? n : ENCODER_HISTORY_SIZE;
+
+  // relative to the first sample found, so the sums of squares stay small
+  int samples = 0;
+  EncoderCount altOrigin = 0;
+  EncoderCount azOrigin = 0;
+  double altSum = 0;
+  double azSum = 0;
+  double altSquares = 0;
+  double azSquares = 0;
+  TimePoint first;
+  TimePoint last;
+  // newest first
+  for (uint32_t i = 1; i <= available; i++) {
+    EncoderSample sample = slots[(n - i) % ENCODER_HISTORY_SIZE].read();
+    if (sample.time > end) {
+      continue;
+    }
+    if (sample.time < start) {
+      break;
+    }
+    if (samples == 0) {
+      altOrigin = sample.altEncoder;
+      azOrigin = sample.azEncoder;
+      last = sample.time;
+    }
+    double alt = (double)(sample.altEncoder - altOrigin);
+    double az = (double)(sample.azEncoder - azOrigin);
+    altSum += alt;
+    azSum += az;
+    altSquares += alt * alt;
+    azSquares += az * az;
+    first = sample.time;
+    samples++;
+  }
+  if (samples == 0) {
+    return false;
+  }
+  double altMean = altSum / samples;
+  double azMean = azSum / samples;
+  window.samples = samples;
+  window.altEncoder = altOrigin + altMean;
+  window.azEncoder = azOrigin + azMean;
+  window.altSpread = sqrt(fmax(0, altSquares / samples - altMean * altMean));
+  window.azSpread = sqrt(fmax(0, azSquares / samples - azMean * azMean));
+  window.coveredSeconds = differenceInSeconds(first, last);
+  return true;
+}
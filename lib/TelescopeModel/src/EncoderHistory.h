@@ -0,0 +1,64 @@
+#ifndef TELESCOPE_MODEL_ENCODER_HISTORY_H
+#define TELESCOPE_MODEL_ENCODER_HISTORY_H
+
+#include "EncoderScale.h"
+#include "SeqLock.h"
+#include "TimePoint.h"
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * The model task keeps one encoder sample every
+ * ENCODER_HISTORY_INTERVAL_SECONDS, for the last ENCODER_HISTORY_SIZE of
+ * them: 51 seconds, long enough for a plate solve's exposure and solve.
+ * About 16KB.
+ */
+#define ENCODER_HISTORY_SIZE 512
+#define ENCODER_HISTORY_INTERVAL_SECONDS 0.1
+
+struct EncoderSample {
+  TimePoint time;
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+};
+
+/**
+ * Encoder counts over a stretch of time: their mean and spread (standard
+ * deviation), and how much of the stretch the samples cover.
+ */
+struct EncoderWindow {
+  int samples;
+  double altEncoder;
+  double azEncoder;
+  double altSpread;
+  double azSpread;
+  double coveredSeconds; // from the first sample in it to the last
+};
+
+/**
+ * Recent encoder samples, written by the model task and read from any
+ * other. Each slot is its own SeqLock, so a reader never sees half a
+ * sample. One that was overwritten while being read (the reader fell a
+ * whole history behind) is newer than the window asked for, and skipped.
+ */
+class EncoderHistory {
+public:
+  EncoderHistory();
+
+  // model task, every tick: keeps one per ENCODER_HISTORY_INTERVAL_SECONDS
+  void add(EncoderCount altEncoder, EncoderCount azEncoder, TimePoint time);
+
+  /**
+   * Summarises the samples from start to end, widened to at least one
+   * interval back from end so a short exposure still catches one. False
+   * if there are none (not recorded yet, or older than the history).
+   */
+  bool summarise(TimePoint start, TimePoint end, EncoderWindow &window) const;
+
+private:
+  SeqLock<EncoderSample> slots[ENCODER_HISTORY_SIZE];
+  std::atomic<uint32_t> count; // samples ever added
+  TimePoint lastAdded;         // model task's own
+};
+
+#endif
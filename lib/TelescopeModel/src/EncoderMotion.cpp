@@ -0,0 +1,107 @@
+#include "EncoderMotion.h"
+#include <math.h>
+#include <stdlib.h>
+
+AxisMotionFilter::AxisMotionFilter()
+    : position(0), velocity(0), acceleration(0) {}
+
+void AxisMotionFilter::reset(double counts) {
+  position = counts;
+  velocity = 0;
+  acceleration = 0;
+}
+
+void AxisMotionFilter::update(double counts, double seconds) {
+  double predicted = position + velocity * seconds +
+                     acceleration * seconds * seconds / 2;
+  double residual = counts - predicted;
+  position = predicted + MOTION_ALPHA * residual;
+  velocity += acceleration * seconds + MOTION_BETA * residual / seconds;
+  acceleration += 2 * MOTION_GAMMA * residual / (seconds * seconds);
+}
+
+double AxisMotionFilter::predictMove(double seconds) const {
+  // slowing down: stops when velocity + acceleration * t gets to 0
+  if (velocity * acceleration < 0) {
+    double stopSeconds = -velocity / acceleration;
+    if (stopSeconds < seconds) {
+      seconds = stopSeconds;
+    }
+  }
+  return velocity * seconds + acceleration * seconds * seconds / 2;
+}
+
+AxisMotion::AxisMotion()
+    : moving(false), still(0), slowSeconds(0), degreesPerSecond(0) {}
+
+void AxisMotion::reset(EncoderCount counts) {
+  filter.reset((double)counts);
+  moving = false;
+  still = counts;
+  slowSeconds = 0;
+  degreesPerSecond = 0;
+}
+
+void AxisMotion::update(EncoderCount counts, double seconds,
+                        long stepsPerRevolution) {
+  filter.update((double)counts, seconds);
+  degreesPerSecond = stepsPerRevolution == 0
+                         ? 0
+                         : filter.getVelocity() * 360.0 /
+                               labs(stepsPerRevolution);
+  double speed = fabs(degreesPerSecond);
+  if (!moving) {
+    if (speed > MOTION_START_DEGREES_PER_SECOND &&
+        llabs(counts - still) > MOTION_START_COUNTS) {
+      moving = true;
+      slowSeconds = 0;
+    }
+  } else if (speed < MOTION_STOP_DEGREES_PER_SECOND) {
+    slowSeconds += seconds;
+    if (slowSeconds >= MOTION_SETTLE_SECONDS) {
+      moving = false;
+      still = counts;
+    }
+  } else {
+    slowSeconds = 0;
+  }
+}
+
+long AxisMotion::predictMove(double seconds) const {
+  return moving ? lround(filter.predictMove(seconds)) : 0;
+}
+
+EncoderMotion::EncoderMotion() : started(false), lastAlt(0), lastAz(0) {}
+
+void EncoderMotion::update(EncoderCount altEncoder, EncoderCount azEncoder,
+                           TimePoint time,
+                           long altStepsPerRevolution,
+                           long azStepsPerRevolution) {
+  double seconds = started ? differenceInSeconds(lastTime, time) : 0;
+  if (!started || seconds <= 0 || seconds > MOTION_MAX_GAP_SECONDS) {
+    // first sample, clock went backwards or a long gap: start again
+    alt.reset(altEncoder);
+    az.reset(azEncoder);
+    started = true;
+  } else {
+    alt.update(altEncoder, seconds, altStepsPerRevolution);
+    az.update(azEncoder, seconds, azStepsPerRevolution);
+  }
+  lastTime = time;
+  lastAlt = altEncoder;
+  lastAz = azEncoder;
+}
+
+void EncoderMotion::predict(double seconds, EncoderCount &altEncoder,
+                            EncoderCount &azEncoder) const {
+  altEncoder = lastAlt;
+  azEncoder = lastAz;
+  if (seconds <= 0) {
+    return;
+  }
+  if (seconds > MOTION_MAX_LEAD_SECONDS) {
+    seconds = MOTION_MAX_LEAD_SECONDS;
+  }
+  altEncoder += alt.predictMove(seconds);
+  azEncoder += az.predictMove(seconds);
+}
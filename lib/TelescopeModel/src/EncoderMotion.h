@@ -0,0 +1,125 @@
+#ifndef TELESCOPE_MODEL_ENCODER_MOTION_H
+#define TELESCOPE_MODEL_ENCODER_MOTION_H
+
+#include "EncoderScale.h"
+#include "TimePoint.h"
+
+/**
+ * Alpha-beta-gamma gains for the per axis filters, for samples every 10ms
+ * (the model task). High enough alpha and beta to pick up a nudge within a
+ * few samples, gamma low so a single count of encoder jitter doesn't show
+ * up as acceleration.
+ */
+#define MOTION_ALPHA 0.5
+#define MOTION_BETA 0.15
+#define MOTION_GAMMA 0.01
+// a longer gap between samples restarts the filters
+#define MOTION_MAX_GAP_SECONDS 0.5
+
+/**
+ * An axis is moving once it's faster than MOTION_START_DEGREES_PER_SECOND
+ * and has moved more than MOTION_START_COUNTS since it stopped (so an
+ * encoder sitting on an edge and flickering between two counts never
+ * counts), and stops once it's slower than MOTION_STOP_DEGREES_PER_SECOND
+ * for MOTION_SETTLE_SECONDS. The sky's own motion is 0.004 degrees a
+ * second, a gentle nudge 0.1 or more.
+ */
+#define MOTION_START_DEGREES_PER_SECOND 0.05
+#define MOTION_START_COUNTS 2
+#define MOTION_STOP_DEGREES_PER_SECOND 0.02
+#define MOTION_SETTLE_SECONDS 0.25
+// no client is that far behind, and past it the extrapolation is a guess
+#define MOTION_MAX_LEAD_SECONDS 1.0
+
+/**
+ * One axis: position, velocity and acceleration in counts and seconds,
+ * updated from each encoder sample by an alpha-beta-gamma filter.
+ */
+class AxisMotionFilter {
+public:
+  AxisMotionFilter();
+
+  void reset(double counts);
+  // seconds since the previous sample, more than 0
+  void update(double counts, double seconds);
+
+  double getPosition() const { return position; }
+  double getVelocity() const { return velocity; }
+  double getAcceleration() const { return acceleration; }
+  /**
+   * How far the axis will have moved, seconds after the last sample. When
+   * it's slowing down, no further than where it stops: a nudge ends with
+   * the scope still, not heading back.
+   */
+  double predictMove(double seconds) const;
+
+private:
+  double position;
+  double velocity;
+  double acceleration;
+};
+
+/**
+ * One axis's filter, and whether it's moving (see
+ * MOTION_START_DEGREES_PER_SECOND).
+ */
+class AxisMotion {
+public:
+  AxisMotion();
+
+  void reset(EncoderCount counts);
+  void update(EncoderCount counts, double seconds, long stepsPerRevolution);
+
+  bool isMoving() const { return moving; }
+  // 0 while still, so encoder jitter doesn't show
+  double getDegreesPerSecond() const {
+    return moving ? degreesPerSecond : 0;
+  }
+  // counts from the last sample, 0 while still
+  long predictMove(double seconds) const;
+
+private:
+  AxisMotionFilter filter;
+  bool moving;
+  EncoderCount still; // where it was when it last stopped
+  double slowSeconds;
+  double degreesPerSecond;
+};
+
+/**
+ * Velocity and acceleration of both axes from the model task's encoder
+ * samples, whether the scope is being moved, and where the encoders are
+ * expected to be a little later. Model task only.
+ */
+class EncoderMotion {
+public:
+  EncoderMotion();
+
+  // Steps per revolution turn counts into degrees for the moving test; 0
+  // (not set yet) never moves.
+  void update(EncoderCount altEncoder, EncoderCount azEncoder, TimePoint time,
+              long altStepsPerRevolution, long azStepsPerRevolution);
+
+  // either axis
+  bool isMoving() const { return alt.isMoving() || az.isMoving(); }
+  double getAltDegreesPerSecond() const { return alt.getDegreesPerSecond(); }
+  double getAzDegreesPerSecond() const { return az.getDegreesPerSecond(); }
+
+  /**
+   * Encoder counts expected seconds (up to MOTION_MAX_LEAD_SECONDS) after
+   * the last sample. That sample plus the predicted move of each moving
+   * axis, so with no lead or a still scope it's exactly the last sample.
+   */
+  void predict(double seconds, EncoderCount &altEncoder,
+               EncoderCount &azEncoder) const;
+
+private:
+  AxisMotion alt;
+  AxisMotion az;
+  bool started;
+  TimePoint lastTime;
+  EncoderCount lastAlt;
+  EncoderCount lastAz;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "EncoderScale.h"
+
+EncoderScale::EncoderScale() : steps(0), turnsPerCount(0) {}
+
+void EncoderScale::setStepsPerRevolution(long newSteps) {
+  if (newSteps == steps) {
+    return;
+  }
+  steps = newSteps;
+  turnsPerCount = encoderTurnsPerCount(encoderRevolution(steps));
+}
+
+uint32_t EncoderScale::toTurns(EncoderCount counts) const {
+  return encoderCountsToTurns(counts, turnsPerCount, steps < 0);
+}
+
+double EncoderScale::toDegrees(EncoderCount counts) const {
+  return toTurns(counts) * DEGREES_PER_TURN_UNIT;
+}
+
+double EncoderScale::toSignedDegrees(EncoderCount counts) const {
+  return (int32_t)toTurns(counts) * DEGREES_PER_TURN_UNIT;
+}
@@ -0,0 +1,73 @@
+#ifndef TELESCOPE_MODEL_ENCODER_SCALE_H
+#define TELESCOPE_MODEL_ENCODER_SCALE_H
+
+#include <stdint.h>
+
+/**
+ * Encoder counts as accumulated by ESP32Encoder: 64 bits, so they never
+ * overflow however many times the scope goes round (long is only 32 bits
+ * on the ESP32).
+ */
+typedef int64_t EncoderCount;
+
+// abs(steps), as the unsigned a revolution of counts always fits
+constexpr uint64_t encoderRevolution(long steps) {
+  return steps < 0 ? -(uint64_t)steps : (uint64_t)steps;
+}
+
+// 2^64 / revolution, rounded: 2^64 = quotient * revolution + remainder + 1.
+// 0 for a revolution of 0 or 1: 2^64 doesn't fit, and a turn a count is as
+// good as none.
+constexpr uint64_t encoderTurnsPerCount(uint64_t revolution) {
+  return revolution <= 1
+             ? 0
+             : UINT64_MAX / revolution +
+                   (2 * (UINT64_MAX % revolution + 1) >= revolution ? 1 : 0);
+}
+
+// counts to a Q32 turn, rounded; reversed for a negative resolution
+constexpr uint32_t encoderCountsToTurns(EncoderCount counts,
+                                        uint64_t turnsPerCount,
+                                        bool reversed) {
+  return (uint32_t)(((reversed ? -((uint64_t)counts * turnsPerCount)
+                               : (uint64_t)counts * turnsPerCount) +
+                     0x80000000u) >>
+                    32);
+}
+
+// degrees in a Q32 turn
+#define DEGREES_PER_TURN_UNIT (360.0 / 4294967296.0)
+
+/**
+ * Encoder counts to angles, in fixed point: a Q32 fraction of a turn, so
+ * 2^32 is a whole revolution and whole turns drop off by themselves.
+ *
+ * The reciprocal of the resolution is kept as a Q64 fraction of a turn
+ * per count and recalculated only when the resolution changes. A
+ * conversion is then one wrapping 64 bit multiply: counts times turns per
+ * count, modulo 2^64, is where in the turn the counts end up. That's good
+ * to a thousandth of an arcsecond for the first 2^31 counts (thousands of
+ * turns), and still a small fraction of one at 2^40. The float divide it
+ * replaces got coarser with every turn, and past 2^24 counts couldn't
+ * even hold the count exactly.
+ */
+class EncoderScale {
+public:
+  EncoderScale();
+
+  // negative counts the other way; 0 (not set) puts everything at 0
+  void setStepsPerRevolution(long steps);
+  long getStepsPerRevolution() const { return steps; }
+
+  uint32_t toTurns(EncoderCount counts) const;
+  // 0 to 360, for azimuth
+  double toDegrees(EncoderCount counts) const;
+  // -180 to 180, for altitude
+  double toSignedDegrees(EncoderCount counts) const;
+
+private:
+  long steps;
+  uint64_t turnsPerCount; // Q64, for abs(steps)
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "EpochTransform.h"
+#include "Sidereal.h"
+#include <math.h>
+#include <string.h>
+
+#define J2000_JULIAN_DAY 2451545.0
+#define ARCSEC_TO_RADIANS (M_PI / (180.0 * 3600.0))
+#define DEGREES_TO_RADIANS (M_PI / 180.0)
+#define ABERRATION_CONSTANT 20.49552 // arcsec
+
+EpochTransform::EpochTransform() : built(false), time() {
+  memset(matrix, 0, sizeof(matrix));
+  matrix[0][0] = matrix[1][1] = matrix[2][2] = 1;
+  memset(aberration, 0, sizeof(aberration));
+}
+
+void EpochTransform::build(TimePoint at) {
+  double t = (julianDay(at) - J2000_JULIAN_DAY) / 36525.0;
+  double t2 = t * t;
+  double t3 = t2 * t;
+
+  // precession, IAU 1976 (Lieske)
+  double zeta = (2306.2181 * t + 0.30188 * t2 + 0.017998 * t3) *
+                ARCSEC_TO_RADIANS;
+  double z = (2306.2181 * t + 1.09468 * t2 + 0.018203 * t3) * ARCSEC_TO_RADIANS;
+  double theta =
+      (2004.3109 * t - 0.42665 * t2 - 0.041833 * t3) * ARCSEC_TO_RADIANS;
+  double cz = cos(zeta), sz = sin(zeta);
+  double cZ = cos(z), sZ = sin(z);
+  double ct = cos(theta), st = sin(theta);
+  double p[3][3] = {{cz * ct * cZ - sz * sZ, -sz * ct * cZ - cz * sZ, -st * cZ},
+                    {cz * ct * sZ + sz * cZ, -sz * ct * sZ + cz * cZ, -st * sZ},
+                    {cz * st, -sz * st, ct}};
+
+  // nutation, the four largest terms (Meeus 22)
+  double omega = (125.04452 - 1934.136261 * t) * DEGREES_TO_RADIANS;
+  double sunLongitude = (280.4665 + 36000.7698 * t) * DEGREES_TO_RADIANS;
+  double moonLongitude = (218.3165 + 481267.8813 * t) * DEGREES_TO_RADIANS;
+  double deltaPsi = (-17.20 * sin(omega) - 1.32 * sin(2 * sunLongitude) -
+                     0.23 * sin(2 * moonLongitude) + 0.21 * sin(2 * omega)) *
+                    ARCSEC_TO_RADIANS;
+  double deltaEps = (9.20 * cos(omega) + 0.57 * cos(2 * sunLongitude) +
+                     0.10 * cos(2 * moonLongitude) - 0.09 * cos(2 * omega)) *
+                    ARCSEC_TO_RADIANS;
+  double meanEps = (84381.448 - 46.8150 * t - 0.00059 * t2 + 0.001813 * t3) *
+                   ARCSEC_TO_RADIANS;
+  double trueEps = meanEps + deltaEps;
+  double cp = cos(deltaPsi), sp = sin(deltaPsi);
+  double ce = cos(meanEps), se = sin(meanEps);
+  double cT = cos(trueEps), sT = sin(trueEps);
+  double n[3][3] = {{cp, -sp * ce, -sp * se},
+                    {sp * cT, cp * cT * ce + sT * se, cp * cT * se - sT * ce},
+                    {sp * sT, cp * sT * ce - cT * se, cp * sT * se + cT * ce}};
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      matrix[i][j] = n[i][0] * p[0][j] + n[i][1] * p[1][j] + n[i][2] * p[2][j];
+    }
+  }
+
+  // annual aberration (Meeus 23): the earth heads for ecliptic longitude
+  // sun - 90 degrees, plus the eccentricity term
+  double anomaly = (357.5291092 + 35999.0502909 * t - 0.0001536 * t2) *
+                   DEGREES_TO_RADIANS;
+  double centre = (1.914602 - 0.004817 * t - 0.000014 * t2) * sin(anomaly) +
+                  (0.019993 - 0.000101 * t) * sin(2 * anomaly) +
+                  0.000289 * sin(3 * anomaly);
+  double sunTrue =
+      (280.46646 + 36000.76983 * t + 0.0003032 * t2 + centre) *
+      DEGREES_TO_RADIANS;
+  double eccentricity = 0.016708634 - 0.000042037 * t - 0.0000001267 * t2;
+  double perihelion = (102.93735 + 1.71946 * t + 0.00046 * t2) *
+                      DEGREES_TO_RADIANS;
+  double kappa = ABERRATION_CONSTANT * ARCSEC_TO_RADIANS;
+  double x = kappa * (sin(sunTrue) - eccentricity * sin(perihelion));
+  double y = kappa * (-cos(sunTrue) + eccentricity * cos(perihelion));
+  aberration[0] = x;
+  aberration[1] = y * cT;
+  aberration[2] = y * sT;
+
+  time = at;
+  built = true;
+}
+
+bool EpochTransform::needsRebuild(TimePoint now) const {
+  return !built ||
+         fabs(differenceInSeconds(time, now)) >= EPOCH_REFRESH_SECONDS;
+}
+
+static void toVector(const EquatorialPosition &position, double v[3]) {
+  double ra = position.raHours * 15 * DEGREES_TO_RADIANS;
+  double dec = position.decDegrees * DEGREES_TO_RADIANS;
+  double cd = cos(dec);
+  v[0] = cd * cos(ra);
+  v[1] = cd * sin(ra);
+  v[2] = sin(dec);
+}
+
+static EquatorialPosition fromVector(const double v[3]) {
+  double r = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  EquatorialPosition position;
+  double ra = atan2(v[1], v[0]) / DEGREES_TO_RADIANS / 15;
+  position.raHours = ra < 0 ? ra + 24 : ra;
+  double s = v[2] / r;
+  position.decDegrees = asin(s > 1 ? 1 : (s < -1 ? -1 : s)) / DEGREES_TO_RADIANS;
+  return position;
+}
+
+EquatorialPosition
+EpochTransform::j2000ToJNow(const EquatorialPosition &j2000) const {
+  double u[3];
+  toVector(j2000, u);
+  double v[3];
+  for (int i = 0; i < 3; i++) {
+    v[i] = matrix[i][0] * u[0] + matrix[i][1] * u[1] + matrix[i][2] * u[2] +
+           aberration[i];
+  }
+  return fromVector(v);
+}
+
+// the inverse of a rotation is its transpose
+EquatorialPosition
+EpochTransform::jNowToJ2000(const EquatorialPosition &jNow) const {
+  double v[3];
+  toVector(jNow, v);
+  for (int i = 0; i < 3; i++) {
+    v[i] -= aberration[i];
+  }
+  double u[3];
+  for (int i = 0; i < 3; i++) {
+    u[i] = matrix[0][i] * v[0] + matrix[1][i] * v[1] + matrix[2][i] * v[2];
+  }
+  return fromVector(u);
+}
+
+void EpochTransform::j2000ToJNow(const EquatorialPosition *in,
+                                 EquatorialPosition *out, size_t count) const {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = j2000ToJNow(in[i]);
+  }
+}
+
+void EpochTransform::jNowToJ2000(const EquatorialPosition *in,
+                                 EquatorialPosition *out, size_t count) const {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = jNowToJ2000(in[i]);
+  }
+}
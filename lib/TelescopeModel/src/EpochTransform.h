@@ -0,0 +1,57 @@
+#ifndef TELESCOPE_MODEL_EPOCH_TRANSFORM_H
+#define TELESCOPE_MODEL_EPOCH_TRANSFORM_H
+
+#include "TimePoint.h"
+#include <stddef.h>
+
+// Precession and nutation change by well under 0.01" a minute
+#define EPOCH_REFRESH_SECONDS 60
+
+// ASCOM EquatorialCoordinateType
+#define EQUATORIAL_SYSTEM_TOPOCENTRIC 1 // JNow
+#define EQUATORIAL_SYSTEM_J2000 2
+
+struct EquatorialPosition {
+  double raHours;
+  double decDegrees;
+};
+
+/**
+ * J2000 <-> JNow (apparent place of date) for catalogue and client
+ * coordinates.
+ *
+ * build() works out the combined precession (IAU 1976) and nutation
+ * (Meeus 22, to about 0.5") rotation for a time, and the earth's velocity
+ * for annual aberration. After that converting a point is a matrix-vector
+ * product plus the aberration offset, instead of the series Ephemeris
+ * evaluates for every coordinate. Rebuild every EPOCH_REFRESH_SECONDS or so;
+ * ModelRunner keeps a current one published for all tasks.
+ *
+ * Plain data, so it can be copied through a SeqLock.
+ */
+class EpochTransform {
+public:
+  EpochTransform();
+
+  void build(TimePoint time);
+  bool isBuilt() const { return built; }
+  TimePoint getTime() const { return time; }
+  bool needsRebuild(TimePoint now) const;
+
+  EquatorialPosition j2000ToJNow(const EquatorialPosition &j2000) const;
+  EquatorialPosition jNowToJ2000(const EquatorialPosition &jNow) const;
+
+  // Whole lists at once, e.g. a catalogue page. in and out may be the same.
+  void j2000ToJNow(const EquatorialPosition *in, EquatorialPosition *out,
+                   size_t count) const;
+  void jNowToJ2000(const EquatorialPosition *in, EquatorialPosition *out,
+                   size_t count) const;
+
+private:
+  bool built;
+  TimePoint time;
+  double matrix[3][3];    // J2000 mean to true equator and equinox of date
+  double aberration[3];   // earth's velocity / c, in the frame of date
+};
+
+#endif
@@ -56,7 +56,7 @@ void EqCoord::setRAInDegrees(int degrees, int minutes, float seconds) {
       degrees, minutes, seconds));
 }
 
-EqCoord EqCoord::addRAInDegrees(float raToAdd) {
+EqCoord EqCoord::addRAInDegrees(float raToAdd) const {
   float raHours = eq.ra + raToAdd / 15.0; //convert degrees to hours
   EqCoord out=EqCoord();
   out.setRAInHours(raHours);
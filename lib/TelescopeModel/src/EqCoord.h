@@ -25,7 +25,7 @@ public:
   void setRAInDegrees(float ra);
   void setRAInHours(float ra);
   void setRAInHours(int hours, int minutes, float seconds);
-  EqCoord addRAInDegrees(float raToAdd);
+  EqCoord addRAInDegrees(float raToAdd) const;
 
 private:
   static constexpr double DEGREES_TO_RADIANS = M_PI / 180.0;
@@ -0,0 +1,45 @@
+#ifndef TELESCOPE_MODEL_FIXED_VECTOR_H
+#define TELESCOPE_MODEL_FIXED_VECTOR_H
+
+#include <stddef.h>
+
+/**
+ * Minimal vector-like container with inline storage. Used in place of
+ * std::vector on the model hot path so that nothing touches the heap:
+ * on the ESP32 a long session of syncs would otherwise slowly fragment it.
+ *
+ * Pushing past capacity is ignored (and reported via the return value),
+ * rather than throwing, as exceptions are off on the device.
+ */
+template <typename T, size_t Capacity> class FixedVector {
+public:
+  FixedVector() : count(0) {}
+
+  size_t size() const { return count; }
+  static size_t capacity() { return Capacity; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == Capacity; }
+  void clear() { count = 0; }
+
+  bool push_back(const T &value) {
+    if (count == Capacity) {
+      return false;
+    }
+    items[count++] = value;
+    return true;
+  }
+
+  T &operator[](size_t i) { return items[i]; }
+  const T &operator[](size_t i) const { return items[i]; }
+
+  T *begin() { return items; }
+  T *end() { return items + count; }
+  const T *begin() const { return items; }
+  const T *end() const { return items + count; }
+
+private:
+  T items[Capacity];
+  size_t count;
+};
+
+#endif
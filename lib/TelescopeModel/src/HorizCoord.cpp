@@ -52,7 +52,7 @@ void HorizCoord::setAzi(int degrees, int minutes, float seconds) {
       degrees, minutes, seconds);
   // normalise();
 }
-HorizCoord HorizCoord::addOffset(float altOffset, float aziOffset) {
+HorizCoord HorizCoord::addOffset(float altOffset, float aziOffset) const {
   HorizCoord out(altInDegrees, aziInDegrees);
   out.altInDegrees += altOffset;
   out.aziInDegrees += aziOffset;
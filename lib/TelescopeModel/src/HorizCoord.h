@@ -24,7 +24,7 @@ public:
   HorizontalCoordinates toHorizontalCoordinates();
   void setAlt(int degrees, int minutes, float seconds);
   void setAzi(int degrees, int minutes, float seconds);
-  HorizCoord addOffset(float altOffset, float aziOffset);
+  HorizCoord addOffset(float altOffset, float aziOffset) const;
 };
 
 
@@ -42,32 +42,49 @@ public:
   float aziAngle;
   float altAngle;
 
-  TakiHorizCoord(HorizCoord altAz, bool northernHemisphere) {
-    altAngle = altAz.altInDegrees;
-    aziAngle = altAz.aziInDegrees;
+  TakiHorizCoord(HorizCoord altAz, bool northernHemisphere)
+      : TakiHorizCoord(northernHemisphere ? from<true>(altAz)
+                                          : from<false>(altAz)) {}
 
-    if (northernHemisphere) {
+  /**
+   * The conversion for one hemisphere, with the branch on it gone at
+   * compile time. Code converting a lot holds on to the one it needs (see
+   * CoordConv::setNorthernHemisphere) rather than asking every time.
+   */
+  template <bool NorthernHemisphere>
+  static TakiHorizCoord from(HorizCoord altAz) {
+    TakiHorizCoord taki;
+    if (NorthernHemisphere) {
       // when in northern hemisphere, alt is positive, and azi is counter
       // clockwise for model
       //  check for "over the top"
-      aziAngle = 360.0 - aziAngle;
+      taki.altAngle = altAz.altInDegrees;
+      taki.aziAngle = 360.0 - altAz.aziInDegrees;
     } else {
       // when in southern hemisphere, alt is negatice, and azi is
       // clockwise for model
-      altAngle = -altAngle;
+      taki.altAngle = -altAz.altInDegrees;
+      taki.aziAngle = altAz.aziInDegrees;
     }
 
-    if (altAngle > 90) {
-      altAngle = 180 - altAngle; // Flip altAngle
-      aziAngle += 180;
+    if (taki.altAngle > 90) {
+      taki.altAngle = 180 - taki.altAngle; // Flip altAngle
+      taki.aziAngle += 180;
     }
-    if (altAngle < -90) {
-      altAngle = -180 - altAngle; // Flip altAngle
-      aziAngle += 180;
+    if (taki.altAngle < -90) {
+      taki.altAngle = -180 - taki.altAngle; // Flip altAngle
+      taki.aziAngle += 180;
     }
     // normalise to 0-360
-    aziAngle = fmod(fmod(aziAngle, 360) + 360, 360);
+    taki.aziAngle = fmod(fmod(taki.aziAngle, 360) + 360, 360);
+    return taki;
   }
+
+private:
+  TakiHorizCoord() {}
 };
 
+// TakiHorizCoord::from for one hemisphere or the other
+typedef TakiHorizCoord (*TakiConversion)(HorizCoord altAz);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef TELESCOPE_MODEL_PREFERENCES_H
+#define TELESCOPE_MODEL_PREFERENCES_H
+
+// Where the device keeps its settings (ESP32 Preferences, so NVS). Shared
+// with tools/replay, which writes its best fit in the same keys.
+#define PREFERENCES_NAMESPACE "DSC"
+
+#define PREF_ALT_STEPS_KEY "AltStepsKey"
+#define PREF_AZ_STEPS_KEY "AzStepsKey"
+#define PREF_EQUATORIAL_SYSTEM_KEY "EqSystemKey"
+#define PREF_REFRACTION_KEY "RefractionKey"
+// tenths, so they fit persistLong
+#define PREF_TEMPERATURE_KEY "TempKey"
+#define PREF_PRESSURE_KEY "PressureKey"
+// milliseconds, -1 to learn it, see setClientLatencyMillis
+#define PREF_CLIENT_LATENCY_KEY "LatencyKey"
+
+#endif
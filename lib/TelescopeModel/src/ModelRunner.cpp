@@ -0,0 +1,230 @@
+#include "ModelRunner.h"
+#include "Logging.h"
+#include "Sidereal.h"
+
+ModelRunner::ModelRunner(TelescopeModel &m)
+    : model(m), trackPending(false), updateCount(0), leadSeconds(0) {
+  publishAlignment();
+  track.active = false;
+  track.id = 0;
+  pushTo.write(track);
+  epoch.write(currentEpoch);
+}
+
+bool ModelRunner::post(ModelCommandType type, double value1, double value2,
+                       EncoderCount altEncoder, EncoderCount azEncoder,
+                       TimePoint time, const PlatformState &platform) {
+  ModelCommand command;
+  command.type = type;
+  command.value1 = value1;
+  command.value2 = value2;
+  command.altEncoder = altEncoder;
+  command.azEncoder = azEncoder;
+  command.time = time;
+  command.platform = platform;
+  if (!commands.push(command)) {
+    log("Model command queue full, dropping command %d", type);
+    return false;
+  }
+  return true;
+}
+
+bool ModelRunner::requestSync(double raHours, double decDegrees,
+                              EncoderCount altEncoder, EncoderCount azEncoder,
+                              TimePoint time, const PlatformState &platform) {
+  return post(MODEL_SYNC, raHours, decDegrees, altEncoder, azEncoder, time,
+              platform);
+}
+bool ModelRunner::requestClearAlignment() {
+  return post(MODEL_CLEAR_ALIGNMENT);
+}
+bool ModelRunner::requestZeroedAlignment(TimePoint time) {
+  return post(MODEL_ZEROED_ALIGNMENT, 0, 0, 0, 0, time);
+}
+bool ModelRunner::requestLatitude(double latitude) {
+  return post(MODEL_SET_LATITUDE, latitude);
+}
+bool ModelRunner::requestLongitude(double longitude) {
+  return post(MODEL_SET_LONGITUDE, longitude);
+}
+bool ModelRunner::requestAltEncoderStepsPerRevolution(long steps) {
+  return post(MODEL_SET_ALT_STEPS, steps);
+}
+bool ModelRunner::requestAzEncoderStepsPerRevolution(long steps) {
+  return post(MODEL_SET_AZ_STEPS, steps);
+}
+bool ModelRunner::requestPushTo(double raHours, double decDegrees) {
+  return post(MODEL_PUSH_TO, raHours, decDegrees);
+}
+bool ModelRunner::requestCancelPushTo() { return post(MODEL_CANCEL_PUSH_TO); }
+bool ModelRunner::requestDoesRefraction(bool enabled) {
+  return post(MODEL_SET_DOES_REFRACTION, enabled ? 1 : 0);
+}
+bool ModelRunner::requestRefractionConditions(double temperatureCelsius,
+                                              double pressureMillibars) {
+  return post(MODEL_SET_REFRACTION_CONDITIONS, temperatureCelsius,
+              pressureMillibars);
+}
+bool ModelRunner::requestClientLatency(double seconds) {
+  return post(MODEL_SET_CLIENT_LATENCY, seconds);
+}
+
+void ModelRunner::apply(ModelCommand &command) {
+  switch (command.type) {
+  case MODEL_SYNC:
+    // sync against the encoder values from when the client asked, not now
+    model.setEncoderValues(command.altEncoder, command.azEncoder);
+    model.setPlatformState(command.platform);
+    model.syncPositionRaDec(command.value1, command.value2, command.time);
+    break;
+  case MODEL_CLEAR_ALIGNMENT:
+    model.clearAlignment();
+    break;
+  case MODEL_ZEROED_ALIGNMENT:
+    model.performZeroedAlignment(command.time);
+    break;
+  case MODEL_SET_LATITUDE:
+    model.setLatitude(command.value1);
+    break;
+  case MODEL_SET_LONGITUDE:
+    model.setLongitude(command.value1);
+    break;
+  case MODEL_SET_ALT_STEPS:
+    model.setAltEncoderStepsPerRevolution(command.value1);
+    break;
+  case MODEL_SET_AZ_STEPS:
+    model.setAzEncoderStepsPerRevolution(command.value1);
+    break;
+  case MODEL_PUSH_TO:
+    track.raHours = command.value1;
+    track.decDegrees = command.value2;
+    track.id++;
+    trackPending = true;
+    break;
+  case MODEL_CANCEL_PUSH_TO:
+    trackPending = false;
+    track.active = false;
+    pushTo.write(track);
+    break;
+  case MODEL_SET_DOES_REFRACTION:
+    model.setDoesRefraction(command.value1 != 0);
+    break;
+  case MODEL_SET_REFRACTION_CONDITIONS:
+    model.setRefractionConditions(command.value1, command.value2);
+    break;
+  case MODEL_SET_CLIENT_LATENCY:
+    leadSeconds = command.value1;
+    break;
+  }
+}
+
+void ModelRunner::publishAlignment() {
+  AlignmentSnapshot snapshot;
+  snapshot.baseAlignmentSynchPoints = model.baseAlignmentSynchPoints;
+  snapshot.lastSyncPoint = model.lastSyncPoint;
+  snapshot.calculatedAltEncoderRes = model.calculatedAltEncoderRes;
+  snapshot.calculatedAziEncoderRes = model.calculatedAziEncoderRes;
+  snapshot.altEncoderStepsPerRevolution =
+      model.getAltEncoderStepsPerRevolution();
+  snapshot.azEncoderStepsPerRevolution = model.getAzEncoderStepsPerRevolution();
+  snapshot.latitude = model.getLatitude();
+  snapshot.longitude = model.getLongitude();
+  snapshot.doesRefraction = model.getDoesRefraction();
+  snapshot.temperatureCelsius = model.getRefraction().getTemperature();
+  snapshot.pressureMillibars = model.getRefraction().getPressure();
+  alignment.write(snapshot);
+}
+
+/**
+ * (Re)calculates the push-to track when there's a new target, the model
+ * has changed, or the old track has run short or no longer matches the
+ * platform. Most ticks this is just the refresh check.
+ */
+void ModelRunner::updatePushTo(bool changed, const PlatformState &platform,
+                               TimePoint now) {
+  if (!trackPending && !track.active) {
+    return;
+  }
+  if (!trackPending && !changed &&
+      !pushToTrackNeedsRefresh(track, platform, now)) {
+    return;
+  }
+  trackPending = false;
+  track.active = model.calculatePushToTrack(track.raHours, track.decDegrees,
+                                            now, platform, track);
+  if (!track.active) {
+    log("Can't push to without encoder resolution");
+  }
+  pushTo.write(track);
+}
+
+/**
+ * One model task iteration: apply any queued changes, then calculate and
+ * publish the current position for the encoders and platform state (see
+ * EQPlatform::calculatePlatformState) at now.
+ */
+void ModelRunner::tick(EncoderCount altEncoder, EncoderCount azEncoder,
+                       const PlatformState &platform, TimePoint now) {
+  ModelCommand command;
+  bool changed = false;
+  while (commands.pop(command)) {
+    apply(command);
+    changed = true;
+  }
+  if (changed) {
+    publishAlignment();
+  }
+
+  updatePushTo(changed, platform, now);
+
+  if (currentEpoch.needsRebuild(now)) {
+    currentEpoch.build(now);
+    epoch.write(currentEpoch);
+  }
+
+  history.add(altEncoder, azEncoder, now);
+  PositionSnapshot snapshot;
+  motion.update(altEncoder, azEncoder, now,
+                model.getAltEncoderStepsPerRevolution(),
+                model.getAzEncoderStepsPerRevolution());
+  snapshot.moving = motion.isMoving();
+  snapshot.altDegreesPerSecond = motion.getAltDegreesPerSecond();
+  snapshot.azDegreesPerSecond = motion.getAzDegreesPerSecond();
+  snapshot.leadSeconds = leadSeconds;
+  bool leading = snapshot.moving && leadSeconds > 0;
+  if (leading) {
+    // before the real position, so that's what the model is left with
+    EncoderCount leadAlt;
+    EncoderCount leadAz;
+    motion.predict(leadSeconds, leadAlt, leadAz);
+    model.setEncoderValues(leadAlt, leadAz);
+    TimePoint leadTime = addSecondsToTime(now, leadSeconds);
+    model.setPlatformState(platform.after(leadSeconds));
+    model.calculateCurrentPosition(leadTime);
+    snapshot.leadRaHours = model.getRACoord();
+    snapshot.leadDecDegrees = model.getDecCoord();
+  }
+
+  model.setEncoderValues(altEncoder, azEncoder);
+  model.setPlatformState(platform);
+  model.calculateCurrentPosition(now);
+
+  snapshot.raHours = model.getRACoord();
+  snapshot.decDegrees = model.getDecCoord();
+  if (!leading) {
+    snapshot.leadRaHours = snapshot.raHours;
+    snapshot.leadDecDegrees = snapshot.decDegrees;
+  }
+  snapshot.siderealTimeHours = localSiderealTime(now, model.getLongitude());
+  HorizCoord sky = equatorialToHorizontalAtSiderealTime(
+      model.currentEqPosition, snapshot.siderealTimeHours,
+      model.getLatitude());
+  snapshot.altDegrees = sky.altInDegrees;
+  snapshot.azDegrees = sky.aziInDegrees;
+  snapshot.altEncoder = altEncoder;
+  snapshot.azEncoder = azEncoder;
+  snapshot.platform = platform;
+  snapshot.time = now;
+  snapshot.updateCount = ++updateCount;
+  position.write(snapshot);
+}
@@ -0,0 +1,164 @@
+#ifndef TELESCOPE_MODEL_RUNNER_H
+#define TELESCOPE_MODEL_RUNNER_H
+
+#include "EncoderHistory.h"
+#include "EncoderMotion.h"
+#include "EpochTransform.h"
+#include "PushTo.h"
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include "TelescopeModel.h"
+#include "TimePoint.h"
+#include <stdint.h>
+
+// How many model changes can be waiting for the model task.
+#define MODEL_COMMAND_QUEUE_SIZE 8
+
+/**
+ * Where the scope is pointing, as last calculated by the model task.
+ * Published as a whole so readers never see ra from one update and dec
+ * from another.
+ */
+struct PositionSnapshot {
+  double raHours;
+  double decDegrees;
+  // where ra/dec is in the sky right now (not platform adjusted)
+  double altDegrees;
+  double azDegrees;
+  double siderealTimeHours; // local
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  PlatformState platform; // platform state used for the calculation
+  TimePoint time;      // wall clock time of the calculation
+  uint32_t updateCount;
+  // from the encoder samples, see EncoderMotion
+  bool moving;
+  double altDegreesPerSecond;
+  double azDegreesPerSecond;
+  // where the scope will be pointing leadSeconds after time, for clients
+  // that show it that much later (see requestClientLatency). The same as
+  // raHours/decDegrees unless it's moving.
+  double leadRaHours;
+  double leadDecDegrees;
+  double leadSeconds;
+};
+
+/**
+ * Copy of the alignment state shown in the WebUI, republished after every
+ * change to the model.
+ */
+struct AlignmentSnapshot {
+  SynchPointList baseAlignmentSynchPoints;
+  SynchPoint lastSyncPoint;
+  long calculatedAltEncoderRes;
+  long calculatedAziEncoderRes;
+  long altEncoderStepsPerRevolution;
+  long azEncoderStepsPerRevolution;
+  float latitude;
+  float longitude;
+  bool doesRefraction;
+  float temperatureCelsius; // for refraction
+  float pressureMillibars;
+};
+
+enum ModelCommandType {
+  MODEL_SYNC,
+  MODEL_CLEAR_ALIGNMENT,
+  MODEL_ZEROED_ALIGNMENT,
+  MODEL_SET_LATITUDE,
+  MODEL_SET_LONGITUDE,
+  MODEL_SET_ALT_STEPS,
+  MODEL_SET_AZ_STEPS,
+  MODEL_PUSH_TO,
+  MODEL_CANCEL_PUSH_TO,
+  MODEL_SET_DOES_REFRACTION,
+  MODEL_SET_REFRACTION_CONDITIONS,
+  MODEL_SET_CLIENT_LATENCY
+};
+
+struct ModelCommand {
+  ModelCommandType type;
+  double value1;
+  double value2;
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  TimePoint time;
+  PlatformState platform;
+};
+
+/**
+ * Owns all access to a TelescopeModel once the tasks are running.
+ *
+ * The model task calls tick() at a fixed rate with fresh encoder values.
+ * Everybody else (HTTP handlers, WebUI) posts changes through the request*
+ * methods, which go onto a lock-free queue and are applied at the start of
+ * the next tick, and reads results through the published snapshots. That
+ * way only one task ever touches the model itself.
+ *
+ * The request* methods must all be called from the same task (on the
+ * device, the async_tcp task that runs the web handlers).
+ */
+class ModelRunner {
+public:
+  explicit ModelRunner(TelescopeModel &m);
+
+  // producer side
+  bool requestSync(double raHours, double decDegrees,
+                   EncoderCount altEncoder, EncoderCount azEncoder,
+                   TimePoint time,
+                   const PlatformState &platform);
+  bool requestClearAlignment();
+  bool requestZeroedAlignment(TimePoint time);
+  bool requestLatitude(double latitude);
+  bool requestLongitude(double longitude);
+  bool requestAltEncoderStepsPerRevolution(long steps);
+  bool requestAzEncoderStepsPerRevolution(long steps);
+  bool requestPushTo(double raHours, double decDegrees);
+  bool requestCancelPushTo();
+  bool requestDoesRefraction(bool enabled);
+  bool requestRefractionConditions(double temperatureCelsius,
+                                   double pressureMillibars);
+  // how far ahead of the encoders to publish the lead position, see
+  // ClientLatency
+  bool requestClientLatency(double seconds);
+
+  // model task side
+  void tick(EncoderCount altEncoder, EncoderCount azEncoder,
+            const PlatformState &platform, TimePoint now);
+
+  // any task
+  PositionSnapshot getPosition() const { return position.read(); }
+  AlignmentSnapshot getAlignment() const { return alignment.read(); }
+  uint32_t getAlignmentVersion() const { return alignment.version(); }
+  PushToTrack getPushTo() const { return pushTo.read(); }
+  // J2000 <-> JNow for the current minute, not built until the first tick
+  EpochTransform getEpoch() const { return epoch.read(); }
+  // encoders over the last minute or so, see SyncGate
+  const EncoderHistory &getEncoderHistory() const { return history; }
+
+private:
+  bool post(ModelCommandType type, double value1 = 0, double value2 = 0,
+            EncoderCount altEncoder = 0, EncoderCount azEncoder = 0,
+            TimePoint time = TimePoint(),
+            const PlatformState &platform = PlatformState());
+  void apply(ModelCommand &command);
+  void publishAlignment();
+  void updatePushTo(bool changed, const PlatformState &platform,
+                    TimePoint now);
+
+  TelescopeModel &model;
+  SpscQueue<ModelCommand, MODEL_COMMAND_QUEUE_SIZE> commands;
+  SeqLock<PositionSnapshot> position;
+  SeqLock<AlignmentSnapshot> alignment;
+  SeqLock<PushToTrack> pushTo;
+  SeqLock<EpochTransform> epoch;
+  EpochTransform currentEpoch; // model task's copy of epoch
+  PushToTrack track; // model task's copy of pushTo
+  bool trackPending; // new target, track not calculated yet
+  uint32_t updateCount;
+  EncoderMotion motion;
+  double leadSeconds;
+  EncoderHistory history;
+};
+
+#endif
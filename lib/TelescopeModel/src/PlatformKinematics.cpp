@@ -0,0 +1,72 @@
+#include "PlatformKinematics.h"
+#include "CoordConv.hpp"
+#include <string.h>
+
+PlatformKinematics::PlatformKinematics()
+    : cachedDecAxisDegrees(0), cacheValid(false), rebuildCount(0) {
+  double identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  setAlignment(identity, 90);
+}
+
+void PlatformKinematics::setAlignment(const double (&tinv)[3][3],
+                                      double eastPointRADegrees) {
+  LA3::copy(alignmentTinv, tinv);
+  LA3::toDirCos(eastPoint, 0, LA3::toRad(eastPointRADegrees));
+  cacheValid = false;
+}
+
+/**
+ * Rotation about the east point (Rodrigues' formula). LA3::toDirCos
+ * measures ra clockwise, so these direction cosines are a mirror image of
+ * the sky: a positive angle here is the tilt that takes the base north.
+ */
+void PlatformKinematics::decAxisRotation(double (&out)[3][3],
+                                         double decAxisDegrees) const {
+  double angle = LA3::toRad(decAxisDegrees);
+  double c = cos(angle);
+  double s = sin(angle);
+  double t = 1 - c;
+  const double(&u)[3] = eastPoint;
+
+  out[0][0] = c + t * u[0] * u[0];
+  out[0][1] = t * u[0] * u[1] - s * u[2];
+  out[0][2] = t * u[0] * u[2] + s * u[1];
+  out[1][0] = t * u[1] * u[0] + s * u[2];
+  out[1][1] = c + t * u[1] * u[1];
+  out[1][2] = t * u[1] * u[2] - s * u[0];
+  out[2][0] = t * u[2] * u[0] - s * u[1];
+  out[2][1] = t * u[2] * u[1] + s * u[0];
+  out[2][2] = c + t * u[2] * u[2];
+}
+
+const double (&PlatformKinematics::referenceTransform(
+    double decAxisDegrees))[3][3] {
+  if (!cacheValid || decAxisDegrees != cachedDecAxisDegrees) {
+    double rotation[3][3];
+    decAxisRotation(rotation, decAxisDegrees);
+    LA3::multiply(cachedTransform, rotation, alignmentTinv);
+    cachedDecAxisDegrees = decAxisDegrees;
+    cacheValid = true;
+    rebuildCount++;
+  }
+  return cachedTransform;
+}
+
+EqCoord PlatformKinematics::removeDecAxisTilt(const EqCoord &eq,
+                                              double decAxisDegrees) const {
+  if (decAxisDegrees == 0) {
+    return eq;
+  }
+  double rotation[3][3];
+  decAxisRotation(rotation, -decAxisDegrees);
+  double in[3], out[3];
+  LA3::toDirCos(in, LA3::toRad(eq.getDecInDegrees()),
+                LA3::toRad(eq.getRAInDegrees()));
+  LA3::multiply(out, rotation, in);
+  double dec, ra;
+  LA3::toAngles(dec, ra, out);
+  EqCoord result;
+  result.setDecInDegrees(LA3::toDeg(dec));
+  result.setRAInDegrees(LA3::toDeg(ra));
+  return result;
+}
@@ -0,0 +1,99 @@
+#ifndef TELESCOPE_MODEL_PLATFORM_KINEMATICS_H
+#define TELESCOPE_MODEL_PLATFORM_KINEMATICS_H
+
+#include "EqCoord.h"
+#include <stdint.h>
+
+// how far the sky turns per second of (solar) time
+#define SIDEREAL_DEGREES_PER_SECOND (360.98564736629 / 86400.0)
+
+/**
+ * Where the EQ platform has put the dob's base, relative to the platform
+ * being centred.
+ *
+ * raAxisDegrees is the rotation about the platform's polar axis. Positive
+ * is before center: the base is turned east, and the platform will bring it
+ * back west as it tracks.
+ * decAxisDegrees is the tilt about the platform's east-west axis (for
+ * platforms that have one), positive tilting the base to point further
+ * north. The dec axis rides on the ra axis.
+ * raAxisDegreesPerSecond is how the ra axis is moving: minus the sidereal
+ * rate while tracking, 0 when stopped.
+ */
+struct PlatformState {
+  double raAxisDegrees;
+  double decAxisDegrees;
+  double raAxisDegreesPerSecond;
+
+  PlatformState()
+      : raAxisDegrees(0), decAxisDegrees(0), raAxisDegreesPerSecond(0) {}
+  PlatformState(double ra, double dec, double raRate = 0)
+      : raAxisDegrees(ra), decAxisDegrees(dec), raAxisDegreesPerSecond(raRate) {
+  }
+
+  // expected state seconds from now, if the platform carries on as it is
+  PlatformState after(double seconds) const {
+    return PlatformState(raAxisDegrees + raAxisDegreesPerSecond * seconds,
+                         decAxisDegrees, raAxisDegreesPerSecond);
+  }
+};
+
+/**
+ * Turns a platform state into the rotation of the dob's base, for use
+ * with the alignment matrix.
+ *
+ * The alignment works in one frame: the sky at the time of the base sync
+ * point, with the platform centred. A rotation about the polar axis is a
+ * pure ra shift in that frame, so it's applied as one (along with the
+ * time since the base sync). The dec axis tilt is a real 3x3 rotation,
+ * about the east point of that frame; it's composed with the alignment's
+ * inverse matrix so a position query costs the same matrix-vector product
+ * it always did.
+ *
+ * The composed matrix is cached for the last dec angle, so it's only
+ * rebuilt when the dec axis moves or the alignment changes, not on every
+ * model tick.
+ */
+class PlatformKinematics {
+public:
+  PlatformKinematics();
+
+  /**
+   * Set after any alignment change. tinv is the alignment's inverse
+   * matrix, eastPointRADegrees the ra of the east point in its frame.
+   */
+  void setAlignment(const double (&tinv)[3][3], double eastPointRADegrees);
+
+  /**
+   * Base rotation for a dec axis angle, on equatorial direction cosines
+   * (LA3::toDirCos(dc, dec, ra)).
+   */
+  void decAxisRotation(double (&out)[3][3], double decAxisDegrees) const;
+
+  /**
+   * Dec axis rotation times the alignment's inverse matrix: takes
+   * instrument direction cosines straight to the alignment frame, platform
+   * tilt included. Cached.
+   */
+  const double (&referenceTransform(double decAxisDegrees))[3][3];
+
+  /**
+   * Undo the dec axis tilt on a position, the opposite direction to
+   * referenceTransform. Used to bring sync points back to the alignment
+   * frame.
+   */
+  EqCoord removeDecAxisTilt(const EqCoord &eq, double decAxisDegrees) const;
+
+  // times referenceTransform has had to rebuild, for tests
+  uint32_t getRebuildCount() const { return rebuildCount; }
+
+private:
+  double alignmentTinv[3][3];
+  double eastPoint[3];
+  double cachedTransform[3][3];
+  double cachedDecAxisDegrees;
+  bool cacheValid;
+  uint32_t rebuildCount;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "PushTo.h"
+#include <math.h>
+
+long wrapEncoderSteps(EncoderCount steps, long stepsPerRevolution) {
+  long revolution = labs(stepsPerRevolution);
+  if (revolution == 0) {
+    return (long)steps;
+  }
+  steps %= revolution;
+  if (steps > revolution / 2) {
+    steps -= revolution;
+  } else if (steps < -revolution / 2) {
+    steps += revolution;
+  }
+  return (long)steps;
+}
+
+static long millisSinceStart(const PushToTrack &track, TimePoint now) {
+  return (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+             now - track.start)
+      .count();
+}
+
+bool calculatePushToDelta(const PushToTrack &track, EncoderCount altEncoder,
+                          EncoderCount azEncoder, TimePoint now,
+                          PushToDelta &delta) {
+  if (!track.active) {
+    return false;
+  }
+  long elapsed = millisSinceStart(track, now);
+  if (elapsed < 0) {
+    elapsed = 0;
+  }
+  long i = elapsed / PUSH_TO_TRACK_STEP_MILLIS;
+  long altTarget;
+  long azTarget;
+  if (i >= PUSH_TO_TRACK_POINTS - 1) {
+    altTarget = track.altEncoder[PUSH_TO_TRACK_POINTS - 1];
+    azTarget = track.azEncoder[PUSH_TO_TRACK_POINTS - 1];
+    delta.onTrack = false;
+  } else {
+    // 64 bit: a big encoder step times 10000 millis overflows a long
+    int64_t fraction = elapsed - i * PUSH_TO_TRACK_STEP_MILLIS;
+    int64_t altMove = track.altEncoder[i + 1] - track.altEncoder[i];
+    int64_t azMove = wrapEncoderSteps(
+        track.azEncoder[i + 1] - track.azEncoder[i], track.azStepsPerRevolution);
+    altTarget = track.altEncoder[i] +
+                (long)(altMove * fraction / PUSH_TO_TRACK_STEP_MILLIS);
+    azTarget = track.azEncoder[i] +
+               (long)(azMove * fraction / PUSH_TO_TRACK_STEP_MILLIS);
+    delta.onTrack = true;
+  }
+  delta.altSteps = (long)(altTarget - altEncoder);
+  delta.azSteps =
+      wrapEncoderSteps(azTarget - azEncoder, track.azStepsPerRevolution);
+  return true;
+}
+
+bool pushToTrackNeedsRefresh(const PushToTrack &track,
+                             const PlatformState &platform, TimePoint now) {
+  long left = (PUSH_TO_TRACK_POINTS - 1) * PUSH_TO_TRACK_STEP_MILLIS -
+              millisSinceStart(track, now);
+  if (left < PUSH_TO_TRACK_REFRESH_MILLIS) {
+    return true;
+  }
+  PlatformState expected =
+      track.platform.after(differenceInSeconds(track.start, now));
+  return fabs(platform.raAxisDegrees - expected.raAxisDegrees) >
+             PUSH_TO_PLATFORM_TOLERANCE_DEGREES ||
+         fabs(platform.decAxisDegrees - expected.decAxisDegrees) >
+             PUSH_TO_PLATFORM_TOLERANCE_DEGREES;
+}
+
+double pushToStepsToDegrees(long steps, long stepsPerRevolution) {
+  if (stepsPerRevolution == 0) {
+    return 0;
+  }
+  return steps * 360.0 / stepsPerRevolution;
+}
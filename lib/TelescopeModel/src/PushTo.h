@@ -0,0 +1,69 @@
+#ifndef TELESCOPE_MODEL_PUSH_TO_H
+#define TELESCOPE_MODEL_PUSH_TO_H
+
+#include "EncoderScale.h"
+#include "PlatformKinematics.h"
+#include "TimePoint.h"
+#include <stdint.h>
+
+// Track covers 5 minutes, a point every 10 seconds. Alt/az change slowly
+// enough that straight line interpolation between points is well under an
+// encoder step.
+#define PUSH_TO_TRACK_POINTS 31
+#define PUSH_TO_TRACK_STEP_MILLIS 10000
+// recalculated once there's less than this much track left
+#define PUSH_TO_TRACK_REFRESH_MILLIS 120000
+// or the platform has drifted this far from where the track assumed
+#define PUSH_TO_PLATFORM_TOLERANCE_DEGREES 0.01
+
+/**
+ * Encoder counts that put the scope on a target, precalculated by the model
+ * for the next few minutes.
+ *
+ * The model task builds it (TelescopeModel::calculatePushToTrack) when a
+ * target is set and again when it runs short or the platform doesn't do
+ * what the track expected. Between those, guidance only needs the encoder
+ * counts: calculatePushToDelta is integer interpolation and subtraction,
+ * cheap enough to run for every frame sent to the WebUI.
+ */
+struct PushToTrack {
+  bool active;
+  uint32_t id; // new for each target
+  double raHours;
+  double decDegrees;
+  TimePoint start;
+  PlatformState platform; // as at start
+  long altStepsPerRevolution;
+  long azStepsPerRevolution;
+  long altEncoder[PUSH_TO_TRACK_POINTS];
+  long azEncoder[PUSH_TO_TRACK_POINTS];
+};
+
+/**
+ * How far to move, in encoder steps: target minus current. Azimuth takes
+ * the short way round.
+ */
+struct PushToDelta {
+  long altSteps;
+  long azSteps;
+  bool onTrack; // false once past the end of the track
+};
+
+bool calculatePushToDelta(const PushToTrack &track, EncoderCount altEncoder,
+                          EncoderCount azEncoder, TimePoint now,
+                          PushToDelta &delta);
+
+/**
+ * True if the track should be recalculated: it's running out, or the
+ * platform isn't where the track assumed it would be (stopped, started,
+ * slewed or the dec axis moved).
+ */
+bool pushToTrackNeedsRefresh(const PushToTrack &track,
+                             const PlatformState &platform, TimePoint now);
+
+double pushToStepsToDegrees(long steps, long stepsPerRevolution);
+
+// steps wrapped to the short way round, within +-half a revolution
+long wrapEncoderSteps(EncoderCount steps, long stepsPerRevolution);
+
+#endif
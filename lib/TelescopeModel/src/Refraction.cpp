@@ -0,0 +1,77 @@
+#include "Refraction.h"
+#include <math.h>
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+double bennettRefraction(double apparentAltitude, float temperatureCelsius,
+                         float pressureMillibars) {
+  double arcminutes =
+      1 / tan((apparentAltitude + 7.31 / (apparentAltitude + 4.4)) *
+              DEG_TO_RAD);
+  // Meeus' small correction so it's zero at the zenith
+  arcminutes -= 0.06 * sin((14.7 * arcminutes + 13) * DEG_TO_RAD);
+  double scale = (pressureMillibars / REFRACTION_STANDARD_PRESSURE) *
+                 (283.0 / (273.0 + temperatureCelsius));
+  double result = arcminutes * scale / 60.0;
+  return result > 0 ? result : 0;
+}
+
+RefractionTable::RefractionTable() {
+  setConditions(REFRACTION_STANDARD_TEMPERATURE, REFRACTION_STANDARD_PRESSURE);
+}
+
+void RefractionTable::setConditions(float temperatureCelsius,
+                                    float pressureMillibars) {
+  temperature = temperatureCelsius;
+  pressure = pressureMillibars;
+  for (int i = 0; i < REFRACTION_TABLE_SIZE; i++) {
+    degrees[i] = bennettRefraction(REFRACTION_TABLE_MIN_ALTITUDE +
+                                       i * REFRACTION_TABLE_STEP_DEGREES,
+                                   temperature, pressure);
+  }
+}
+
+double RefractionTable::refractionAt(double apparentAltitude) const {
+  double slope;
+  return lookup(apparentAltitude, slope);
+}
+
+// interpolated refraction and the slope of the table segment it's on
+double RefractionTable::lookup(double apparentAltitude, double &slope) const {
+  double position = (apparentAltitude - REFRACTION_TABLE_MIN_ALTITUDE) /
+                    REFRACTION_TABLE_STEP_DEGREES;
+  slope = 0;
+  if (!(position > 0)) {
+    return degrees[0];
+  }
+  if (position >= REFRACTION_TABLE_SIZE - 1) {
+    return degrees[REFRACTION_TABLE_SIZE - 1];
+  }
+  int index = (int)position;
+  double fraction = position - index;
+  double step = degrees[index + 1] - degrees[index];
+  slope = step / REFRACTION_TABLE_STEP_DEGREES;
+  return degrees[index] + step * fraction;
+}
+
+double RefractionTable::apparentToTrue(double apparentAltitude) const {
+  return apparentAltitude - refractionAt(apparentAltitude);
+}
+
+/**
+ * Solves apparent - refraction(apparent) = true. The table is piecewise
+ * linear, so Newton's method lands exactly on the answer once it's on the
+ * right segment.
+ */
+double RefractionTable::trueToApparent(double trueAltitude) const {
+  double apparent = trueAltitude + refractionAt(trueAltitude);
+  for (int i = 0; i < REFRACTION_INVERSE_ITERATIONS; i++) {
+    double slope;
+    double error = apparent - lookup(apparent, slope) - trueAltitude;
+    if (error == 0) {
+      break;
+    }
+    apparent -= error / (1 - slope);
+  }
+  return apparent;
+}
@@ -0,0 +1,57 @@
+#ifndef TELESCOPE_MODEL_REFRACTION_H
+#define TELESCOPE_MODEL_REFRACTION_H
+
+// Table covers apparent altitudes from just below the horizon to the zenith.
+// Below the first entry the refraction is held at its value there.
+#define REFRACTION_TABLE_MIN_ALTITUDE (-2.0)
+#define REFRACTION_TABLE_STEP_DEGREES 0.2
+#define REFRACTION_TABLE_SIZE 461 // -2 to 90 degrees inclusive
+
+// Conditions the standard refraction formulas are given for
+#define REFRACTION_STANDARD_TEMPERATURE 10.0 // celsius
+#define REFRACTION_STANDARD_PRESSURE 1010.0  // millibars (hPa)
+
+// Newton steps for trueToApparent, most need one or two
+#define REFRACTION_INVERSE_ITERATIONS 4
+
+/**
+ * Atmospheric refraction for the pointing model: how much higher something
+ * looks (apparent altitude, what the encoders see) than it is (true,
+ * geometric altitude, what ra/dec convert to).
+ *
+ * Bennett's formula (Meeus 16.4), scaled for temperature and pressure, is
+ * evaluated once per table entry when the conditions change. After that
+ * each conversion is a lookup and a linear interpolation, with no trig, so
+ * it can run on every model tick. trueToApparent inverts the same table so
+ * the two directions agree exactly.
+ */
+class RefractionTable {
+public:
+  RefractionTable();
+
+  void setConditions(float temperatureCelsius, float pressureMillibars);
+  float getTemperature() const { return temperature; }
+  float getPressure() const { return pressure; }
+
+  // refraction in degrees for an apparent altitude in degrees
+  double refractionAt(double apparentAltitude) const;
+
+  double apparentToTrue(double apparentAltitude) const;
+  double trueToApparent(double trueAltitude) const;
+
+private:
+  double lookup(double apparentAltitude, double &slope) const;
+
+  float temperature;
+  float pressure;
+  float degrees[REFRACTION_TABLE_SIZE];
+};
+
+/**
+ * Bennett's formula itself, in degrees, for building the table and for
+ * checking it.
+ */
+double bennettRefraction(double apparentAltitude, float temperatureCelsius,
+                         float pressureMillibars);
+
+#endif
@@ -0,0 +1,65 @@
+#include "Sidereal.h"
+#include <math.h>
+
+#define J2000_JULIAN_DAY 2451545.0
+#define UNIX_EPOCH_JULIAN_DAY 2440587.5
+#define MILLIS_PER_DAY 86400000.0
+#define DEG_TO_RAD (M_PI / 180.0)
+#define RAD_TO_DEG (180.0 / M_PI)
+
+double julianDay(TimePoint tp) {
+  long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         tp.time_since_epoch())
+                         .count();
+  return millis / MILLIS_PER_DAY + UNIX_EPOCH_JULIAN_DAY;
+}
+
+double greenwichMeanSiderealTime(TimePoint tp) {
+  double d = julianDay(tp) - J2000_JULIAN_DAY;
+  double t = d / 36525.0;
+  double degrees = 280.46061837 + 360.98564736629 * d +
+                   t * t * (0.000387933 - t / 38710000.0);
+  degrees = fmod(degrees, 360.0);
+  if (degrees < 0) {
+    degrees += 360.0;
+  }
+  return degrees / 15.0;
+}
+
+double localSiderealTime(TimePoint tp, double longitude) {
+  double hours = greenwichMeanSiderealTime(tp) + longitude / 15.0;
+  return fmod(fmod(hours, 24.0) + 24.0, 24.0);
+}
+
+HorizCoord equatorialToHorizontalAtSiderealTime(const EqCoord &eq,
+                                                double siderealTimeHours,
+                                                double latitude) {
+  double hourAngle = (siderealTimeHours - eq.getRAInHours()) * 15.0 * DEG_TO_RAD;
+  double dec = eq.getDecInDegrees() * DEG_TO_RAD;
+  double phi = latitude * DEG_TO_RAD;
+
+  double azi = atan2(sin(hourAngle),
+                     cos(hourAngle) * sin(phi) - tan(dec) * cos(phi));
+  azi = azi * RAD_TO_DEG + 180; // +180 -> North is 0°
+  azi = fmod(fmod(azi, 360.0) + 360.0, 360.0);
+  double alt =
+      asin(sin(phi) * sin(dec) + cos(phi) * cos(dec) * cos(hourAngle));
+  return HorizCoord(alt * RAD_TO_DEG, azi);
+}
+
+EqCoord horizontalToEquatorialAtSiderealTime(const HorizCoord &horiz,
+                                             double siderealTimeHours,
+                                             double latitude) {
+  double alt = horiz.altInDegrees * DEG_TO_RAD;
+  double azi = horiz.aziInDegrees * DEG_TO_RAD;
+  double phi = latitude * DEG_TO_RAD;
+
+  double sinDec = sin(phi) * sin(alt) + cos(phi) * cos(alt) * cos(azi);
+  sinDec = sinDec > 1 ? 1 : (sinDec < -1 ? -1 : sinDec);
+  // hour angle measured west, as above
+  double hourAngle = atan2(-cos(alt) * sin(azi),
+                           cos(phi) * sin(alt) - sin(phi) * cos(alt) * cos(azi));
+  double ra = siderealTimeHours * 15.0 - hourAngle * RAD_TO_DEG;
+  ra = fmod(fmod(ra, 360.0) + 360.0, 360.0);
+  return EqCoord(ra, asin(sinDec) * RAD_TO_DEG);
+}
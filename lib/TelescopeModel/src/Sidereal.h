@@ -0,0 +1,46 @@
+#ifndef TELESCOPE_MODEL_SIDEREAL_H
+#define TELESCOPE_MODEL_SIDEREAL_H
+
+#include "EqCoord.h"
+#include "HorizCoord.h"
+#include "TimePoint.h"
+
+/**
+ * Julian day (including fraction) for a UTC time point.
+ */
+double julianDay(TimePoint tp);
+
+/**
+ * Mean sidereal time at Greenwich, in hours 0-24 (Meeus 12.4).
+ *
+ * Works straight from the time point, so unlike the Ephemeris routines it
+ * doesn't break the time into calendar fields or compute nutation: cheap
+ * enough to call on every model tick. Mean rather than apparent sidereal
+ * time differs by at most about a second.
+ */
+double greenwichMeanSiderealTime(TimePoint tp);
+
+/**
+ * Local mean sidereal time in hours, longitude in degrees east positive
+ * (the same convention as TelescopeModel::setLongitude).
+ */
+double localSiderealTime(TimePoint tp, double longitude);
+
+/**
+ * Alt/az (azimuth from north through east) of an equatorial position for
+ * a given local sidereal time and latitude. Same maths as
+ * Ephemeris::equatorialToHorizontal, without touching Ephemeris' global
+ * location so it's safe from any task.
+ */
+HorizCoord equatorialToHorizontalAtSiderealTime(const EqCoord &eq,
+                                                double siderealTimeHours,
+                                                double latitude);
+
+/**
+ * Inverse of equatorialToHorizontalAtSiderealTime.
+ */
+EqCoord horizontalToEquatorialAtSiderealTime(const HorizCoord &horiz,
+                                             double siderealTimeHours,
+                                             double latitude);
+
+#endif
@@ -0,0 +1,84 @@
+#include "SyncGate.h"
+#include <math.h>
+#include <stdlib.h>
+
+static double countsToDegrees(double counts, long stepsPerRevolution) {
+  if (stepsPerRevolution == 0) {
+    return 0;
+  }
+  return counts * 360.0 / labs(stepsPerRevolution);
+}
+
+/**
+ * Scores the window and decides. seconds is how long the exposure was,
+ * 0 for the recent check (which is always fully covered if there's
+ * anything in it).
+ */
+static SyncAssessment assess(const EncoderWindow &window, double seconds,
+                             long altStepsPerRevolution,
+                             long azStepsPerRevolution) {
+  SyncAssessment result = SyncAssessment();
+  double alt = countsToDegrees(window.altSpread, altStepsPerRevolution);
+  double az = countsToDegrees(window.azSpread, azStepsPerRevolution);
+  result.spreadDegrees = sqrt(alt * alt + az * az);
+  result.samples = window.samples;
+  result.coverage = 1;
+  if (seconds > ENCODER_HISTORY_INTERVAL_SECONDS) {
+    // each sample stands for an interval
+    double covered = window.coveredSeconds + ENCODER_HISTORY_INTERVAL_SECONDS;
+    result.coverage = fmin(1, covered / seconds);
+  }
+  double stillness = 1 - result.spreadDegrees / SYNC_MAX_SPREAD_DEGREES;
+  result.quality = result.coverage * fmax(0, stillness);
+  if (result.spreadDegrees > SYNC_MAX_SPREAD_DEGREES) {
+    result.reason = "Scope moved during the exposure";
+  } else if (result.coverage < SYNC_MIN_COVERAGE) {
+    result.reason = "Exposure is older than the encoder history";
+  } else {
+    result.accepted = true;
+  }
+  return result;
+}
+
+SyncAssessment assessExposureSync(const EncoderHistory &history,
+                                  TimePoint start, TimePoint end,
+                                  long altStepsPerRevolution,
+                                  long azStepsPerRevolution) {
+  EncoderWindow window;
+  if (end < start) {
+    SyncAssessment result = SyncAssessment();
+    result.reason = "Exposure ends before it starts";
+    return result;
+  }
+  if (!history.summarise(start, end, window)) {
+    SyncAssessment result = SyncAssessment();
+    result.reason = "Exposure is not in the encoder history";
+    return result;
+  }
+  double seconds = differenceInSeconds(start, end);
+  SyncAssessment result = assess(window, seconds, altStepsPerRevolution,
+                                 azStepsPerRevolution);
+  result.altEncoder = llround(window.altEncoder);
+  result.azEncoder = llround(window.azEncoder);
+  result.time = addSecondsToTime(start, seconds / 2);
+  return result;
+}
+
+SyncAssessment assessSync(const EncoderHistory &history,
+                          EncoderCount altEncoder, EncoderCount azEncoder,
+                          TimePoint now,
+                          long altStepsPerRevolution,
+                          long azStepsPerRevolution) {
+  EncoderWindow window;
+  SyncAssessment result = SyncAssessment();
+  if (history.summarise(addSecondsToTime(now, -SYNC_RECENT_SECONDS), now,
+                        window)) {
+    result = assess(window, 0, altStepsPerRevolution, azStepsPerRevolution);
+  } else {
+    result.accepted = true;
+  }
+  result.altEncoder = altEncoder;
+  result.azEncoder = azEncoder;
+  result.time = now;
+  return result;
+}
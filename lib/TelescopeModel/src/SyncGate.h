@@ -0,0 +1,69 @@
+#ifndef TELESCOPE_MODEL_SYNC_GATE_H
+#define TELESCOPE_MODEL_SYNC_GATE_H
+
+#include "EncoderHistory.h"
+#include "TimePoint.h"
+#include <stdint.h>
+
+/**
+ * A sync is only as good as the encoder counts it's paired with. A plate
+ * solve's coordinates are where the scope pointed during its exposure,
+ * which ended seconds before the sync arrives, so its counts are the
+ * average over the exposure. If the encoders spread more than
+ * SYNC_MAX_SPREAD_DEGREES (standard deviation, both axes together) over
+ * it, the scope was moving and the sync is refused rather than corrupting
+ * the model. A sync without exposure times is checked over the last
+ * SYNC_RECENT_SECONDS instead, and uses the counts at arrival as before.
+ * 3 arcminutes is a few counts of jitter on a typical encoder, and much
+ * less than any push.
+ */
+#define SYNC_MAX_SPREAD_DEGREES 0.05
+#define SYNC_RECENT_SECONDS 0.5
+// the samples have to span at least this much of the exposure
+#define SYNC_MIN_COVERAGE 0.5
+
+struct SyncAssessment {
+  bool accepted;
+  const char *reason; // why not, for the client
+  /**
+   * 1 for a still scope and a fully covered exposure, falling to 0 at
+   * SYNC_MAX_SPREAD_DEGREES or no coverage. 0 for a sync that couldn't be
+   * checked (no history yet).
+   */
+  double quality;
+  double spreadDegrees;
+  double coverage; // fraction of the exposure with samples
+  int samples;
+  // what to sync against: mid exposure
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  TimePoint time;
+};
+
+// for the diagnostics
+struct SyncGateStats {
+  uint32_t accepted;
+  uint32_t rejected;
+  SyncAssessment last; // accepted or not, time 0 before the first
+};
+
+/**
+ * For a plate solve of an exposure from start to end. Steps per
+ * revolution turn the spread into degrees.
+ */
+SyncAssessment assessExposureSync(const EncoderHistory &history,
+                                  TimePoint start, TimePoint end,
+                                  long altStepsPerRevolution,
+                                  long azStepsPerRevolution);
+
+/**
+ * For a sync without exposure times, with the encoders as it arrived.
+ * Accepted unchecked before there's any history.
+ */
+SyncAssessment assessSync(const EncoderHistory &history,
+                          EncoderCount altEncoder, EncoderCount azEncoder,
+                          TimePoint now,
+                          long altStepsPerRevolution,
+                          long azStepsPerRevolution);
+
+#endif
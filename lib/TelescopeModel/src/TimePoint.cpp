@@ -1,15 +1,9 @@
-#ifndef TELESCOPE_MODEL_TIMEPOINT_H
-#define TELESCOPE_MODEL_TIMEPOINT_H
-
+#include "TimePoint.h"
+#include "TimeService.h"
 #include <chrono>
 #include <ctime>
+#include <stdio.h>
 #include <string>
-#include <sys/time.h>
-#include "TimePoint.h"
-
-// Type aliases for simplicity
-using Clock = std::chrono::system_clock;
-using TimePoint = Clock::time_point;
 
 TimePoint addMillisToTime(TimePoint tp, unsigned long millis) {
   return tp + std::chrono::milliseconds(millis);
@@ -20,40 +14,49 @@ TimePoint addSecondsToTime(TimePoint tp, double seconds) {
                   std::chrono::duration<double>(seconds));
 }
 
-void setSystemTime(const TimePoint &tp) {
-  // Convert TimePoint to time_t
-  std::time_t tt = Clock::to_time_t(tp);
-
-  // Convert time_t to timeval
-  struct timeval tv;
-  tv.tv_sec = tt;
-  tv.tv_usec = 0; // Setting microseconds to 0 for simplicity
-
-  // Set the system time
-  settimeofday(&tv, nullptr);
+/**
+ * Days from 1970-01-01 to a Gregorian date, by arithmetic rather than
+ * mktime, which works in local time (and the time zone's DST rules).
+ * Years run March to February so the leap day comes last.
+ */
+static long daysFromCivil(long year, unsigned int month, unsigned int day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  unsigned int yearOfEra = (unsigned int)(year - era * 400);
+  unsigned int dayOfYear =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  unsigned int dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (long)dayOfEra - 719468;
 }
 
 TimePoint createTimePoint(unsigned int day, unsigned int month,
                           unsigned int year, unsigned int hour,
                           unsigned int minute, unsigned int second) {
-  std::tm timeStruct = {};
-  timeStruct.tm_year = year - 1900; // Years since 1900
-  timeStruct.tm_mon = month - 1;    // Months are 0-based
-  timeStruct.tm_mday = day;
-  timeStruct.tm_hour = hour;
-  timeStruct.tm_min = minute;
-  timeStruct.tm_sec = second;
-
-  /// Convert tm to time_t (local time)
-  std::time_t tt = std::mktime(&timeStruct);
-
-  // Adjust for time zone to get UTC
-  std::tm utc_tm = *std::gmtime(&tt);
-  tt -= std::mktime(&utc_tm) - tt;
-
-  // Convert time_t to TimePoint
+  std::time_t tt = (std::time_t)daysFromCivil(year, month, day) * 86400 +
+                   hour * 3600 + minute * 60 + second;
   return Clock::from_time_t(tt);
 }
+
+bool parseUtcTime(const char *text, TimePoint &time) {
+  unsigned int year;
+  unsigned int month;
+  unsigned int day;
+  unsigned int hour;
+  unsigned int minute;
+  double second;
+  char zone;
+  if (sscanf(text, "%4u-%2u-%2uT%2u:%2u:%lf%c", &year, &month, &day, &hour,
+             &minute, &second, &zone) != 7 ||
+      zone != 'Z' || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour > 23 || minute > 59 || second < 0 || second >= 61) {
+    return false;
+  }
+  unsigned int whole = (unsigned int)second;
+  time = addSecondsToTime(
+      createTimePoint(day, month, year, hour, minute, whole), second - whole);
+  return true;
+}
 /**
  * Convert from %4d-%2d-%2dT%2d:%2d:%2dZ
  */
@@ -85,7 +88,7 @@ double differenceInSeconds(TimePoint early, TimePoint late) {
   return duration.count();
 }
 
-std::string timePointToString(TimePoint tp) {
+void timePointToString(TimePoint tp, char *buffer, size_t bufferSize) {
   // Convert the time_point to time_t
   std::time_t tt = Clock::to_time_t(tp);
 
@@ -93,9 +96,12 @@ std::string timePointToString(TimePoint tp) {
   std::tm *timeStruct = std::localtime(&tt);
 
   // Format the tm structure to a string
-  char buffer[80];
-  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeStruct);
+  strftime(buffer, bufferSize, "%Y-%m-%d %H:%M:%S", timeStruct);
+}
 
+std::string timePointToString(TimePoint tp) {
+  char buffer[80];
+  timePointToString(tp, buffer, sizeof(buffer));
   return std::string(buffer);
 }
 
@@ -108,5 +114,4 @@ unsigned long convertTimePointToEpochSeconds(TimePoint tp) {
   return static_cast<unsigned long>(tt);
 }
 
-TimePoint getNow() { return std::chrono::system_clock::now(); }
-#endif
+TimePoint getNow() { return getTimeService().now(); }
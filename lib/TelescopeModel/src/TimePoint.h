@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <ctime>
+#include <stddef.h>
 #include <string>
 
 
@@ -14,11 +15,15 @@ TimePoint addMillisToTime(TimePoint tp, unsigned long millis);
 
 TimePoint addSecondsToTime(TimePoint tp, double seconds) ;
 
-void setSystemTime(const TimePoint &tp) ;
-
+// UTC, whatever the time zone
 TimePoint createTimePoint(unsigned int day, unsigned int month,
                           unsigned int year, unsigned int hour,
                           unsigned int minute, unsigned int second);
+/**
+ * ISO 8601 UTC, seconds optionally fractional: 2023-09-16T10:39:00.25Z, as
+ * Alpaca clients send it. False if it isn't one.
+ */
+bool parseUtcTime(const char *text, TimePoint &time);
 /**
  * Convert from %4d-%2d-%2dT%2d:%2d:%2dZ
  */
@@ -26,8 +31,14 @@ TimePoint convertToTimePointFromString(const std::string &utc);
 
 double differenceInSeconds(TimePoint early, TimePoint late);
 std::string timePointToString(TimePoint tp);
+/**
+ * Same as above, but formats into a caller supplied buffer so that it
+ * doesn't allocate.
+ */
+void timePointToString(TimePoint tp, char *buffer, size_t bufferSize);
 
 unsigned long convertTimePointToEpochSeconds(TimePoint tp);
 
+// UTC, see TimeService
 TimePoint getNow();
 #endif
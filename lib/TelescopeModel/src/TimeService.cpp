@@ -0,0 +1,99 @@
+#include "TimeService.h"
+#include <math.h>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+int64_t systemMonotonicMicros() { return esp_timer_get_time(); }
+#else
+int64_t systemMonotonicMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+static int64_t toMicros(TimePoint time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+static TimePoint fromMicros(int64_t micros) {
+  return TimePoint(std::chrono::duration_cast<Clock::duration>(
+      std::chrono::microseconds(micros)));
+}
+
+TimeService::TimeService(MonotonicMicros source)
+    : source(source), lastUpdate(0), current() {
+  // until a client says, whatever the system clock says
+  anchor.monotonicMicros = source();
+  anchor.utcMicros = toMicros(Clock::now());
+  anchor.rate = 1;
+  anchor.slewMicros = 0;
+  published.write(anchor);
+  stats.write(current);
+}
+
+double TimeService::slewedAt(const Anchor &anchor, int64_t micros) {
+  double most = (micros - anchor.monotonicMicros) * TIME_SLEW_RATE;
+  return anchor.slewMicros < 0 ? fmax(anchor.slewMicros, -most)
+                               : fmin(anchor.slewMicros, most);
+}
+
+int64_t TimeService::utcAt(const Anchor &anchor, int64_t micros) {
+  // read before the anchor moved: as of the anchor, still never behind
+  if (micros < anchor.monotonicMicros) {
+    micros = anchor.monotonicMicros;
+  }
+  return anchor.utcMicros +
+         llround((micros - anchor.monotonicMicros) * anchor.rate +
+                 slewedAt(anchor, micros));
+}
+
+TimePoint TimeService::at(int64_t micros) const {
+  return fromMicros(utcAt(published.read(), micros));
+}
+
+TimeUpdateResult TimeService::update(TimePoint utc, int64_t received) {
+  int64_t client = toMicros(utc);
+  int64_t ours = utcAt(anchor, received);
+  // where ours is heading once the slew under way is in
+  double remaining = anchor.slewMicros - slewedAt(anchor, received);
+  double offset = client - (ours + remaining);
+  current.updates++;
+  current.lastOffsetSeconds = offset / 1e6;
+
+  TimeUpdateResult result;
+  if (!current.set || offset > TIME_STEP_SECONDS * 1e6) {
+    // the first can go either way: until then it was only a guess
+    anchor.utcMicros = current.set && client < ours ? ours : client;
+    anchor.slewMicros = 0;
+    current.set = true;
+    current.steps++;
+    result = TIME_UPDATE_SET;
+  } else if (offset < -TIME_STEP_SECONDS * 1e6) {
+    current.refused++;
+    stats.write(current);
+    return TIME_UPDATE_REFUSED;
+  } else {
+    double interval = (received - lastUpdate) / 1e6;
+    double rate = anchor.rate + TIME_DRIFT_GAIN * offset / 1e6 /
+                                    fmax(interval, TIME_DRIFT_MIN_SECONDS);
+    anchor.rate = fmin(fmax(rate, 1 - TIME_MAX_DRIFT), 1 + TIME_MAX_DRIFT);
+    anchor.utcMicros = ours;
+    anchor.slewMicros = remaining + TIME_OFFSET_GAIN * offset;
+    result = TIME_UPDATE_SLEWED;
+  }
+  anchor.monotonicMicros = received;
+  lastUpdate = received;
+  current.lastUpdated = fromMicros(anchor.utcMicros);
+  current.rateCorrection = anchor.rate - 1;
+  published.write(anchor);
+  stats.write(current);
+  return result;
+}
+
+TimeService &getTimeService() {
+  static TimeService service;
+  return service;
+}
@@ -0,0 +1,105 @@
+#ifndef TELESCOPE_MODEL_TIME_SERVICE_H
+#define TELESCOPE_MODEL_TIME_SERVICE_H
+
+#include "SeqLock.h"
+#include "TimePoint.h"
+#include <stdint.h>
+
+/**
+ * A client's time more than this off is either a first setting (ahead:
+ * stepped to) or a client with its clock wrong (behind: refused, as the
+ * clock never goes backwards). Within it, it's slewed in.
+ */
+#define TIME_STEP_SECONDS 2.0
+// how fast a correction is slewed in: 50ms a second, so 1s takes 20s
+#define TIME_SLEW_RATE 0.05
+// how much of each client's offset to correct (the rest is its jitter)
+#define TIME_OFFSET_GAIN 0.5
+// how much of the offset per second since the last update is drift
+#define TIME_DRIFT_GAIN 0.3
+// an offset counts as drift over at least this long, so updates close
+// together (their offset is mostly the clients' jitter) barely move it
+#define TIME_DRIFT_MIN_SECONDS 300
+// a crystal is tens of ppm out; more is the clients disagreeing
+#define TIME_MAX_DRIFT 0.0002
+
+// microseconds since boot, never going back (esp_timer, steady_clock)
+typedef int64_t (*MonotonicMicros)();
+int64_t systemMonotonicMicros();
+
+enum TimeUpdateResult {
+  TIME_UPDATE_SET,     // the first, or ahead by more than TIME_STEP_SECONDS
+  TIME_UPDATE_SLEWED,  // within TIME_STEP_SECONDS, being slewed in
+  TIME_UPDATE_REFUSED, // behind by more than TIME_STEP_SECONDS
+};
+
+struct TimeServiceStats {
+  bool set; // by a client, rather than whatever the clock said at boot
+  uint32_t updates;
+  uint32_t steps; // including the first setting
+  uint32_t refused;
+  double lastOffsetSeconds; // client minus ours, as it arrived
+  TimePoint lastUpdated;    // ours, as of the last update taken
+  // applied to the monotonic clock for drift, 1e-6 is running it 1ppm fast
+  double rateCorrection;
+};
+
+/**
+ * UTC, for the model and the platform: a monotonic clock with microsecond
+ * resolution (esp_timer on the device) plus where it is in UTC, so getNow()
+ * never depends on settimeofday and carries the fraction of a second the
+ * clients send.
+ *
+ * Clients' times are filtered rather than taken as they come: each update
+ * corrects part of the offset (slewed in, at TIME_SLEW_RATE, rather than
+ * stepped) and the offset that builds up between updates far enough
+ * apart is taken as drift, so the clock keeps better time between them.
+ * It never goes backwards: the only step is forwards, and a slew back
+ * only slows it down.
+ *
+ * now() can be called from any task. update() must all be from the same
+ * task (on the device, the async_tcp task that runs the web handlers).
+ * Pass a fake MonotonicMicros to test it.
+ */
+class TimeService {
+public:
+  explicit TimeService(MonotonicMicros source = systemMonotonicMicros);
+
+  TimePoint now() const { return at(source()); }
+  // UTC at a time from the monotonic source
+  TimePoint at(int64_t micros) const;
+  int64_t micros() const { return source(); }
+
+  // a client's time, as of received (from micros(), when it arrived)
+  TimeUpdateResult update(TimePoint utc, int64_t received);
+  TimeUpdateResult update(TimePoint utc) { return update(utc, source()); }
+
+  TimeServiceStats getStats() const { return stats.read(); }
+
+private:
+  /**
+   * UTC from anchor on: rate per monotonic second, plus slewMicros added
+   * at TIME_SLEW_RATE (so the correction is spread out, not a jump).
+   */
+  struct Anchor {
+    int64_t monotonicMicros;
+    int64_t utcMicros;
+    double rate;
+    double slewMicros;
+  };
+  static double slewedAt(const Anchor &anchor, int64_t micros);
+  static int64_t utcAt(const Anchor &anchor, int64_t micros);
+
+  MonotonicMicros source;
+  SeqLock<Anchor> published;
+  // update()'s own
+  Anchor anchor;
+  int64_t lastUpdate;
+  TimeServiceStats current;
+  SeqLock<TimeServiceStats> stats;
+};
+
+// the one getNow() reads
+TimeService &getTimeService();
+
+#endif
@@ -0,0 +1,132 @@
+#include "VisibilityPlanner.h"
+#include "Sidereal.h"
+#include <algorithm>
+#include <math.h>
+
+// sidereal hours per solar hour
+#define SIDEREAL_RATE 1.00273790935f
+#define HOURS_TO_RADIANS ((float)M_PI / 12)
+#define RADIANS_TO_DEGREES (180 / (float)M_PI)
+
+NightConstants prepareNight(double latitude, double longitude,
+                            double minAltitudeDegrees, TimePoint start,
+                            TimePoint end) {
+  NightConstants night;
+  double hours = differenceInSeconds(start, end) / 3600;
+  night.valid = hours > 0 && hours <= VISIBILITY_MAX_NIGHT_HOURS;
+  night.windowHours = (float)hours;
+  night.sinLatitude = (float)sin(latitude * M_PI / 180);
+  night.cosLatitude = (float)cos(latitude * M_PI / 180);
+  night.sinMinAltitude = (float)sin(minAltitudeDegrees * M_PI / 180);
+  night.startSiderealHours = localSiderealTime(start, longitude);
+  return night;
+}
+
+// hours within [-12, 12)
+static float wrapHours(float hours) {
+  hours = fmodf(hours + 12, 24);
+  return hours < 0 ? hours + 12 : hours - 12;
+}
+
+static float overlapHours(float from, float to, float windowHours) {
+  from = from < 0 ? 0 : from;
+  to = to > windowHours ? windowHours : to;
+  return to > from ? to - from : 0;
+}
+
+bool planVisibility(const NightConstants &night, const PlannerTarget *targets,
+                    size_t count, Visibility *visibility) {
+  if (!night.valid) {
+    return false;
+  }
+  const float window = night.windowHours;
+  const float middle = window / 2;
+  const float siderealDay = 24 / SIDEREAL_RATE; // in solar hours
+  // hour angle at the start of the window is this minus ra
+  const float startSidereal = (float)night.startSiderealHours;
+  const float endAdvance = window * SIDEREAL_RATE;
+
+  for (size_t i = 0; i < count; i++) {
+    const PlannerTarget &target = targets[i];
+    Visibility &out = visibility[i];
+    out.id = target.id;
+
+    float startHourAngle = startSidereal - target.raHours;
+    float transit =
+        middle - wrapHours(startHourAngle + middle * SIDEREAL_RATE) /
+                     SIDEREAL_RATE;
+    float dec = target.decDegrees * ((float)M_PI / 180);
+    float sinDec = sinf(dec);
+    float cosDec = cosf(dec);
+    float a = night.sinLatitude * sinDec;
+    float b = night.cosLatitude * cosDec; // >= 0
+
+    // hour angle either side of transit that it's above minAltitude
+    float halfHours = 0;
+    if (b < 1e-6f) {
+      // at a pole, or the target is: the altitude never changes
+      out.state = a >= night.sinMinAltitude ? VISIBILITY_ALWAYS_UP
+                                            : VISIBILITY_NEVER_UP;
+    } else {
+      float cosHalf = (night.sinMinAltitude - a) / b;
+      if (cosHalf <= -1) {
+        out.state = VISIBILITY_ALWAYS_UP;
+      } else if (cosHalf >= 1) {
+        out.state = VISIBILITY_NEVER_UP;
+      } else {
+        out.state = VISIBILITY_RISES_AND_SETS;
+        halfHours = acosf(cosHalf) / HOURS_TO_RADIANS / SIDEREAL_RATE;
+      }
+    }
+
+    float observable;
+    if (out.state == VISIBILITY_RISES_AND_SETS) {
+      out.riseSeconds = (transit - halfHours) * 3600;
+      out.setSeconds = (transit + halfHours) * 3600;
+      // a window of up to a day can also catch the passes either side
+      observable = 0;
+      for (int n = -1; n <= 1; n++) {
+        float pass = transit + n * siderealDay;
+        observable +=
+            overlapHours(pass - halfHours, pass + halfHours, window);
+      }
+    } else {
+      out.riseSeconds = NAN;
+      out.setSeconds = NAN;
+      observable = out.state == VISIBILITY_ALWAYS_UP ? window : 0;
+    }
+    out.transitSeconds = transit * 3600;
+    out.observableSeconds = observable * 3600;
+
+    // highest at transit if that's in the window, otherwise at whichever
+    // end of the window is nearer to it
+    float cosHourAngle;
+    if (transit >= 0 && transit <= window) {
+      cosHourAngle = 1;
+      out.bestSeconds = out.transitSeconds;
+    } else {
+      float atStart = cosf(startHourAngle * HOURS_TO_RADIANS);
+      float atEnd = cosf((startHourAngle + endAdvance) * HOURS_TO_RADIANS);
+      cosHourAngle = atStart >= atEnd ? atStart : atEnd;
+      out.bestSeconds = atStart >= atEnd ? 0 : window * 3600;
+    }
+    float sinAltitude = a + b * cosHourAngle;
+    sinAltitude = sinAltitude > 1 ? 1 : (sinAltitude < -1 ? -1 : sinAltitude);
+    out.maxAltitudeDegrees = asinf(sinAltitude) * RADIANS_TO_DEGREES;
+  }
+  return true;
+}
+
+static bool moreObservable(const Visibility &a, const Visibility &b) {
+  if (a.observableSeconds != b.observableSeconds) {
+    return a.observableSeconds > b.observableSeconds;
+  }
+  if (a.maxAltitudeDegrees != b.maxAltitudeDegrees) {
+    return a.maxAltitudeDegrees > b.maxAltitudeDegrees;
+  }
+  return a.id < b.id;
+}
+
+void sortByObservability(Visibility *visibility, size_t count) {
+  std::sort(visibility, visibility + count, moreObservable);
+}
@@ -0,0 +1,80 @@
+#ifndef TELESCOPE_MODEL_VISIBILITY_PLANNER_H
+#define TELESCOPE_MODEL_VISIBILITY_PLANNER_H
+
+#include "TimePoint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Standard refraction at the horizon, as Ephemeris' rise and set use
+#define VISIBILITY_HORIZON_DEGREES (-34.0 / 60.0)
+#define VISIBILITY_MAX_NIGHT_HOURS 24
+
+struct PlannerTarget {
+  float raHours;
+  float decDegrees;
+  uint32_t id; // caller's, e.g. a catalogue record number
+};
+
+enum VisibilityState {
+  VISIBILITY_RISES_AND_SETS,
+  VISIBILITY_ALWAYS_UP, // never below minAltitude (circumpolar)
+  VISIBILITY_NEVER_UP
+};
+
+/**
+ * One target's night. Times are seconds from the start of the window, and
+ * can fall outside it: rise, transit and set are for the transit nearest
+ * the middle of the night. Rise and set are NAN unless the state is
+ * VISIBILITY_RISES_AND_SETS.
+ */
+struct Visibility {
+  uint32_t id;
+  uint8_t state;
+  float riseSeconds;
+  float transitSeconds;
+  float setSeconds;
+  float maxAltitudeDegrees; // highest during the window
+  float bestSeconds;        // when it's that high
+  float observableSeconds;  // above minAltitude during the window
+};
+
+/**
+ * Everything the planner needs that's the same for every target on a
+ * given night: the latitude terms and the sidereal time at the start of the
+ * window. Computed once, so the per target work is a handful of float
+ * trig calls and no calendar or sidereal maths.
+ */
+struct NightConstants {
+  float sinLatitude;
+  float cosLatitude;
+  float sinMinAltitude;
+  double startSiderealHours; // local mean sidereal time at window start
+  float windowHours;
+  bool valid;
+};
+
+/**
+ * Latitude and longitude in degrees (east positive, as TelescopeModel).
+ * minAltitudeDegrees is what counts as up: the horizon, or higher to allow
+ * for trees and haze. Windows longer than VISIBILITY_MAX_NIGHT_HOURS or
+ * ending before they start aren't valid.
+ */
+NightConstants prepareNight(double latitude, double longitude,
+                            double minAltitudeDegrees, TimePoint start,
+                            TimePoint end);
+
+/**
+ * Rise, transit, set and the best of the night for every target in one
+ * pass. visibility must have room for count entries. Returns false if
+ * night isn't valid.
+ */
+bool planVisibility(const NightConstants &night, const PlannerTarget *targets,
+                    size_t count, Visibility *visibility);
+
+/**
+ * Most observable first: longest above minAltitude during the window, then
+ * highest. In place and without allocating.
+ */
+void sortByObservability(Visibility *visibility, size_t count);
+
+#endif
@@ -1,6 +1,7 @@
 #include "TelescopeModel.h"
 #include "Ephemeris.h"
 #include "Logging.h"
+#include "Sidereal.h"
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
@@ -22,6 +23,7 @@ void TelescopeModel::performBaselineAlignment() {
   alignment.addReferenceCoord(h, eq); // degreess
   alignment.calculateThirdReference();
   defaultAlignment = true;
+  alignmentChanged();
 }
 
 TelescopeModel::TelescopeModel() {
@@ -33,12 +35,16 @@ TelescopeModel::TelescopeModel() {
 
   performBaselineAlignment();
 
+  doesRefraction = true;
+
   altEnc = 0;
   azEnc = 0;
   altDelta = 0;
   aziDelta = 0;
   azEncoderStepsPerRevolution = 0;
   altEncoderStepsPerRevolution = 0;
+  calculatedAltEncoderRes = 0;
+  calculatedAziEncoderRes = 0;
 
   // known eq position at sync
   // raBasePos = 0;
@@ -71,16 +77,22 @@ void TelescopeModel::clearAlignment() {
   performBaselineAlignment();
 }
 
-void TelescopeModel::setEncoderValues(long encAlt, long encAz) {
+void TelescopeModel::setEncoderValues(EncoderCount encAlt, EncoderCount encAz) {
   altEnc = encAlt;
   azEnc = encAz;
 }
 
+void TelescopeModel::setPlatformState(const PlatformState &state) {
+  platformState = state;
+}
+
 void TelescopeModel::setAzEncoderStepsPerRevolution(long azResolution) {
   azEncoderStepsPerRevolution = azResolution;
+  azScale.setStepsPerRevolution(azResolution);
 }
 void TelescopeModel::setAltEncoderStepsPerRevolution(long altResolution) {
   altEncoderStepsPerRevolution = altResolution;
+  altScale.setStepsPerRevolution(altResolution);
 }
 
 void TelescopeModel::setLatitude(float lat) {
@@ -90,6 +102,46 @@ void TelescopeModel::setLatitude(float lat) {
 void TelescopeModel::setLongitude(float lng) {
   longitude = lng;
   Ephemeris::setLocationOnEarth(latitude, longitude);
+  alignmentChanged();
+}
+
+void TelescopeModel::setDoesRefraction(bool enabled) {
+  if (enabled == doesRefraction) {
+    return;
+  }
+  doesRefraction = enabled;
+  rebuildAlignment();
+}
+
+void TelescopeModel::setRefractionConditions(float temperatureCelsius,
+                                             float pressureMillibars) {
+  if (temperatureCelsius == refraction.getTemperature() &&
+      pressureMillibars == refraction.getPressure()) {
+    return;
+  }
+  refraction.setConditions(temperatureCelsius, pressureMillibars);
+  if (doesRefraction) {
+    rebuildAlignment();
+  }
+}
+
+/**
+ * The alignment's reference points went through toAlignmentFrame, so were
+ * refracted as things stood when they were synced. Anything that changes
+ * that builds it again from the syncs, which are stored refraction free,
+ * along with the offsets from a sync after the two base points.
+ */
+void TelescopeModel::rebuildAlignment() {
+  if (baseAlignmentSynchPoints.size() == 2) {
+    addReferencePoints(baseAlignmentSynchPoints);
+    if (lastSyncPoint.isValid &&
+        lastSyncPoint.timePoint != baseAlignmentSynchPoints[0].timePoint &&
+        lastSyncPoint.timePoint != baseAlignmentSynchPoints[1].timePoint) {
+      calculateSyncOffsets(lastSyncPoint);
+    }
+  } else if (baseSyncPoint.isValid) {
+    performOneStarAlignment(baseSyncPoint);
+  }
 }
 
 float TelescopeModel::getLatitude() { return latitude; }
@@ -99,74 +151,163 @@ float TelescopeModel::getAltCoord() { return currentAlt; }
 float TelescopeModel::getAzCoord() { return currentAz; }
 
 /**
- * Perform straight interpolation to alt/az using encoders
+ * Inverse of calculateAltAzFromEncoders, with the sync offsets taken back
+ * off: how many encoder steps to move from altEncVal/azEncVal to point at
+ * a model alt/az (as from alignment.toInstrumentCoord). Azimuth goes the
+ * short way round.
  */
-HorizCoord TelescopeModel::calculateAltAzFromEncoders(long altEncVal,
-                                                      long azEncVal) {
+void TelescopeModel::calculateEncoderOffsetFromAltAz(float alt, float az,
+                                                     EncoderCount altEncVal,
+                                                     EncoderCount azEncVal,
+                                                     long &altEncOffset,
+                                                     long &azEncOffset) {
+  long altTarget =
+      lround((alt - altDelta) * altEncoderStepsPerRevolution / 360.0);
+  long azTarget = lround((az - aziDelta) * azEncoderStepsPerRevolution / 360.0);
+  altEncOffset = (long)(altTarget - altEncVal);
+  azEncOffset =
+      wrapEncoderSteps(azTarget - azEncVal, azEncoderStepsPerRevolution);
+}
 
-  float alt =
-      360.0 * ((float)(altEncVal)) / (float)altEncoderStepsPerRevolution;
-  float az = 360.0 * ((float)(azEncVal)) / (float)azEncoderStepsPerRevolution;
-  return HorizCoord(alt, az);
+/**
+ * Encoder values that point at ra/dec over the next few minutes, assuming
+ * the platform carries on as it is. Runs the model backwards: target into
+ * the alignment frame, through the alignment matrix to alt/az, then to
+ * encoder steps. False if the encoder resolution isn't known.
+ */
+bool TelescopeModel::calculatePushToTrack(double raHours, double decDegrees,
+                                          TimePoint start,
+                                          const PlatformState &platform,
+                                          PushToTrack &track) {
+  if (altEncoderStepsPerRevolution == 0 || azEncoderStepsPerRevolution == 0) {
+    return false;
+  }
+  EqCoord target;
+  target.setRAInHours(raHours);
+  target.setDecInDegrees(decDegrees);
+
+  track.raHours = raHours;
+  track.decDegrees = decDegrees;
+  track.start = start;
+  track.platform = platform;
+  track.altStepsPerRevolution = altEncoderStepsPerRevolution;
+  track.azStepsPerRevolution = azEncoderStepsPerRevolution;
+  for (int i = 0; i < PUSH_TO_TRACK_POINTS; i++) {
+    unsigned long millis = (unsigned long)i * PUSH_TO_TRACK_STEP_MILLIS;
+    HorizCoord modeled = alignment.toInstrumentCoord(
+        toAlignmentFrame(target, addMillisToTime(start, millis),
+                         platform.after(millis / 1000.0)));
+    calculateEncoderOffsetFromAltAz(modeled.altInDegrees, modeled.aziInDegrees,
+                                    0, 0, track.altEncoder[i],
+                                    track.azEncoder[i]);
+  }
+  return true;
+}
+
+/**
+ * Perform straight interpolation to alt/az using encoders, in fixed point
+ * (see EncoderScale) so it's as exact after many turns of azimuth as in
+ * the first. Alt comes out -180 to 180, az 0 to 360.
+ */
+HorizCoord TelescopeModel::calculateAltAzFromEncoders(EncoderCount altEncVal,
+                                                      EncoderCount azEncVal) {
+  return HorizCoord(altScale.toSignedDegrees(altEncVal),
+                    azScale.toDegrees(azEncVal));
 }
 
 /**
  * @brief Calculates the current position of the telescope based on encoder
- * values, at a point in time.
+ * values and platform state, at a point in time.
  *
  * This method performs the following steps:
  * 1. Calculates alt az positon using encoder values
  * 2. Adjust that position based on error offsets, calcuated at last sync
  * 3. Convert that alt/az to equatorial coords, using the two star aligned
- * model
+ * model, with the platform's dec axis tilt composed into the matrix
  * 4. Adjust the ra of the result to reflect time that has passed since model
- * creation
+ * creation, and the platform's rotation about its polar axis
+ * 5. Take off atmospheric refraction (see applyRefraction)
  * @return void
  */
 void TelescopeModel::calculateCurrentPosition(TimePoint &timePoint) {
-  // log("");
-  // log("=====calculateCurrentPosition====");
-
-  float altEncoderDegrees;
-  float azEncoderDegrees;
   // convert encoder values to degrees
   HorizCoord encoderAltAz = calculateAltAzFromEncoders(altEnc, azEnc);
-  // log("Raw Alt az from encoders: \t\talt: %lf\taz:%lf\tat time:%s",
-  //     encoderAltAz.altInDegrees, encoderAltAz.aziInDegrees,
-  //     timePointToString(timePoint).c_str());
 
   HorizCoord offsetAltAz = encoderAltAz.addOffset(altDelta, aziDelta);
-  // log("Offset from encoders: \t\talt: %lf\taz:%lf\tat time:%s",
-  //     offsetAltAz.altInDegrees, offsetAltAz.aziInDegrees,
-  //     timePointToString(timePoint).c_str());
 
-  currentEqPosition = alignment.toReferenceCoord(offsetAltAz);
-  // log("Base position\t\t\tra(h): %lf\tdec: %lf",
-  //     currentEqPosition.getRAInHours(), currentEqPosition.getDecInDegrees());
+  currentEqPosition = alignment.toReferenceCoord(
+      offsetAltAz,
+      kinematics.referenceTransform(platformState.decAxisDegrees));
 
-  // Work out how many seconds since the model was created. Add this
-  // to the RA to compensate for time passing.
-  double timeDeltaSeconds = 0;
+  // a scope that stays put points at increasing ra as the earth turns,
+  // and the platform turning the base east does the same
+  currentEqPosition = currentEqPosition.addRAInDegrees(
+      raShiftInDegrees(timePoint, platformState));
 
+  // that's where it appears, the true position is a little lower
+  currentEqPosition = applyRefraction(currentEqPosition, timePoint, false);
+}
+
+/**
+ * Moves eq along its vertical circle by the refraction at its altitude
+ * at tp: up to where it appears (toApparent), or back down to where it
+ * is. Unchanged with doesRefraction off.
+ */
+EqCoord TelescopeModel::applyRefraction(const EqCoord &eq, TimePoint tp,
+                                        bool toApparent) {
+  if (!doesRefraction) {
+    return eq;
+  }
+  double siderealTime = localSiderealTime(tp, longitude);
+  HorizCoord sky =
+      equatorialToHorizontalAtSiderealTime(eq, siderealTime, latitude);
+  sky.altInDegrees = toApparent ? refraction.trueToApparent(sky.altInDegrees)
+                                : refraction.apparentToTrue(sky.altInDegrees);
+  return horizontalToEquatorialAtSiderealTime(sky, siderealTime, latitude);
+}
+
+/**
+ * How far ra has moved, for a fixed direction in the dob's base, between
+ * the alignment frame (base sync time, platform centred) and the given
+ * time and platform state.
+ */
+double TelescopeModel::raShiftInDegrees(TimePoint tp,
+                                        const PlatformState &state) {
+  double timeDeltaSeconds = 0;
   if (baseSyncPoint.isValid) {
-    // function does timepoint-base.timepoint
+    // function does tp-base.timepoint
     // so will be positive as time moves forward
-    timeDeltaSeconds = differenceInSeconds(baseSyncPoint.timePoint, timePoint);
+    timeDeltaSeconds = differenceInSeconds(baseSyncPoint.timePoint, tp);
   }
+  return secondsToRADeltaInDegrees(timeDeltaSeconds) + state.raAxisDegrees;
+}
 
-  double raDeltaDegrees = secondsToRADeltaInDegrees(timeDeltaSeconds);
-  // log("Time delta seconds: %lf degrees: %lf", timeDeltaSeconds,
-  // raDeltaDegrees);
-
-  // this should substract from calculated position as has passed:
-  // if scope is pointing to same position, but earth has turned,
-  // ra pointed to gets smaller
-  currentEqPosition = currentEqPosition.addRAInDegrees(-raDeltaDegrees);
+/**
+ * Where a (true) position seen at tp, with the platform in state, sits in
+ * the alignment frame. Inverse of the adjustments in
+ * calculateCurrentPosition.
+ */
+EqCoord TelescopeModel::toAlignmentFrame(const EqCoord &eq, TimePoint tp,
+                                         const PlatformState &state) {
+  EqCoord shifted = applyRefraction(eq, tp, true)
+                        .addRAInDegrees(-raShiftInDegrees(tp, state));
+  return kinematics.removeDecAxisTilt(shifted, state.decAxisDegrees);
+}
 
-  // log("Final position\t\t\tra(h): %lf\tdec: %lf",
-  //     currentEqPosition.getRAInHours(), currentEqPosition.getDecInDegrees());
-  // log("=====calculateCurrentPosition====");
-  // log("");
+/**
+ * The alignment frame is the sky at the base sync point's time, so the
+ * east point (where a centred platform's dec axis points) moves with the
+ * base sync point. Called after anything that changes either.
+ */
+void TelescopeModel::alignmentChanged() {
+  double tinv[3][3];
+  alignment.getTinv(tinv);
+  double eastPointRA = 90;
+  if (baseSyncPoint.isValid) {
+    eastPointRA =
+        localSiderealTime(baseSyncPoint.timePoint, longitude) * 15.0 + 90;
+  }
+  kinematics.setAlignment(tinv, eastPointRA);
 }
 
 float TelescopeModel::getDecCoord() {
@@ -176,11 +317,11 @@ float TelescopeModel::getRACoord() { return currentEqPosition.getRAInHours(); }
 
 /**
  * Convert a time period, in seconds to an ra delta.
- * Used to work out how much to adjust ra by over time.
+ * Used to work out how much to adjust ra by over time. The sky turns once
+ * per sidereal day, not once per 24 hours.
  */
 double TelescopeModel::secondsToRADeltaInDegrees(double secondsDelta) {
-  double RA_delta_degrees = (secondsDelta / (24.0 * 3600.0)) * 360.0;
-  return RA_delta_degrees;
+  return secondsDelta * SIDEREAL_DEGREES_PER_SECOND;
 }
 
 /**
@@ -196,17 +337,28 @@ double TelescopeModel::secondsToRADeltaInDegrees(double secondsDelta) {
  * alignment. Then they can choose to do more accurate manual alignment
  * points.
  */
-void TelescopeModel::performOneStarAlignment(SynchPoint &syncPoint) {
-  log("Time (local) for one star alignment: %s",
-      timePointToString(syncPoint.timePoint).c_str());
-  alignment.addReferenceCoord(syncPoint.encoderAltAz, syncPoint.eqCoord);
+void TelescopeModel::performOneStarAlignment(const SynchPoint &syncPoint) {
+  if (isLoggingEnabled()) {
+    char timeBuffer[32];
+    timePointToString(syncPoint.timePoint, timeBuffer, sizeof(timeBuffer));
+    log("Time (local) for one star alignment: %s", timeBuffer);
+  }
+  baseSyncPoint = syncPoint; // creates syncpoint with no error
+  alignmentChanged();
+  alignment.addReferenceCoord(
+      syncPoint.encoderAltAz,
+      toAlignmentFrame(syncPoint.eqCoord, syncPoint.timePoint,
+                       syncPoint.platformState));
 
   HorizCoord horiz2 = syncPoint.encoderAltAz.addOffset(80, 0);
-  // this is calculated based on current lat long time
+  // this is calculated based on current lat long time, assuming the base
+  // is level when the platform is centred, so is already in the alignment
+  // frame
   EqCoord eq2 = EqCoord(horiz2, syncPoint.timePoint);
   alignment.addReferenceCoord(horiz2, eq2);
 
   alignment.calculateThirdReference();
+  alignmentChanged();
 
   log("===Generated 1 star reference point===");
   log("Point 1: \t\talt: %lf\taz:%lf\tra(h): %lf\tdec:%lf",
@@ -214,7 +366,6 @@ void TelescopeModel::performOneStarAlignment(SynchPoint &syncPoint) {
       syncPoint.eqCoord.getRAInHours(), syncPoint.eqCoord.getDecInDegrees());
   log("Point 2: \t\talt: %lf\taz:%lf\tra(h): %lf\tdec:%lf", horiz2.altInDegrees,
       horiz2.aziInDegrees, eq2.getRAInHours(), eq2.getDecInDegrees());
-  baseSyncPoint = syncPoint; // creates syncpoint with no error
 }
 
 /**
@@ -228,8 +379,14 @@ void TelescopeModel::performZeroedAlignment(TimePoint now) {
   log("Performing zero alignment");
 
   HorizCoord h = HorizCoord(0, 180); // this is if we were pointing south
-  log("Time for zero alignment: %s", timePointToString(now).c_str());
+  if (isLoggingEnabled()) {
+    char timeBuffer[32];
+    timePointToString(now, timeBuffer, sizeof(timeBuffer));
+    log("Time for zero alignment: %s", timeBuffer);
+  }
   EqCoord eq = EqCoord(h, now); // uses Epheremis to calculate.
+  // the horizon as seen: sync points are kept refraction free
+  eq = applyRefraction(eq, now, false);
 
   log("Zero Point: \t\talt: %lf\taz:%lf\tra(h): %lf\tdec:%lf", h.altInDegrees,
       h.aziInDegrees, eq.getRAInHours(), eq.getDecInDegrees());
@@ -282,14 +439,14 @@ void TelescopeModel::performZeroedAlignment(TimePoint now) {
  * are also grounded back to this base syncpoint time.
  *
  */
-void TelescopeModel::addReferencePoints(std::vector<SynchPoint> &points) {
+void TelescopeModel::addReferencePoints(const SynchPointList &points) {
 
   if (points.size() != 2) {
     log("Size of add reference points is %d not 2!", points.size());
     return;
   }
-  SynchPoint point1 = points[0];
-  SynchPoint point2 = points[1];
+  const SynchPoint &point1 = points[0];
+  const SynchPoint &point2 = points[1];
   // SynchPoint point3 = points[2];
 
   log("");
@@ -299,27 +456,21 @@ void TelescopeModel::addReferencePoints(std::vector<SynchPoint> &points) {
   alignment.clean();
   alignment.reset();
 
-  // align all points to same time
+  // align all points to same time, with the platform centred
   baseSyncPoint = point1;
+  alignmentChanged();
   // if p1 is at midnight, and p2 is 60 seconds later
-  // p2DegreeDelta=60
   // point2.eqCoord needs ra adjusted BACK so position
   // is where it was 60 seconds ago.
-  double p1top2TimeInSeconds =
-      differenceInSeconds(point1.timePoint, point2.timePoint);
-  double p2DegreeDelta = secondsToRADeltaInDegrees(p1top2TimeInSeconds);
-
-  EqCoord p2Adjusted = point2.eqCoord.addRAInDegrees(-p2DegreeDelta);
+  EqCoord p1Adjusted = toAlignmentFrame(point1.eqCoord, point1.timePoint,
+                                        point1.platformState);
+  EqCoord p2Adjusted = toAlignmentFrame(point2.eqCoord, point2.timePoint,
+                                        point2.platformState);
 
-  // double p1ToP3TimeInSeconds =
-  //     differenceInSeconds(point1.timePoint, point3.timePoint);
-  // double p3DegreeDelta = secondsToRADeltaInDegrees(p1ToP3TimeInSeconds);
-  // EqCoord p3Adjusted = point3.eqCoord.addRAInDegrees(-p3DegreeDelta);
-
-  alignment.addReferenceCoord(point1.encoderAltAz, point1.eqCoord);
+  alignment.addReferenceCoord(point1.encoderAltAz, p1Adjusted);
   alignment.addReferenceCoord(point2.encoderAltAz, p2Adjusted);
   alignment.calculateThirdReference();
-  // alignment.addReferenceCoord(point3.encoderAltAz, p3Adjusted);
+  alignmentChanged();
 
   log("Calculated model from three references...");
 
@@ -357,9 +508,9 @@ void TelescopeModel::addReferencePoints(std::vector<SynchPoint> &points) {
  * the stars  moving since the model was made. The other points syncpoints
  * are also grounded back to this base syncpoint time.
  *
- * The time of the syncpoints is also adjusted at creation
- * by the sidereal offset of the eq platform, if present, similar
- * to the calculateCurrentPosition logic.
+ * Each syncpoint also records the EQ platform's state, and is brought
+ * back to the platform being centred along with the time shift (see
+ * toAlignmentFrame), the inverse of the calculateCurrentPosition logic.
  *
  * When a third or fourth sync is performed, we only calculate a
  * alt/az adjustment. As the input for this we apply the same
@@ -383,20 +534,21 @@ void TelescopeModel::addReferencePoints(std::vector<SynchPoint> &points) {
  *
  * Point 3:
  * Now we shift the scope another + 10 ra so it is pointing at ra 30.
- * We turn the platform on and wait ten minutes, then platesolve again
+ * We turn the platform on (centred) and wait ten minutes, then platesolve
+ * again.
  *
  * The planet rotates +10 ra, but this is cancelled by the platform, so
  * the scope is still pointing at 30 ra.
  *
- * We do the same math as before: point 3 time-point 1 time = 20-0,
- * and subtract that from point 3 ra to get an ra of 10 degreess to be
- * used in the model.
- *
- * However now the platform emits a delta of -10 minutes to center.
- * This is subtracted from the platesolved ra to get ra 30 to be used in the
- * model. (This is done in platform.calculateAdjustedTime(), and
- * adjusts the timepoint passed into this method before passing)
+ * We do the same math as before: point 3 time-point 1 time = 20-0.
+ * But the platform is now 10 minutes past center, so its ra axis angle
+ * is -10 minutes of ra: the base has been turned west. Both are taken
+ * off the platesolved ra, 30 - (20 - 10), to get the ra of 20 degrees to
+ * be used in the model: where the scope would have pointed at 12:00 am,
+ * platform centred.
  *
+ * A platform that can also tilt about a dec axis has that tilt removed
+ * too, as a rotation about the east point.
  *
  * */
 void TelescopeModel::syncPositionRaDec(float raInHours, float decInDegrees,
@@ -416,12 +568,16 @@ void TelescopeModel::syncPositionRaDec(float raInHours, float decInDegrees,
   lastSyncedEq.setRAInHours(raInHours);
   lastSyncedEq.setDecInDegrees(decInDegrees);
 
-  log("Calculating expected alt az bazed on \tra(degrees): %lf \tdec: %lf "
-      "and  "
-      "time "
-      "%s",
-      lastSyncedEq.getRAInDegrees(), lastSyncedEq.getDecInDegrees(),
-      timePointToString(now).c_str());
+  if (isLoggingEnabled()) {
+    char timeBuffer[32];
+    timePointToString(now, timeBuffer, sizeof(timeBuffer));
+    log("Calculating expected alt az bazed on \tra(degrees): %lf \tdec: %lf "
+        "and  "
+        "time "
+        "%s",
+        lastSyncedEq.getRAInDegrees(), lastSyncedEq.getDecInDegrees(),
+        timeBuffer);
+  }
 
   // HorizCoord modeledAltAz = alignment.toInstrumentCoord(lastSyncedEq);
   // log("Calculated alt/az from model\t\talt: %lf\t\taz:%lf",
@@ -443,7 +599,7 @@ void TelescopeModel::syncPositionRaDec(float raInHours, float decInDegrees,
 
   SynchPoint thisSyncPoint =
       SynchPoint(lastSyncedEq, calculatedAltAzFromEncoders, now,
-                 currentEqPosition, altEnc, azEnc);
+                 currentEqPosition, altEnc, azEnc, platformState);
 
   // compare to last to use for encoder calibration
 
@@ -456,29 +612,7 @@ void TelescopeModel::syncPositionRaDec(float raInHours, float decInDegrees,
   lastSyncPoint = thisSyncPoint;
 
   if (baseAlignmentSynchPoints.size() == 2) {
-    // Adjust time back to model time
-    double basePointToNowTimeInSeconds =
-        differenceInSeconds(baseSyncPoint.timePoint, now);
-    double basePointToNowDeltaInDegrees =
-        secondsToRADeltaInDegrees(basePointToNowTimeInSeconds);
-
-    // where was this point at time of model creation?
-    // basePointToNowDeltaInDegrees is positive as time moves forward
-    // and a fixed alt az point results in ra decreasing over time
-    // so to find ra of point some time ago we add the delta
-    EqCoord adjusted =
-        lastSyncedEq.addRAInDegrees(basePointToNowDeltaInDegrees);
-    log("Adjusted ra (degrees) %lf", adjusted.getRAInDegrees());
-
-    // altDelta and aziDelta will be ADDED to encoder values in
-    // calculateAlzAzFromEncoders.
-    // So if modeled alt encoder is 100, but actualy is 50,
-    // modeleded-alt=50, and when calculating we get the right result.
-    HorizCoord modeledAltAz = alignment.toInstrumentCoord(adjusted);
-    altDelta =
-        modeledAltAz.altInDegrees - calculatedAltAzFromEncoders.altInDegrees;
-    aziDelta =
-        modeledAltAz.aziInDegrees - calculatedAltAzFromEncoders.aziInDegrees;
+    calculateSyncOffsets(lastSyncPoint);
 
     log("3 points in base aligment. Calculated alt offset: %ld and az offset "
         ": "
@@ -508,6 +642,26 @@ void TelescopeModel::syncPositionRaDec(float raInHours, float decInDegrees,
   log("");
 }
 
+/**
+ * The alt/az offsets that put a sync point where the alignment says it
+ * should be, for syncs after the two base points.
+ */
+void TelescopeModel::calculateSyncOffsets(const SynchPoint &point) {
+  // where was this point at time of model creation, with the platform
+  // centred?
+  EqCoord adjusted =
+      toAlignmentFrame(point.eqCoord, point.timePoint, point.platformState);
+  log("Adjusted ra (degrees) %lf", adjusted.getRAInDegrees());
+
+  // altDelta and aziDelta will be ADDED to encoder values in
+  // calculateAlzAzFromEncoders.
+  // So if modeled alt encoder is 100, but actualy is 50,
+  // modeleded-alt=50, and when calculating we get the right result.
+  HorizCoord modeledAltAz = alignment.toInstrumentCoord(adjusted);
+  altDelta = modeledAltAz.altInDegrees - point.encoderAltAz.altInDegrees;
+  aziDelta = modeledAltAz.aziInDegrees - point.encoderAltAz.aziInDegrees;
+}
+
 long TelescopeModel::getAzEncoderStepsPerRevolution() {
   return azEncoderStepsPerRevolution;
 }
@@ -531,13 +685,13 @@ long TelescopeModel::getAltEncoderStepsPerRevolution() {
  * revolution.
  */
 long TelescopeModel::calculateAzEncoderStepsPerRevolution(
-    SynchPoint &startPoint, SynchPoint &endPoint) {
+    const SynchPoint &startPoint, const SynchPoint &endPoint) {
 
-  EqCoord start = startPoint.eqCoord;
-  EqCoord end = endPoint.eqCoord;
+  const EqCoord &start = startPoint.eqCoord;
+  const EqCoord &end = endPoint.eqCoord;
 
   double distance = start.calculateDistanceInDegrees(end);
-  double encoderMove = abs(startPoint.azEncoder - endPoint.azEncoder);
+  double encoderMove = fabs((double)(startPoint.azEncoder - endPoint.azEncoder));
 
   double stepsPerDegree = encoderMove / distance;
   long stepsPerRevolution = stepsPerDegree * 360;
@@ -559,14 +713,15 @@ long TelescopeModel::calculateAzEncoderStepsPerRevolution(
  * altitude revolution.
  */
 long TelescopeModel::calculateAltEncoderStepsPerRevolution(
-    SynchPoint &startPoint, SynchPoint &endPoint) {
+    const SynchPoint &startPoint, const SynchPoint &endPoint) {
 
-  EqCoord start = startPoint.eqCoord;
-  EqCoord end = endPoint.eqCoord;
+  const EqCoord &start = startPoint.eqCoord;
+  const EqCoord &end = endPoint.eqCoord;
 
   double distance = start.calculateDistanceInDegrees(end);
 
-  double encoderMove = abs(startPoint.altEncoder - endPoint.altEncoder);
+  double encoderMove =
+      fabs((double)(startPoint.altEncoder - endPoint.altEncoder));
   double stepsPerDegree = encoderMove / distance;
   long stepsPerRevolution = stepsPerDegree * 360;
   log("Alt Encoder Res Calcs: Distance: %f Encoder Move: %lf Steps per "
@@ -1,14 +1,20 @@
 #ifndef TELESCOPE_MODEL_H
 #define TELESCOPE_MODEL_H
 #include "CoordConv.hpp"
+#include "EncoderScale.h"
 #include "EqCoord.h"
+#include "FixedVector.h"
 #include "HorizCoord.h"
+#include "PlatformKinematics.h"
+#include "PushTo.h"
+#include "Refraction.h"
 #include "TimePoint.h"
 #include <Ephemeris.h>
-#include <vector>
 
 // when adding syncpoints, any existing points closer than this are deleted.
 #define SYNCHPOINT_FILTER_DISTANCE_DEGREES 10
+// max number of syncpoints kept for building the base alignment.
+#define BASE_ALIGNMENT_SYNCHPOINT_CAPACITY 3
 
 struct SynchPoint {
   EqCoord eqCoord;
@@ -16,33 +22,40 @@ struct SynchPoint {
   TimePoint timePoint;
   double errorInDegreesAtCreation;
   bool isValid;
-  long altEncoder;
-  long azEncoder;
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  PlatformState platformState;
 
   SynchPoint()
       : errorInDegreesAtCreation(0), isValid(false) {
   } // Initialize members as needed
 
   SynchPoint(const EqCoord &eq, const HorizCoord &encoderHorizontal,
-             const TimePoint &tp, const EqCoord &calculatedeq,long altEncoder,long azEncoder)
+             const TimePoint &tp, const EqCoord &calculatedeq,EncoderCount altEncoder,EncoderCount azEncoder,
+             const PlatformState &state = PlatformState())
       : eqCoord(eq), encoderAltAz(encoderHorizontal), timePoint(tp),
-        isValid(true),altEncoder(altEncoder),azEncoder(azEncoder) {
+        isValid(true),altEncoder(altEncoder),azEncoder(azEncoder),
+        platformState(state) {
     errorInDegreesAtCreation = eq.calculateDistanceInDegrees(calculatedeq);
   }
 };
 
+typedef FixedVector<SynchPoint, BASE_ALIGNMENT_SYNCHPOINT_CAPACITY>
+    SynchPointList;
+
 /**
  *  This class does the heavy lifting of modeling where the telescope
  * is pointing, and storing its internal state. It uses Taki Toshimi's
  * 2 star alignment method (code taken from teenastro), and models the
- * equatorial platform state as a simple offset to in and out ra values.
+ * equatorial platform as a rotation of the dob's base (see
+ * PlatformKinematics).
  *
  * General use cases are:
  * 0) Initialisation. Model is initialised with either saved transformation
  *    matrix, or default reference points.
  * 1) Basic ra/dec sync. Call:
  *    - setEncoderValues() with current encoder values, then
- *    - setRaOffset() with number of seconds in RA ahead/behind (EQ platform)
+ *    - setPlatformState() with the EQ platform's axis angles
  *    - setPositionRADec() with where the scope is currently pointing.
  *    setPositionRADec takes current ra and dec, and current time.
  *    These are stored, along with current encoder values, and raoffset.
@@ -60,7 +73,7 @@ struct SynchPoint {
  *       as per next section
  * 2) Rebuild matrix. Call:
  *    - setEncoderValues()
- *    - setPlatformRAOffset() with number of seconds in RA ahead/behind
+ *    - setPlatformState()
  *    - setPositionRADec()
  *    - addReferencePoint()
  *    Twice. AddReferencePoint will take the last position calculated.
@@ -71,10 +84,18 @@ struct SynchPoint {
  *    in from setPosition?
  * 3) Find current position. Call:
  *    - setEncoderValues()
- *    - setPlatformRAOffset() with number of seconds in RA ahead/behind
+ *    - setPlatformState()
  *    - calculateCurrentPosition() with current time
  *    This will invoke convert the encoder values to alt/az, then invoke the
- *    transformation matrix to derive ra/dec. ra will be adjust based on offset
+ *    transformation matrix to derive ra/dec. ra will be adjusted for time and
+ *    platform state
+ *
+ * Refraction: the encoders see the sky as refracted, ra/dec in and out are
+ * true positions. With doesRefraction on (the default) the alignment is
+ * built against where sync points appeared in the sky, and refraction is
+ * taken back off every position calculated. Sync points themselves are
+ * stored refraction free, so the alignment is rebuilt from them when
+ * refraction is switched or its conditions change.
  *
  *
  *
@@ -87,21 +108,19 @@ class TelescopeModel {
 public:
   TelescopeModel();
 
-  std::vector<SynchPoint> baseAlignmentSynchPoints;
+  SynchPointList baseAlignmentSynchPoints;
   EqCoord currentEqPosition;
   SynchPoint lastSyncPoint;
 
   void clearAlignment();
   void syncPositionRaDec(float raInHours, float decInDegrees, TimePoint &tp);
 
-  std::vector<SynchPoint> findFarthest(SynchPoint &sp,
-                                       std::vector<SynchPoint> &baseSyncPoints);
-
-  void performOneStarAlignment(SynchPoint &point);
+  void performOneStarAlignment(const SynchPoint &point);
 
   void calculateCurrentPosition(TimePoint &tp);
 
-  void setEncoderValues(long encAlt, long encAz);
+  void setEncoderValues(EncoderCount encAlt, EncoderCount encAz);
+  void setPlatformState(const PlatformState &state);
   void setAzEncoderStepsPerRevolution(long altResolution);
   void setAltEncoderStepsPerRevolution(long altResolution);
   long getAzEncoderStepsPerRevolution();
@@ -109,9 +128,19 @@ public:
 
   void performZeroedAlignment(TimePoint now);
 
+  bool calculatePushToTrack(double raHours, double decDegrees,
+                            TimePoint start, const PlatformState &platform,
+                            PushToTrack &track);
+
   void setLatitude(float lat);
   void setLongitude(float lng);
 
+  void setDoesRefraction(bool enabled);
+  bool getDoesRefraction() const { return doesRefraction; }
+  void setRefractionConditions(float temperatureCelsius,
+                               float pressureMillibars);
+  const RefractionTable &getRefraction() const { return refraction; }
+
   float getLatitude();
   float getLongitude();
 
@@ -129,32 +158,47 @@ private:
   float latitude;
   float longitude;
 
-  long altEnc;
-  long azEnc;
+  EncoderCount altEnc;
+  EncoderCount azEnc;
   //deltas get added to calculated alt/azi values for fine model adjustments
   double altDelta;
   double aziDelta;
   long azEncoderStepsPerRevolution;
   long altEncoderStepsPerRevolution;
+  EncoderScale altScale; // from the steps per revolution
+  EncoderScale azScale;
 
   CoordConv alignment;
   SynchPoint baseSyncPoint;
+  PlatformState platformState;
+  PlatformKinematics kinematics;
+  RefractionTable refraction;
+  bool doesRefraction;
 
   bool defaultAlignment;
   float currentAlt;
   float currentAz;
   double secondsToRADeltaInDegrees(double secondsDelta);
+  double raShiftInDegrees(TimePoint tp, const PlatformState &state);
+  EqCoord toAlignmentFrame(const EqCoord &eq, TimePoint tp,
+                           const PlatformState &state);
+  EqCoord applyRefraction(const EqCoord &eq, TimePoint tp, bool toApparent);
+  void alignmentChanged();
+  void rebuildAlignment();
+  void calculateSyncOffsets(const SynchPoint &point);
   void performBaselineAlignment();
-  void calculateEncoderOffsetFromAltAz(float alt, float az, long altEncVal,
-                                       long azEncVal, long &altEncOffset,
-                                       long &azEncOffset);
-  HorizCoord calculateAltAzFromEncoders(long altEncVal, long azEncVal);
-
-    void addReferencePoints(std::vector<SynchPoint> & points);
-    long calculateAzEncoderStepsPerRevolution(SynchPoint & startPoint,
-                                              SynchPoint & endPoint);
-    long calculateAltEncoderStepsPerRevolution(SynchPoint & startPoint,
-                                               SynchPoint & endPoint);
+  void calculateEncoderOffsetFromAltAz(float alt, float az,
+                                       EncoderCount altEncVal,
+                                       EncoderCount azEncVal,
+                                       long &altEncOffset, long &azEncOffset);
+  HorizCoord calculateAltAzFromEncoders(EncoderCount altEncVal,
+                                        EncoderCount azEncVal);
+
+    void addReferencePoints(const SynchPointList &points);
+    long calculateAzEncoderStepsPerRevolution(const SynchPoint &startPoint,
+                                              const SynchPoint &endPoint);
+    long calculateAltEncoderStepsPerRevolution(const SynchPoint &startPoint,
+                                               const SynchPoint &endPoint);
   };
 
 #endif
@@ -0,0 +1,159 @@
+#include "WebAssets.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+WebAssetTable::WebAssetTable() : count(0) {}
+
+// copies the next space separated field into out, false if missing or
+// too long
+static bool nextField(const char *&cursor, const char *end, char *out,
+                      size_t outSize) {
+  while (cursor < end && *cursor == ' ') {
+    cursor++;
+  }
+  const char *start = cursor;
+  while (cursor < end && *cursor != ' ') {
+    cursor++;
+  }
+  size_t length = cursor - start;
+  if (length == 0 || length >= outSize) {
+    return false;
+  }
+  memcpy(out, start, length);
+  out[length] = 0;
+  return true;
+}
+
+int WebAssetTable::parseManifest(const char *text, size_t length) {
+  count = 0;
+  const char *cursor = text;
+  const char *textEnd = text + length;
+  while (cursor < textEnd) {
+    const char *lineEnd = cursor;
+    while (lineEnd < textEnd && *lineEnd != '\n') {
+      lineEnd++;
+    }
+    const char *end = lineEnd;
+    if (end > cursor && end[-1] == '\r') {
+      end--;
+    }
+    if (end > cursor && *cursor != '#') {
+      if (count == WEB_ASSET_CAPACITY) {
+        count = 0;
+        return -1;
+      }
+      WebAsset &asset = assets[count];
+      char size[12];
+      char immutable[4];
+      if (!nextField(cursor, end, asset.url, sizeof(asset.url)) ||
+          !nextField(cursor, end, asset.file, sizeof(asset.file)) ||
+          !nextField(cursor, end, asset.etag, sizeof(asset.etag)) ||
+          !nextField(cursor, end, asset.contentType,
+                     sizeof(asset.contentType)) ||
+          !nextField(cursor, end, size, sizeof(size)) ||
+          !nextField(cursor, end, immutable, sizeof(immutable))) {
+        count = 0;
+        return -1;
+      }
+      asset.size = strtoul(size, nullptr, 10);
+      asset.immutable = immutable[0] == '1';
+      count++;
+    }
+    cursor = lineEnd + 1;
+  }
+  return count;
+}
+
+const WebAsset *WebAssetTable::find(const char *url) const {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(assets[i].url, url) == 0) {
+      return &assets[i];
+    }
+  }
+  return nullptr;
+}
+
+bool webAssetEtagMatches(const char *ifNoneMatch, const char *etag) {
+  if (ifNoneMatch == nullptr || etag == nullptr) {
+    return false;
+  }
+  size_t etagLength = strlen(etag);
+  const char *cursor = ifNoneMatch;
+  while (*cursor) {
+    while (*cursor == ' ' || *cursor == ',') {
+      cursor++;
+    }
+    if (*cursor == '*') {
+      return true;
+    }
+    // weak comparison, as If-None-Match uses
+    if (cursor[0] == 'W' && cursor[1] == '/') {
+      cursor += 2;
+    }
+    const char *start = cursor;
+    while (*cursor && *cursor != ',' && *cursor != ' ') {
+      cursor++;
+    }
+    if ((size_t)(cursor - start) == etagLength &&
+        strncmp(start, etag, etagLength) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// digits only, no sign or spaces; false if none or it overflows
+static bool parseOffset(const char *&cursor, uint32_t &value) {
+  const char *start = cursor;
+  uint64_t result = 0;
+  while (*cursor >= '0' && *cursor <= '9') {
+    result = result * 10 + (*cursor - '0');
+    if (result > 0xffffffffULL) {
+      return false;
+    }
+    cursor++;
+  }
+  value = (uint32_t)result;
+  return cursor > start;
+}
+
+WebAssetRangeResult parseWebAssetRange(const char *header, uint32_t size,
+                                       uint32_t &start, uint32_t &end) {
+  const char prefix[] = "bytes=";
+  if (header == nullptr || strncmp(header, prefix, sizeof(prefix) - 1) != 0 ||
+      strchr(header, ',') != nullptr) {
+    return WEB_ASSET_RANGE_NONE;
+  }
+  const char *cursor = header + sizeof(prefix) - 1;
+  uint32_t first = 0;
+  uint32_t last = 0;
+  if (*cursor == '-') {
+    // suffix: the last n bytes
+    cursor++;
+    uint32_t suffix;
+    if (!parseOffset(cursor, suffix) || *cursor != 0) {
+      return WEB_ASSET_RANGE_NONE;
+    }
+    if (suffix == 0 || size == 0) {
+      return WEB_ASSET_RANGE_UNSATISFIABLE;
+    }
+    start = suffix >= size ? 0 : size - suffix;
+    end = size - 1;
+    return WEB_ASSET_RANGE_PARTIAL;
+  }
+  if (!parseOffset(cursor, first) || *cursor != '-') {
+    return WEB_ASSET_RANGE_NONE;
+  }
+  cursor++;
+  bool open = *cursor == 0;
+  if (!open && (!parseOffset(cursor, last) || *cursor != 0 || last < first)) {
+    return WEB_ASSET_RANGE_NONE;
+  }
+  if (first >= size) {
+    return WEB_ASSET_RANGE_UNSATISFIABLE;
+  }
+  start = first;
+  end = open || last >= size ? size - 1 : last;
+  return WEB_ASSET_RANGE_PARTIAL;
+}
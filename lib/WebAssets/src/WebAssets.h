@@ -0,0 +1,78 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Written by tools/build_webui.py next to the compressed assets
+#define WEB_ASSET_MANIFEST "manifest.txt"
+#define WEB_ASSET_CAPACITY 8
+#define WEB_ASSET_URL_SIZE 48
+#define WEB_ASSET_FILE_SIZE 48
+#define WEB_ASSET_ETAG_SIZE 20 // 16 hex digits, quotes and the nul
+#define WEB_ASSET_TYPE_SIZE 32
+
+// Fingerprinted assets never change under the same url
+#define WEB_ASSET_IMMUTABLE_CACHE_CONTROL "public, max-age=31536000, immutable"
+// The entry page keeps its url, so browsers check back every time (a 304
+// when nothing has changed)
+#define WEB_ASSET_REVALIDATE_CACHE_CONTROL "no-cache"
+
+/**
+ * One precompressed WebUI file: served gzip encoded from file, under url.
+ */
+struct WebAsset {
+  char url[WEB_ASSET_URL_SIZE];
+  char file[WEB_ASSET_FILE_SIZE]; // relative to the asset directory
+  char etag[WEB_ASSET_ETAG_SIZE]; // quoted, ready for the header
+  char contentType[WEB_ASSET_TYPE_SIZE];
+  uint32_t size; // compressed
+  bool immutable;
+};
+
+/**
+ * The assets tools/build_webui.py produced, looked up by url for each
+ * request. Filled once at startup from the manifest, so serving a file
+ * needs no directory listing, stat or hashing.
+ *
+ * Manifest lines are "url file etag type size immutable", space separated;
+ * blank lines and lines starting with # are skipped.
+ */
+class WebAssetTable {
+public:
+  WebAssetTable();
+
+  // Replaces the table. Returns the number of assets read, or -1 if a line
+  // is malformed or there are more than WEB_ASSET_CAPACITY.
+  int parseManifest(const char *text, size_t length);
+
+  const WebAsset *find(const char *url) const;
+  size_t size() const { return count; }
+
+private:
+  WebAsset assets[WEB_ASSET_CAPACITY];
+  size_t count;
+};
+
+/**
+ * True if an If-None-Match header value names etag: "*", or etag in a comma
+ * separated list, weak (W/) or not.
+ */
+bool webAssetEtagMatches(const char *ifNoneMatch, const char *etag);
+
+enum WebAssetRangeResult {
+  WEB_ASSET_RANGE_NONE,         // no (usable) Range header: send it all
+  WEB_ASSET_RANGE_PARTIAL,      // 206 with start..end
+  WEB_ASSET_RANGE_UNSATISFIABLE // 416
+};
+
+/**
+ * A single "bytes=" range against a file of size bytes, end inclusive.
+ * "bytes=a-b", "bytes=a-" and "bytes=-n" (the last n) are understood.
+ * Multiple ranges and other units are answered with the whole file, which
+ * RFC 9110 allows.
+ */
+WebAssetRangeResult parseWebAssetRange(const char *header, uint32_t size,
+                                       uint32_t &start, uint32_t &end);
+
+#endif
@@ -1,141 +1,201 @@
 #include "EQPlatform.h"
 
 #include "Logging.h"
+#include "Metrics.h"
+#include "PlatformPacket.h"
 #include "TimePoint.h"
 #include "WiFi.h"
-#include <ArduinoJson.h>
 
 #define IPBROADCASTPERIOD 10000
 #define IPBROADCASTPORT 50375
-#define STALE_EQ_WARNING_THRESHOLD_SECONDS 10 // used to detect packet loss
 
-TimePoint lastPositionReceivedTime;
-// TODO #2 make sendEQCommand private, and expose the command directly. Better
-// encapsulation
-void EQPlatform::sendEQCommand(String command, double parm1, double parm2) {
+/**
+ * Queue a command on the channel and send it straight away. key is set
+ * for commands that replace earlier ones of the same kind, timed for ones
+ * whose parameters are millis from now (see CommandChannel).
+ */
+void EQPlatform::sendEQCommand(const char *command, double parm1,
+                               double parm2, const char *key, bool timed) {
+  std::lock_guard<std::mutex> guard(commandLock);
+  if (timed) {
+    commands.queueTimed(command, parm1, parm2, key, getNow());
+  } else {
+    commands.queue(command, parm1, parm2, key, getNow());
+  }
+  flushCommands();
+}
+
+/**
+ * Everything due on the channel: new commands and resends. Unicast once
+ * the platform has been heard from, broadcast until then so it can be
+ * found. Call with commandLock held.
+ */
+void EQPlatform::flushCommands() {
   // Check if the device is connected to the WiFi
   if (WiFi.status() != WL_CONNECTED) {
     return;
   }
-  if (eqUDPOut.connect(
-          IPAddress(255, 255, 255, 255),
-          IPBROADCASTPORT)) { // Choose any available port, e.g., 12345
-    char response[400];
-
-    // Estimate JSON capacity
-    const size_t capacity = JSON_OBJECT_SIZE(4);
-
-    DynamicJsonDocument doc(capacity);
-    // Populate the JSON object
-    doc["command"] = command;
-    doc["parameter1"] = parm1;
-    doc["parameter2"] = parm2;
-
-    String json;
-    serializeJson(doc, json);
-    json = "EQ:" + json;
-    eqUDPOut.print(json.c_str());
-
-    log("EQ Command command sent %s", json);
+  char packet[COMMAND_PACKET_SIZE];
+  size_t length;
+  while (commands.nextPacket(getNow(), packet, sizeof(packet), length)) {
+    if (platformAddressKnown) {
+      eqUDPOut.writeTo((const uint8_t *)packet, length, platformAddress,
+                       IPBROADCASTPORT);
+    } else {
+      eqUDPOut.broadcastTo((uint8_t *)packet, length, IPBROADCASTPORT);
+    }
+    log("EQ Command command sent %s", packet);
   }
 }
 
+// network task, every iteration: resends anything not acked in time
+void EQPlatform::serviceCommands() {
+  std::lock_guard<std::mutex> guard(commandLock);
+  flushCommands();
+}
+
 void EQPlatform::park() { sendEQCommand("park", 0, 0); }
 void EQPlatform::findHome() { sendEQCommand("home", 0, 0); }
+/**
+ * Rate in degrees/sec, on top of tracking. Positive turns the base east
+ * (ra axis) or tilts it north (dec axis), as PlatformState.
+ */
 void EQPlatform::moveAxis(int axis, double rate) {
   // 0 axis = ra
   // 1 axis= dec
-  sendEQCommand("moveaxis", axis,rate);
+  sendEQCommand("moveaxis", axis, rate, axis == 0 ? "moveaxis0" : "moveaxis1");
+}
+
+void EQPlatform::slewTo(double raHours, double decDegrees) {
+  slew.requestSlew(raHours, decDegrees);
+}
+
+void EQPlatform::abortSlew(bool stopAxes) { slew.requestAbort(stopAxes); }
+
+/**
+ * One closed loop slew step, from the slew task. Only axes whose rate
+ * changed are sent, so a slew at full speed is quiet on the network.
+ */
+void EQPlatform::controlSlew(double raHours, double decDegrees) {
+  PlatformTelemetry latest = telemetry.read();
+  SlewFeedback feedback;
+  feedback.raHours = raHours;
+  feedback.decDegrees = decDegrees;
+  feedback.platformTime = latest.receivedTime;
+  feedback.maxRate = latest.axisMoveRateMax;
+  feedback.hasDecAxis = latest.hasDecAxis;
+  TimePoint now = getNow();
+  feedback.connected = isPlatformConnected(latest, now);
+
+  SlewRates before = slew.getStatus().rates;
+  SlewRates rates;
+  if (slew.tick(feedback, now, rates)) {
+    if (rates.ra != before.ra) {
+      moveAxis(0, rates.ra);
+    }
+    if (rates.dec != before.dec) {
+      moveAxis(1, rates.dec);
+    }
+  }
 }
 
 void EQPlatform::slewByDegrees(int axis,double degreesToSlew) {
   //0 axis = ra
   //1 axis= dec
   sendEQCommand("slewbydegrees",axis, degreesToSlew);
-  slewing = true;
+  slewRequested = true;
+  stateVersion++;
 }
 void EQPlatform::setTracking(int tracking) {
-  sendEQCommand("track", tracking, 0);
+  sendEQCommand("track", tracking, 0, "track");
+}
+
+/**
+ * Platforms that don't ack yet have older firmware, which only knows
+ * pulseguide, one direction at a time: they get each request as it comes,
+ * as they always did. The scheduler still tracks when it ends.
+ */
+bool EQPlatform::pulseGuide(int direction, long duration) {
+  if (!pulseGuides.requestPulse(direction, duration, getNow())) {
+    return false;
+  }
+  if (!platformAcks()) {
+    sendEQCommand("pulseguide", direction, duration);
+  }
+  return true;
+}
+
+bool EQPlatform::isPulseGuiding() const {
+  return pulseGuides.isPulseGuiding(getNow());
+}
+
+bool EQPlatform::platformAcks() {
+  std::lock_guard<std::mutex> guard(commandLock);
+  return commands.getPlatformAcks();
 }
 
-void EQPlatform::pulseGuide(int direction, long duration) {
-  sendEQCommand("pulseguide", direction, duration);
+/**
+ * Both axes in one packet: the pulse each should be doing from now, in
+ * millis, positive east/north. Replaces any pulse in progress. Only for
+ * platforms that understand it (see pulseGuide).
+ */
+void EQPlatform::runPulseGuides() {
+  PulseGuideCommand command;
+  if (pulseGuides.tick(getNow(), command) && platformAcks()) {
+    sendEQCommand("pulseguideaxes", command.raMillis, command.decMillis,
+                  "pulseguide", true);
+  }
 }
 
 void EQPlatform::zeroOffsetTime() { sendEQCommand("zerooffset", 0, 0); }
 
 void EQPlatform::processPacket(AsyncUDPPacket &packet) {
-  unsigned long now = millis();
-  String start = packet.readStringUntil(':');
-
-  // String msg = packet.readStringUntil('\n');
-
-  // log("UDP Broadcast received: %s", msg.c_str());
-  if (start == "DSC") {
-    // Check if the broadcast is from EQ Platform
-    // if (msg.startsWith("EQ:")) {
-
-    // msg = msg.substring(3);
-    // log("Got payload from eq plaform %s",msg.c_str());
-
-    // Create a JSON document to hold the payload
-    const size_t capacity =
-        JSON_OBJECT_SIZE(9) + 100; // Reserve some memory for the JSON document
-    StaticJsonDocument<capacity> doc;
-
-    DeserializationError error = deserializeJson(doc, packet);
-    // Deserialize the JSON payload
-    // DeserializationError error = deserializeJson(doc, msg);
-    if (error) {
-      log("Failed to parse payload with error %s", error.c_str());
-      // log("Failed to parse payload %s with error %s", msg.c_str(),
-      //     error.c_str());
-      return;
-    }
+  // on async_udp, which isn't pinned to a core
+  METRICS_SCOPE_UNPINNED(METRIC_EQ_PACKET);
+  PlatformPacket parsed;
+  if (!parsePlatformPacket(packet.data(), packet.length(), getNow(),
+                           parsed)) {
+    return;
+  }
+  // parsed here, counted and published by servicePackets
+  IPAddress remoteIp = packet.remoteIP();
+  snprintf(parsed.telemetry.ip, sizeof(parsed.telemetry.ip), "%s",
+           remoteIp.toString().c_str());
+  if (!packets.push(parsed.telemetry)) {
+    log("Platform packet queue full, dropping packet");
+  }
+  {
+    std::lock_guard<std::mutex> guard(commandLock);
+    commands.setPlatformAcks(parsed.acks);
+    commands.onAck(parsed.ack, parsed.ackBits);
+    platformAddress = remoteIp;
+    platformAddressKnown = true;
+  }
+}
 
-    if (doc.containsKey("timeToCenter") && doc.containsKey("timeToEnd") &&
-        doc.containsKey("axisMoveRateMax") &&
-        doc.containsKey("axisMoveRateMin") &&
-        doc.containsKey("guideMoveRate") && doc.containsKey("trackingRate") &&
-        doc.containsKey("slewing") && doc.containsKey("isTracking") &&
-        doc["timeToCenter"].is<double>() && doc["guideMoveRate"].is<double>() &&
-        doc["axisMoveRateMax"].is<double>() &&
-        doc["axisMoveRateMin"].is<double>() &&
-        doc["trackingRate"].is<double>() && doc["timeToEnd"].is<double>()) {
-      runtimeFromCenterSeconds = doc["timeToCenter"];
-
-      timeToEnd = doc["timeToEnd"];
-      currentlyRunning = doc["isTracking"];
-      slewing = doc["slewing"];
-      pulseGuideRate = doc["guideMoveRate"];
-      axisMoveRateMax = doc["axisMoveRateMax"];
-      axisMoveRateMin = doc["axisMoveRateMin"];
-      trackingRate = doc["trackingRate"];
-      lastPositionReceivedTime = getNow();
-
-      if (eqPlatformIP == "") {
-
-        IPAddress remoteIp = packet.remoteIP();
-
-        // Convert the IP address to a string
-        eqPlatformIP = remoteIp.toString();
-      }
-      // log("Distance from center %lf, platformResetOffsetSeconds %lf,running
-      // %d",
-      //     runtimeFromCenterSeconds,
-      //     platformResetOffsetSeconds,currentlyRunning);
-    } else {
-      log("Payload missing required fields.");
-      return;
+void EQPlatform::servicePackets() {
+  PlatformTelemetry parsed;
+  while (packets.pop(parsed)) {
+    PlatformTelemetry latest = telemetry.read();
+    bool wasRunning = latest.currentlyRunning;
+    bool wasSlewing = latest.slewing;
+    parsed.packetCount = latest.packetCount + 1;
+    // the first platform heard from
+    if (latest.ip[0] != 0) {
+      memcpy(parsed.ip, latest.ip, sizeof(parsed.ip));
+    }
+    telemetry.write(parsed);
+    // platform has now told us whether it is slewing
+    bool wasRequested = slewRequested.exchange(false);
+    // only after the new values are visible
+    if (wasRequested || parsed.currentlyRunning != wasRunning ||
+        parsed.slewing != wasSlewing) {
+      stateVersion++;
     }
-  } else {
-    log("Message has bad starting chars");
   }
 }
 
 void EQPlatform::setupEQListener() {
-  eqPlatformIP = "";
-
   // set up listening for ip address from eq platform
 
   // Initialize UDP to listen for broadcasts.
@@ -147,77 +207,39 @@ void EQPlatform::setupEQListener() {
   }
 }
 
-void EQPlatform::checkConnectionStatus() {
-  TimePoint now = getNow();
-  if (differenceInSeconds(lastPositionReceivedTime, now) >
-      STALE_EQ_WARNING_THRESHOLD_SECONDS) {
-    platformConnected = false;
-  } else {
-    platformConnected = true;
-  }
+PlatformTelemetry EQPlatform::getTelemetry() const { return telemetry.read(); }
+
+bool EQPlatform::isConnected() const {
+  return isPlatformConnected(telemetry.read(), getNow());
+}
+
+bool EQPlatform::isSlewing() const {
+  return slew.isSlewing() || slewRequested || telemetry.read().slewing;
 }
 
 /**
- * Returns an time (epoch in millis) to be used for model calculations.
- * This is obstensibly the time that the platform is
- * as the middle of the run, it can be in the past or in the future.
+ * Returns the platform's axis angles to be used for model calculations,
+ * for right now. The ra axis angle is worked out from the time the
+ * platform says it has to go to the middle of the run.
  *
- * The platform emits runtimeFromCenterSeconds, which is how many
- * seconds the platform will take to reach the center (reference)
- * point. When the platform is running, this number is reducing
- * at the same rate time is moving forward, so the reference time
- * point stays the same, so the scope keeps pointing at the same ra
- * if alt/azi do not change.
- *
- * When the platform stops, this number stays static but time moves
- * on, so ra changes over time.
- *
- * As the platform emits position periodically, we interpolate values for
- * runtimeFromCenterSeconds here to try to get sub second accuracy.
- * (If we don't do this, we see drift that resets pericodically as
- * platform pulses an update.)
+ * Reads one telemetry snapshot, so the time to center and the time it was
+ * received always come from the same packet. The calculation itself is in
+ * lib/EQPlatform so it can be tested natively.
  * If we ever add other tracking rates, this may be wrong, but the
  * error should be marginal.
  *
  */
-TimePoint EQPlatform::calculateAdjustedTime() {
-  TimePoint now = getNow();
-  //TODO not sure why this is here anymore
-  checkConnectionStatus();
-  // log("Calculating  adjusted time from (now): %s",
-  //     timePointToString(now).c_str());
-  // unsigned long now = millis();
-  // log("Now millis since start: %ld", now);
-
-  // if platform is running, then it has moved on since packet
-  // recieved. The time since the packet received needs to be added to
-  // the timeToCenter.
-  // eg if time to center is 100s, and packet was received a second ago,
-  // time to center should be considered as 99s.
-  double interpolationTimeSeconds = 0;
-  if (currentlyRunning) {
-    // log("setting interpolation time");
-    interpolationTimeSeconds =
-        differenceInSeconds(lastPositionReceivedTime, now);
-  }
-  TimePoint adjustedTime = addSecondsToTime(now, runtimeFromCenterSeconds -
-                                                     interpolationTimeSeconds);
-
-  // log("Returned adjusted time: %s from now : %s",
-  //     timePointToString(adjustedTime).c_str(),
-  //     timePointToString(now).c_str());
-  return adjustedTime;
+PlatformState EQPlatform::calculatePlatformState() {
+  return ::calculatePlatformState(telemetry.read(), getNow());
 }
 /**
  * Checked before calc
  */
 
-EQPlatform::EQPlatform() {
-  eqPlatformIP = "";
-
-  lastPositionReceivedTime = getNow();
-  currentlyRunning = false;
-  platformConnected = false;
-
-  runtimeFromCenterSeconds = 0;
+EQPlatform::EQPlatform()
+    : slewRequested(false), stateVersion(0), platformAddressKnown(false) {
+  PlatformTelemetry initial = PlatformTelemetry();
+  // treat as connected until we've waited a while for the first packet
+  initial.receivedTime = getNow();
+  telemetry.write(initial);
 }
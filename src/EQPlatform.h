@@ -1,44 +1,90 @@
 #ifndef EQPLATFORM
 #define EQPLATFORM
 #include "AsyncUDP.h"
+#include "CommandChannel.h"
+#include "PlatformTelemetry.h"
+#include "PulseGuide.h"
+#include "SeqLock.h"
+#include "SlewController.h"
+#include "SpscQueue.h"
 #include "TimePoint.h"
+#include <atomic>
+#include <mutex>
+
+// packets come every second or so, and are published every
+// NETWORK_TASK_PERIOD_MS
+#define PLATFORM_PACKET_QUEUE_SIZE 4
 
 class EQPlatform {
 public:
   EQPlatform();
 
   void setupEQListener();
-  void checkConnectionStatus();
-  TimePoint calculateAdjustedTime();
+  PlatformState calculatePlatformState();
+
+  // Consistent copy of the latest telemetry, safe to call from any task.
+  PlatformTelemetry getTelemetry() const;
+  bool isConnected() const;
+  bool isSlewing() const;
+  // Bumped whenever tracking or slewing changes, so cached replies can
+  // tell they're stale. Both counters only go up, so neither can hide a
+  // change in the other.
+  uint32_t getStateVersion() const {
+    return stateVersion + slew.getPhaseVersion();
+  }
+  double getSlewSettleSeconds() const {
+    return slew.getSettings().settleSeconds;
+  }
 
   void park();
   void findHome();
   void moveAxis(int axis,double rate);
   void slewByDegrees(int axis, double degreesToSlew);
+  // closed loop, see SlewController
+  void slewTo(double raHours, double decDegrees);
+  void abortSlew(bool stopAxes = true);
+  // slew task only, with the latest model position
+  void controlSlew(double raHours, double decDegrees);
   void setTracking(int tracking);
-  void pulseGuide(int direction, long duration);
+  // queued, see PulseGuideScheduler. False if direction or duration is bad
+  bool pulseGuide(int direction, long duration);
+  bool isPulseGuiding() const;
+  // network task only: sends any new pulses in one packet
+  void runPulseGuides();
+  // network task only: resends unacked commands
+  void serviceCommands();
+  // network task only: publishes the packets the AsyncUDP callback queued
+  void servicePackets();
   void zeroOffsetTime();
 
-  double runtimeFromCenterSeconds;
-
-
-  String eqPlatformIP;
-  double timeToEnd;
-  bool currentlyRunning;
-  bool platformConnected;
-  bool slewing;
-  double pulseGuideRate;//degrees/sec
-  double axisMoveRateMax;
-  double axisMoveRateMin;
-   double trackingRate;
-   
-
-
 private:
   AsyncUDP eqUDPOut;
   AsyncUDP eqUdpIn;
+  /**
+   * Parsed in the AsyncUDP callback, which isn't pinned to a core, and
+   * published from the network task, which is: so the model task on core
+   * 1 never waits on a write it preempted.
+   */
+  SpscQueue<PlatformTelemetry, PLATFORM_PACKET_QUEUE_SIZE> packets;
+  // written only from the network task
+  SeqLock<PlatformTelemetry> telemetry;
+  // set by slewByDegrees until the platform reports back
+  std::atomic<bool> slewRequested;
+  std::atomic<uint32_t> stateVersion;
+  SlewController slew;
+  PulseGuideScheduler pulseGuides;
+  // commands are sent from the handlers, the slew and network tasks, and
+  // acked from the AsyncUDP callback. Held only to queue and send.
+  std::mutex commandLock;
+  CommandChannel commands;
+  IPAddress platformAddress;
+  bool platformAddressKnown;
   void processPacket(AsyncUDPPacket &packet);
-  void sendEQCommand(String command, double parm1, double parm2);
+  void sendEQCommand(const char *command, double parm1, double parm2,
+                     const char *key = nullptr, bool timed = false);
+  void flushCommands();
+  // new enough firmware to ack, and to take pulseguideaxes
+  bool platformAcks();
 };
 
 #endif
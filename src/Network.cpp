@@ -1,4 +1,5 @@
 #include "Network.h"
+#include "BootTimeline.h"
 #include "Logging.h"
 #include <WiFiManager.h>
 
@@ -11,6 +12,17 @@
 #define ESPWIFISSID "ESPWIFISSID"
 #define ESPWIFIPASS "ESPWIFIPASS"
 
+// the last network connected to (its SSID key), and the access point and
+// channel it was on, for fastConnect
+#define LASTWIFINETWORK "WIFILASTNET"
+#define LASTWIFIBSSID "WIFILASTBSSID"
+#define LASTWIFICHANNEL "WIFILASTCHAN"
+#define BSSID_SIZE 6
+
+#define WIFI_TASK_STACK_SIZE 4096
+#define WIFI_TASK_PRIORITY 1
+#define WIFI_TASK_CORE 0
+
 WiFiManager wifiManager;
 
 /*
@@ -84,32 +96,90 @@ void Network::storeESP32WifiCreds(String ssid, String pw) {
   storeWifiCreds(ssid, pw, ESPWIFISSID, ESPWIFIPASS);
 }
 
-void Network::connectToWiFi(WiFiNetwork &network) {
+/*
+ * Connects to a network, on the given access point and channel if they're
+ * known (0 and nullptr if not), waiting at most timeoutMs.
+ */
+bool Network::connectToWiFi(WiFiNetwork &network, int32_t channel,
+                            const uint8_t *bssid, uint32_t timeoutMs) {
   String ssid = preferences.getString(network.ssidKey);
   String password = preferences.getString(network.passwordKey);
 
   if (ssid.length() == 0 || password.length() == 0) {
     log("SSID or password not stored on ESP32, please set");
-    return;
+    return false;
   }
 
   if (!WiFi.config(network.local_IP, network.gateway, network.subnet,
                    network.primaryDNS)) {
     log("WIFI Failed to configure");
-    return;
+    return false;
   }
 
-  WiFi.begin(ssid.c_str(), password.c_str());
+  WiFi.begin(ssid.c_str(), password.c_str(), channel, bssid);
 
+  uint32_t start = millis();
   while (WiFi.status() != WL_CONNECTED) {
-    delay(1000);
-    log("Waiting for connection to %s...", ssid.c_str());
+    if (millis() - start >= timeoutMs) {
+      log("No connection to %s after %lums", ssid.c_str(),
+          (unsigned long)timeoutMs);
+      WiFi.disconnect();
+      return false;
+    }
+    delay(WIFI_POLL_MS);
   }
 
   // Once connected, log the IP address
   IPAddress ip = WiFi.localIP();
-  log("Connected to %s! IP address: %d.%d.%d.%d", ssid.c_str(), ip[0], ip[1],
-      ip[2], ip[3]);
+  log("Connected to %s in %lums! IP address: %d.%d.%d.%d", ssid.c_str(),
+      (unsigned long)(millis() - start), ip[0], ip[1], ip[2], ip[3]);
+  cacheConnection(network);
+  return true;
+}
+
+WiFiNetwork *Network::findNetwork(const String &ssidKey) {
+  WiFiNetwork *networks[] = {&espNetwork, &phoneNetwork, &homeNetwork};
+  for (WiFiNetwork *network : networks) {
+    if (ssidKey == network->ssidKey) {
+      return network;
+    }
+  }
+  return nullptr;
+}
+
+// Only written when it changes, to spare the flash
+void Network::cacheConnection(WiFiNetwork &network) {
+  uint8_t *bssid = WiFi.BSSID();
+  int32_t channel = WiFi.channel();
+  uint8_t cached[BSSID_SIZE];
+  if (preferences.getString(LASTWIFINETWORK) == network.ssidKey &&
+      preferences.getInt(LASTWIFICHANNEL) == channel &&
+      preferences.getBytes(LASTWIFIBSSID, cached, BSSID_SIZE) == BSSID_SIZE &&
+      bssid != nullptr && memcmp(cached, bssid, BSSID_SIZE) == 0) {
+    return;
+  }
+  preferences.putString(LASTWIFINETWORK, network.ssidKey);
+  preferences.putInt(LASTWIFICHANNEL, channel);
+  if (bssid != nullptr) {
+    preferences.putBytes(LASTWIFIBSSID, bssid, BSSID_SIZE);
+  }
+}
+
+/*
+ * Straight to the access point and channel last connected to, without a
+ * scan. False if there isn't one or it isn't there any more.
+ */
+bool Network::fastConnect() {
+  WiFiNetwork *network = findNetwork(preferences.getString(LASTWIFINETWORK));
+  uint8_t bssid[BSSID_SIZE];
+  int32_t channel = preferences.getInt(LASTWIFICHANNEL);
+  if (network == nullptr || channel == 0 ||
+      preferences.getBytes(LASTWIFIBSSID, bssid, BSSID_SIZE) != BSSID_SIZE) {
+    return false;
+  }
+  log("Connecting to %s as last time, channel %d...",
+      preferences.getString(network->ssidKey).c_str(), channel);
+  return connectToWiFi(*network, channel, bssid, WIFI_FAST_CONNECT_TIMEOUT_MS);
 }
 
 /*
@@ -117,7 +187,7 @@ void Network::connectToWiFi(WiFiNetwork &network) {
  * Assumes that credentials have been written to device first using
  * store*creds()
  */
-void Network::setupWifi() {
+bool Network::scanAndConnect() {
   log("Scanning for networks...");
 
   int n = WiFi.scanNetworks();
@@ -137,19 +207,45 @@ void Network::setupWifi() {
       homeFound = true;
     }
   }
+  WiFi.scanDelete();
 
   if (espFound) {
     log("Connecting to ESP32 hotspot...");
-    connectToWiFi(espNetwork);
+    return connectToWiFi(espNetwork, 0, nullptr, WIFI_CONNECT_TIMEOUT_MS);
   } else if (phoneFound) {
     log("Connecting to Phone hotspot...");
-    connectToWiFi(phoneNetwork);
+    return connectToWiFi(phoneNetwork, 0, nullptr, WIFI_CONNECT_TIMEOUT_MS);
   } else if (homeFound) {
     log("Connecting to Home WiFi...");
-    connectToWiFi(homeNetwork);
-  } else {
-    log("No known networks found.");
+    return connectToWiFi(homeNetwork, 0, nullptr, WIFI_CONNECT_TIMEOUT_MS);
   }
+  log("No known networks found.");
+  return false;
+}
+
+// Until connected: once that's happened, the WiFi driver reconnects
+void Network::connectInBackground() {
+  if (!fastConnect()) {
+    while (!scanAndConnect()) {
+      delay(WIFI_RETRY_MS);
+    }
+  }
+  markBootPhase(BOOT_WIFI_CONNECTED);
+  // gone after this, so it can't be watched with the others (see Tasks)
+  log("WiFi task stack left: %u bytes",
+      (unsigned)uxTaskGetStackHighWaterMark(NULL));
+}
+
+void Network::wifiTask(void *network) {
+  static_cast<Network *>(network)->connectInBackground();
+  vTaskDelete(NULL);
+}
+
+void Network::setupWifi() {
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  xTaskCreatePinnedToCore(wifiTask, "wifi", WIFI_TASK_STACK_SIZE, this,
+                          WIFI_TASK_PRIORITY, nullptr, WIFI_TASK_CORE);
 }
 
 /*
@@ -16,9 +16,26 @@ struct WiFiNetwork {
   IPAddress primaryDNS;
 };
 
+/**
+ * How long to wait for a connection to the cached access point (no scan,
+ * static IP) before scanning, and for one found by a scan before trying
+ * again. Between scans that find nothing, WIFI_RETRY_MS.
+ */
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+#define WIFI_RETRY_MS 5000
+#define WIFI_POLL_MS 50
+
 class Network {
 public:
   Network(Preferences &p, int whoarewe);
+  /**
+   * Starts connecting in its own task and returns straight away, so the
+   * rest of setup (and the first position) doesn't wait for WiFi. The
+   * network stack is up when it returns, so servers can be started. The
+   * task reads and caches credentials in preferences alongside setup()'s
+   * own reads, which NVS's locking allows.
+   */
   void setupWifi();
   void setUpAccessPoint();
   void storeHomeWifiCreds(String ssid, String pw);
@@ -28,7 +45,14 @@ public:
 private:
   void storeWifiCreds(String ssid, String pw, const char *ssidKey,
                       const char *pwKey);
-  void connectToWiFi(WiFiNetwork &network);
+  static void wifiTask(void *network);
+  void connectInBackground();
+  bool fastConnect();
+  bool scanAndConnect();
+  bool connectToWiFi(WiFiNetwork &network, int32_t channel,
+                     const uint8_t *bssid, uint32_t timeoutMs);
+  void cacheConnection(WiFiNetwork &network);
+  WiFiNetwork *findNetwork(const String &ssidKey);
   void logIP();
 
   Preferences &preferences;
@@ -38,4 +62,4 @@ private:
   WiFiNetwork espNetwork;
 };
 
-#endif // NETWORK_H
\ No newline at end of file
+#endif // NETWORK_H
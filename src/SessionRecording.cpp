@@ -0,0 +1,228 @@
+#include "SessionRecording.h"
+#include "Logging.h"
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <string.h>
+
+#define SESSION_EVENT_QUEUE_SIZE 16
+
+/**
+ * The recorder's files on LittleFS, SESSION_DIRECTORY/00000012.rec and so
+ * on. Each boot starts a new file after the newest there, and the oldest
+ * go once there are more than RECORDER_FILE_COUNT.
+ *
+ * Every append opens, writes and closes the file, so it's committed to
+ * flash (and complete for a download) when it returns. Flash writes stall
+ * both cores for a few ms, which is why the recorder batches them.
+ */
+class LittleFSRecorderSink : public RecorderSink {
+public:
+  LittleFSRecorderSink() : sequence(0) { path[0] = 0; }
+
+  bool begin() {
+    if (!LittleFS.exists(SESSION_DIRECTORY) &&
+        !LittleFS.mkdir(SESSION_DIRECTORY)) {
+      return false;
+    }
+    uint32_t oldest;
+    if (scan(oldest, sequence) == 0) {
+      sequence = 0;
+    }
+    return true;
+  }
+
+  bool startFile() override {
+    sequence++;
+    if (!makePath(sequence)) {
+      return false;
+    }
+    File file = LittleFS.open(path, "w");
+    if (!file) {
+      return false;
+    }
+    file.close();
+    removeOldFiles();
+    return true;
+  }
+
+  bool append(const uint8_t *data, size_t length) override {
+    File file = LittleFS.open(path, "a");
+    if (!file) {
+      return false;
+    }
+    size_t written = file.write(data, length);
+    file.close();
+    return written == length;
+  }
+
+private:
+  bool makePath(uint32_t fileSequence) {
+    char name[RECORDER_FILE_NAME_SIZE];
+    return formatRecorderFileName(fileSequence, name, sizeof(name)) &&
+           snprintf(path, sizeof(path), SESSION_DIRECTORY "/%s", name) <
+               (int)sizeof(path);
+  }
+
+  // how many recorder files there are, and the oldest and newest
+  size_t scan(uint32_t &oldest, uint32_t &newest) {
+    size_t count = 0;
+    File directory = LittleFS.open(SESSION_DIRECTORY);
+    if (!directory) {
+      return 0;
+    }
+    File file;
+    while ((file = directory.openNextFile())) {
+      // older cores give the whole path
+      const char *name = strrchr(file.name(), '/');
+      name = name ? name + 1 : file.name();
+      uint32_t fileSequence;
+      if (parseRecorderFileName(name, fileSequence)) {
+        if (count == 0 || fileSequence < oldest) {
+          oldest = fileSequence;
+        }
+        if (count == 0 || fileSequence > newest) {
+          newest = fileSequence;
+        }
+        count++;
+      }
+      file.close();
+    }
+    return count;
+  }
+
+  void removeOldFiles() {
+    uint32_t oldest;
+    uint32_t newest;
+    while (scan(oldest, newest) > RECORDER_FILE_COUNT) {
+      char current[sizeof(path)];
+      strcpy(current, path);
+      bool removed = makePath(oldest) && LittleFS.remove(path);
+      strcpy(path, current);
+      if (!removed) {
+        return;
+      }
+    }
+  }
+
+  uint32_t sequence;
+  char path[sizeof(SESSION_DIRECTORY) + RECORDER_FILE_NAME_SIZE];
+};
+
+enum SessionEventType {
+  SESSION_EVENT_SYNC,
+  SESSION_EVENT_QUERY,
+  SESSION_EVENT_FLUSH
+};
+
+struct SessionEvent {
+  SessionEventType type;
+  TimePoint time;
+  double raHours; // or the query's answer
+  double decDegrees;
+  EncoderCount altEncoder;
+  EncoderCount azEncoder;
+  PlatformState platform;
+  RecorderQuery query;
+};
+
+static LittleFSRecorderSink sessionFiles;
+static SessionRecorder recorder(sessionFiles); // housekeeping task only
+static bool recording = false;
+static uint32_t alignmentVersion = UINT32_MAX;
+static SpscQueue<SessionEvent, SESSION_EVENT_QUEUE_SIZE> events;
+// written by the housekeeping task, read by the web handlers
+static SeqLock<RecorderStats> stats;
+static RecorderStats lastStats; // web handlers only
+
+bool setupSessionRecording() {
+  if (!sessionFiles.begin()) {
+    log("Can't make %s, not recording the session", SESSION_DIRECTORY);
+    return false;
+  }
+  recording = true;
+  return true;
+}
+
+void serviceSessionRecording(ModelRunner &runner, EQPlatform &platform) {
+  if (!recording) {
+    return;
+  }
+  bool flushRequested = false;
+  SessionEvent event;
+  while (events.pop(event)) {
+    switch (event.type) {
+    case SESSION_EVENT_SYNC:
+      recorder.recordSync(event.time, event.raHours, event.decDegrees,
+                          event.altEncoder, event.azEncoder, event.platform);
+      break;
+    case SESSION_EVENT_QUERY:
+      recorder.recordQuery(event.time, event.query, event.raHours);
+      break;
+    case SESSION_EVENT_FLUSH:
+      flushRequested = true;
+      break;
+    }
+  }
+
+  TimePoint now = getNow();
+  recorder.recordPlatform(platform.getTelemetry());
+  uint32_t version = runner.getAlignmentVersion();
+  if (version != alignmentVersion) {
+    alignmentVersion = version;
+    recorder.recordAlignment(now, runner.getAlignment());
+  }
+  recorder.recordPosition(runner.getPosition());
+  if (flushRequested) {
+    recorder.flush();
+  } else {
+    recorder.service(now);
+  }
+  stats.write(recorder.getStats());
+}
+
+static void queueEvent(const SessionEvent &event) {
+  if (recording && !events.push(event) && event.type == SESSION_EVENT_SYNC) {
+    log("Session queue full, sync not recorded");
+  }
+}
+
+void recordSessionSync(TimePoint time, double raHours, double decDegrees,
+                       EncoderCount altEncoder, EncoderCount azEncoder,
+                       const PlatformState &platform) {
+  SessionEvent event = SessionEvent();
+  event.type = SESSION_EVENT_SYNC;
+  event.time = time;
+  event.raHours = raHours;
+  event.decDegrees = decDegrees;
+  event.altEncoder = altEncoder;
+  event.azEncoder = azEncoder;
+  event.platform = platform;
+  queueEvent(event);
+}
+
+void recordSessionQuery(RecorderQuery query, double value) {
+  SessionEvent event = SessionEvent();
+  event.type = SESSION_EVENT_QUERY;
+  event.time = getNow();
+  event.query = query;
+  event.raHours = value;
+  queueEvent(event);
+}
+
+void requestSessionFlush() {
+  SessionEvent event = SessionEvent();
+  event.type = SESSION_EVENT_FLUSH;
+  queueEvent(event);
+}
+
+/**
+ * The web handlers run above the housekeeping task on its core, so can't
+ * wait on a stats write they preempted (see SeqLock): if one's in
+ * progress they get the copy from last time.
+ */
+RecorderStats getSessionRecorderStats() {
+  stats.tryRead(lastStats);
+  return lastStats;
+}
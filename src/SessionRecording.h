@@ -0,0 +1,31 @@
+#ifndef SESSION_RECORDING_H
+#define SESSION_RECORDING_H
+
+#include "EQPlatform.h"
+#include "ModelRunner.h"
+#include "SessionRecorder.h"
+
+// where the recorder's files go, see lib/Recorder
+#define SESSION_DIRECTORY "/session"
+
+// Starts a new file on LittleFS. Call after LittleFS.begin(). Without it
+// nothing is recorded.
+bool setupSessionRecording();
+
+// Housekeeping task only: samples the snapshots, takes what the web
+// handlers queued and writes to flash when it's time.
+void serviceSessionRecording(ModelRunner &runner, EQPlatform &platform);
+
+// Web handlers only (single producer). Never block: dropped if the
+// housekeeping task has fallen behind.
+void recordSessionSync(TimePoint time, double raHours, double decDegrees,
+                       EncoderCount altEncoder, EncoderCount azEncoder,
+                       const PlatformState &platform);
+void recordSessionQuery(RecorderQuery query, double value);
+// gets what's buffered onto flash, eg before a download
+void requestSessionFlush();
+
+// Latest stats, web handlers only.
+RecorderStats getSessionRecorderStats();
+
+#endif
@@ -0,0 +1,77 @@
+#include "SkyCatalogue.h"
+#include "Logging.h"
+#include "Metrics.h"
+#include "SeqLock.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+
+/**
+ * Reads the catalogue straight from the LittleFS file, a page at a time as
+ * the reader asks for it. LittleFS caches the blocks it has read, so the
+ * band index and pages near the last query are usually in RAM already.
+ */
+class LittleFSCatalogueSource : public CatalogueSource {
+public:
+  bool open(const char *path) {
+    file = LittleFS.open(path, "r");
+    return (bool)file;
+  }
+
+  bool read(uint32_t offset, void *buffer, size_t length) override {
+    return file.seek(offset) &&
+           file.read(static_cast<uint8_t *>(buffer), length) == length;
+  }
+
+private:
+  File file;
+};
+
+static LittleFSCatalogueSource catalogueFile;
+static CatalogueReader catalogue;
+static SeqLock<NearbyObjects> nearby;
+static NearbyObjects working; // catalogue task only
+
+bool setupCatalogue() {
+  if (!catalogueFile.open(CATALOGUE_PATH)) {
+    log("No catalogue at %s", CATALOGUE_PATH);
+    return false;
+  }
+  if (!catalogue.open(&catalogueFile)) {
+    return false;
+  }
+  log("Catalogue: %lu objects in %lu bands",
+      (unsigned long)catalogue.getObjectCount(),
+      (unsigned long)catalogue.getBandCount());
+  return true;
+}
+
+void updateNearby(double raHours, double decDegrees,
+                  const EpochTransform &epoch) {
+  if (!catalogue.isOpen()) {
+    return;
+  }
+  METRICS_SCOPE(METRIC_CATALOGUE_QUERY);
+  uint32_t start = micros();
+  working.available = true;
+  working.raHours = raHours;
+  working.decDegrees = decDegrees;
+  working.radiusDegrees = CATALOGUE_NEARBY_RADIUS_DEGREES;
+  EquatorialPosition centre = {raHours, decDegrees};
+  if (epoch.isBuilt()) {
+    centre = epoch.jNowToJ2000(centre);
+  }
+  working.count = catalogue.findNear(centre.raHours, centre.decDegrees,
+                                     CATALOGUE_NEARBY_RADIUS_DEGREES,
+                                     working.matches, CATALOGUE_NEARBY_MAX);
+  // a rotation, so the distances stay as they are
+  for (size_t i = 0; epoch.isBuilt() && i < working.count; i++) {
+    EquatorialPosition jNow = epoch.j2000ToJNow(
+        {working.matches[i].raHours, working.matches[i].decDegrees});
+    working.matches[i].raHours = jNow.raHours;
+    working.matches[i].decDegrees = jNow.decDegrees;
+  }
+  working.queryMicros = micros() - start;
+  nearby.write(working);
+}
+
+NearbyObjects getNearby() { return nearby.read(); }
@@ -0,0 +1,23 @@
+#ifndef SKY_CATALOGUE_H
+#define SKY_CATALOGUE_H
+
+#include "Catalogue.h"
+#include "EpochTransform.h"
+
+// built by tools/build_catalogue.py into data/
+#define CATALOGUE_PATH "/catalogue.bin"
+
+// Opens the catalogue on LittleFS. Call after LittleFS.begin(). Without it
+// the WebUI just shows no nearby objects.
+bool setupCatalogue();
+
+// Catalogue task only: looks up what's around ra/dec (JNow, as the model)
+// and publishes it. The catalogue is J2000, so the lookup goes through
+// epoch; the matches are published in JNow for push-to.
+void updateNearby(double raHours, double decDegrees,
+                  const EpochTransform &epoch);
+
+// Latest lookup, any task.
+NearbyObjects getNearby();
+
+#endif
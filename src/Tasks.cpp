@@ -0,0 +1,264 @@
+#include "Tasks.h"
+#include "BootTimeline.h"
+#include "Encoders.h"
+#include "Logging.h"
+#include "Metrics.h"
+#include "SessionRecording.h"
+#include "SkyCatalogue.h"
+#include "SpscQueue.h"
+#include "WebUI.h"
+#include <Arduino.h>
+#include <freertos/ringbuf.h>
+
+// Core 1 (APP_CPU) is left to the model task. WiFi, lwIP and AsyncTCP
+// (CONFIG_ASYNC_TCP_RUNNING_CORE in platformio.ini) run on core 0.
+#define MODEL_TASK_CORE 1
+#define NETWORK_TASK_CORE 0
+#define SLEW_TASK_CORE 0
+#define HOUSEKEEPING_TASK_CORE 0
+#define CATALOGUE_TASK_CORE 1
+
+#define MODEL_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define NETWORK_TASK_PRIORITY 3
+#define SLEW_TASK_PRIORITY 2
+#define HOUSEKEEPING_TASK_PRIORITY 1
+#define CATALOGUE_TASK_PRIORITY 1
+
+#define MODEL_TASK_PERIOD_MS 10
+#define NETWORK_TASK_PERIOD_MS 5
+#define HOUSEKEEPING_TASK_PERIOD_MS 50
+#define PUSH_TO_STREAM_PERIOD_MS 50 // 20Hz guidance to the WebUI
+
+#define MODEL_TASK_STACK_SIZE 8192 // sync logs and Ephemeris maths are deep
+#define HOUSEKEEPING_TASK_STACK_SIZE 8192 // LittleFS and NVS writes
+#define TASK_STACK_SIZE 4096
+// stack headroom is checked this often, and logged when it's a new low
+#define STACK_REPORT_PERIOD_MS 10000
+#define WATCHED_TASK_COUNT 5
+#define LOG_RING_BUFFER_BYTES 4096
+#define PERSIST_QUEUE_SIZE 8
+#define PERSIST_KEY_LENGTH 16 // NVS keys are at most 15 chars
+
+struct PersistCommand {
+  char key[PERSIST_KEY_LENGTH];
+  long value;
+  // removes all of these instead of writing key, see persistRemoveAll
+  const char *const *keys;
+  size_t keyCount;
+};
+
+static ModelRunner *modelRunner;
+static EQPlatform *eqPlatform;
+static Preferences *preferences;
+
+static RingbufHandle_t logRingBuffer;
+static SpscQueue<PersistCommand, PERSIST_QUEUE_SIZE> persistQueue;
+
+/**
+ * The least stack each task has had left, so the sizes above can be set
+ * from what they use rather than guessed. The others are added before the
+ * housekeeping task is created, and it adds itself, so only one task at a
+ * time ever touches the list.
+ */
+struct WatchedTask {
+  const char *name;
+  TaskHandle_t handle;
+  UBaseType_t lowest; // bytes, on the ESP32
+};
+static WatchedTask watchedTasks[WATCHED_TASK_COUNT];
+static int watchedTaskCount = 0;
+
+static void watchTask(const char *name, TaskHandle_t handle) {
+  if (handle == nullptr || watchedTaskCount == WATCHED_TASK_COUNT) {
+    return;
+  }
+  WatchedTask &task = watchedTasks[watchedTaskCount++];
+  task.name = name;
+  task.handle = handle;
+  task.lowest = ~(UBaseType_t)0;
+}
+
+// housekeeping task: logs every task's headroom if any has hit a new low
+static void reportTaskStacks() {
+  char report[160];
+  size_t written = 0;
+  bool lower = false;
+  report[0] = 0;
+  for (int i = 0; i < watchedTaskCount; i++) {
+    WatchedTask &task = watchedTasks[i];
+    UBaseType_t left = uxTaskGetStackHighWaterMark(task.handle);
+    if (left < task.lowest) {
+      task.lowest = left;
+      lower = true;
+    }
+    int n = snprintf(report + written, sizeof(report) - written, "%s%s %u",
+                     written ? ", " : "", task.name, (unsigned)task.lowest);
+    if (n > 0 && written + n < sizeof(report)) {
+      written += n;
+    }
+  }
+  if (lower) {
+    log("Stack left (bytes): %s", report);
+  }
+}
+
+static void modelTask(void *) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    {
+      METRICS_SCOPE(METRIC_UPDATE_POSITION);
+      PlatformState platform = eqPlatform->calculatePlatformState();
+      EncoderCount altEncoder;
+      EncoderCount azEncoder;
+      {
+        METRICS_SCOPE(METRIC_ENCODER_READ);
+        altEncoder = getEncoderAl();
+        azEncoder = getEncoderAz();
+      }
+      METRICS_SCOPE(METRIC_MODEL_CALCULATE);
+      modelRunner->tick(altEncoder, azEncoder, platform, getNow());
+    }
+    if (!bootTimeline().isMarked(BOOT_FIRST_POSITION)) {
+      markBootPhase(BOOT_FIRST_POSITION);
+    }
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(MODEL_TASK_PERIOD_MS));
+  }
+}
+
+static void networkTask(void *) {
+  TickType_t lastPushTo = xTaskGetTickCount();
+  for (;;) {
+    loopEncoders();
+    eqPlatform->servicePackets();
+    eqPlatform->runPulseGuides();
+    eqPlatform->serviceCommands();
+    if (xTaskGetTickCount() - lastPushTo >=
+        pdMS_TO_TICKS(PUSH_TO_STREAM_PERIOD_MS)) {
+      lastPushTo = xTaskGetTickCount();
+      streamPushTo();
+    }
+    vTaskDelay(pdMS_TO_TICKS(NETWORK_TASK_PERIOD_MS));
+  }
+}
+
+// Closed loop slews run off the position snapshot, at SLEW_CONTROL_PERIOD_MS
+static void slewTask(void *) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    PositionSnapshot position = modelRunner->getPosition();
+    eqPlatform->controlSlew(position.raHours, position.decDegrees);
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SLEW_CONTROL_PERIOD_MS));
+  }
+}
+
+/**
+ * What's around the current position, at CATALOGUE_NEARBY_PERIOD_MS. On
+ * core 1 below the model task, so it only gets the model's idle time, and
+ * its SeqLock writes never share a core with the web handlers reading them.
+ */
+static void catalogueTask(void *) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    PositionSnapshot position = modelRunner->getPosition();
+    updateNearby(position.raHours, position.decDegrees,
+                 modelRunner->getEpoch());
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CATALOGUE_NEARBY_PERIOD_MS));
+  }
+}
+
+/**
+ * Log sink used once tasks are running. Never blocks: if the housekeeping
+ * task has fallen behind the line is dropped. The ring buffer is safe for
+ * multiple producers, unlike the SPSC queues.
+ */
+static void queueLogLine(const char *line) {
+  xRingbufferSend(logRingBuffer, line, strlen(line) + 1, 0);
+}
+
+static void housekeepingTask(void *) {
+  watchTask("housekeeping", xTaskGetCurrentTaskHandle());
+  TickType_t lastStackReport = xTaskGetTickCount();
+  for (;;) {
+    size_t size;
+    char *line;
+    while ((line = (char *)xRingbufferReceive(logRingBuffer, &size, 0)) !=
+           nullptr) {
+      Serial.println(line);
+      vRingbufferReturnItem(logRingBuffer, line);
+    }
+
+    PersistCommand command;
+    while (persistQueue.pop(command)) {
+      if (command.keys != nullptr) {
+        for (size_t i = 0; i < command.keyCount; i++) {
+          preferences->remove(command.keys[i]);
+        }
+      } else {
+        preferences->putLong(command.key, command.value);
+      }
+    }
+
+    serviceSessionRecording(*modelRunner, *eqPlatform);
+    if (xTaskGetTickCount() - lastStackReport >=
+        pdMS_TO_TICKS(STACK_REPORT_PERIOD_MS)) {
+      lastStackReport = xTaskGetTickCount();
+      reportTaskStacks();
+    }
+    vTaskDelay(pdMS_TO_TICKS(HOUSEKEEPING_TASK_PERIOD_MS));
+  }
+}
+
+bool persistLong(const char *key, long value) {
+  PersistCommand command;
+  strncpy(command.key, key, PERSIST_KEY_LENGTH - 1);
+  command.key[PERSIST_KEY_LENGTH - 1] = 0;
+  command.value = value;
+  command.keys = nullptr;
+  command.keyCount = 0;
+  if (!persistQueue.push(command)) {
+    log("Persist queue full, dropping write to %s", key);
+    return false;
+  }
+  return true;
+}
+
+bool persistRemoveAll(const char *const *keys, size_t count) {
+  PersistCommand command;
+  command.key[0] = 0;
+  command.value = 0;
+  command.keys = keys;
+  command.keyCount = count;
+  if (!persistQueue.push(command)) {
+    log("Persist queue full, dropping removal of %u keys", (unsigned)count);
+    return false;
+  }
+  return true;
+}
+
+void setupTasks(ModelRunner &runner, EQPlatform &platform, Preferences &prefs) {
+  modelRunner = &runner;
+  eqPlatform = &platform;
+  preferences = &prefs;
+
+  logRingBuffer = xRingbufferCreate(LOG_RING_BUFFER_BYTES, RINGBUF_TYPE_NOSPLIT);
+  // the others first, see watchedTasks
+  TaskHandle_t handle = nullptr;
+  xTaskCreatePinnedToCore(modelTask, "model", MODEL_TASK_STACK_SIZE, nullptr,
+                          MODEL_TASK_PRIORITY, &handle, MODEL_TASK_CORE);
+  watchTask("model", handle);
+  xTaskCreatePinnedToCore(networkTask, "network", TASK_STACK_SIZE, nullptr,
+                          NETWORK_TASK_PRIORITY, &handle, NETWORK_TASK_CORE);
+  watchTask("network", handle);
+  xTaskCreatePinnedToCore(slewTask, "slew", TASK_STACK_SIZE, nullptr,
+                          SLEW_TASK_PRIORITY, &handle, SLEW_TASK_CORE);
+  watchTask("slew", handle);
+  xTaskCreatePinnedToCore(catalogueTask, "catalogue", TASK_STACK_SIZE, nullptr,
+                          CATALOGUE_TASK_PRIORITY, &handle, CATALOGUE_TASK_CORE);
+  watchTask("catalogue", handle);
+  xTaskCreatePinnedToCore(housekeepingTask, "housekeeping",
+                          HOUSEKEEPING_TASK_STACK_SIZE, nullptr,
+                          HOUSEKEEPING_TASK_PRIORITY, nullptr,
+                          HOUSEKEEPING_TASK_CORE);
+  setLogSink(queueLogLine);
+  log("Tasks started");
+}
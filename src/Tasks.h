@@ -0,0 +1,34 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include "EQPlatform.h"
+#include "ModelRunner.h"
+#include <Preferences.h>
+
+/**
+ * Starts the pinned tasks:
+ * - model: high priority on core 1, samples encoders and runs the model at a
+ *   fixed rate, publishing a position snapshot
+ * - network: core 0, serves the SkySafari encoder protocol, publishes
+ *   platform packets, sends pulse guides to the platform and streams
+ *   push-to guidance to the WebUI
+ * - slew: core 0, closes the loop on platform slews from the position
+ *   snapshot (see SlewController)
+ * - catalogue: low priority on core 1, looks up the objects near the
+ *   position snapshot for the WebUI (see SkyCatalogue)
+ * - housekeeping: low priority on core 0, writes log lines to serial,
+ *   saves preferences, records the session (see SessionRecording) and logs
+ *   each task's stack headroom when it hits a new low
+ * WiFi, lwIP and AsyncTCP (web handlers) also run on core 0.
+ */
+void setupTasks(ModelRunner &runner, EQPlatform &platform, Preferences &prefs);
+
+// Queue a preferences write for the housekeeping task. Call from the web
+// handlers only (single producer). False if the queue is full and the
+// write was dropped.
+bool persistLong(const char *key, long value);
+// Removes all of keys (which must outlive the write) as one queued write,
+// so a burst of them can't overrun the queue part way through.
+bool persistRemoveAll(const char *const *keys, size_t count);
+
+#endif
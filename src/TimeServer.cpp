@@ -0,0 +1,26 @@
+#include "TimeServer.h"
+#include "AsyncUDP.h"
+#include "Logging.h"
+#include "Sntp.h"
+#include "TimePoint.h"
+#include "TimeService.h"
+
+AsyncUDP timeUdp;
+
+void setupTimeServer() {
+  if (!timeUdp.listen(SNTP_PORT)) {
+    log("Couldn't listen for SNTP on port %d", SNTP_PORT);
+    return;
+  }
+  log("Serving SNTP on port %d", SNTP_PORT);
+  timeUdp.onPacket([](AsyncUDPPacket packet) {
+    // as soon as it's here, and as late as possible before it goes
+    TimePoint received = getNow();
+    TimeServiceStats stats = getTimeService().getStats();
+    uint8_t reply[SNTP_PACKET_SIZE];
+    if (sntpServerReply(packet.data(), packet.length(), received, getNow(),
+                        stats.set, stats.lastUpdated, reply)) {
+      packet.write(reply, sizeof(reply));
+    }
+  });
+}
@@ -0,0 +1,10 @@
+#ifndef TIME_SERVER_H
+#define TIME_SERVER_H
+
+/**
+ * SNTP on port 123 from the TimeService, so the platform and focuser can
+ * keep to the DSC's clock in the field, no internet needed (see Sntp).
+ */
+void setupTimeServer();
+
+#endif
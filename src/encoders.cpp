@@ -7,51 +7,38 @@
 ESP32Encoder altEncoder;
 ESP32Encoder aziEncoder;
 
-const long resolution_az = 108531; // 36900 on paper.
-const long resolution_alt = 30000;
-
 WiFiServer server(4030);
 WiFiClient client;
 
-// #define enc_az_A 34
-// #define enc_az_B 35
-// #define enc_al_A 25
-// #define enc_al_B 26
-#define enc_az_A 25
-#define enc_az_B 26
-#define enc_al_A 27
-#define enc_al_B 14
-
 void printFirmware() {
   client.print("Frankendob DSB ");
   client.print("1.0");
   client.print(", az rezolution = ");
-  client.print(resolution_az);
+  client.print(AzAxis::resolution);
   client.print(", alt rezolution = ");
-  client.print(resolution_alt);
+  client.print(AltAxis::resolution);
   client.print("\r");
 }
 
 void printResolution() {
 
-  client.print(resolution_az);
+  client.print(AzAxis::resolution);
   client.print("-");
-  client.print(resolution_alt);
+  client.print(AltAxis::resolution);
 }
 
-volatile long getEncoderAz() { return -aziEncoder.getCount(); }
-volatile long getEncoderAl() { return -altEncoder.getCount(); }
+EncoderCount getEncoderAz() { return AzAxis::sample(aziEncoder.getCount()); }
+EncoderCount getEncoderAl() { return AltAxis::sample(altEncoder.getCount()); }
 
 void setupEncoders() {
-  delay(1000);
-  pinMode(enc_al_A, INPUT_PULLUP);
-  pinMode(enc_al_B, INPUT_PULLUP);
-  pinMode(enc_az_A, INPUT_PULLUP);
-  pinMode(enc_az_B, INPUT_PULLUP);
-  aziEncoder.attachFullQuad(enc_az_A, enc_az_B);
+  pinMode(AltAxis::pinA, INPUT_PULLUP);
+  pinMode(AltAxis::pinB, INPUT_PULLUP);
+  pinMode(AzAxis::pinA, INPUT_PULLUP);
+  pinMode(AzAxis::pinB, INPUT_PULLUP);
+  aziEncoder.attachFullQuad(AzAxis::pinA, AzAxis::pinB);
   aziEncoder.setCount(0);
 
-  altEncoder.attachFullQuad(enc_al_A, enc_al_B);
+  altEncoder.attachFullQuad(AltAxis::pinA, AltAxis::pinB);
   altEncoder.setCount(0);
 
   server.begin();
@@ -88,12 +75,13 @@ void loopEncoders() {
     int c = client.read();
     if (c == 81) {
       char response[50];
-      sprintf(response, "%+05d\t%+05d\r", getEncoderAl(), getEncoderAz());
+      sprintf(response, "%+05ld\t%+05ld\r", (long)getEncoderAl(),
+              (long)getEncoderAz());
       client.print(response);
 
-      printEncoderValue(getEncoderAz());
+      printEncoderValue((long)getEncoderAz());
       client.print("\t");
-      printEncoderValue(getEncoderAl());
+      printEncoderValue((long)getEncoderAl());
       client.print("\r");
 
     } else if (c == 86) {
@@ -1,9 +1,21 @@
 #ifndef ENCODERS_H
 #define ENCODERS_H
 
+#include "EncoderAxis.h"
+
+/**
+ * The encoders as wired on this board: pins A and B, direction, and the
+ * model's default steps per revolution (Preferences override it, see
+ * loadPreferences). Az is 36900 on paper, 108531 measured. Older boards
+ * had az on 34/35 and alt on 25/26.
+ */
+typedef EncoderAxis<27, 14, -1, -30000> AltAxis;
+typedef EncoderAxis<25, 26, -1, 108531> AzAxis;
+
 void setupEncoders();
 void loopEncoders();
-long volatile getEncoderAz();
-long volatile getEncoderAl();
+// ESP32Encoder's 64 bit counts, however many turns
+EncoderCount getEncoderAz();
+EncoderCount getEncoderAl();
 void zeroEncoders();
 #endif
@@ -1,9 +1,16 @@
+#include "BootTimeline.h"
 #include "EQPlatform.h"
 #include "Logging.h"
 #include "Network.h"
+#include "SessionRecording.h"
+#include "SkyCatalogue.h"
 #include "webserver/AlpacaWebServer.h"
 #include "Encoders.h"
+#include "ModelPreferences.h"
+#include "ModelRunner.h"
+#include "Tasks.h"
 #include "TelescopeModel.h"
+#include "TimeServer.h"
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <Preferences.h>
@@ -11,27 +18,43 @@
 
 Preferences prefs;
 TelescopeModel model;
+ModelRunner modelRunner(model);
 EQPlatform platform;
 Network network(prefs, WE_ARE_DSC);
 
+/**
+ * Nothing here waits for WiFi: it connects in the background while the
+ * rest starts, and the servers are listening for when it's up. Each phase
+ * is marked, and the whole timeline logged once WiFi and the first
+ * position are both there (see BootTimeline).
+ */
 void setup() {
   Serial.begin(115200);
-  delay(1000);
   Serial.println("starting");
-  prefs.begin("DSC", false);
+  markBootPhase(BOOT_SERIAL);
+  prefs.begin(PREFERENCES_NAMESPACE, false);
+  markBootPhase(BOOT_PREFERENCES);
   // Fresh ESP32s need their wifi creds initialised (once off) as follows. Do
   // not commit. network.storeESP32WifiCreds("","");
   // network.storeHomeWifiCreds("", "");
   // network.storePhoneWifiCreds("", "");
   network.setupWifi();
   LittleFS.begin();
+  setupCatalogue();
+  setupSessionRecording();
+  markBootPhase(BOOT_FILESYSTEM);
   // model.setAltEncoderStepsPerRevolution(-30000);
   // model.setAzEncoderStepsPerRevolution(108229);
 
   setupEncoders();
+  markBootPhase(BOOT_ENCODERS);
   platform.setupEQListener();
-  setupWebServer(model, prefs, platform);
-  delay(500);
+  setupTimeServer();
+  setupWebServer(modelRunner, prefs, platform);
+  markBootPhase(BOOT_SERVERS);
+  setupTasks(modelRunner, platform, prefs);
+  markBootPhase(BOOT_TASKS);
 }
 
-void loop() { loopEncoders(); }
+// Everything runs in the pinned tasks, see Tasks.cpp
+void loop() { vTaskDelete(NULL); }
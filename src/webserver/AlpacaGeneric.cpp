@@ -1,12 +1,19 @@
 
 #include "AlpacaGeneric.h"
 #include "Logging.h"
+#include "Metrics.h"
 #include <cstdlib>
 const int BUFFER_SIZE = 300;
 /**
  * Hold generic alpaca return functions
  */
 
+void sendJson(AsyncWebServerRequest *request, const char *buffer) {
+  METRICS_SCOPE(METRIC_HTTP_SEND);
+  String json = buffer;
+  request->send(200, "application/json", json);
+}
+
 long getTransactionID(AsyncWebServerRequest *request) {
 
   String id = request->arg("ClientTransactionID");
@@ -26,106 +33,137 @@ void returnSingleString(AsyncWebServerRequest *request, String s) {
   log("Single string value url is %s, string is %s", request->url().c_str(), s);
 
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
              "ErrorNumber": 0,
              "ErrorMessage": "",
              "Value": "%s",
         "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           s, getTransactionID(request), generateServerID());
+             s, getTransactionID(request), generateServerID());
+  }
 
-  String json = buffer;
-  request->send(200, "application/json", json);
+  sendJson(request, buffer);
 }
 
 void returnEmptyArray(AsyncWebServerRequest *request) {
   log("Empty array value url is %s", request->url().c_str());
 
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
              "ErrorNumber": 0,
              "ErrorMessage": "",
              "Value": [],
         "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           getTransactionID(request), generateServerID());
+             getTransactionID(request), generateServerID());
+  }
 
-  String json = buffer;
-  request->send(200, "application/json", json);
+  sendJson(request, buffer);
 }
 
 void returnNoError(AsyncWebServerRequest *request) {
 
   // log("Returning no error for url %s ", request->url().c_str());
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
            "ErrorNumber": 0,
            "ErrorMessage": "",
         "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           getTransactionID(request), generateServerID());
-  String json = buffer;
-  request->send(200, "application/json", json);
+             getTransactionID(request), generateServerID());
+  }
+  sendJson(request, buffer);
 }
 
 void returnSingleDouble(AsyncWebServerRequest *request, double d) {
   // log("Single double value url is %s, double is %lf", request->url().c_str(),
   //     d);
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
              "ErrorNumber": 0,
              "ErrorMessage": "",
              "Value": %lf,
           "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           d, getTransactionID(request), generateServerID);
+             d, getTransactionID(request), generateServerID);
+  }
 
-  String json = buffer;
-  request->send(200, "application/json", json);
+  sendJson(request, buffer);
 }
 
 void returnSingleBool(AsyncWebServerRequest *request, bool b) {
   log("Single bool value url is %s, bool is %d", request->url().c_str(), b);
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
              "ErrorNumber": 0,
              "ErrorMessage": "",
              "Value": %s,
         "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           b ? "true" : "false", getTransactionID(request), generateServerID);
+             b ? "true" : "false", getTransactionID(request), generateServerID);
+  }
 
 
-  String json = buffer;
-  request->send(200, "application/json", json);
+  sendJson(request, buffer);
 }
 
 void returnSingleInteger(AsyncWebServerRequest *request, int value) {
   log("Single int value url is %s, int is %ld", request->url().c_str(), value);
   char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    snprintf(buffer, sizeof(buffer),
+             R"({
              "ErrorNumber": 0,
              "ErrorMessage": "",
              "Value": %ld,
         "ClientTransactionID": %ld,
          "ServerTransactionID": %ld
         })",
-           value,getTransactionID(request), generateServerID);
+             value,getTransactionID(request), generateServerID);
+  }
 
 
-  String json = buffer;
-  request->send(200, "application/json", json);
+  sendJson(request, buffer);
+}
+
+/**
+ * Alpaca errors still return 200, with the error in the body.
+ */
+void returnError(AsyncWebServerRequest *request, int errorNumber,
+                 const char *message) {
+  log("Returning error %d (%s) for url %s", errorNumber, message,
+      request->url().c_str());
+  char buffer[BUFFER_SIZE];
+  snprintf(buffer, sizeof(buffer),
+           R"({
+           "ErrorNumber": %d,
+           "ErrorMessage": "%s",
+        "ClientTransactionID": %ld,
+         "ServerTransactionID": %ld
+        })",
+           errorNumber, message, getTransactionID(request), generateServerID());
+  sendJson(request, buffer);
 }
 
 void handleNotFound(AsyncWebServerRequest *request) {
@@ -9,7 +9,10 @@ void returnSingleDouble(AsyncWebServerRequest *request, double d);
 void returnNoError(AsyncWebServerRequest *request);
 void returnSingleInteger(AsyncWebServerRequest *request, int value);
 void handleNotFound(AsyncWebServerRequest *request);
+void returnError(AsyncWebServerRequest *request, int errorNumber,
+                 const char *message);
 void returnSingleString(AsyncWebServerRequest *request, String s);
 long getTransactionID(AsyncWebServerRequest *request);
 long generateServerID();
+void sendJson(AsyncWebServerRequest *request, const char *buffer);
 #endif
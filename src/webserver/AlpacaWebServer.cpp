@@ -1,13 +1,20 @@
 #include "AlpacaWebServer.h"
 #include "AlpacaDiscovery.h"
+#include "AlpacaResponseCache.h"
 #include "AsyncUDP.h"
+#include "ClientLatency.h"
 #include "Encoders.h"
 #include "Logging.h"
+#include "Metrics.h"
+#include "SessionRecording.h"
+#include "SyncGate.h"
 #include "TimePoint.h"
+#include "TimeService.h"
 #include <ArduinoJson.h> // Include the library
 #include <ESPAsyncWebServer.h>
 // #include <WebSerial.h>
 #include <WebSocketsClient.h>
+#include <math.h>
 #include <time.h>
 
 #include "AlpacaGeneric.h"
@@ -16,24 +23,88 @@
 
 #define WEBSERVER_PORT 80
 const int BUFFER_SIZE = 300;
-#define STALE_POSITION_TIME 200
-// used to track ra/dec requests, so we do for one but not both
-unsigned long long lastPositionCalculatedTime;
 
-// used to store last time position was received from EQ
+#define ALPACA_INVALID_VALUE 0x401
+#define ALPACA_INVALID_OPERATION 0x40B
+#define ALPACA_ACTION_NOT_IMPLEMENTED 0x40C
+
+#define TELESCOPE_PATH "/api/v1/telescope/0/"
+#define TELESCOPE_PATH_LENGTH (sizeof(TELESCOPE_PATH) - 1)
+
+// smaller latency changes aren't worth a model command every poll
+#define CLIENT_LATENCY_POST_SECONDS 0.005
 
 AsyncWebServer alpacaWebServer(WEBSERVER_PORT);
+AlpacaResponseCache responseCache;
+// what clients send and get back, see setEquatorialSystem
+static int equatorialSystem = EQUATORIAL_SYSTEM_TOPOCENTRIC;
+
+void setEquatorialSystem(int system) {
+  if (system != EQUATORIAL_SYSTEM_TOPOCENTRIC &&
+      system != EQUATORIAL_SYSTEM_J2000) {
+    log("Unknown equatorial system %d, keeping %d", system, equatorialSystem);
+    return;
+  }
+  equatorialSystem = system;
+  // https://ascom-standards.org/Help/Developer/html/T_ASCOM_DeviceInterface_EquatorialCoordinateType.htm
+  responseCache.putInteger("equatorialsystem", system);
+}
+
+int getEquatorialSystem() { return equatorialSystem; }
+
+static ClientLatency clientLatency;
+// what the model task was last sent, see updateClientLatency
+static double postedLatencySeconds = -1;
+
+static void updateClientLatency(ModelRunner &runner) {
+  double seconds = clientLatency.getSeconds();
+  if (fabs(seconds - postedLatencySeconds) < CLIENT_LATENCY_POST_SECONDS) {
+    return;
+  }
+  if (runner.requestClientLatency(seconds)) {
+    postedLatencySeconds = seconds;
+  }
+}
+
+void setClientLatencyMillis(ModelRunner &runner, double millis) {
+  clientLatency.setFixed(millis < 0 ? -1 : millis / 1000);
+  updateClientLatency(runner);
+}
+
+void addClientRoundTrip(ModelRunner &runner, double seconds) {
+  clientLatency.addRoundTrip(seconds);
+  updateClientLatency(runner);
+}
+
+const ClientLatency &getClientLatency() { return clientLatency; }
+
+static SyncGateStats syncStats;
+
+SyncGateStats getSyncGateStats() { return syncStats; }
+
 /**
- * Checks when last position was calculated. Assume position will be calced
- * after this is called.
+ * Client coordinates to the model's (JNow), through the model task's
+ * cached rotation. Passed through unchanged until the first model tick
+ * has built one.
  */
-bool checkStalePositionAndUpdate() {
-  unsigned long now = millis();
-  if ((now - lastPositionCalculatedTime) > STALE_POSITION_TIME) {
-    lastPositionCalculatedTime = now;
-    return true;
+static EquatorialPosition fromClientSystem(ModelRunner &runner, double raHours,
+                                           double decDegrees) {
+  EquatorialPosition position = {raHours, decDegrees};
+  if (equatorialSystem != EQUATORIAL_SYSTEM_J2000) {
+    return position;
+  }
+  EpochTransform epoch = runner.getEpoch();
+  return epoch.isBuilt() ? epoch.j2000ToJNow(position) : position;
+}
+
+static EquatorialPosition toClientSystem(ModelRunner &runner, double raHours,
+                                         double decDegrees) {
+  EquatorialPosition position = {raHours, decDegrees};
+  if (equatorialSystem != EQUATORIAL_SYSTEM_J2000) {
+    return position;
   }
-  return false;
+  EpochTransform epoch = runner.getEpoch();
+  return epoch.isBuilt() ? epoch.jNowToJ2000(position) : position;
 }
 
 /**
@@ -53,7 +124,7 @@ void returnAxisRates(AsyncWebServerRequest *request, EQPlatform &platform) {
   }
   char buffer[BUFFER_SIZE];
   // TODO fix this later
-  // double axisRateMax = platform.axisMoveRateMax;
+  // double axisRateMax = platform.getTelemetry().axisMoveRateMax;
   double axisRateMax = 21;
 
   snprintf(buffer, sizeof(buffer),
@@ -74,52 +145,27 @@ void returnAxisRates(AsyncWebServerRequest *request, EQPlatform &platform) {
   String json = buffer;
   request->send(200, "application/json", json);
 }
-void returnTrackingRates(AsyncWebServerRequest *request) {
-  log("Return tracking rates url is  %s", request->url().c_str());
-  // TODO #4 implement lunar tracking
-  /**
-   * DriveRate object corresponding to one of the standard drive rates
-   * driveSidereal = 0 - Sidereal tracking rate (15.041 arcseconds per second).
-   * driveLunar = 1 - Lunar tracking rate (14.685 arcseconds per second).
-   * driveSolar = 2 - Solar tracking rate (15.0 arcseconds per second).
-   * driveKing = 3 - King tracking rate (15.0369 arcseconds per second).
-   */
-  char buffer[BUFFER_SIZE];
-  snprintf(buffer, sizeof(buffer),
-           R"({
-           "ErrorNumber": 0,
-             "ErrorMessage": "",
-             "Value": [ 0 , 1 ],
-        "ClientTransactionID": %ld,
-         "ServerTransactionID": %ld
-        })",
-           getTransactionID(request), generateServerID);
-
-  String json = buffer;
-  request->send(200, "application/json", json);
-}
-
 /** Parse and set longitude passed as a double*/
-void setSiteLatitude(AsyncWebServerRequest *request, TelescopeModel &model) {
+void setSiteLatitude(AsyncWebServerRequest *request, ModelRunner &runner) {
   String lat = request->arg("SiteLatitude");
   if (lat != NULL) {
     log("Received parameterName: %s", lat.c_str());
 
     double parsedValue = strtod(lat.c_str(), NULL);
     log("Parsed lat value: %lf", parsedValue);
-    model.setLatitude(parsedValue);
+    runner.requestLatitude(parsedValue);
   }
   return returnNoError(request);
 }
 /** Parse and set latitude passed as a double*/
-void setSiteLongitude(AsyncWebServerRequest *request, TelescopeModel &model) {
+void setSiteLongitude(AsyncWebServerRequest *request, ModelRunner &runner) {
   String lng = request->arg("SiteLongitude");
   if (lng != NULL) {
     log("Received parameterName: %s", lng.c_str());
 
     double parsedValue = strtod(lng.c_str(), NULL);
     log("Parsed lng value: %lf", parsedValue);
-    model.setLongitude(parsedValue);
+    runner.requestLongitude(parsedValue);
     log("Long set");
   }
   return returnNoError(request);
@@ -142,9 +188,12 @@ void canMoveAxis(AsyncWebServerRequest *request) {
   return returnSingleBool(request, false);
 }
 
-void abortSlew(AsyncWebServerRequest *request, EQPlatform &platform) {
+void abortSlew(AsyncWebServerRequest *request, ModelRunner &runner,
+               EQPlatform &platform) {
+  platform.abortSlew();
   platform.moveAxis(0, 0);
   platform.moveAxis(1, 0);
+  runner.requestCancelPushTo();
 
   return returnNoError(request);
 }
@@ -171,6 +220,8 @@ void moveAxis(AsyncWebServerRequest *request, EQPlatform &platform) {
     return returnNoError(request);
   }
 
+  // a manual move takes over from any slew in progress
+  platform.abortSlew(false);
   platform.moveAxis(parsedAxis,parsedRate);
 
   return returnNoError(request);
@@ -178,8 +229,9 @@ void moveAxis(AsyncWebServerRequest *request, EQPlatform &platform) {
 
 void pulseGuide(AsyncWebServerRequest *request, EQPlatform &platform) {
   String direction = request->arg("Direction");
-  int parsedDirection;
-  long parsedDuration;
+  // rejected by the scheduler if not given
+  int parsedDirection = -1;
+  long parsedDuration = -1;
   if (direction != NULL) {
     log("Received parameterName: %s", direction.c_str());
     parsedDirection = strtol(direction.c_str(), NULL, 10);
@@ -193,11 +245,28 @@ void pulseGuide(AsyncWebServerRequest *request, EQPlatform &platform) {
   }
   log("Pulse guiding in direction %d for %d millis", parsedDirection,
       parsedDuration);
-  platform.pulseGuide(parsedDirection, parsedDuration);
+  if (!platform.pulseGuide(parsedDirection, parsedDuration)) {
+    return returnError(request, ALPACA_INVALID_VALUE, "Invalid pulse guide");
+  }
 
   return returnNoError(request);
 }
 
+/**
+ * Refraction on or off. The temperature and pressure it uses are set from
+ * the WebUI.
+ */
+void setDoesRefraction(AsyncWebServerRequest *request, ModelRunner &runner) {
+  String doesRefraction = request->arg("DoesRefraction");
+  if (doesRefraction != NULL) {
+    log("Received DoesRefraction: %s", doesRefraction.c_str());
+    runner.requestDoesRefraction(doesRefraction.equalsIgnoreCase("True"));
+  } else {
+    log("No DoesRefraction parm found");
+  }
+  return returnNoError(request);
+}
+
 /**
  *  Turn tracking on and off
  *
@@ -230,57 +299,41 @@ void setTracking(AsyncWebServerRequest *request, EQPlatform &platform) {
   return returnNoError(request);
 }
 
-void setUTCDate(AsyncWebServerRequest *request, TelescopeModel &model) {
+/**
+ * A client's UTC goes to the TimeService, fraction of a second and all,
+ * filtered with the others rather than set outright (see TimeService).
+ */
+void setUTCDate(AsyncWebServerRequest *request) {
+  TimeService &service = getTimeService();
+  int64_t received = service.micros();
   String utc = request->arg("UTCDate");
-  if (!utc.isEmpty())
-    log("Received UTCDate: %s", utc.c_str());
-
-  // int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
-
-  // sscanf(utc.c_str(), "%4d-%2d-%2dT%2d:%2d:%2dZ", &year, &month, &day,
-  // &hour,
-  //        &minute, &second);
-
-  int year = utc.substring(0, 4).toInt();
-  int month = utc.substring(5, 7).toInt();
-  int day = utc.substring(8, 10).toInt();
-  int hour = utc.substring(11, 13).toInt();
-  int minute = utc.substring(14, 16).toInt();
-  int second = utc.substring(17, 19).toInt();
-
-  log("Parsed Date - Year: %d, Month: %d, Day: %d, Hour: %d, Minute: %d, "
-      "Second: %d",
-      year, month, day, hour, minute, second);
-  TimePoint tp = createTimePoint(day, month, year, hour, minute, second);
-  log("Setting system data to %s", timePointToString(tp).c_str());
-  setSystemTime(tp);
-  // epochMillisBase = createTimePoint(day, month, year, hour, minute,
-  // second);
-
-  // log("Stored base epoch time in millis: %llu", epochMillisBase);
-  // epochMillisBase = addMillisToTime(epochMillisBase,millis());// we'll add
-  // millis every time we need epoch time
-
-  // log("Stored base epoch time in millis after offset : %llu",
-  // epochMillisBase);
+  log("Received UTCDate: %s", utc.c_str());
+  TimePoint tp;
+  if (!parseUtcTime(utc.c_str(), tp)) {
+    return returnError(request, ALPACA_INVALID_VALUE,
+                       "UTCDate must be UTC, eg 2023-09-16T10:39:00.25Z");
+  }
+  TimeUpdateResult result = service.update(tp, received);
+  TimeServiceStats stats = service.getStats();
+  if (result == TIME_UPDATE_REFUSED) {
+    log("UTCDate refused, %.3fs behind", -stats.lastOffsetSeconds);
+  } else {
+    log("UTCDate %s, offset %.3fs, rate correction %.1fppm",
+        result == TIME_UPDATE_SET ? "set" : "slewing in",
+        stats.lastOffsetSeconds, stats.rateCorrection * 1e6);
+  }
   returnNoError(request);
-  log("finished utc");
 }
 
-// Calculate position.
-// Triggered from ra or dec request. Should only run for one of them and
-// then cache for a few millis
-void updatePosition(TelescopeModel &model, EQPlatform &platform) {
-
-  TimePoint timeAtMiddleOfRun = platform.calculateAdjustedTime();
-  model.setEncoderValues(getEncoderAl(), getEncoderAz());
-  model.calculateCurrentPosition(timeAtMiddleOfRun);
-}
 /**
  * Take ra dec passed by client, and set current ra/dec to this.
- * Lots of fancy logic inside model for this one.
+ * Lots of fancy logic inside model for this one. The encoder values and
+ * time are captured now, or averaged over the exposure if the client
+ * passes ExposureStart and ExposureEnd (not part of Alpaca, for plate
+ * solvers that know), and refused if the scope was moving. The model task
+ * applies the sync on its next tick.
  */
-void syncToCoords(AsyncWebServerRequest *request, TelescopeModel &model,
+void syncToCoords(AsyncWebServerRequest *request, ModelRunner &runner,
                   EQPlatform &platform) {
   String ra = request->arg("RightAscension");
   double parsedRAHours;
@@ -304,18 +357,59 @@ void syncToCoords(AsyncWebServerRequest *request, TelescopeModel &model,
     log("Could not parse dec arg!");
   }
 
-  TimePoint timeAtMiddleOfRun = platform.calculateAdjustedTime();
-  log("Encoder values: %ld,%ld", getEncoderAl(), getEncoderAz());
-  // log("Timestamp for middle of run: %llu", timeAtMiddleOfRunSeconds);
-  model.setEncoderValues(getEncoderAl(), getEncoderAz());
-  model.syncPositionRaDec(parsedRAHours, parsedDecDegrees, timeAtMiddleOfRun);
-  updatePosition(model, platform);
+  EncoderCount altEncoder = getEncoderAl();
+  EncoderCount azEncoder = getEncoderAz();
+  TimePoint now = getNow();
+  log("Encoder values: %lld,%lld", (long long)altEncoder,
+      (long long)azEncoder);
+
+  // a plate solve can say when its exposure was, see SyncGate
+  AlignmentSnapshot alignment = runner.getAlignment();
+  const EncoderHistory &history = runner.getEncoderHistory();
+  SyncAssessment sync;
+  if (request->hasArg("ExposureStart") || request->hasArg("ExposureEnd")) {
+    TimePoint start;
+    TimePoint end;
+    if (!parseUtcTime(request->arg("ExposureStart").c_str(), start) ||
+        !parseUtcTime(request->arg("ExposureEnd").c_str(), end)) {
+      return returnError(request, ALPACA_INVALID_VALUE,
+                         "ExposureStart and ExposureEnd must both be UTC, "
+                         "eg 2023-09-16T10:39:00.25Z");
+    }
+    sync = assessExposureSync(history, start, end,
+                              alignment.altEncoderStepsPerRevolution,
+                              alignment.azEncoderStepsPerRevolution);
+  } else {
+    sync = assessSync(history, altEncoder, azEncoder, now,
+                      alignment.altEncoderStepsPerRevolution,
+                      alignment.azEncoderStepsPerRevolution);
+  }
+  syncStats.last = sync;
+  if (!sync.accepted) {
+    syncStats.rejected++;
+    log("Sync refused: %s (spread %.4f degrees over %d samples)", sync.reason,
+        sync.spreadDegrees, sync.samples);
+    return returnError(request, ALPACA_INVALID_OPERATION, sync.reason);
+  }
+  syncStats.accepted++;
+  log("Sync quality %.2f (spread %.4f degrees over %d samples)", sync.quality,
+      sync.spreadDegrees, sync.samples);
+
+  // the platform as it was then, if the sync is from an exposure
+  PlatformState platformState = platform.calculatePlatformState().after(
+      -differenceInSeconds(sync.time, now));
+  EquatorialPosition target =
+      fromClientSystem(runner, parsedRAHours, parsedDecDegrees);
+  runner.requestSync(target.raHours, target.decDegrees, sync.altEncoder,
+                     sync.azEncoder, sync.time, platformState);
+  recordSessionSync(sync.time, target.raHours, target.decDegrees,
+                    sync.altEncoder, sync.azEncoder, platformState);
   // model.saveEncoderCalibrationPoint();
 
   returnNoError(request);
 }
 
-void slewToCoords(AsyncWebServerRequest *request, TelescopeModel &model,
+void slewToCoords(AsyncWebServerRequest *request, ModelRunner &runner,
                   EQPlatform &platform) {
   log("Slewing to coords requested");
   String ra = request->arg("RightAscension");
@@ -340,87 +434,238 @@ void slewToCoords(AsyncWebServerRequest *request, TelescopeModel &model,
     log("Could not parse dec arg!");
   }
 
-  // get latest position
-  updatePosition(model, platform);
-
-  double targetRADegrees = parsedRAHours * 15.0;
-  double modelledRADegrees = model.currentEqPosition.getRAInDegrees();
-
-  // negative degree shifts move from limit(east)
-  // to 0 (west).
-  // ra increases as stars are more west
-  // so if target is west of actual,
-  //   modelledRADegrees -targetRADegreeswill be positive
-  // so this is right.
-  double raDeltaDegrees = modelledRADegrees - targetRADegrees;
-  //TODO implement dec
-  platform.slewByDegrees(0,raDeltaDegrees);
-  log("Asked platform to slew by %lf degrees: target is %lf, actual eq is %lf",
-      raDeltaDegrees, targetRADegrees, modelledRADegrees);
+  EquatorialPosition target =
+      fromClientSystem(runner, parsedRAHours, parsedDecDegrees);
+  // closed loop on the model position, see SlewController. Slewing stays
+  // true until it has settled on the target.
+  platform.slewTo(target.raHours, target.decDegrees);
+  // the platform can't move far (or in dec at all, for most), so the rest
+  // is up to the user, guided by push-to in the WebUI
+  runner.requestPushTo(target.raHours, target.decDegrees);
 
   returnNoError(request);
 }
 
+/**
+ * The whole point. Return ra/dec back to client: where the scope will be
+ * by the time the client shows it, while it's being moved (see
+ * ClientLatency). Clients poll ra first, so that's what times the polls.
+ */
+void getRA(AsyncWebServerRequest *request, ModelRunner &runner) {
+  clientLatency.addPoll(getNow());
+  updateClientLatency(runner);
+  PositionSnapshot position = runner.getPosition();
+  double raHours =
+      toClientSystem(runner, position.leadRaHours, position.leadDecDegrees)
+          .raHours;
+  recordSessionQuery(RECORDER_QUERY_RA, raHours);
+  returnSingleDouble(request, raHours);
+}
+
 /**
  * The whole point. Return ra/dec back to client
  */
-void getRA(AsyncWebServerRequest *request, TelescopeModel &model,
-           EQPlatform &platform) {
-  if (checkStalePositionAndUpdate()) {
-    updatePosition(model, platform);
+void getDec(AsyncWebServerRequest *request, ModelRunner &runner) {
+  PositionSnapshot position = runner.getPosition();
+  double decDegrees =
+      toClientSystem(runner, position.leadRaHours, position.leadDecDegrees)
+          .decDegrees;
+  recordSessionQuery(RECORDER_QUERY_DEC, decDegrees);
+  returnSingleDouble(request, decDegrees);
+}
+/**
+ * Gathers the mount state from the latest snapshots. Each part is read in
+ * one go, so ra/dec/alt/az always come from the same model tick.
+ */
+MountState collectMountState(ModelRunner &runner, EQPlatform &platform) {
+  PositionSnapshot position = runner.getPosition();
+  PlatformTelemetry telemetry = platform.getTelemetry();
+  AlignmentSnapshot alignment = runner.getAlignment();
+
+  MountState state;
+  state.rightAscension = position.raHours;
+  state.declination = position.decDegrees;
+  state.altitude = position.altDegrees;
+  state.azimuth = position.azDegrees;
+  state.siderealTime = position.siderealTimeHours;
+  state.tracking = telemetry.currentlyRunning;
+  state.slewing = platform.isSlewing();
+  state.isPulseGuiding = platform.isPulseGuiding();
+  time_t now = Clock::to_time_t(getNow());
+  struct tm utc;
+  gmtime_r(&now, &utc);
+  strftime(state.utcDate, sizeof(state.utcDate), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+  state.platformConnected = isPlatformConnected(telemetry, getNow());
+  state.timeToCenter = telemetry.runtimeFromCenterSeconds;
+  state.timeToEnd = telemetry.timeToEnd;
+  strncpy(state.platformIP, telemetry.ip, sizeof(state.platformIP));
+  state.platformIP[sizeof(state.platformIP) - 1] = 0;
+
+  state.calculatedAltEncoderSteps = alignment.calculatedAltEncoderRes;
+  state.calculatedAzEncoderSteps = alignment.calculatedAziEncoderRes;
+  state.altEncoderSteps = alignment.altEncoderStepsPerRevolution;
+  state.azEncoderSteps = alignment.azEncoderStepsPerRevolution;
+  state.alignmentVersion = runner.getAlignmentVersion();
+  state.modelUpdate = position.updateCount;
+  state.moving = position.moving;
+  state.leadSeconds = position.moving ? position.leadSeconds : 0;
+  return state;
+}
+
+/**
+ * Alpaca action. The only one is getstate, which returns the whole mount
+ * state in one reply.
+ */
+void performAction(AsyncWebServerRequest *request, ModelRunner &runner,
+                   EQPlatform &platform) {
+  String action = request->arg("Action");
+  if (!action.equalsIgnoreCase(MOUNT_STATE_ACTION)) {
+    return returnError(request, ALPACA_ACTION_NOT_IMPLEMENTED,
+                       "Action not implemented");
+  }
+  // the WebUI's copy of the state stays in JNow, clients get their system
+  MountState state = collectMountState(runner, platform);
+  EquatorialPosition position =
+      toClientSystem(runner, state.rightAscension, state.declination);
+  state.rightAscension = position.raHours;
+  state.declination = position.decDegrees;
+  char buffer[MOUNT_STATE_ACTION_BUFFER_SIZE];
+  size_t length;
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    length = renderMountStateAction(state, getTransactionID(request),
+                                    generateServerID(), buffer, sizeof(buffer));
   }
+  if (length == 0) {
+    log("getstate reply too big for buffer");
+    request->send(500);
+    return;
+  }
+  sendJson(request, buffer);
+}
 
-  returnSingleDouble(request, model.getRACoord());
+/**
+ * Members whose value never changes. Rendered once into the response
+ * cache at startup rather than formatted on every poll.
+ */
+void fillResponseCache(EQPlatform &platform) {
+  responseCache.putInteger("alignmentmode", 0);
+  responseCache.putInteger("sideofpier", -1);
+  // what the slew controller actually waits for
+  responseCache.putInteger("slewsettletime",
+                           lround(platform.getSlewSettleSeconds()));
+  // equTopocentric unless the WebUI has chosen J2000
+  setEquatorialSystem(equatorialSystem);
+  responseCache.putInteger("interfaceversion", 3);
+
+  const char *zeroDoubles[] = {
+      "aperturearea", "aperturediameter", "declinationrate",
+      "focallength",  "guideratedeclination", "siteelevation",
+      "sitelatitude", "sitelongitude"};
+  for (const char *member : zeroDoubles)
+    responseCache.putDouble(member, 0);
+
+  const char *falseBools[] = {"athome",
+                              "atpark",
+                              "cansetdeclinationrate",
+                              "cansetpark",
+                              "cansetpierside",
+                              "cansetrightascensionrate",
+                              "cansyncaltaz",
+                              "canunpark",
+                              "canslew",
+                              "canslewaltaz",
+                              "canslewaltazasync",
+                              // TODO implement
+                              "cansetguiderates"};
+  for (const char *member : falseBools)
+    responseCache.putBool(member, false);
+
+  const char *trueBools[] = {"cansettracking", "canslewasync", "canpark",
+                             "canfindhome",    "canpulseguide", "cansync",
+                             "connected"};
+  for (const char *member : trueBools)
+    responseCache.putBool(member, true);
+
+  responseCache.putString("driverversion", "1.0");
+  responseCache.putString("driverinfo", "Hackypoo");
+  responseCache.putString("description", "Frankendob");
+  responseCache.putString("name", "Frankendob");
+  responseCache.putString("utcdate", "");
+  responseCache.putRaw("supportedactions", "[\"" MOUNT_STATE_ACTION "\"]");
+  // TODO #4 implement lunar tracking
+  responseCache.putRaw("trackingrate", "[0,1]");
+  log("Response cache holds %d members", responseCache.size());
 }
 
 /**
- * The whole point. Return ra/dec back to client
+ * Sends the cached response for member, if there is a current one.
  */
-void getDec(AsyncWebServerRequest *request, TelescopeModel &model,
-            EQPlatform &platform) {
-  if (checkStalePositionAndUpdate()) {
-    updatePosition(model, platform);
+bool sendCached(AsyncWebServerRequest *request, const char *member,
+                uint32_t stateVersion) {
+  char body[ALPACA_CACHE_BODY_SIZE];
+  size_t length;
+  {
+    METRICS_SCOPE(METRIC_JSON_FORMAT);
+    length = responseCache.render(member, stateVersion,
+                                  getTransactionID(request),
+                                  generateServerID(), body, sizeof(body));
+  }
+  if (length == 0) {
+    return false;
   }
+  sendJson(request, body);
+  return true;
+}
 
-  returnSingleDouble(request, model.getDecCoord());
+/**
+ * For members that follow platform state: the rendered value stays in the
+ * cache until the state version moves on.
+ */
+void cacheAndSendBool(AsyncWebServerRequest *request, const char *member,
+                      bool value, uint32_t stateVersion) {
+  if (!responseCache.putBool(member, value, stateVersion) ||
+      !sendCached(request, member, stateVersion)) {
+    returnSingleBool(request, value);
+  }
 }
+
 /**
- * Map all the paths.
+ * Map all the paths. Handlers never touch the model directly: they read
+ * the snapshots published by the model task, and post changes to it.
  */
-void setupWebServer(TelescopeModel &model, Preferences &prefs,
+void setupWebServer(ModelRunner &runner, Preferences &prefs,
                     EQPlatform &platform) {
+  fillResponseCache(platform);
 
   // GETS. Mostly default flags.
   alpacaWebServer.on(
       "^\\/api\\/v1\\/telescope\\/0\\/.*$", HTTP_GET,
-      [&model, &platform](AsyncWebServerRequest *request) {
-        String url = request->url();
-        // log("Processing GET on url %s", url.c_str());
-
-        // Strip off the initial portion of the URL
-        String subPath = url.substring(String("/api/v1/telescope/0/").length());
-
-        if (subPath == "alignmentmode")
-          return returnSingleInteger(request, 0);
-        if (subPath == "aperturearea")
-          return returnSingleDouble(request, 0);
-        if (subPath == "aperturediameter")
-          return returnSingleDouble(request, 0);
-
-        if (subPath == "athome" || subPath == "atpark" ||
-            subPath == "cansetdeclinationrate" || subPath == "cansetpark" ||
-            subPath == "cansetpierside" ||
-            subPath == "cansetrightascensionrate" ||
-            subPath == "cansyncaltaz" || subPath == "canunpark" ||
-            subPath == "doesrefraction") {
-          return returnSingleBool(request, false);
-        }
+      [&runner, &platform](AsyncWebServerRequest *request) {
+        METRICS_SCOPE(METRIC_ALPACA_GET);
+        // Constant members and unchanged tracking/slewing are answered
+        // straight from the cache, before any String work.
+        const char *member = request->url().c_str() + TELESCOPE_PATH_LENGTH;
+        uint32_t stateVersion = platform.getStateVersion();
+        if (sendCached(request, member, stateVersion))
+          return;
+
+        String subPath = member;
+        // log("Processing GET on url %s", request->url().c_str());
 
         if (subPath == "slewing") {
-          return returnSingleBool(request, platform.slewing);
+          return cacheAndSendBool(request, member, platform.isSlewing(),
+                                  stateVersion);
         }
-        if (subPath == "sideofpier") {
-          return returnSingleInteger(request, -1);
+        if (subPath == "tracking") {
+          return cacheAndSendBool(request, member,
+                                  platform.getTelemetry().currentlyRunning,
+                                  stateVersion);
+        }
+        // polled by guiding software after every pulse, so never cached
+        if (subPath == "ispulseguiding") {
+          return returnSingleBool(request, platform.isPulseGuiding());
         }
         if (subPath == "canmoveaxis") {
           return canMoveAxis(request);
@@ -428,120 +673,41 @@ void setupWebServer(TelescopeModel &model, Preferences &prefs,
         if (subPath == "axisrates") {
           return returnAxisRates(request, platform);
         }
-        if (subPath == "cansettracking") {
-          return returnSingleBool(request, true);
-        }
-
-        if (subPath == "canslew") {
-          return returnSingleBool(request, false);
-        }
-        if (subPath == "canslewaltaz") {
-          return returnSingleBool(request, false);
-        }
-        if (subPath == "canslewasync") {
-          return returnSingleBool(request, true);
-        }
-        // TODO expose as config
-        if (subPath == "slewsettletime") {
-          return returnSingleInteger(request, 1);
-        }
-        if (subPath == "canslewaltazasync") {
-          return returnSingleBool(request, false);
-        }
-        if (subPath == "canpark") {
-          return returnSingleBool(request, true);
-        }
-
-        if (subPath == "canfindhome") {
-          return returnSingleBool(request, true);
-        }
-
-        if (subPath == "canpulseguide") {
-          return returnSingleBool(request, true);
-        }
-        // TODO implement
-        if (subPath == "cansetguiderates") {
-          return returnSingleBool(request, false);
-        }
-        if (subPath == "ispulseguiding") {
-          return returnSingleBool(request, false);
-        }
-
-        if (subPath == "tracking") {
-          return returnSingleBool(request, platform.currentlyRunning);
-        }
-
-        if (subPath == "cansync") {
-          return returnSingleBool(request, true);
-        }
-
-        if (subPath == "declinationrate" || subPath == "guideratedeclination" ||
-            subPath == "focallength" || subPath == "siderealtime") {
-          return returnSingleDouble(request, 0);
-        }
-
-        if (subPath == "trackingrate") {
-          return returnTrackingRates(request);
-        }
 
         if (subPath == "rightascensionrate") {
-          return returnSingleDouble(request, platform.trackingRate);
+          return returnSingleDouble(request,
+                                    platform.getTelemetry().trackingRate);
         }
         if (subPath == "guideraterightascension") {
-          return returnSingleDouble(request, platform.pulseGuideRate);
-        }
-
-        if (subPath == "equatorialsystem") {
-          return returnSingleInteger(
-              request,
-              1); // equTopocentric
-                  // https://ascom-standards.org/Help/Developer/html/T_ASCOM_DeviceInterface_EquatorialCoordinateType.htm
-        }
-
-        if (subPath == "interfaceversion") {
-          return returnSingleInteger(request, 3);
+          return returnSingleDouble(request,
+                                    platform.getTelemetry().pulseGuideRate);
         }
 
-        if (subPath == "driverversion" || subPath == "driverinfo" ||
-            subPath == "description" || subPath == "name") {
-          String responseValue = "Frankendob"; // Default
-          if (subPath == "driverversion")
-            responseValue = "1.0";
-          else if (subPath == "driverinfo")
-            responseValue = "Hackypoo";
-          return returnSingleString(request, responseValue);
-        }
+        if (subPath == "doesrefraction")
+          return returnSingleBool(request,
+                                  runner.getAlignment().doesRefraction);
 
-        if (subPath == "supportedactions") {
-          return returnEmptyArray(request);
+        if (subPath == "altitude") {
+          double altDegrees = runner.getPosition().altDegrees;
+          recordSessionQuery(RECORDER_QUERY_ALTITUDE, altDegrees);
+          return returnSingleDouble(request, altDegrees);
         }
 
-        if (subPath == "connected") {
-          return returnSingleBool(request, true);
+        if (subPath == "azimuth") {
+          double azDegrees = runner.getPosition().azDegrees;
+          recordSessionQuery(RECORDER_QUERY_AZIMUTH, azDegrees);
+          return returnSingleDouble(request, azDegrees);
         }
-        if (subPath == "utcdate")
-          return returnSingleString(request, "");
-
-        if (subPath == "siteelevation")
-          return returnSingleDouble(request, 0);
-
-        if (subPath == "sitelatitude")
-          return returnSingleDouble(request, 0);
-
-        if (subPath == "sitelongitude")
-          return returnSingleDouble(request, 0);
 
-        if (subPath == "azimuth")
-          return returnSingleDouble(request, 0);
-
-        if (subPath == "altitude")
-          return returnSingleDouble(request, 0);
+        if (subPath == "siderealtime")
+          return returnSingleDouble(request,
+                                    runner.getPosition().siderealTimeHours);
 
         if (subPath == "declination")
-          return getDec(request, model, platform);
+          return getDec(request, runner);
 
         if (subPath == "rightascension")
-          return getRA(request, model, platform);
+          return getRA(request, runner);
 
         return handleNotFound(request);
       });
@@ -550,27 +716,33 @@ void setupWebServer(TelescopeModel &model, Preferences &prefs,
   //  PUTS implementation
 
   alpacaWebServer.on("^\\/api\\/v1\\/telescope\\/0\\/.*$", HTTP_PUT,
-                     [&model, &platform](AsyncWebServerRequest *request) {
+                     [&runner, &platform](AsyncWebServerRequest *request) {
                        String url = request->url();
                        log("Processing PUT on url %s", url.c_str());
                        // Strip off the initial portion of the URL
-                       String subPath = url.substring(
-                           String("/api/v1/telescope/0/").length());
+                       String subPath =
+                           url.substring(TELESCOPE_PATH_LENGTH);
 
                        if (subPath.startsWith("connected"))
                          return returnNoError(request);
 
+                       if (subPath.startsWith("action"))
+                         return performAction(request, runner, platform);
+
                        if (subPath.startsWith("synctocoordinates"))
-                         return syncToCoords(request, model, platform);
+                         return syncToCoords(request, runner, platform);
 
                        if (subPath.startsWith("sitelatitude"))
-                         return setSiteLatitude(request, model);
+                         return setSiteLatitude(request, runner);
 
                        if (subPath.startsWith("sitelongitude"))
-                         return setSiteLongitude(request, model);
+                         return setSiteLongitude(request, runner);
+
+                       if (subPath.startsWith("doesrefraction"))
+                         return setDoesRefraction(request, runner);
 
                        if (subPath.startsWith("utcdate"))
-                         return setUTCDate(request, model);
+                         return setUTCDate(request);
 
                        if (subPath.startsWith("trackingrate"))
                          return setTrackingRate(request, platform);
@@ -591,10 +763,10 @@ void setupWebServer(TelescopeModel &model, Preferences &prefs,
                          return pulseGuide(request, platform);
 
                        if (subPath.startsWith("abortslew"))
-                         return abortSlew(request, platform);
+                         return abortSlew(request, runner, platform);
 
                        if (subPath.startsWith("slewtocoordinatesasync"))
-                         return slewToCoords(request, model, platform);
+                         return slewToCoords(request, runner, platform);
 
                        // Add more routes here as needed
 
@@ -606,7 +778,7 @@ void setupWebServer(TelescopeModel &model, Preferences &prefs,
   // ===============================
 
   setupAlpacaManagment(alpacaWebServer);
-  setupWebUI(alpacaWebServer, model, platform, prefs);
+  setupWebUI(alpacaWebServer, runner, platform, prefs);
 
   alpacaWebServer.onNotFound(
       [](AsyncWebServerRequest *request) { handleNotFound(request); });
@@ -617,7 +789,6 @@ void setupWebServer(TelescopeModel &model, Preferences &prefs,
   // WebSerial.begin(&alpacaWebServer);
   // setWebSerialReady();
 
-  lastPositionCalculatedTime = 0;
   setupAlpacaDiscovery(WEBSERVER_PORT);
 
   log("Server started");
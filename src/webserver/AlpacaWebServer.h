@@ -1,10 +1,37 @@
 #ifndef MYWEBSERVER_H
 #define MYWEBSERVER_H
-#include "TelescopeModel.h"
+#include "ClientLatency.h"
+#include "ModelRunner.h"
+#include "MountState.h"
+#include "SyncGate.h"
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
 #include "EQPlatform.h"
 
-void setupWebServer(TelescopeModel &model,Preferences &prefs,EQPlatform &platform);
+void setupWebServer(ModelRunner &runner,Preferences &prefs,EQPlatform &platform);
+MountState collectMountState(ModelRunner &runner, EQPlatform &platform);
+
+/**
+ * The coordinates Alpaca clients send and get back:
+ * EQUATORIAL_SYSTEM_TOPOCENTRIC (JNow, what the model works in) or
+ * EQUATORIAL_SYSTEM_J2000, converted with the model task's EpochTransform.
+ * ASCOM has EquatorialSystem read only, so it's chosen from the WebUI.
+ * Web handler task only.
+ */
+void setEquatorialSystem(int system);
+int getEquatorialSystem();
+
+/**
+ * How far ahead of the encoders ra/dec are given to clients while the scope
+ * is being moved, see ClientLatency. Fixed in milliseconds, or negative to
+ * learn it from the WebUI's round trips and the clients' polls. Web
+ * handler task only.
+ */
+void setClientLatencyMillis(ModelRunner &runner, double millis);
+void addClientRoundTrip(ModelRunner &runner, double seconds);
+const ClientLatency &getClientLatency();
+
+// syncs let through or refused by SyncGate, and the last one's score
+SyncGateStats getSyncGateStats();
 
 #endif
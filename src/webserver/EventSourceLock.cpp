@@ -0,0 +1,28 @@
+#include "EventSourceLock.h"
+
+void lockEventSourceClient(AsyncEventSourceClient *client, std::mutex &lock,
+                           EventSourceClientGone gone) {
+  AsyncClient *tcp = client->client();
+  tcp->onAck(
+      [&lock](void *arg, AsyncClient *c, size_t len, uint32_t time) {
+        std::lock_guard<std::mutex> guard(lock);
+        static_cast<AsyncEventSourceClient *>(arg)->_onAck(len, time);
+      },
+      client);
+  tcp->onPoll(
+      [&lock](void *arg, AsyncClient *c) {
+        std::lock_guard<std::mutex> guard(lock);
+        static_cast<AsyncEventSourceClient *>(arg)->_onPoll();
+      },
+      client);
+  tcp->onDisconnect(
+      [&lock, gone](void *arg, AsyncClient *c) {
+        std::lock_guard<std::mutex> guard(lock);
+        AsyncEventSourceClient *client =
+            static_cast<AsyncEventSourceClient *>(arg);
+        gone(client);
+        client->_onDisconnect(); // deletes it
+        delete c;
+      },
+      client);
+}
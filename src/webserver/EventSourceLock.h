@@ -0,0 +1,28 @@
+#ifndef EVENT_SOURCE_LOCK_H
+#define EVENT_SOURCE_LOCK_H
+
+#include <ESPAsyncWebServer.h>
+#include <mutex>
+
+// called with the lock held, just before the client is deleted
+typedef void (*EventSourceClientGone)(AsyncEventSourceClient *client);
+
+/**
+ * Makes it safe to send to client from another task, holding lock. Call
+ * from the event source's onConnect.
+ *
+ * AsyncEventSourceClient runs its message queue from its AsyncClient's ack
+ * and poll handlers on async_tcp, and deletes itself from the disconnect
+ * handler, none of them locked. This puts the same handlers back with lock
+ * held around each, and gone called before the delete.
+ *
+ * It replaces handlers the library sets itself, calling its _onAck,
+ * _onPoll and _onDisconnect as they do, so it's written against exactly
+ * ottowinter/ESPAsyncWebServer-esphome 3.0.0 (pinned in platformio.ini).
+ * Check AsyncEventSourceClient's constructor against this before moving
+ * the pin.
+ */
+void lockEventSourceClient(AsyncEventSourceClient *client, std::mutex &lock,
+                           EventSourceClientGone gone);
+
+#endif
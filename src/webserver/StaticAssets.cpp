@@ -0,0 +1,119 @@
+#include "StaticAssets.h"
+#include "Logging.h"
+#include "WebAssets.h"
+#include <LittleFS.h>
+
+#define MANIFEST_BUFFER_SIZE 1024
+
+static WebAssetTable assets;
+
+/**
+ * Looks each GET up in the asset table, so anything that isn't a WebUI file
+ * falls through to onNotFound as before.
+ */
+class StaticAssetHandler : public AsyncWebHandler {
+public:
+  bool canHandle(AsyncWebServerRequest *request) override {
+    if (request->method() != HTTP_GET ||
+        assets.find(request->url().c_str()) == nullptr) {
+      return false;
+    }
+    // the server drops headers no handler has asked for
+    request->addInterestingHeader("If-None-Match");
+    request->addInterestingHeader("Range");
+    return true;
+  }
+
+  void handleRequest(AsyncWebServerRequest *request) override {
+    const WebAsset *asset = assets.find(request->url().c_str());
+    if (asset == nullptr) {
+      request->send(404);
+      return;
+    }
+    if (request->hasHeader("If-None-Match") &&
+        webAssetEtagMatches(request->header("If-None-Match").c_str(),
+                            asset->etag)) {
+      AsyncWebServerResponse *response = request->beginResponse(304);
+      addCacheHeaders(response, asset);
+      request->send(response);
+      return;
+    }
+
+    uint32_t start = 0;
+    uint32_t end = asset->size - 1;
+    WebAssetRangeResult range = WEB_ASSET_RANGE_NONE;
+    if (request->hasHeader("Range")) {
+      range = parseWebAssetRange(request->header("Range").c_str(), asset->size,
+                                 start, end);
+    }
+    char contentRange[48];
+    if (range == WEB_ASSET_RANGE_UNSATISFIABLE) {
+      AsyncWebServerResponse *response = request->beginResponse(416);
+      snprintf(contentRange, sizeof(contentRange), "bytes */%lu",
+               (unsigned long)asset->size);
+      response->addHeader("Content-Range", contentRange);
+      request->send(response);
+      return;
+    }
+
+    char path[sizeof(STATIC_ASSET_DIRECTORY) + WEB_ASSET_FILE_SIZE];
+    snprintf(path, sizeof(path), "%s%s", STATIC_ASSET_DIRECTORY, asset->file);
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      log("WebUI file %s missing", path);
+      request->send(500);
+      return;
+    }
+    // read straight into the TCP send buffer a piece at a time, so the
+    // file is never held in RAM
+    AsyncWebServerResponse *response = request->beginResponse(
+        asset->contentType, end - start + 1,
+        [file, start](uint8_t *buffer, size_t maxLength,
+                      size_t index) mutable -> size_t {
+          if (!file.seek(start + index)) {
+            return 0;
+          }
+          return file.read(buffer, maxLength);
+        });
+    if (range == WEB_ASSET_RANGE_PARTIAL) {
+      response->setCode(206);
+      snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu",
+               (unsigned long)start, (unsigned long)end,
+               (unsigned long)asset->size);
+      response->addHeader("Content-Range", contentRange);
+    }
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("Accept-Ranges", "bytes");
+    addCacheHeaders(response, asset);
+    request->send(response);
+  }
+
+private:
+  static void addCacheHeaders(AsyncWebServerResponse *response,
+                              const WebAsset *asset) {
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control",
+                        asset->immutable ? WEB_ASSET_IMMUTABLE_CACHE_CONTROL
+                                         : WEB_ASSET_REVALIDATE_CACHE_CONTROL);
+    response->addHeader("Vary", "Accept-Encoding");
+  }
+};
+
+void setupStaticAssets(AsyncWebServer &server) {
+  File manifest = LittleFS.open(STATIC_ASSET_DIRECTORY WEB_ASSET_MANIFEST, "r");
+  if (!manifest) {
+    log("No WebUI manifest, run tools/build_webui.py and upload the "
+        "filesystem");
+    return;
+  }
+  char buffer[MANIFEST_BUFFER_SIZE];
+  size_t length = manifest.read((uint8_t *)buffer, sizeof(buffer));
+  manifest.close();
+  if (length == sizeof(buffer) ||
+      assets.parseManifest(buffer, length) <= 0) {
+    log("Can't read the WebUI manifest");
+    return;
+  }
+  log("WebUI: %d files", (int)assets.size());
+  server.addHandler(new StaticAssetHandler());
+}
@@ -0,0 +1,17 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <ESPAsyncWebServer.h>
+
+// built by tools/build_webui.py into data/www
+#define STATIC_ASSET_DIRECTORY "/www/"
+
+/**
+ * Serves the WebUI from the precompressed, fingerprinted files in
+ * STATIC_ASSET_DIRECTORY: gzip encoded as stored, with ETag/304 handling,
+ * long lived caching for the fingerprinted files and single byte ranges.
+ * Call after LittleFS.begin().
+ */
+void setupStaticAssets(AsyncWebServer &server);
+
+#endif
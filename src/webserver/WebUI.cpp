@@ -1,19 +1,90 @@
 #include "WebUI.h"
+#include "AlpacaWebServer.h"
 #include "Encoders.h"
+#include "EventSourceLock.h"
 #include "Logging.h"
-#include "TelescopeModel.h"
+#include "Metrics.h"
+#include "ModelPreferences.h"
+#include "ModelRunner.h"
+#include "PushTo.h"
+#include "SessionRecording.h"
+#include "SkyCatalogue.h"
+#include "StaticAssets.h"
+#include "Tasks.h"
 #include <ArduinoJson.h>
 #include <EQPlatform.h>
 #include <LittleFS.h>
 #include <Preferences.h>
+#include <mutex>
+
+#define PUSH_TO_EVENT_BUFFER_SIZE 160
+#define PUSH_TO_MAX_CLIENTS 4 // browsers following the guidance at once
+
+static AsyncEventSource pushToEvents("/pushToEvents");
+static ModelRunner *pushToRunner = nullptr;
+static bool pushToWasActive = false;
+
+/**
+ * The push-to clients, sent to from the network task. The event source
+ * keeps its own client list, changed from async_tcp with no lock, so the
+ * network task never goes near it: it sends to these instead. Adding and
+ * removing them, every send, and async_tcp's handling of each client (see
+ * lockEventSourceClient) all hold pushToClientsLock.
+ */
+static std::mutex pushToClientsLock;
+static AsyncEventSourceClient *pushToClients[PUSH_TO_MAX_CLIENTS];
+
+// with the lock held
+static void forgetPushToClient(AsyncEventSourceClient *client) {
+  for (int i = 0; i < PUSH_TO_MAX_CLIENTS; i++) {
+    if (pushToClients[i] == client) {
+      pushToClients[i] = nullptr;
+    }
+  }
+}
 
-#define PREF_ALT_STEPS_KEY "AltStepsKey"
-#define PREF_AZ_STEPS_KEY "AzStepsKey"
+// on async_tcp, as the client's added
+static void onPushToConnect(AsyncEventSourceClient *client) {
+  lockEventSourceClient(client, pushToClientsLock, forgetPushToClient);
+  {
+    std::lock_guard<std::mutex> guard(pushToClientsLock);
+    for (int i = 0; i < PUSH_TO_MAX_CLIENTS; i++) {
+      if (pushToClients[i] == nullptr) {
+        pushToClients[i] = client;
+        return;
+      }
+    }
+  }
+  // closing it here would delete it under the library's feet, so it
+  // just goes without guidance
+  log("Push to: too many clients");
+}
+
+// to every push-to client, holding the lock
+static void sendPushTo(const char *frame) {
+  std::lock_guard<std::mutex> guard(pushToClientsLock);
+  for (int i = 0; i < PUSH_TO_MAX_CLIENTS; i++) {
+    if (pushToClients[i] != nullptr && pushToClients[i]->connected()) {
+      pushToClients[i]->send(frame, "pushto");
+    }
+  }
+}
 
-void getScopeStatus(AsyncWebServerRequest *request, TelescopeModel &model,
+static bool hasPushToClients() {
+  std::lock_guard<std::mutex> guard(pushToClientsLock);
+  for (int i = 0; i < PUSH_TO_MAX_CLIENTS; i++) {
+    if (pushToClients[i] != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void getScopeStatus(AsyncWebServerRequest *request, ModelRunner &runner,
                     EQPlatform &platform) {
   // log("/getStatus");
-  platform.checkConnectionStatus();
+  PlatformTelemetry telemetry = platform.getTelemetry();
+  AlignmentSnapshot model = runner.getAlignment();
 
   // Estimate JSON capacity
   const size_t capacity = JSON_OBJECT_SIZE(15);
@@ -24,16 +95,15 @@ void getScopeStatus(AsyncWebServerRequest *request, TelescopeModel &model,
   doc["calculateAltEncoderStepsPerRevolution"] = model.calculatedAltEncoderRes;
   doc["calculateAzEncoderStepsPerRevolution"] = model.calculatedAziEncoderRes;
   doc["actualAltEncoderStepsPerRevolution"] =
-      model.getAltEncoderStepsPerRevolution();
-  doc["actualAzEncoderStepsPerRevolution"] =
-      model.getAzEncoderStepsPerRevolution();
+      model.altEncoderStepsPerRevolution;
+  doc["actualAzEncoderStepsPerRevolution"] = model.azEncoderStepsPerRevolution;
 
-  doc["eqPlatformIP"] = platform.eqPlatformIP.c_str();
-  doc["platformTracking"] = platform.currentlyRunning;
+  doc["eqPlatformIP"] = telemetry.ip;
+  doc["platformTracking"] = telemetry.currentlyRunning;
   doc["timeToMiddle"] =
-      static_cast<float>(platform.runtimeFromCenterSeconds) / 60.0f;
-  doc["timeToEnd"] = static_cast<float>(platform.timeToEnd) / 60.0f;
-  doc["platformConnected"] = platform.platformConnected;
+      static_cast<float>(telemetry.runtimeFromCenterSeconds) / 60.0f;
+  doc["timeToEnd"] = static_cast<float>(telemetry.timeToEnd) / 60.0f;
+  doc["platformConnected"] = isPlatformConnected(telemetry, getNow());
   doc["lastAlignmentTimestamp"]=timePointToString(model.lastSyncPoint.timePoint);
 
   String json;
@@ -42,13 +112,34 @@ void getScopeStatus(AsyncWebServerRequest *request, TelescopeModel &model,
   request->send(200, "application/json", json);
 }
 
-void getAlignmentData(AsyncWebServerRequest *request, TelescopeModel &model,
+/**
+ * Same state as the Alpaca getstate action, as plain json. One request
+ * gives the WebUI everything it shows apart from the alignment details.
+ * The WebUI passes how long its last one took (rtt, milliseconds) for
+ * ClientLatency to learn from.
+ */
+void getState(AsyncWebServerRequest *request, ModelRunner &runner,
+              EQPlatform &platform) {
+  if (request->hasArg("rtt")) {
+    addClientRoundTrip(runner, request->arg("rtt").toDouble() / 1000);
+  }
+  char buffer[MOUNT_STATE_BUFFER_SIZE];
+  if (renderMountState(collectMountState(runner, platform), buffer,
+                       sizeof(buffer)) == 0) {
+    request->send(500);
+    return;
+  }
+  request->send(200, "application/json", buffer);
+}
+
+void getAlignmentData(AsyncWebServerRequest *request, ModelRunner &runner,
                       EQPlatform &platform) {
+  AlignmentSnapshot model = runner.getAlignment();
   const size_t capacity =
       JSON_ARRAY_SIZE(model.baseAlignmentSynchPoints.size()) +
       JSON_OBJECT_SIZE(3) +
       model.baseAlignmentSynchPoints.size() * JSON_OBJECT_SIZE(7) +
-      JSON_OBJECT_SIZE(7);
+      JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(8);
 
   DynamicJsonDocument doc(capacity);
 
@@ -75,110 +166,498 @@ void getAlignmentData(AsyncWebServerRequest *request, TelescopeModel &model,
   lastSyncPoint["az"] = model.lastSyncPoint.encoderAltAz.aziInDegrees;
   lastSyncPoint["error"] = model.lastSyncPoint.errorInDegreesAtCreation;
 
+  // the last sync asked for, whether or not SyncGate let it through
+  SyncGateStats syncs = getSyncGateStats();
+  JsonObject syncGate = doc.createNestedObject("syncGate");
+  syncGate["accepted"] = syncs.accepted;
+  syncGate["rejected"] = syncs.rejected;
+  syncGate["lastAccepted"] = syncs.last.accepted;
+  syncGate["lastReason"] = syncs.last.reason ? syncs.last.reason : "";
+  syncGate["lastQuality"] = syncs.last.quality;
+  syncGate["lastSpread"] = syncs.last.spreadDegrees;
+  syncGate["lastSamples"] = syncs.last.samples;
+
   String json;
   serializeJson(doc, json);
 
   request->send(200, "application/json", json);
 }
 
-void saveAltEncoderSteps(AsyncWebServerRequest *request, TelescopeModel &model,
-                         Preferences &prefs) {
+// applied, but the write to flash was refused (see persistLong)
+static void sendNotSaved(AsyncWebServerRequest *request) {
+  request->send(503, "text/plain", "Applied but not saved, try again");
+}
+
+void saveAltEncoderSteps(AsyncWebServerRequest *request, ModelRunner &runner) {
 
-  long alt = model.calculatedAltEncoderRes;
+  long alt = runner.getAlignment().calculatedAltEncoderRes;
   log("Setting new value for encoder alt steps  to %ld", alt);
-  model.setAltEncoderStepsPerRevolution(alt);
+  runner.requestAltEncoderStepsPerRevolution(alt);
 
-  prefs.putLong(PREF_ALT_STEPS_KEY, alt);
+  if (!persistLong(PREF_ALT_STEPS_KEY, alt)) {
+    sendNotSaved(request);
+    return;
+  }
   request->send(200);
 }
 
-void saveAzEncoderSteps(AsyncWebServerRequest *request, TelescopeModel &model,
-                        Preferences &prefs) {
+void saveAzEncoderSteps(AsyncWebServerRequest *request, ModelRunner &runner) {
 
-  long az = model.calculatedAziEncoderRes;
+  long az = runner.getAlignment().calculatedAziEncoderRes;
   log("Setting new value for encoder az steps to %ld", az);
-  model.setAzEncoderStepsPerRevolution(az);
+  runner.requestAzEncoderStepsPerRevolution(az);
 
-  prefs.putLong(PREF_AZ_STEPS_KEY, az);
+  if (!persistLong(PREF_AZ_STEPS_KEY, az)) {
+    sendNotSaved(request);
+    return;
+  }
   request->send(200);
 }
-void clearAlignment(AsyncWebServerRequest *request, TelescopeModel &model) {
+void clearAlignment(AsyncWebServerRequest *request, ModelRunner &runner) {
   log("Clearing alignment");
-  model.clearAlignment();
+  runner.requestClearAlignment();
   request->send(200);
 }
-void loadPreferences(Preferences &prefs, TelescopeModel &model) {
-  model.setAltEncoderStepsPerRevolution(
-      prefs.getLong(PREF_ALT_STEPS_KEY, -30000));
+void loadPreferences(Preferences &prefs, ModelRunner &runner) {
+  runner.requestAltEncoderStepsPerRevolution(
+      prefs.getLong(PREF_ALT_STEPS_KEY, AltAxis::stepsPerRevolution));
+
+  runner.requestAzEncoderStepsPerRevolution(
+      prefs.getLong(PREF_AZ_STEPS_KEY, AzAxis::stepsPerRevolution));
+
+  setEquatorialSystem(
+      prefs.getLong(PREF_EQUATORIAL_SYSTEM_KEY, EQUATORIAL_SYSTEM_TOPOCENTRIC));
+
+  runner.requestDoesRefraction(prefs.getLong(PREF_REFRACTION_KEY, 1) != 0);
+  runner.requestRefractionConditions(
+      prefs.getLong(PREF_TEMPERATURE_KEY,
+                    lround(REFRACTION_STANDARD_TEMPERATURE * 10)) /
+          10.0,
+      prefs.getLong(PREF_PRESSURE_KEY,
+                    lround(REFRACTION_STANDARD_PRESSURE * 10)) /
+          10.0);
+
+  setClientLatencyMillis(runner, prefs.getLong(PREF_CLIENT_LATENCY_KEY, -1));
+}
 
-  model.setAzEncoderStepsPerRevolution(
-      prefs.getLong(PREF_AZ_STEPS_KEY, 108531));
+void getRefractionSettings(AsyncWebServerRequest *request,
+                           ModelRunner &runner) {
+  AlignmentSnapshot model = runner.getAlignment();
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer),
+           "{\"enabled\":%s,\"temperature\":%.1f,\"pressure\":%.1f}",
+           model.doesRefraction ? "true" : "false", model.temperatureCelsius,
+           model.pressureMillibars);
+  request->send(200, "application/json", buffer);
 }
 
-// safety: clears encoder steps
-void clearPrefs(AsyncWebServerRequest *request, Preferences &prefs,
-                TelescopeModel &model) {
+/**
+ * Refraction on/off and the air it's worked out for: temperature in
+ * celsius, pressure in millibars at the site (not sea level).
+ */
+void saveRefractionSettings(AsyncWebServerRequest *request,
+                            ModelRunner &runner) {
+  if (!request->hasArg("enabled") || !request->hasArg("temperature") ||
+      !request->hasArg("pressure")) {
+    request->send(400, "text/plain",
+                  "enabled, temperature (C) and pressure (mb) needed");
+    return;
+  }
+  bool enabled = request->arg("enabled") == "true";
+  double temperature = request->arg("temperature").toDouble();
+  double pressure = request->arg("pressure").toDouble();
+  if (temperature < -50 || temperature > 50 || pressure < 500 ||
+      pressure > 1100) {
+    request->send(400, "text/plain",
+                  "temperature -50 to 50 C, pressure 500 to 1100 mb");
+    return;
+  }
+  log("Refraction %s, %.1fC %.1fmb", enabled ? "on" : "off", temperature,
+      pressure);
+  runner.requestDoesRefraction(enabled);
+  runner.requestRefractionConditions(temperature, pressure);
+  if (!persistLong(PREF_REFRACTION_KEY, enabled ? 1 : 0) ||
+      !persistLong(PREF_TEMPERATURE_KEY, lround(temperature * 10)) ||
+      !persistLong(PREF_PRESSURE_KEY, lround(pressure * 10))) {
+    sendNotSaved(request);
+    return;
+  }
+  request->send(200);
+}
 
-  prefs.remove(PREF_ALT_STEPS_KEY);
-  prefs.remove(PREF_AZ_STEPS_KEY);
+void getEquatorialSystemSetting(AsyncWebServerRequest *request) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "{\"system\":%d}", getEquatorialSystem());
+  request->send(200, "application/json", buffer);
+}
+
+// JNow or J2000 for Alpaca clients, see setEquatorialSystem
+void saveEquatorialSystem(AsyncWebServerRequest *request) {
+  if (!request->hasArg("system")) {
+    request->send(400, "text/plain", "system (1 JNow, 2 J2000) needed");
+    return;
+  }
+  int system = request->arg("system").toInt();
+  if (system != EQUATORIAL_SYSTEM_TOPOCENTRIC &&
+      system != EQUATORIAL_SYSTEM_J2000) {
+    request->send(400, "text/plain", "system must be 1 (JNow) or 2 (J2000)");
+    return;
+  }
+  log("Alpaca equatorial system now %d", system);
+  setEquatorialSystem(system);
+  if (!persistLong(PREF_EQUATORIAL_SYSTEM_KEY, system)) {
+    sendNotSaved(request);
+    return;
+  }
+  request->send(200);
+}
 
-  loadPreferences(prefs, model);
+void getClientLatencySetting(AsyncWebServerRequest *request) {
+  const ClientLatency &latency = getClientLatency();
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer),
+           "{\"automatic\":%s,\"millis\":%.0f,\"roundTrip\":%.0f,"
+           "\"poll\":%.0f}",
+           latency.isAutomatic() ? "true" : "false",
+           latency.getSeconds() * 1000, latency.getRoundTripSeconds() * 1000,
+           latency.getPollSeconds() * 1000);
+  request->send(200, "application/json", buffer);
+}
+
+/**
+ * How far ahead ra/dec are given to clients while the scope is moving:
+ * millis, or blank to learn it.
+ */
+void saveClientLatency(AsyncWebServerRequest *request, ModelRunner &runner) {
+  if (!request->hasArg("millis")) {
+    request->send(400, "text/plain", "millis (blank for automatic) needed");
+    return;
+  }
+  String arg = request->arg("millis");
+  long millis = arg.length() == 0 ? -1 : arg.toInt();
+  if (millis > MOTION_MAX_LEAD_SECONDS * 1000) {
+    request->send(400, "text/plain", "millis 0 to 1000, blank for automatic");
+    return;
+  }
+  if (millis < 0) {
+    millis = -1;
+    log("Client latency automatic");
+  } else {
+    log("Client latency %ldms", millis);
+  }
+  setClientLatencyMillis(runner, millis);
+  if (!persistLong(PREF_CLIENT_LATENCY_KEY, millis)) {
+    sendNotSaved(request);
+    return;
+  }
+  request->send(200);
+}
+
+// every setting clearPrefs puts back to its default
+static const char *const clearedPrefKeys[] = {
+    PREF_ALT_STEPS_KEY,    PREF_AZ_STEPS_KEY,    PREF_EQUATORIAL_SYSTEM_KEY,
+    PREF_REFRACTION_KEY,   PREF_TEMPERATURE_KEY, PREF_PRESSURE_KEY,
+    PREF_CLIENT_LATENCY_KEY};
+
+// safety: clears encoder steps
+void clearPrefs(AsyncWebServerRequest *request, ModelRunner &runner) {
+  // one write, so it's all or nothing
+  if (!persistRemoveAll(clearedPrefKeys,
+                        sizeof(clearedPrefKeys) / sizeof(clearedPrefKeys[0]))) {
+    request->send(503, "text/plain", "Busy saving settings, try again");
+    return;
+  }
+
+  // back to defaults
+  runner.requestAltEncoderStepsPerRevolution(AltAxis::stepsPerRevolution);
+  runner.requestAzEncoderStepsPerRevolution(AzAxis::stepsPerRevolution);
+  setEquatorialSystem(EQUATORIAL_SYSTEM_TOPOCENTRIC);
+  runner.requestDoesRefraction(true);
+  runner.requestRefractionConditions(REFRACTION_STANDARD_TEMPERATURE,
+                                     REFRACTION_STANDARD_PRESSURE);
+  setClientLatencyMillis(runner, -1);
   request->send(200);
 }
 
 void performZeroedAlignment(AsyncWebServerRequest *request,
-                            EQPlatform &platform, TelescopeModel &model) {
+                            EQPlatform &platform, ModelRunner &runner) {
   zeroEncoders();
+  // the platform takes where it is now as center
   platform.zeroOffsetTime();
-  TimePoint now = platform.calculateAdjustedTime();
-  model.performZeroedAlignment(now);
+  runner.requestZeroedAlignment(getNow());
+  request->send(200);
+}
+void startPushTo(AsyncWebServerRequest *request, ModelRunner &runner) {
+  if (!request->hasArg("ra") || !request->hasArg("dec")) {
+    request->send(400, "text/plain", "ra (hours) and dec (degrees) needed");
+    return;
+  }
+  double ra = request->arg("ra").toDouble();
+  double dec = request->arg("dec").toDouble();
+  log("Push to ra %lf dec %lf", ra, dec);
+  runner.requestPushTo(ra, dec);
   request->send(200);
 }
-void setupWebUI(AsyncWebServer &alpacaWebServer, TelescopeModel &model,
+
+void cancelPushTo(AsyncWebServerRequest *request, ModelRunner &runner) {
+  runner.requestCancelPushTo();
+  request->send(200);
+}
+
+/**
+ * One push-to frame: how far to move in alt and az, from the track the
+ * model task precalculated and the raw encoder counts. Cheap (no model
+ * maths) so it can run at 20Hz. Nothing is sent when no one's listening.
+ * On the network task, so it only uses the locked client list.
+ */
+void streamPushTo() {
+  if (pushToRunner == nullptr || !hasPushToClients()) {
+    return;
+  }
+  PushToTrack track = pushToRunner->getPushTo();
+  PushToDelta delta;
+  if (!calculatePushToDelta(track, getEncoderAl(), getEncoderAz(), getNow(),
+                            delta)) {
+    if (pushToWasActive) {
+      sendPushTo("{\"active\":false}");
+      pushToWasActive = false;
+    }
+    return;
+  }
+  pushToWasActive = true;
+  char buffer[PUSH_TO_EVENT_BUFFER_SIZE];
+  snprintf(buffer, sizeof(buffer),
+           "{\"active\":true,\"id\":%lu,\"ra\":%.4f,\"dec\":%.4f,"
+           "\"alt\":%.3f,\"az\":%.3f,\"onTrack\":%s}",
+           (unsigned long)track.id, track.raHours, track.decDegrees,
+           pushToStepsToDegrees(delta.altSteps, track.altStepsPerRevolution),
+           pushToStepsToDegrees(delta.azSteps, track.azStepsPerRevolution),
+           delta.onTrack ? "true" : "false");
+  sendPushTo(buffer);
+}
+
+// Objects around the current position, from the catalogue task
+void getNearbyObjects(AsyncWebServerRequest *request) {
+  char buffer[CATALOGUE_NEARBY_BUFFER_SIZE];
+  if (renderNearbyObjects(getNearby(), buffer, sizeof(buffer)) == 0) {
+    request->send(500);
+    return;
+  }
+  request->send(200, "application/json", buffer);
+}
+
+struct SessionFile {
+  uint32_t sequence;
+  uint32_t size;
+};
+
+/**
+ * The session recorder's files, oldest first, and what recording has cost
+ * an hour. Asks for whatever is buffered to be written out, so the newest
+ * file is up to date by the time it's downloaded.
+ */
+void getSessionFiles(AsyncWebServerRequest *request) {
+  requestSessionFlush();
+  // one spare, in case the housekeeping task is part way through rotating
+  SessionFile files[RECORDER_FILE_COUNT + 1];
+  size_t count = 0;
+  File directory = LittleFS.open(SESSION_DIRECTORY);
+  File file;
+  while (directory && count < RECORDER_FILE_COUNT + 1 &&
+         (file = directory.openNextFile())) {
+    const char *name = strrchr(file.name(), '/');
+    name = name ? name + 1 : file.name();
+    SessionFile entry;
+    if (parseRecorderFileName(name, entry.sequence)) {
+      entry.size = file.size();
+      size_t i = count++;
+      for (; i > 0 && files[i - 1].sequence > entry.sequence; i--) {
+        files[i] = files[i - 1];
+      }
+      files[i] = entry;
+    }
+    file.close();
+  }
+
+  RecorderStats stats = getSessionRecorderStats();
+  double hours = stats.hours() > 0 ? stats.hours() : 1;
+  const size_t capacity =
+      JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(RECORDER_FILE_COUNT + 1) +
+      (RECORDER_FILE_COUNT + 1) *
+          (JSON_OBJECT_SIZE(2) + RECORDER_FILE_NAME_SIZE);
+  DynamicJsonDocument doc(capacity);
+  JsonArray list = doc.createNestedArray("files");
+  for (size_t i = 0; i < count; i++) {
+    char name[RECORDER_FILE_NAME_SIZE];
+    formatRecorderFileName(files[i].sequence, name, sizeof(name));
+    JsonObject entry = list.createNestedObject();
+    entry["name"] = name; // copied, it isn't const
+    entry["size"] = files[i].size;
+  }
+  doc["bytesPerHour"] = stats.bytes / hours;
+  doc["flashWritesPerHour"] = stats.flashWrites / hours;
+  doc["cpuMillisPerHour"] = (stats.recordTicks + stats.flushTicks) *
+                            metricsSecondsPerTick() * 1000 / hours;
+  doc["bufferedBytes"] = stats.bufferedBytes;
+  doc["failures"] = stats.failures;
+
+  String json;
+  serializeJson(doc, json);
+  request->send(200, "application/json", json);
+}
+
+void getSessionFile(AsyncWebServerRequest *request) {
+  uint32_t sequence;
+  // only names the recorder makes, so nothing else on LittleFS
+  if (!request->hasArg("file") ||
+      !parseRecorderFileName(request->arg("file").c_str(), sequence)) {
+    request->send(400, "text/plain", "file needed, see /sessionFiles");
+    return;
+  }
+  char path[sizeof(SESSION_DIRECTORY) + RECORDER_FILE_NAME_SIZE];
+  snprintf(path, sizeof(path), SESSION_DIRECTORY "/%s",
+           request->arg("file").c_str());
+  if (!LittleFS.exists(path)) {
+    request->send(404);
+    return;
+  }
+  request->send(LittleFS, path, "application/octet-stream", true);
+}
+
+#ifdef ENABLE_METRICS
+static bool printMetricsLine(const char *line, void *context) {
+  static_cast<AsyncResponseStream *>(context)->print(line);
+  return true;
+}
+
+/**
+ * Latency histograms for each instrumented stage, in Prometheus text
+ * format. Rendered a line at a time straight into the response, so no
+ * buffer has to hold all of a stage's buckets.
+ */
+void getMetrics(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response =
+      request->beginResponseStream("text/plain; version=0.0.4");
+  double secondsPerTick = metricsSecondsPerTick();
+  for (int i = 0; i < METRIC_STAGE_COUNT; i++) {
+    MetricStage stage = static_cast<MetricStage>(i);
+    renderPrometheusHistogram(metricsStageName(stage), metricsStageHelp(stage),
+                              metricsHistogram(stage), secondsPerTick,
+                              printMetricsLine, response);
+  }
+  request->send(response);
+}
+#endif
+
+void setupWebUI(AsyncWebServer &alpacaWebServer, ModelRunner &runner,
                 EQPlatform &platform, Preferences &prefs) {
-  loadPreferences(prefs, model);
+  loadPreferences(prefs, runner);
   alpacaWebServer.on("/getScopeStatus", HTTP_GET,
-                     [&model, &platform](AsyncWebServerRequest *request) {
-                       getScopeStatus(request, model, platform);
+                     [&runner, &platform](AsyncWebServerRequest *request) {
+                       getScopeStatus(request, runner, platform);
+                     });
+
+  alpacaWebServer.on("/getState", HTTP_GET,
+                     [&runner, &platform](AsyncWebServerRequest *request) {
+                       getState(request, runner, platform);
                      });
 
   alpacaWebServer.on("/getAlignmentData", HTTP_GET,
-                     [&model, &platform](AsyncWebServerRequest *request) {
-                       getAlignmentData(request, model, platform);
+                     [&runner, &platform](AsyncWebServerRequest *request) {
+                       getAlignmentData(request, runner, platform);
                      });
 
   alpacaWebServer.on("/saveAltEncoderSteps", HTTP_POST,
-                     [&model, &prefs](AsyncWebServerRequest *request) {
-                       saveAltEncoderSteps(request, model, prefs);
+                     [&runner](AsyncWebServerRequest *request) {
+                       saveAltEncoderSteps(request, runner);
                      });
 
   alpacaWebServer.on("/saveAzEncoderSteps", HTTP_POST,
-                     [&model, &prefs](AsyncWebServerRequest *request) {
-                       saveAzEncoderSteps(request, model, prefs);
+                     [&runner](AsyncWebServerRequest *request) {
+                       saveAzEncoderSteps(request, runner);
                      });
 
   alpacaWebServer.on("/clearAlignment", HTTP_POST,
-                     [&model, &prefs](AsyncWebServerRequest *request) {
-                       clearAlignment(request, model);
+                     [&runner](AsyncWebServerRequest *request) {
+                       clearAlignment(request, runner);
                      });
 
   alpacaWebServer.on("/clearPrefs", HTTP_POST,
-                     [&model, &prefs](AsyncWebServerRequest *request) {
-                       clearPrefs(request, prefs, model);
+                     [&runner](AsyncWebServerRequest *request) {
+                       clearPrefs(request, runner);
+                     });
+
+  alpacaWebServer.on("/equatorialSystem", HTTP_GET,
+                     [](AsyncWebServerRequest *request) {
+                       getEquatorialSystemSetting(request);
+                     });
+
+  alpacaWebServer.on("/equatorialSystem", HTTP_POST,
+                     [](AsyncWebServerRequest *request) {
+                       saveEquatorialSystem(request);
+                     });
+
+  alpacaWebServer.on("/refraction", HTTP_GET,
+                     [&runner](AsyncWebServerRequest *request) {
+                       getRefractionSettings(request, runner);
+                     });
+
+  alpacaWebServer.on("/refraction", HTTP_POST,
+                     [&runner](AsyncWebServerRequest *request) {
+                       saveRefractionSettings(request, runner);
+                     });
+
+  alpacaWebServer.on("/clientLatency", HTTP_GET,
+                     [](AsyncWebServerRequest *request) {
+                       getClientLatencySetting(request);
+                     });
+
+  alpacaWebServer.on("/clientLatency", HTTP_POST,
+                     [&runner](AsyncWebServerRequest *request) {
+                       saveClientLatency(request, runner);
                      });
 
   alpacaWebServer.on("/performZeroedAlignment", HTTP_POST,
-                     [&model, &platform](AsyncWebServerRequest *request) {
-                       performZeroedAlignment(request, platform, model);
+                     [&runner, &platform](AsyncWebServerRequest *request) {
+                       performZeroedAlignment(request, platform, runner);
+                     });
+
+  alpacaWebServer.on("/pushTo", HTTP_POST,
+                     [&runner](AsyncWebServerRequest *request) {
+                       startPushTo(request, runner);
+                     });
+
+  alpacaWebServer.on("/cancelPushTo", HTTP_POST,
+                     [&runner](AsyncWebServerRequest *request) {
+                       cancelPushTo(request, runner);
+                     });
+  pushToRunner = &runner;
+  pushToEvents.onConnect(onPushToConnect);
+  alpacaWebServer.addHandler(&pushToEvents);
+
+  alpacaWebServer.on("/nearby", HTTP_GET, [](AsyncWebServerRequest *request) {
+    getNearbyObjects(request);
+  });
+
+  alpacaWebServer.on("/sessionFiles", HTTP_GET,
+                     [](AsyncWebServerRequest *request) {
+                       getSessionFiles(request);
                      });
+  alpacaWebServer.on("/session", HTTP_GET, [](AsyncWebServerRequest *request) {
+    getSessionFile(request);
+  });
 
   alpacaWebServer.on("/trackingOn", HTTP_GET,
-                     [&model, &platform](AsyncWebServerRequest *request) {
+                     [&platform](AsyncWebServerRequest *request) {
                        platform.setTracking(true);
                      });
   alpacaWebServer.on("/trackingOff", HTTP_GET,
-                     [&model, &platform](AsyncWebServerRequest *request) {
+                     [&platform](AsyncWebServerRequest *request) {
                        platform.setTracking(false);
                      });
-  alpacaWebServer.serveStatic("/", LittleFS, "/fs/");
+#ifdef ENABLE_METRICS
+  alpacaWebServer.on("/metrics", HTTP_GET,
+                     [](AsyncWebServerRequest *request) { getMetrics(request); });
+#endif
+  setupStaticAssets(alpacaWebServer);
 }
@@ -1,11 +1,14 @@
 #ifndef WEBUI
 #define WEBUI
-#include "TelescopeModel.h"
+#include "ModelRunner.h"
 #include "EQPlatform.h"
 #include <Preferences.h>
 
 #include <ESPAsyncWebServer.h>
-void setupWebUI(AsyncWebServer &alpacaWebServer, TelescopeModel &model,
+void setupWebUI(AsyncWebServer &alpacaWebServer, ModelRunner &runner,
                 EQPlatform &platform,  Preferences &prefs);
 
+// Send a push-to guidance frame to connected WebUIs. Network task only.
+void streamPushTo();
+
 #endif
@@ -1,6 +1,36 @@
+#include "AlpacaResponseCache.h"
+#include "BootTimeline.h"
+#include "Catalogue.h"
+#include "ClientLatency.h"
+#include "CommandChannel.h"
 #include "CoordConv.hpp"
+#include "EncoderAxis.h"
+#include "EncoderHistory.h"
+#include "EncoderMotion.h"
+#include "EncoderScale.h"
+#include "EpochTransform.h"
 #include "Logging.h"
+#include "Metrics.h"
+#include "ModelRunner.h"
+#include "MountState.h"
+#include "PlatformKinematics.h"
+#include "PlatformPacket.h"
+#include "PlatformTelemetry.h"
+#include "PulseGuide.h"
+#include "PushTo.h"
+#include "Refraction.h"
+#include "SeqLock.h"
+#include "SessionRecorder.h"
+#include "SessionReplay.h"
+#include "Sidereal.h"
+#include "SlewController.h"
+#include "Sntp.h"
+#include "SpscQueue.h"
+#include "SyncGate.h"
 #include "TelescopeModel.h"
+#include "TimeService.h"
+#include "VisibilityPlanner.h"
+#include "WebAssets.h"
 #include <Ephemeris.h>
 
 #include "TimePoint.h"
@@ -11,7 +41,26 @@
 #include <string>
 #include <unity.h>
 #define PI 3.14159265
+#include <cstdlib>
 #include <iostream>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Count heap allocations so tests can check the model hot path doesn't
+// allocate (the device runs for hours, fragmentation matters).
+static std::atomic<unsigned long> heapAllocations(0);
+void *operator new(size_t size) {
+  heapAllocations++;
+  void *p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
 
 bool isLeapYear(unsigned int year) {
   return (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
@@ -1244,13 +1293,13 @@ void test_telescope_model_mylocation() {
   TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.15, star4Dec, model.getDecCoord(), "dec");
   TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.5, star4RAHours, model.getRACoord(), "ra");
 
-  log("=== Waiting ten minutes, no sync ====");
-  // check what happens ten minutes later. Scope is pointing to same spot,
-  // but earth should have turned. So same alt az should give ra ten minutes
-  // back
+  log("=== Waiting an hour, no sync ====");
+  // check what happens an hour later. Scope is pointing to same spot,
+  // but earth should have turned. So same alt az should give ra an hour
+  // on (the meridian has moved to stars an hour further east)
   long timeShiftHours = 1;
   TimePoint oneHourLater = addSecondsToTime(baseTime, timeShiftHours * 60 * 60);
-  double expectedRAHours = model.getRACoord() - timeShiftHours;
+  double expectedRAHours = model.getRACoord() + timeShiftHours;
 
   model.calculateCurrentPosition(oneHourLater);
 
@@ -1696,6 +1745,4098 @@ void test_time_difference(void) {
   TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.15, -1.5, diff, "time");
 }
 
+void test_model_hot_path_does_not_allocate() {
+  TelescopeModel model;
+  model.setLatitude(-34.0493);
+  model.setLongitude(151.0494);
+  model.setAltEncoderStepsPerRevolution(36000);
+  model.setAzEncoderStepsPerRevolution(36000);
+  TimePoint time = createTimePoint(16, 9, 2023, 6, 39, 0);
+
+  setLoggingEnabled(false);
+  unsigned long before = heapAllocations;
+
+  // first sync: one star alignment
+  model.setEncoderValues(3000, 9000);
+  model.syncPositionRaDec(18.6288, 38.8, time);
+  // second sync: builds two star model
+  TimePoint later = addSecondsToTime(time, 60);
+  model.setEncoderValues(1000, 20000);
+  model.syncPositionRaDec(22.1, -46.8, later);
+  // third sync: offset only
+  later = addSecondsToTime(later, 60);
+  model.setEncoderValues(1200, 20100);
+  model.syncPositionRaDec(22.2, -46.0, later);
+
+  for (int i = 0; i < 100; i++) {
+    model.setEncoderValues(1000 + i, 20000 - i);
+    later = addSecondsToTime(later, 1);
+    model.calculateCurrentPosition(later);
+  }
+
+  unsigned long allocations = heapAllocations - before;
+  setLoggingEnabled(true);
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(0, allocations,
+                                  "model hot path allocated on heap");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(2, model.baseAlignmentSynchPoints.size(),
+                                  "base alignment points");
+}
+
+void test_histogram_buckets() {
+  // small values get a bucket each
+  for (uint32_t v = 0; v < 16; v++) {
+    TEST_ASSERT_EQUAL_INT64_MESSAGE(v, LatencyHistogram::bucketForValue(v),
+                                    "linear bucket");
+  }
+  // every bucket's range maps back to itself, and buckets are contiguous
+  for (size_t b = 0; b < METRICS_BUCKET_COUNT; b++) {
+    uint32_t low = LatencyHistogram::lowestValueInBucket(b);
+    uint32_t high = LatencyHistogram::highestValueInBucket(b);
+    TEST_ASSERT_EQUAL_INT64_MESSAGE(b, LatencyHistogram::bucketForValue(low),
+                                    "low");
+    TEST_ASSERT_EQUAL_INT64_MESSAGE(b, LatencyHistogram::bucketForValue(high),
+                                    "high");
+    if (b > 0) {
+      TEST_ASSERT_EQUAL_INT64_MESSAGE(
+          LatencyHistogram::highestValueInBucket(b - 1) + 1, low, "contiguous");
+    }
+    // relative error bounded by bucket width
+    if (low >= 16) {
+      TEST_ASSERT_TRUE_MESSAGE((double)(high - low) / low <= 0.125,
+                               "relative error");
+    }
+  }
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(METRICS_BUCKET_COUNT - 1,
+                                  LatencyHistogram::bucketForValue(UINT32_MAX),
+                                  "top bucket");
+}
+
+void test_histogram_percentiles() {
+  LatencyHistogram h;
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(0, h.valueAtPercentile(50), "empty");
+  for (uint32_t v = 1; v <= 1000; v++) {
+    h.record(v);
+  }
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(1000, h.getCount(), "count");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(500500, h.getSum(), "sum");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(1, h.getMin(), "min");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(1000, h.getMax(), "max");
+
+  uint32_t p50 = h.valueAtPercentile(50);
+  uint32_t p99 = h.valueAtPercentile(99);
+  TEST_ASSERT_TRUE_MESSAGE(p50 >= 500 && p50 <= 500 * 1.125, "p50");
+  TEST_ASSERT_TRUE_MESSAGE(p99 >= 990 && p99 <= 1000, "p99 clamped to max");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(1000, h.valueAtPercentile(100), "p100");
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(1, h.valueAtPercentile(0), "p0");
+}
+
+void test_histogram_prometheus() {
+  LatencyHistogram h;
+  h.record(3);
+  h.record(3);
+  h.record(100);
+  char buffer[512];
+  size_t n = renderPrometheusHistogram("t_seconds", "help text", h, 1e-6,
+                                       buffer, sizeof(buffer));
+  std::string out(buffer);
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(out.size(), n, "length");
+  TEST_ASSERT_TRUE_MESSAGE(out.find("# TYPE t_seconds histogram\n") !=
+                               std::string::npos,
+                           "type");
+  TEST_ASSERT_TRUE_MESSAGE(
+      out.find("t_seconds_bucket{le=\"3e-06\"} 2\n") != std::string::npos,
+      "first bucket");
+  // 100 falls in bucket 96-103, cumulative count 3
+  TEST_ASSERT_TRUE_MESSAGE(
+      out.find("t_seconds_bucket{le=\"0.000103\"} 3\n") != std::string::npos,
+      "second bucket");
+  TEST_ASSERT_TRUE_MESSAGE(out.find("t_seconds_bucket{le=\"+Inf\"} 3\n") !=
+                               std::string::npos,
+                           "inf");
+  TEST_ASSERT_TRUE_MESSAGE(out.find("t_seconds_count 3\n") != std::string::npos,
+                           "count");
+
+  // truncates at a line boundary
+  n = renderPrometheusHistogram("t_seconds", "help text", h, 1e-6, buffer, 40);
+  TEST_ASSERT_TRUE_MESSAGE(n < 40 && buffer[n - 1] == '\n', "truncated");
+
+  // a line at a time, nothing lost with every bucket in use
+  LatencyHistogram full;
+  for (size_t i = 0; i < METRICS_BUCKET_COUNT; i++) {
+    full.record(LatencyHistogram::highestValueInBucket(i));
+  }
+  std::string lines;
+  renderPrometheusHistogram(
+      "t_seconds", "help text", full, 1e-6,
+      [](const char *line, void *context) {
+        static_cast<std::string *>(context)->append(line);
+        return true;
+      },
+      &lines);
+  size_t buckets = 0;
+  for (size_t at = lines.find("_bucket{"); at != std::string::npos;
+       at = lines.find("_bucket{", at + 1)) {
+    buckets++;
+  }
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(METRICS_BUCKET_COUNT + 1, buckets,
+                                  "every bucket");
+  char count[64];
+  snprintf(count, sizeof(count), "t_seconds_count %d\n",
+           (int)METRICS_BUCKET_COUNT);
+  TEST_ASSERT_TRUE_MESSAGE(lines.size() > strlen(count) &&
+                               lines.compare(lines.size() - strlen(count),
+                                             strlen(count), count) == 0,
+                           "ends with the count");
+  TEST_ASSERT_TRUE_MESSAGE(lines.find("t_seconds_sum ") != std::string::npos,
+                           "sum");
+}
+
+void test_metrics_scope_overhead() {
+  TelescopeModel model;
+  model.setAltEncoderStepsPerRevolution(36000);
+  model.setAzEncoderStepsPerRevolution(36000);
+  TimePoint time = createTimePoint(16, 9, 2023, 6, 39, 0);
+  const int iterations = 20000;
+
+  uint32_t start = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    model.setEncoderValues(i, i);
+    model.calculateCurrentPosition(time);
+  }
+  double modelTicks = (double)(metricsTicks() - start) / iterations;
+
+  LatencyHistogram &h = metricsHistogram(METRIC_MODEL_CALCULATE);
+  start = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    MetricsScope scope(METRIC_MODEL_CALCULATE);
+  }
+  double scopeTicks = (double)(metricsTicks() - start) / iterations;
+  h.reset();
+
+  log("Model calculate %.0f ns, metrics scope %.1f ns", modelTicks, scopeTicks);
+  // An Alpaca GET takes a millisecond or more on the device and passes
+  // through at most five scopes, so 1% leaves 2us per scope.
+  TEST_ASSERT_TRUE_MESSAGE(scopeTicks < 2000,
+                           "metrics scope too expensive for 1% budget");
+}
+
+/**
+ * Timed by the clock every core shares, still recorded in ticks: a 5ms
+ * sleep comes out as 5ms or a little more.
+ */
+void test_metrics_unpinned_scope() {
+  LatencyHistogram &histogram = metricsHistogram(METRIC_EQ_PACKET);
+  histogram.reset();
+  {
+    MetricsUnpinnedScope scope(METRIC_EQ_PACKET);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, histogram.getCount());
+  double seconds = histogram.getMax() * metricsSecondsPerTick();
+  TEST_ASSERT_TRUE(seconds >= 0.0049 && seconds < 0.1);
+  histogram.reset();
+}
+
+void test_spsc_queue_threads() {
+  SpscQueue<uint32_t, 16> queue;
+  const uint32_t count = 200000;
+  std::thread producer([&queue, count]() {
+    for (uint32_t i = 0; i < count;) {
+      if (queue.push(i)) {
+        i++;
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  bool inOrder = true;
+  while (expected < count) {
+    uint32_t value;
+    if (queue.pop(value)) {
+      inOrder = inOrder && value == expected;
+      expected++;
+    }
+  }
+  producer.join();
+  TEST_ASSERT_TRUE_MESSAGE(inOrder, "values lost or reordered");
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+struct TearCheck {
+  uint32_t a;
+  uint32_t b;
+  double c;
+  uint32_t d;
+};
+
+void test_seqlock_threads() {
+  SeqLock<TearCheck> lock;
+  std::atomic<bool> done(false);
+  std::thread writer([&lock, &done]() {
+    for (uint32_t i = 1; i <= 200000; i++) {
+      TearCheck v;
+      v.a = i;
+      v.b = i;
+      v.c = i;
+      v.d = i;
+      lock.write(v);
+    }
+    done = true;
+  });
+
+  std::atomic<int> torn(0);
+  std::thread readers[2];
+  for (int r = 0; r < 2; r++) {
+    readers[r] = std::thread([&lock, &done, &torn]() {
+      uint32_t last = 0;
+      while (!done) {
+        TearCheck v = lock.read();
+        if (v.a != v.b || v.a != v.d || v.c != (double)v.a || v.a < last) {
+          torn++;
+        }
+        last = v.a;
+      }
+    });
+  }
+  // keeps the last copy it got whenever it gives up on a write
+  std::atomic<int> tryTorn(0);
+  std::thread tryReader([&lock, &done, &tryTorn]() {
+    TearCheck v = TearCheck();
+    uint32_t last = 0;
+    while (!done) {
+      lock.tryRead(v);
+      if (v.a != v.b || v.a != v.d || v.c != (double)v.a || v.a < last) {
+        tryTorn++;
+      }
+      last = v.a;
+    }
+  });
+  writer.join();
+  readers[0].join();
+  readers[1].join();
+  tryReader.join();
+  TEST_ASSERT_EQUAL_INT(0, torn);
+  TEST_ASSERT_EQUAL_INT(0, tryTorn);
+  TEST_ASSERT_EQUAL_INT(200000, lock.version());
+}
+
+void test_model_runner_threads() {
+  TelescopeModel model;
+  ModelRunner runner(model);
+  runner.requestLatitude(-34.0493);
+  runner.requestLongitude(151.0494);
+  runner.requestAltEncoderStepsPerRevolution(36000);
+  runner.requestAzEncoderStepsPerRevolution(36000);
+  TimePoint time = createTimePoint(16, 9, 2023, 6, 39, 0);
+
+  setLoggingEnabled(false);
+  std::atomic<bool> done(false);
+  // stands in for the model task
+  std::thread modelTask([&runner, &done, time]() {
+    long i = 0;
+    while (!done) {
+      TimePoint now = addSecondsToTime(time, i % 60);
+      runner.tick(1000 + (i % 100), 20000, PlatformState(), now);
+      i++;
+    }
+  });
+
+  // this thread stands in for the web handlers
+  bool consistent = true;
+  uint32_t lastUpdate = 0;
+  for (int i = 0; i < 2000; i++) {
+    if (i % 500 == 0) {
+      while (!runner.requestSync(22.1, -46.8, 1000, 20000, time,
+                                 PlatformState())) {
+        std::this_thread::yield();
+      }
+    }
+    PositionSnapshot position = runner.getPosition();
+    // updateCount 0 is the empty snapshot from before the first tick
+    consistent = consistent && position.updateCount >= lastUpdate &&
+                 (position.updateCount == 0 || position.azEncoder == 20000);
+    lastUpdate = position.updateCount;
+    AlignmentSnapshot alignment = runner.getAlignment();
+    consistent = consistent &&
+                 alignment.baseAlignmentSynchPoints.size() <=
+                     SynchPointList::capacity();
+  }
+  while (!runner.getAlignment().lastSyncPoint.isValid) {
+    std::this_thread::yield();
+  }
+  done = true;
+  modelTask.join();
+  setLoggingEnabled(true);
+
+  AlignmentSnapshot alignment = runner.getAlignment();
+  TEST_ASSERT_TRUE_MESSAGE(consistent, "inconsistent snapshot");
+  TEST_ASSERT_EQUAL_INT(36000, alignment.altEncoderStepsPerRevolution);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -34.0493, alignment.latitude);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 22.1 * 15,
+                           alignment.lastSyncPoint.eqCoord.getRAInDegrees());
+  TEST_ASSERT_TRUE(runner.getPosition().updateCount > 0);
+}
+
+void test_platform_state() {
+  TimePoint now = createTimePoint(16, 9, 2023, 6, 39, 0);
+  PlatformTelemetry telemetry = PlatformTelemetry();
+  telemetry.runtimeFromCenterSeconds = 100;
+  telemetry.decAxisDegrees = 1.5;
+  telemetry.receivedTime = addSecondsToTime(now, -1);
+
+  // stopped: time to center is taken as is
+  telemetry.currentlyRunning = false;
+  PlatformState state = calculatePlatformState(telemetry, now);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 100 * SIDEREAL_DEGREES_PER_SECOND,
+                           state.raAxisDegrees);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 1.5, state.decAxisDegrees);
+  TEST_ASSERT_EQUAL_FLOAT(0, state.raAxisDegreesPerSecond);
+  // running: platform has moved on a second since the packet
+  telemetry.currentlyRunning = true;
+  state = calculatePlatformState(telemetry, now);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 99 * SIDEREAL_DEGREES_PER_SECOND,
+                           state.raAxisDegrees);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 1.5, state.decAxisDegrees);
+  // and will be at center 99s from now
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 0, state.after(99).raAxisDegrees);
+
+  TEST_ASSERT_TRUE(isPlatformConnected(telemetry, now));
+  TEST_ASSERT_FALSE(isPlatformConnected(telemetry, addSecondsToTime(now, 11)));
+}
+
+void test_platform_telemetry_threads() {
+  // Every packet the writer publishes gives the same ra axis angle at a
+  // fixed time, as if the platform were running at exactly the sidereal
+  // rate. A reader that saw runtimeFromCenterSeconds from one packet with
+  // receivedTime from another would get a different answer.
+  TimePoint base = createTimePoint(16, 9, 2023, 6, 39, 0);
+  // center is an hour after base, now is 5000s after it
+  double expectedRAAxis = (3600 - 5000) * SIDEREAL_DEGREES_PER_SECOND;
+  SeqLock<PlatformTelemetry> telemetry;
+  std::atomic<bool> done(false);
+
+  std::thread writer([&telemetry, &done, base]() {
+    PlatformTelemetry latest = PlatformTelemetry();
+    latest.currentlyRunning = true;
+    for (uint32_t i = 1; i <= 100000; i++) {
+      latest.receivedTime = addMillisToTime(base, i * 10);
+      latest.runtimeFromCenterSeconds = 3600 - i * 0.01;
+      latest.timeToEnd = latest.runtimeFromCenterSeconds * 2;
+      latest.packetCount = i;
+      telemetry.write(latest);
+    }
+    done = true;
+  });
+
+  std::atomic<int> inconsistent(0);
+  std::atomic<long> reads(0);
+  std::thread readers[2];
+  for (int r = 0; r < 2; r++) {
+    readers[r] = std::thread([&telemetry, &done, &inconsistent, &reads, base,
+                              expectedRAAxis]() {
+      uint32_t lastPacket = 0;
+      while (!done) {
+        PlatformTelemetry t = telemetry.read();
+        reads++;
+        if (t.packetCount == 0) {
+          continue;
+        }
+        TimePoint now = addSecondsToTime(base, 5000);
+        double error =
+            calculatePlatformState(t, now).raAxisDegrees - expectedRAAxis;
+        if (fabs(error) > 0.002 * SIDEREAL_DEGREES_PER_SECOND ||
+            t.timeToEnd != t.runtimeFromCenterSeconds * 2 ||
+            t.packetCount < lastPacket) {
+          inconsistent++;
+        }
+        lastPacket = t.packetCount;
+      }
+    });
+  }
+  writer.join();
+  readers[0].join();
+  readers[1].join();
+
+  log("%ld telemetry reads during 100000 writes", (long)reads);
+  TEST_ASSERT_EQUAL_INT(0, inconsistent);
+  TEST_ASSERT_EQUAL_INT(100000, telemetry.read().packetCount);
+}
+
+void test_alpaca_cache_render() {
+  AlpacaResponseCache cache;
+  char body[ALPACA_CACHE_BODY_SIZE];
+  TEST_ASSERT_TRUE(cache.putBool("canslew", false));
+  TEST_ASSERT_TRUE(cache.putInteger("interfaceversion", 3));
+  TEST_ASSERT_TRUE(cache.putString("name", "Frankendob"));
+
+  TEST_ASSERT_EQUAL_INT(0, cache.render("canpark", 0, 1, 2, body,
+                                        sizeof(body))); // never stored
+  size_t length = cache.render("canslew", 7, 12, 345, body, sizeof(body));
+  TEST_ASSERT_EQUAL_STRING("{\"ErrorNumber\":0,\"ErrorMessage\":\"\","
+                           "\"Value\":false,\"ClientTransactionID\":12,"
+                           "\"ServerTransactionID\":345}",
+                           body);
+  TEST_ASSERT_EQUAL_INT(strlen(body), length);
+
+  cache.render("name", 0, -1, 0, body, sizeof(body));
+  TEST_ASSERT_EQUAL_STRING("{\"ErrorNumber\":0,\"ErrorMessage\":\"\","
+                           "\"Value\":\"Frankendob\","
+                           "\"ClientTransactionID\":-1,"
+                           "\"ServerTransactionID\":0}",
+                           body);
+
+  // too small a buffer is a miss, not a truncated reply
+  TEST_ASSERT_EQUAL_INT(0, cache.render("interfaceversion", 0, 1, 2, body, 40));
+}
+
+void test_alpaca_cache_versions() {
+  AlpacaResponseCache cache;
+  char body[ALPACA_CACHE_BODY_SIZE];
+  cache.putBool("tracking", true, 4);
+  TEST_ASSERT_TRUE(cache.render("tracking", 4, 1, 1, body, sizeof(body)) > 0);
+  // platform state moved on
+  TEST_ASSERT_EQUAL_INT(0, cache.render("tracking", 5, 1, 1, body,
+                                        sizeof(body)));
+  cache.putBool("tracking", false, 5);
+  TEST_ASSERT_TRUE(cache.render("tracking", 5, 1, 1, body, sizeof(body)) > 0);
+  TEST_ASSERT_TRUE(strstr(body, "\"Value\":false") != nullptr);
+  TEST_ASSERT_EQUAL_INT(1, cache.size());
+
+  char member[16];
+  for (int i = 1; i < ALPACA_CACHE_CAPACITY; i++) {
+    snprintf(member, sizeof(member), "member%d", i);
+    TEST_ASSERT_TRUE(cache.putBool(member, true));
+  }
+  TEST_ASSERT_FALSE_MESSAGE(cache.putBool("onetoomany", true),
+                            "stored past capacity");
+  TEST_ASSERT_FALSE_MESSAGE(
+      cache.putRaw("tracking", "[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15]"),
+      "value longer than ALPACA_CACHE_VALUE_SIZE");
+}
+
+// Replies as they were formatted before the cache, for comparison.
+static void formatUncached(char *buffer, size_t size, bool value, long client,
+                           long server) {
+  snprintf(buffer, size,
+           R"({
+             "ErrorNumber": 0,
+             "ErrorMessage": "",
+             "Value": %s,
+        "ClientTransactionID": %ld,
+         "ServerTransactionID": %ld
+        })",
+           value ? "true" : "false", client, server);
+}
+
+void test_alpaca_cache_polling_load() {
+  // What N.I.N.A polls every second or so, plus the position which isn't
+  // cached.
+  const char *polled[] = {"connected",     "canslew",        "canpark",
+                          "cansettracking", "canpulseguide", "atpark",
+                          "athome",        "slewing",        "tracking",
+                          "ispulseguiding", "sideofpier",    "alignmentmode",
+                          "equatorialsystem", "canmoveaxis", "cansync",
+                          "interfaceversion", "name",        "driverinfo",
+                          "canslewasync",  "doesrefraction"};
+  const int memberCount = sizeof(polled) / sizeof(polled[0]);
+  AlpacaResponseCache cache;
+  for (int i = 0; i < memberCount; i++) {
+    cache.putBool(polled[i], i % 2 == 0);
+  }
+
+  // 50 req/s for 100 simulated seconds
+  const int requests = 5000;
+  const double simulatedSeconds = requests / 50.0;
+  LatencyHistogram uncached;
+  LatencyHistogram cached;
+  char body[300];
+  volatile size_t sink = 0;
+  for (int i = 0; i < requests; i++) {
+    const char *member = polled[i % memberCount];
+    uint32_t start = metricsTicks();
+    formatUncached(body, sizeof(body), i % 2 == 0, i, i);
+    sink += strlen(body);
+    uncached.record(metricsTicks() - start);
+
+    start = metricsTicks();
+    sink += cache.render(member, 0, i, i, body, sizeof(body));
+    cached.record(metricsTicks() - start);
+  }
+
+  double secondsPerTick = metricsSecondsPerTick();
+  log("Alpaca GET body at 50 req/s: uncached p50 %u p99 %u ns, cpu %.4f%%; "
+      "cached p50 %u p99 %u ns, cpu %.4f%%",
+      uncached.valueAtPercentile(50), uncached.valueAtPercentile(99),
+      100.0 * uncached.getSum() * secondsPerTick / simulatedSeconds,
+      cached.valueAtPercentile(50), cached.valueAtPercentile(99),
+      100.0 * cached.getSum() * secondsPerTick / simulatedSeconds);
+  TEST_ASSERT_EQUAL_INT(requests, cached.getCount());
+  TEST_ASSERT_TRUE_MESSAGE(cached.getSum() < uncached.getSum(),
+                           "cached replies should be cheaper to build");
+}
+
+void test_sidereal_time() {
+  // Meeus, Astronomical Algorithms, examples 12.a and 12.b
+  TimePoint midnight = createTimePoint(10, 4, 1987, 0, 0, 0);
+  TEST_ASSERT_FLOAT_WITHIN(0.000001, 2446895.5, julianDay(midnight));
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 13.0 + 10.0 / 60 + 46.3668 / 3600,
+                           greenwichMeanSiderealTime(midnight));
+  TimePoint evening = createTimePoint(10, 4, 1987, 19, 21, 0);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 8.0 + 34.0 / 60 + 57.0896 / 3600,
+                           greenwichMeanSiderealTime(evening));
+  // east is positive, and wraps
+  TEST_ASSERT_FLOAT_WITHIN(0.00001,
+                           8.0 + 34.0 / 60 + 57.0896 / 3600 + 151.0494 / 15,
+                           localSiderealTime(evening, 151.0494));
+  TEST_ASSERT_FLOAT_WITHIN(0.00001,
+                           13.0 + 10.0 / 60 + 46.3668 / 3600 + 170.0 / 15 - 24,
+                           localSiderealTime(midnight, 170.0));
+}
+
+void test_alt_az_at_sidereal_time() {
+  Ephemeris::setLocationOnEarth(-34.0493, 151.0494);
+  Ephemeris::flipLongitude(false);
+  TimePoint time = createTimePoint(16, 9, 2023, 10, 39, 0);
+  double lst = localSiderealTime(time, 151.0494);
+
+  const float targets[][2] = {{279.23, 38.78}, {344.41, -29.62}, {297.7, 8.87},
+                              {10.0, -80.0},   {180.0, 0.0}};
+  for (const float *target : targets) {
+    EqCoord eq(target[0], target[1]);
+    HorizCoord expected(eq, time);
+    HorizCoord actual = equatorialToHorizontalAtSiderealTime(eq, lst, -34.0493);
+    // mean vs apparent sidereal time is at most a second or so of rotation
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.01, expected.altInDegrees,
+                                     actual.altInDegrees, "alt");
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.02, expected.aziInDegrees,
+                                     actual.aziInDegrees, "az");
+  }
+}
+
+static MountState sampleMountState() {
+  MountState state;
+  memset(&state, 0, sizeof(state));
+  state.rightAscension = 18.6156;
+  state.declination = -38.78;
+  state.altitude = 45.5;
+  state.azimuth = 359.9;
+  state.siderealTime = 23.99;
+  state.tracking = true;
+  strcpy(state.utcDate, "2023-09-16T10:39:00Z");
+  state.platformConnected = true;
+  state.timeToCenter = -1234.5;
+  state.timeToEnd = 2400;
+  strcpy(state.platformIP, "192.168.100.200");
+  state.calculatedAltEncoderSteps = -2147483647;
+  state.calculatedAzEncoderSteps = -2147483647;
+  state.altEncoderSteps = -30000;
+  state.azEncoderSteps = 108531;
+  state.alignmentVersion = 4294967295u;
+  state.modelUpdate = 4294967295u;
+  state.leadSeconds = MOTION_MAX_LEAD_SECONDS;
+  return state;
+}
+
+void test_mount_state_render() {
+  MountState state = sampleMountState();
+  char json[MOUNT_STATE_BUFFER_SIZE];
+  size_t length = renderMountState(state, json, sizeof(json));
+  TEST_ASSERT_TRUE(length > 0);
+  TEST_ASSERT_EQUAL_INT(strlen(json), length);
+  TEST_ASSERT_TRUE(strstr(json, "\"rightascension\":18.615600,") != nullptr);
+  TEST_ASSERT_TRUE(strstr(json, "\"tracking\":true,\"slewing\":false") !=
+                   nullptr);
+  TEST_ASSERT_TRUE(strstr(json, "\"platformip\":\"192.168.100.200\"") !=
+                   nullptr);
+  TEST_ASSERT_TRUE(strstr(json, "\"moving\":false,\"leadseconds\":1.000}") !=
+                   nullptr);
+  TEST_ASSERT_EQUAL_INT(0, renderMountState(state, json, 100));
+
+  // worst case values still fit the action reply
+  char reply[MOUNT_STATE_ACTION_BUFFER_SIZE];
+  length = renderMountStateAction(state, 2147483647, 2147483647, reply,
+                                  sizeof(reply));
+  TEST_ASSERT_TRUE_MESSAGE(length > 0, "action reply overflowed");
+  TEST_ASSERT_TRUE(strstr(reply, "\"Value\":\"{\\\"rightascension\\\":") !=
+                   nullptr);
+  TEST_ASSERT_TRUE(strstr(reply, "}\",\"ClientTransactionID\":2147483647,") !=
+                   nullptr);
+  TEST_ASSERT_EQUAL_INT(0, renderMountStateAction(state, 1, 1, reply, 200));
+}
+
+void test_mount_state_request_count() {
+  // Before: one GET per member to get the same picture.
+  const char *members[] = {"rightascension", "declination", "altitude",
+                           "azimuth",        "siderealtime", "tracking",
+                           "slewing",        "utcdate"};
+  const int memberRequests = sizeof(members) / sizeof(members[0]);
+  MountState state = sampleMountState();
+  AlpacaResponseCache cache;
+  cache.putBool("tracking", true, 1);
+  cache.putBool("slewing", false, 1);
+  cache.putString("utcdate", state.utcDate, 1);
+  const double doubles[] = {state.rightAscension, state.declination,
+                            state.altitude, state.azimuth, state.siderealTime};
+
+  const int refreshes = 2000;
+  LatencyHistogram separate;
+  LatencyHistogram single;
+  char buffer[MOUNT_STATE_ACTION_BUFFER_SIZE];
+  volatile size_t sink = 0;
+  for (int i = 0; i < refreshes; i++) {
+    uint32_t start = metricsTicks();
+    for (int m = 0; m < memberRequests; m++) {
+      if (m < 5) {
+        sink += snprintf(buffer, sizeof(buffer),
+                         "{\"ErrorNumber\":0,\"ErrorMessage\":\"\",\"Value\":%lf,"
+                         "\"ClientTransactionID\":%d,"
+                         "\"ServerTransactionID\":%d}",
+                         doubles[m], i, i);
+      } else {
+        sink += cache.render(members[m], 1, i, i, buffer, sizeof(buffer));
+      }
+    }
+    separate.record(metricsTicks() - start);
+
+    start = metricsTicks();
+    sink += renderMountStateAction(state, i, i, buffer, sizeof(buffer));
+    single.record(metricsTicks() - start);
+  }
+  log("Per refresh: %d requests, bodies p50 %u ns; getstate: 1 request, "
+      "body p50 %u ns",
+      memberRequests, separate.valueAtPercentile(50),
+      single.valueAtPercentile(50));
+  TEST_ASSERT_EQUAL_INT(refreshes, single.getCount());
+}
+
+void test_platform_kinematics_rotation() {
+  PlatformKinematics kinematics;
+  double identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  kinematics.setAlignment(identity, 100);
+
+  // a point on the meridian (6h west of the east point) moves north by the
+  // tilt, and removeDecAxisTilt takes it back
+  EqCoord meridian(10, 20);
+  double dc[3], tilted[3];
+  LA3::toDirCos(dc, LA3::toRad(20), LA3::toRad(10));
+  LA3::multiply(tilted, kinematics.referenceTransform(1.5), dc);
+  double dec, ra;
+  LA3::toAngles(dec, ra, tilted);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 21.5, LA3::toDeg(dec));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 10, LA3::toDeg(ra));
+  EqCoord back = kinematics.removeDecAxisTilt(
+      EqCoord(LA3::toDeg(ra), LA3::toDeg(dec)), 1.5);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 0,
+                           back.calculateDistanceInDegrees(meridian));
+
+  // composed matrix only rebuilt when the dec axis or alignment changes
+  uint32_t rebuilds = kinematics.getRebuildCount();
+  kinematics.referenceTransform(1.5);
+  kinematics.referenceTransform(1.5);
+  TEST_ASSERT_EQUAL_UINT32(rebuilds, kinematics.getRebuildCount());
+  kinematics.referenceTransform(0.5);
+  TEST_ASSERT_EQUAL_UINT32(rebuilds + 1, kinematics.getRebuildCount());
+  kinematics.setAlignment(identity, 100);
+  kinematics.referenceTransform(0.5);
+  TEST_ASSERT_EQUAL_UINT32(rebuilds + 2, kinematics.getRebuildCount());
+}
+
+// east, north, up direction cosines for an alt/az (azimuth from north
+// through east)
+static void horizontalToENU(double (&v)[3], double alt, double az) {
+  v[0] = cos(LA3::toRad(alt)) * sin(LA3::toRad(az));
+  v[1] = cos(LA3::toRad(alt)) * cos(LA3::toRad(az));
+  v[2] = sin(LA3::toRad(alt));
+}
+
+// right handed rotation of v about a unit axis
+static void rotateAboutAxis(double (&v)[3], const double (&axis)[3],
+                            double degrees) {
+  double c = cos(LA3::toRad(degrees));
+  double s = sin(LA3::toRad(degrees));
+  double cross[3];
+  LA3::crossProduct(cross, axis, v);
+  double dot = axis[0] * v[0] + axis[1] * v[1] + axis[2] * v[2];
+  for (int i = 0; i < 3; i++) {
+    v[i] = v[i] * c + cross[i] * s + axis[i] * dot * (1 - c);
+  }
+}
+
+/**
+ * Refraction for a true altitude at standard conditions, Saemundsson's
+ * formula (Meeus 16.5): independent of the model's table, which works
+ * from Bennett's.
+ */
+static double testRefractionDegrees(double trueAltitude) {
+  double arcminutes =
+      1.02 / tan(LA3::toRad(trueAltitude + 10.3 / (trueAltitude + 5.11)));
+  return arcminutes / 60;
+}
+
+/**
+ * Encoder counts for a dob on an EQ platform pointing at eq. Worked out
+ * from the real sky and the platform's geometry, independent of the
+ * model: the ra axis points at the celestial pole and carries an
+ * east-west dec axis. With the platform centred the base is level and
+ * azimuth encoder zero is azOffset east of north. eq is lifted by
+ * refraction unless refracted is false.
+ */
+static void simulatePlatformEncoders(const EqCoord &eq, TimePoint tp,
+                                     const PlatformState &state,
+                                     double latitude, double longitude,
+                                     double azOffset, long &altEncoder,
+                                     long &azEncoder, bool refracted = true) {
+  HorizCoord sky = equatorialToHorizontalAtSiderealTime(
+      eq, localSiderealTime(tp, longitude), latitude);
+  if (refracted) {
+    sky.altInDegrees += testRefractionDegrees(sky.altInDegrees);
+  }
+  double v[3], pole[3];
+  horizontalToENU(v, sky.altInDegrees, sky.aziInDegrees);
+  horizontalToENU(pole, latitude, 0);
+  double east[3] = {1, 0, 0};
+  // the platform turns the base east about the pole, and tilts it north
+  // on top of that: undo both, outermost first
+  rotateAboutAxis(v, pole, -state.raAxisDegrees);
+  rotateAboutAxis(v, east, state.decAxisDegrees);
+  double alt = LA3::toDeg(asin(v[2]));
+  double az = LA3::toDeg(atan2(v[0], v[1])) - azOffset;
+  az = fmod(fmod(az, 360.0) + 360.0, 360.0);
+  altEncoder = lround(alt * 1000);
+  azEncoder = lround(az * 1000);
+}
+
+/**
+ * Simulates an hour long platform run, with the dec axis being adjusted
+ * through it, and measures how far the model's ra/dec is from the real
+ * sky. The old approach (platform as an ra/time offset only) is the same
+ * model with the dec axis left out.
+ */
+void test_platform_kinematics_run() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  const double azOffset = 37;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EqCoord stars[] = {EqCoord(279.432, 38.8026),    // vega
+                     EqCoord(344.7353, -29.4966),  // fomalhaut
+                     EqCoord(297.979, 8.9274),     // altair
+                     EqCoord(332.4273, -46.8462)}; // alnair
+
+  TelescopeModel kinematic;
+  TelescopeModel offsetOnly;
+  TelescopeModel *models[] = {&kinematic, &offsetOnly};
+  for (TelescopeModel *model : models) {
+    model->setLatitude(latitude);
+    model->setLongitude(longitude);
+    model->setAltEncoderStepsPerRevolution(360000);
+    model->setAzEncoderStepsPerRevolution(360000);
+  }
+
+  setLoggingEnabled(false);
+  double maxError[2] = {0, 0};
+  double sumSquares[2] = {0, 0};
+  int samples = 0;
+  // platform runs from 30 minutes before center to 30 after, dec axis
+  // swept from -1 to +1 degrees. Syncs in the first minute.
+  for (int second = 0; second <= 3600; second += 30) {
+    TimePoint now = addSecondsToTime(start, second);
+    PlatformState state((1800 - second) * SIDEREAL_DEGREES_PER_SECOND,
+                        -1.0 + 2.0 * second / 3600);
+    const EqCoord &star = stars[(second / 30) % 4];
+    long altEncoder, azEncoder;
+    simulatePlatformEncoders(star, now, state, latitude, longitude, azOffset,
+                             altEncoder, azEncoder);
+    for (int m = 0; m < 2; m++) {
+      models[m]->setEncoderValues(altEncoder, azEncoder);
+      models[m]->setPlatformState(
+          m == 0 ? state : PlatformState(state.raAxisDegrees, 0));
+      if (second < 60) {
+        models[m]->syncPositionRaDec(star.getRAInHours(),
+                                     star.getDecInDegrees(), now);
+        continue;
+      }
+      models[m]->calculateCurrentPosition(now);
+      double error =
+          models[m]->currentEqPosition.calculateDistanceInDegrees(star);
+      maxError[m] = error > maxError[m] ? error : maxError[m];
+      sumSquares[m] += error * error;
+    }
+    if (second >= 60) {
+      samples++;
+    }
+  }
+
+  // cost of a query with the dec axis still vs moving every query
+  const int iterations = 20000;
+  TimePoint now = addSecondsToTime(start, 1800);
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    kinematic.setPlatformState(PlatformState(i * 0.0001, 0.5));
+    kinematic.calculateCurrentPosition(now);
+  }
+  double cachedTicks = (double)(metricsTicks() - startTicks) / iterations;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    kinematic.setPlatformState(PlatformState(i * 0.0001, i * 0.0001));
+    kinematic.calculateCurrentPosition(now);
+  }
+  double rebuildTicks = (double)(metricsTicks() - startTicks) / iterations;
+  setLoggingEnabled(true);
+
+  log("Platform run pointing error over %d samples (degrees):", samples);
+  log("  kinematic:   max %lf rms %lf", maxError[0],
+      sqrt(sumSquares[0] / samples));
+  log("  offset only: max %lf rms %lf", maxError[1],
+      sqrt(sumSquares[1] / samples));
+  log("Position query %.0fns, %.0fns when the dec axis moves every query",
+      cachedTicks * metricsSecondsPerTick() * 1e9,
+      rebuildTicks * metricsSecondsPerTick() * 1e9);
+
+  TEST_ASSERT_TRUE_MESSAGE(maxError[0] < 0.01, "kinematic model error");
+  // the dec axis sweep is worth most of a degree to the old approach
+  TEST_ASSERT_TRUE(maxError[1] > 0.5);
+}
+
+/**
+ * Push-to track built from a model synced on a running platform, checked
+ * against encoders actually pointing at the target (worked out from the
+ * real sky, see simulatePlatformEncoders) over the life of the track.
+ */
+void test_push_to_track() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  const double azOffset = 37;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EqCoord stars[] = {EqCoord(279.432, 38.8026),   // vega
+                     EqCoord(344.7353, -29.4966), // fomalhaut
+                     EqCoord(297.979, 8.9274)};   // altair
+  TelescopeModel model;
+  model.setLatitude(latitude);
+  model.setLongitude(longitude);
+  model.setAltEncoderStepsPerRevolution(360000);
+  model.setAzEncoderStepsPerRevolution(360000);
+
+  PushToTrack track;
+  setLoggingEnabled(false);
+  PlatformState running(900 * SIDEREAL_DEGREES_PER_SECOND, 0.5,
+                        -SIDEREAL_DEGREES_PER_SECOND);
+  for (int i = 0; i < 3; i++) {
+    TimePoint now = addSecondsToTime(start, i * 20);
+    long altEncoder, azEncoder;
+    simulatePlatformEncoders(stars[i], now, running.after(i * 20), latitude,
+                             longitude, azOffset, altEncoder, azEncoder);
+    model.setEncoderValues(altEncoder, azEncoder);
+    model.setPlatformState(running.after(i * 20));
+    model.syncPositionRaDec(stars[i].getRAInHours(),
+                            stars[i].getDecInDegrees(), now);
+  }
+  setLoggingEnabled(true);
+
+  // alnair, platform carrying on tracking
+  EqCoord target(332.4273, -46.8462);
+  TimePoint trackStart = addSecondsToTime(start, 120);
+  PlatformState atStart = running.after(120);
+  TEST_ASSERT_TRUE(model.calculatePushToTrack(
+      target.getRAInHours(), target.getDecInDegrees(), trackStart, atStart,
+      track));
+  track.active = true;
+
+  long worst = 0;
+  PushToDelta delta;
+  for (long millis = 0; millis <= 300000; millis += 7000) {
+    TimePoint now = addMillisToTime(trackStart, millis);
+    long altEncoder, azEncoder;
+    simulatePlatformEncoders(target, now, atStart.after(millis / 1000.0),
+                             latitude, longitude, azOffset, altEncoder,
+                             azEncoder);
+    TEST_ASSERT_TRUE(
+        calculatePushToDelta(track, altEncoder, azEncoder, now, delta));
+    TEST_ASSERT_TRUE(delta.onTrack || millis >= 300000);
+    worst = labs(delta.altSteps) > worst ? labs(delta.altSteps) : worst;
+    worst = labs(delta.azSteps) > worst ? labs(delta.azSteps) : worst;
+  }
+  // 1000 steps a degree, so within 0.01 degrees
+  TEST_ASSERT_TRUE_MESSAGE(worst <= 10, "push to track error");
+
+  // off target: 2 degrees low and 3 degrees clockwise, through zero
+  long altEncoder, azEncoder;
+  simulatePlatformEncoders(target, trackStart, atStart, latitude, longitude,
+                           azOffset, altEncoder, azEncoder);
+  calculatePushToDelta(track, altEncoder - 2000,
+                       wrapEncoderSteps(azEncoder + 3000, 360000) + 360000,
+                       trackStart, delta);
+  TEST_ASSERT_INT_WITHIN(10, 2000, delta.altSteps);
+  TEST_ASSERT_INT_WITHIN(10, -3000, delta.azSteps);
+  TEST_ASSERT_FLOAT_WITHIN(0.02, -3,
+                           pushToStepsToDegrees(delta.azSteps, 360000));
+  TEST_ASSERT_EQUAL_INT(-10, wrapEncoderSteps(359990, 360000));
+  TEST_ASSERT_EQUAL_INT(10, wrapEncoderSteps(-359990, 360000));
+
+  // past the end, holds the last point
+  TEST_ASSERT_TRUE(calculatePushToDelta(
+      track, 0, 0, addSecondsToTime(trackStart, 400), delta));
+  TEST_ASSERT_FALSE(delta.onTrack);
+  track.active = false;
+  TEST_ASSERT_FALSE(calculatePushToDelta(track, 0, 0, trackStart, delta));
+  track.active = true;
+
+  // the streaming hot path
+  const int iterations = 100000;
+  long sum = 0;
+  unsigned long allocationsBefore = heapAllocations;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    calculatePushToDelta(track, altEncoder + i % 1000, azEncoder,
+                         addMillisToTime(trackStart, i * 3), delta);
+    sum += delta.altSteps;
+  }
+  double ticks = (double)(metricsTicks() - startTicks) / iterations;
+  unsigned long allocations = heapAllocations - allocationsBefore;
+  log("Push to delta %.0fns (checksum %ld), track error max %ld steps",
+      ticks * metricsSecondsPerTick() * 1e9, sum, worst);
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+void test_push_to_runner() {
+  TelescopeModel model;
+  ModelRunner runner(model);
+  TimePoint time = createTimePoint(16, 9, 2023, 6, 39, 0);
+  PlatformState platform(2, 0, -SIDEREAL_DEGREES_PER_SECOND);
+  TEST_ASSERT_FALSE(runner.getPushTo().active);
+
+  // no encoder resolution yet
+  setLoggingEnabled(false);
+  runner.requestPushTo(22.1, -46.8);
+  runner.tick(1000, 20000, platform, time);
+  TEST_ASSERT_FALSE(runner.getPushTo().active);
+
+  runner.requestLatitude(-34.0493);
+  runner.requestLongitude(151.0494);
+  runner.requestAltEncoderStepsPerRevolution(36000);
+  runner.requestAzEncoderStepsPerRevolution(36000);
+  runner.requestPushTo(22.1, -46.8);
+  runner.tick(1000, 20000, platform, time);
+  setLoggingEnabled(true);
+  PushToTrack track = runner.getPushTo();
+  TEST_ASSERT_TRUE(track.active);
+  TEST_ASSERT_EQUAL_UINT32(2, track.id);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 22.1, track.raHours);
+
+  // platform doing what the track expected: left alone
+  TimePoint later = addSecondsToTime(time, 30);
+  runner.tick(1000, 20000, platform.after(30), later);
+  TEST_ASSERT_TRUE(runner.getPushTo().start == time);
+  // platform stopped: recalculated
+  runner.tick(1000, 20000, PlatformState(platform.raAxisDegrees, 0), later);
+  TEST_ASSERT_TRUE(runner.getPushTo().start == later);
+  // running short: recalculated
+  TimePoint muchLater = addSecondsToTime(later, 200);
+  runner.tick(1000, 20000, PlatformState(platform.raAxisDegrees, 0),
+              muchLater);
+  TEST_ASSERT_TRUE(runner.getPushTo().start == muchLater);
+
+  runner.requestCancelPushTo();
+  runner.tick(1000, 20000, platform, muchLater);
+  TEST_ASSERT_FALSE(runner.getPushTo().active);
+}
+
+/**
+ * Stands in for the EQ platform and the model, for the slew controller.
+ * The platform follows commanded rates after a little network latency,
+ * and reports its axes once a second. The model position is what the
+ * model makes of the last report: ra follows the ra axis one for one, dec
+ * follows 0.9 of the dec axis (target a little off the meridian).
+ */
+struct SimulatedSlewPlatform {
+  double raAxis;
+  double decAxis;
+  SlewRates rates;
+  SlewRates pending;
+  TimePoint pendingTime;
+  TimePoint reportTime;
+  double reportedRAAxis;
+  double reportedDecAxis;
+  bool responds;
+
+  SimulatedSlewPlatform(TimePoint now)
+      : raAxis(0), decAxis(0), pendingTime(now), reportTime(now),
+        reportedRAAxis(0), reportedDecAxis(0), responds(true) {
+    rates.ra = rates.dec = pending.ra = pending.dec = 0;
+  }
+
+  void command(const SlewRates &newRates, TimePoint now) {
+    pending = newRates;
+    pendingTime = addMillisToTime(now, 50);
+  }
+
+  void step(TimePoint now, double seconds) {
+    if (responds && now >= pendingTime) {
+      rates = pending;
+    }
+    raAxis += rates.ra * seconds;
+    decAxis += rates.dec * seconds;
+    if (differenceInSeconds(reportTime, now) >= 1.0) {
+      reportTime = now;
+      reportedRAAxis = raAxis;
+      reportedDecAxis = decAxis;
+    }
+  }
+
+  SlewFeedback feedback(double baseRAHours, double baseDec) const {
+    SlewFeedback feedback;
+    feedback.raHours = baseRAHours + reportedRAAxis / 15.0;
+    feedback.decDegrees = baseDec + 0.9 * reportedDecAxis;
+    feedback.platformTime = reportTime;
+    feedback.maxRate = 0;
+    feedback.hasDecAxis = true;
+    feedback.connected = true;
+    return feedback;
+  }
+};
+
+void test_slew_controller_sim() {
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  SlewController controller;
+  const SlewSettings &settings = controller.getSettings();
+  SimulatedSlewPlatform platform(start);
+  const double baseRAHours = 23.9;
+  const double baseDec = -20;
+  // 8 degrees east, through 0h, and 1.5 degrees south
+  const double targetRAHours = baseRAHours + 8 / 15.0 - 24;
+  const double targetDec = baseDec - 1.5;
+
+  setLoggingEnabled(false);
+  uint32_t phaseVersion = controller.getPhaseVersion();
+  TEST_ASSERT_FALSE(controller.isSlewing());
+  controller.requestSlew(targetRAHours, targetDec);
+  double maxRate = 0;
+  double maxRateStep = 0;
+  double maxOvershoot = 0;
+  double settledAt = -1;
+  double idleAt = -1;
+  SlewRates last = {0, 0};
+  for (int ms = 0; ms <= 60000; ms += 10) {
+    TimePoint now = addMillisToTime(start, ms);
+    if (ms % SLEW_CONTROL_PERIOD_MS == 0) {
+      SlewRates rates;
+      if (controller.tick(platform.feedback(baseRAHours, baseDec), now,
+                          rates)) {
+        platform.command(rates, now);
+      }
+      maxRate = fmax(maxRate, fmax(fabs(rates.ra), fabs(rates.dec)));
+      maxRateStep = fmax(maxRateStep, fmax(fabs(rates.ra - last.ra),
+                                           fabs(rates.dec - last.dec)));
+      last = rates;
+      SlewStatus status = controller.getStatus();
+      if (status.phase == SLEW_SETTLING && settledAt < 0) {
+        settledAt = ms / 1000.0;
+      }
+      if (status.phase == SLEW_IDLE && idleAt < 0) {
+        idleAt = ms / 1000.0;
+      }
+    }
+    platform.step(now, 0.01);
+    // going past the target, in either axis
+    maxOvershoot = fmax(maxOvershoot, platform.raAxis - 8);
+    maxOvershoot = fmax(maxOvershoot, -1.5 - 0.9 * platform.decAxis);
+  }
+  setLoggingEnabled(true);
+
+  log("Slew settled after %.1fs, idle after %.1fs, overshoot %.3f degrees",
+      settledAt, idleAt, maxOvershoot);
+  SlewStatus status = controller.getStatus();
+  TEST_ASSERT_EQUAL_INT(SLEW_IDLE, status.phase);
+  TEST_ASSERT_FALSE(status.timedOut);
+  TEST_ASSERT_TRUE(settledAt > 0);
+  // slewing reported until the settle time has passed
+  TEST_ASSERT_TRUE(idleAt - settledAt >= settings.settleSeconds - 0.001);
+  TEST_ASSERT_TRUE(controller.getPhaseVersion() - phaseVersion >= 3);
+  // really on target, not just as the controller estimates it
+  TEST_ASSERT_FLOAT_WITHIN(settings.toleranceDegrees, 8, platform.raAxis);
+  TEST_ASSERT_FLOAT_WITHIN(settings.toleranceDegrees, -1.5,
+                           0.9 * platform.decAxis);
+  TEST_ASSERT_EQUAL_FLOAT(0, platform.rates.ra);
+  TEST_ASSERT_EQUAL_FLOAT(0, platform.rates.dec);
+  // ramped and capped
+  TEST_ASSERT_TRUE(maxRate <= settings.maxRate + 1e-9);
+  TEST_ASSERT_TRUE(maxRateStep <=
+                   settings.acceleration * SLEW_CONTROL_PERIOD_MS / 1000.0 +
+                       1e-9);
+  TEST_ASSERT_TRUE_MESSAGE(maxOvershoot < 0.2, "slew overshoot");
+}
+
+void test_slew_controller_stops() {
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  SlewSettings settings;
+  settings.timeoutSeconds = 5;
+  SlewController controller(settings);
+  SimulatedSlewPlatform platform(start);
+  SlewRates rates;
+  setLoggingEnabled(false);
+
+  // abort: stopped at once, and told to the platform
+  controller.requestSlew(1, -20);
+  TimePoint now = start;
+  for (int i = 0; i < 5; i++) {
+    now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+    controller.tick(platform.feedback(0, -20), now, rates);
+  }
+  TEST_ASSERT_TRUE(controller.isSlewing());
+  TEST_ASSERT_TRUE(rates.ra > 0);
+  controller.requestAbort();
+  now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+  TEST_ASSERT_TRUE(controller.tick(platform.feedback(0, -20), now, rates));
+  TEST_ASSERT_EQUAL_FLOAT(0, rates.ra);
+  TEST_ASSERT_FALSE(controller.isSlewing());
+
+  // a manual move taking over: stopped, but nothing sent over it
+  controller.requestSlew(1, -20);
+  for (int i = 0; i < 5; i++) {
+    now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+    controller.tick(platform.feedback(0, -20), now, rates);
+  }
+  controller.requestAbort(false);
+  now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+  TEST_ASSERT_FALSE(controller.tick(platform.feedback(0, -20), now, rates));
+  TEST_ASSERT_FALSE(controller.isSlewing());
+
+  // platform that never moves: gives up
+  controller.requestSlew(1, -20);
+  for (int i = 0; i < 100; i++) {
+    now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+    SlewFeedback feedback = platform.feedback(0, -20);
+    feedback.platformTime = now; // fresh packets, no movement
+    controller.tick(feedback, now, rates);
+  }
+  TEST_ASSERT_FALSE(controller.isSlewing());
+  TEST_ASSERT_TRUE(controller.getStatus().timedOut);
+  TEST_ASSERT_EQUAL_FLOAT(0, rates.ra);
+
+  // platform gone
+  controller.requestSlew(1, -20);
+  now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+  controller.tick(platform.feedback(0, -20), now, rates);
+  TEST_ASSERT_TRUE(controller.isSlewing());
+  SlewFeedback lost = platform.feedback(0, -20);
+  lost.connected = false;
+  now = addMillisToTime(now, SLEW_CONTROL_PERIOD_MS);
+  controller.tick(lost, now, rates);
+  TEST_ASSERT_FALSE(controller.isSlewing());
+  setLoggingEnabled(true);
+}
+
+void test_pulse_guide_merging() {
+  PulseGuideScheduler scheduler;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  PulseGuideCommand command;
+  setLoggingEnabled(false);
+  TEST_ASSERT_FALSE(scheduler.requestPulse(4, 100, start));
+  TEST_ASSERT_FALSE(scheduler.requestPulse(GUIDE_NORTH, -1, start));
+  setLoggingEnabled(true);
+  TEST_ASSERT_FALSE(scheduler.isPulseGuiding(start));
+
+  // guiding as soon as it's asked for, before the tick
+  scheduler.requestPulse(GUIDE_NORTH, 1000, start);
+  TEST_ASSERT_TRUE(scheduler.isPulseGuiding(start));
+  TEST_ASSERT_TRUE(scheduler.tick(start, command));
+  TEST_ASSERT_EQUAL_INT(0, command.raMillis);
+  TEST_ASSERT_EQUAL_INT(1000, command.decMillis);
+
+  // same direction overlapping: runs to the later end, not 2000ms
+  scheduler.requestPulse(GUIDE_NORTH, 1000, addMillisToTime(start, 400));
+  scheduler.tick(addMillisToTime(start, 400), command);
+  TEST_ASSERT_EQUAL_INT(1000, command.decMillis);
+  // opposing: 800ms left north less 300ms south
+  scheduler.requestPulse(GUIDE_SOUTH, 300, addMillisToTime(start, 600));
+  scheduler.tick(addMillisToTime(start, 600), command);
+  TEST_ASSERT_EQUAL_INT(500, command.decMillis);
+  // opposing and longer: turns round
+  scheduler.requestPulse(GUIDE_SOUTH, 700, addMillisToTime(start, 700));
+  scheduler.tick(addMillisToTime(start, 700), command);
+  TEST_ASSERT_EQUAL_INT(-300, command.decMillis);
+  // both axes in the one packet
+  scheduler.requestPulse(GUIDE_WEST, 200, addMillisToTime(start, 800));
+  scheduler.requestPulse(GUIDE_EAST, 50, addMillisToTime(start, 800));
+  TEST_ASSERT_TRUE(scheduler.tick(addMillisToTime(start, 800), command));
+  TEST_ASSERT_EQUAL_INT(-150, command.raMillis);
+  TEST_ASSERT_EQUAL_INT(-200, command.decMillis);
+
+  TEST_ASSERT_TRUE(scheduler.isPulseGuiding(addMillisToTime(start, 999)));
+  TEST_ASSERT_FALSE(scheduler.isPulseGuiding(addMillisToTime(start, 1000)));
+  TEST_ASSERT_FALSE(scheduler.tick(addMillisToTime(start, 1000), command));
+  PulseGuideStatus status = scheduler.getStatus();
+  TEST_ASSERT_EQUAL_UINT32(6, status.requests);
+  TEST_ASSERT_EQUAL_UINT32(1, status.coalesced);
+  TEST_ASSERT_EQUAL_UINT32(3, status.cancelled);
+  TEST_ASSERT_EQUAL_UINT32(5, status.packets);
+}
+
+/**
+ * PHD2 style guiding against a simulated platform: an exposure, a pulse
+ * on each axis for the measured error, then ispulseguiding polled every
+ * 50ms until it's done before the next exposure. Every fourth cycle a
+ * second pulse lands while the first is running (alternately the same way
+ * and the other way), as when guiding with very short exposures.
+ */
+void test_pulse_guide_phd2_sim() {
+  const int tickMillis = 5; // network task period
+  const int exposureMillis = 2000;
+  const int pollMillis = 50;
+  PulseGuideScheduler scheduler;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+
+  long platformRemaining[2] = {0, 0}; // ra, dec, signed
+  uint32_t random = 12345;
+  int cycles = 0;
+  int ticksWithPackets = 0;
+  int maxPacketsPerTick = 0;
+  long worstLateMillis = 0; // ispulseguiding still true after platform done
+  bool earlyFalse = false;  // false while the platform is still moving
+
+  int nextExposureEnd = exposureMillis;
+  int nextPoll = -1;
+  int extraPulseAt = -1;
+  int platformDoneAt = -1;
+  for (int ms = 0; ms < 600000; ms++) {
+    TimePoint now = addMillisToTime(start, ms);
+    if (ms == nextExposureEnd) {
+      cycles++;
+      random = random * 1103515245 + 12345;
+      scheduler.requestPulse((random >> 8) & 1 ? GUIDE_EAST : GUIDE_WEST,
+                             50 + (random >> 16) % 400, now);
+      random = random * 1103515245 + 12345;
+      scheduler.requestPulse((random >> 8) & 1 ? GUIDE_NORTH : GUIDE_SOUTH,
+                             50 + (random >> 16) % 400, now);
+      nextPoll = ms + pollMillis;
+      if (cycles % 4 == 0) {
+        extraPulseAt = ms + 30;
+      }
+    }
+    if (ms == extraPulseAt) {
+      scheduler.requestPulse(cycles % 8 == 0 ? GUIDE_EAST : GUIDE_WEST, 200,
+                             now);
+    }
+    if (ms % tickMillis == 0) {
+      PulseGuideCommand command;
+      int packets = 0;
+      if (scheduler.tick(now, command)) {
+        packets++;
+        platformRemaining[0] = command.raMillis;
+        platformRemaining[1] = command.decMillis;
+        platformDoneAt = -1;
+      }
+      ticksWithPackets += packets > 0 ? 1 : 0;
+      maxPacketsPerTick = packets > maxPacketsPerTick ? packets
+                                                      : maxPacketsPerTick;
+    }
+    bool platformMoving = platformRemaining[0] != 0 || platformRemaining[1] != 0;
+    if (ms == nextPoll) {
+      bool guiding = scheduler.isPulseGuiding(now);
+      if (!guiding && platformMoving) {
+        earlyFalse = true;
+      }
+      if (guiding) {
+        nextPoll = ms + pollMillis;
+        if (!platformMoving && platformDoneAt >= 0 &&
+            ms - platformDoneAt > worstLateMillis) {
+          worstLateMillis = ms - platformDoneAt;
+        }
+      } else {
+        // plus a few ms to download, so requests land between ticks
+        nextExposureEnd = ms + exposureMillis + (random >> 4) % tickMillis;
+      }
+    }
+    for (long &remaining : platformRemaining) {
+      if (remaining > 0) {
+        remaining--;
+      } else if (remaining < 0) {
+        remaining++;
+      }
+    }
+    if (platformMoving && platformRemaining[0] == 0 &&
+        platformRemaining[1] == 0) {
+      platformDoneAt = ms + 1;
+    }
+  }
+
+  PulseGuideStatus status = scheduler.getStatus();
+  log("PHD2 sim: %d cycles, %u pulses in %u packets (%u merged, %u "
+      "cancelled), latency max %ldms, ispulseguiding late by at most %ldms",
+      cycles, status.requests, status.packets, status.coalesced,
+      status.cancelled, status.maxLatencyMillis, worstLateMillis);
+  TEST_ASSERT_TRUE(cycles > 100);
+  TEST_ASSERT_FALSE_MESSAGE(earlyFalse, "ispulseguiding false too early");
+  TEST_ASSERT_EQUAL_INT(1, maxPacketsPerTick);
+  // both axes go in one packet
+  TEST_ASSERT_TRUE(status.packets < status.requests * 2 / 3);
+  TEST_ASSERT_TRUE(status.coalesced + status.cancelled > 0);
+  TEST_ASSERT_TRUE(status.maxLatencyMillis <= tickMillis);
+  TEST_ASSERT_TRUE(worstLateMillis <= tickMillis);
+}
+
+void test_command_channel_acks() {
+  CommandChannel channel;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  char packet[COMMAND_PACKET_SIZE];
+  size_t length;
+  channel.setPlatformAcks(true);
+
+  uint32_t first = channel.queue("park", 0, 0, nullptr, start);
+  uint32_t second = channel.queue("moveaxis", 0, 0.5, "moveaxis0", start);
+  uint32_t third = channel.queue("moveaxis", 1, 0.5, "moveaxis1", start);
+  // all three go out without waiting for acks
+  TEST_ASSERT_TRUE(channel.nextPacket(start, packet, sizeof(packet), length));
+  TEST_ASSERT_TRUE(strstr(packet, "\"command\":\"park\"") != nullptr);
+  TEST_ASSERT_TRUE(channel.nextPacket(start, packet, sizeof(packet), length));
+  TEST_ASSERT_TRUE(channel.nextPacket(start, packet, sizeof(packet), length));
+  TEST_ASSERT_FALSE(channel.nextPacket(start, packet, sizeof(packet), length));
+  TEST_ASSERT_EQUAL_INT(3, channel.inFlight());
+
+  // third acked, first in the bits, second lost
+  channel.onAck(third, 1UL << (third - first - 1));
+  TEST_ASSERT_EQUAL_INT(1, channel.inFlight());
+  TimePoint later = addMillisToTime(start, COMMAND_RETRANSMIT_MILLIS);
+  TEST_ASSERT_TRUE(channel.nextPacket(later, packet, sizeof(packet), length));
+  char expected[32];
+  snprintf(expected, sizeof(expected), "\"seq\":%lu}", (unsigned long)second);
+  TEST_ASSERT_TRUE(strstr(packet, expected) != nullptr);
+
+  // a newer rate for the same axis replaces the unacked one
+  uint32_t fourth = channel.queue("moveaxis", 0, 0.25, "moveaxis0", later);
+  TEST_ASSERT_EQUAL_INT(1, channel.inFlight());
+  channel.nextPacket(later, packet, sizeof(packet), length);
+  channel.onAck(fourth, 0);
+  TEST_ASSERT_EQUAL_INT(0, channel.inFlight());
+
+  CommandChannelStats stats = channel.getStats();
+  TEST_ASSERT_EQUAL_UINT32(4, stats.sent);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.retransmitted);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.acked);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.superseded);
+
+  // a platform that doesn't ack gets everything once
+  CommandChannel oldPlatform;
+  oldPlatform.queue("park", 0, 0, nullptr, start);
+  TEST_ASSERT_TRUE(
+      oldPlatform.nextPacket(start, packet, sizeof(packet), length));
+  TEST_ASSERT_FALSE(oldPlatform.nextPacket(
+      addMillisToTime(start, 10000), packet, sizeof(packet), length));
+}
+
+/**
+ * EQ platform end of the channel, for the loss test: acks everything it
+ * receives in its next telemetry packet, applies each keyed command only
+ * if it's newer than the last one applied for that key, and counts park
+ * commands (which aren't keyed, so none may be lost).
+ */
+struct SimulatedCommandPlatform {
+  uint32_t latest;
+  uint32_t received[64]; // seqs, ring
+  uint32_t receivedCount;
+  uint32_t appliedSeq[2];
+  double axisRate[2];
+  int parks;
+  uint32_t parkSeqs[64];
+
+  SimulatedCommandPlatform() : latest(0), receivedCount(0), parks(0) {
+    appliedSeq[0] = appliedSeq[1] = 0;
+    axisRate[0] = axisRate[1] = 0;
+  }
+
+  bool seen(uint32_t seq) const {
+    for (uint32_t i = 0; i < receivedCount && i < 64; i++) {
+      if (received[i] == seq) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void receive(const char *packet) {
+    char command[32];
+    double parameter1, parameter2;
+    unsigned long seq;
+    TEST_ASSERT_EQUAL_INT(
+        4, sscanf(packet,
+                  "EQ:{\"command\":\"%31[^\"]\",\"parameter1\":%lf,"
+                  "\"parameter2\":%lf,\"seq\":%lu}",
+                  command, &parameter1, &parameter2, &seq));
+    bool duplicate = seen(seq);
+    if (!duplicate) {
+      received[receivedCount++ % 64] = seq;
+    }
+    if ((int32_t)(seq - latest) > 0) {
+      latest = seq;
+    }
+    if (strcmp(command, "moveaxis") == 0) {
+      int axis = (int)parameter1;
+      if ((int32_t)(seq - appliedSeq[axis]) > 0) {
+        appliedSeq[axis] = seq;
+        axisRate[axis] = parameter2;
+      }
+    } else if (strcmp(command, "park") == 0 && !duplicate) {
+      parks++;
+    }
+  }
+
+  uint32_t ackBits() const {
+    uint32_t bits = 0;
+    for (uint32_t n = 1; n <= 32; n++) {
+      if (seen(latest - n)) {
+        bits |= 1UL << (n - 1);
+      }
+    }
+    return bits;
+  }
+};
+
+/**
+ * Bursts of moveaxis on both axes, with parks mixed in, over a link that
+ * drops 30% of packets each way and delays the rest. Checks the platform
+ * ends up at the last rate asked for on each axis and gets every park,
+ * with and without the channel's retransmission.
+ */
+static void runCommandLossSim(bool acks, CommandChannelStats &stats,
+                              int &wrongFinalRates, int &lostParks) {
+  CommandChannel channel;
+  SimulatedCommandPlatform platform;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  uint32_t random = 4242;
+  const int latencyMillis = 15;
+  // packets in flight: arrival time (ms) and contents
+  struct InFlight {
+    int arrives;
+    bool toPlatform;
+    char packet[COMMAND_PACKET_SIZE];
+    uint32_t ack, ackBits;
+  };
+  static InFlight wire[256];
+  int wireCount = 0;
+  int parksSent = 0;
+  wrongFinalRates = 0;
+
+  for (int burst = 0; burst < 40; burst++) {
+    int burstStart = burst * 2000;
+    double lastRate[2] = {0, 0};
+    for (int ms = burstStart; ms < burstStart + 2000; ms++) {
+      TimePoint now = addMillisToTime(start, ms);
+      // 20 commands 10ms apart, alternating axes, then quiet
+      if (ms - burstStart < 200 && (ms - burstStart) % 10 == 0) {
+        int axis = ((ms - burstStart) / 10) % 2;
+        random = random * 1103515245 + 12345;
+        double rate = ((random >> 16) % 200) / 100.0 - 1.0;
+        channel.queue("moveaxis", axis, rate,
+                      axis == 0 ? "moveaxis0" : "moveaxis1", now);
+        lastRate[axis] = rate;
+        if ((ms - burstStart) == 100) {
+          channel.queue("park", 0, 0, nullptr, now);
+          parksSent++;
+        }
+      }
+      // network task: anything due goes on the wire
+      char packet[COMMAND_PACKET_SIZE];
+      size_t length;
+      while (channel.nextPacket(now, packet, sizeof(packet), length)) {
+        random = random * 1103515245 + 12345;
+        if ((random >> 16) % 100 < 30 || wireCount == 256) {
+          continue; // lost
+        }
+        InFlight &f = wire[wireCount++];
+        f.arrives = ms + latencyMillis + (random >> 8) % 10;
+        f.toPlatform = true;
+        memcpy(f.packet, packet, length + 1);
+      }
+      // deliver, both ways
+      for (int i = 0; i < wireCount;) {
+        if (wire[i].arrives > ms) {
+          i++;
+          continue;
+        }
+        InFlight f = wire[i];
+        wire[i] = wire[--wireCount];
+        if (!f.toPlatform) {
+          if (acks) {
+            channel.setPlatformAcks(true);
+            channel.onAck(f.ack, f.ackBits);
+          }
+          continue;
+        }
+        platform.receive(f.packet);
+        // telemetry straight back, carrying the ack
+        random = random * 1103515245 + 12345;
+        if ((random >> 16) % 100 < 30 || wireCount == 256) {
+          continue;
+        }
+        InFlight &reply = wire[wireCount++];
+        reply.arrives = ms + latencyMillis;
+        reply.toPlatform = false;
+        reply.ack = platform.latest;
+        reply.ackBits = platform.ackBits();
+      }
+    }
+    for (int axis = 0; axis < 2; axis++) {
+      if (fabs(platform.axisRate[axis] - lastRate[axis]) > 1e-6) {
+        wrongFinalRates++;
+      }
+    }
+  }
+  stats = channel.getStats();
+  lostParks = parksSent - platform.parks;
+}
+
+/**
+ * Pulse guides (timed commands) over the same lossy link: 500ms east and
+ * 300ms south every second. The platform guides each axis for what a
+ * packet says from when it arrives, so a resend carrying the whole pulse
+ * would run on past where the scheduler says guiding ends. Returns the
+ * most any axis ran past that, and how many pulses never got there.
+ */
+static void runPulseLossSim(CommandChannelStats &stats, int &worstLateMillis,
+                            int &missedPulses) {
+  CommandChannel channel;
+  channel.setPlatformAcks(true);
+  SimulatedCommandPlatform platform;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  uint32_t random = 777;
+  const int latencyMillis = 15;
+  struct InFlight {
+    int arrives;
+    bool toPlatform;
+    char packet[COMMAND_PACKET_SIZE];
+    uint32_t ack, ackBits;
+  };
+  static InFlight wire[256];
+  int wireCount = 0;
+  const int pulses = 40;
+  const long pulseMillis[2] = {500, -300};
+  int guideEnd[2] = {0, 0};
+  uint32_t lastPulseSeq = 0;
+  int applied = 0;
+  worstLateMillis = 0;
+
+  for (int ms = 0; ms < pulses * 1000 + 1000; ms++) {
+    TimePoint now = addMillisToTime(start, ms);
+    if (ms % 1000 == 0 && ms < pulses * 1000) {
+      channel.queueTimed("pulseguideaxes", pulseMillis[0], pulseMillis[1],
+                         "pulseguide", now);
+    }
+    char packet[COMMAND_PACKET_SIZE];
+    size_t length;
+    while (channel.nextPacket(now, packet, sizeof(packet), length)) {
+      random = random * 1103515245 + 12345;
+      if ((random >> 16) % 100 < 30 || wireCount == 256) {
+        continue; // lost
+      }
+      InFlight &f = wire[wireCount++];
+      f.arrives = ms + latencyMillis + (random >> 8) % 10;
+      f.toPlatform = true;
+      memcpy(f.packet, packet, length + 1);
+    }
+    for (int i = 0; i < wireCount;) {
+      if (wire[i].arrives > ms) {
+        i++;
+        continue;
+      }
+      InFlight f = wire[i];
+      wire[i] = wire[--wireCount];
+      if (!f.toPlatform) {
+        channel.onAck(f.ack, f.ackBits);
+        continue;
+      }
+      platform.receive(f.packet);
+      double millis[2];
+      unsigned long seq;
+      TEST_ASSERT_EQUAL_INT(
+          3, sscanf(f.packet,
+                    "EQ:{\"command\":\"pulseguideaxes\",\"parameter1\":%lf,"
+                    "\"parameter2\":%lf,\"seq\":%lu}",
+                    &millis[0], &millis[1], &seq));
+      if ((int32_t)(seq - lastPulseSeq) > 0) {
+        lastPulseSeq = seq;
+        applied++;
+      }
+      // each axis guides for what's in the packet, from now
+      int queuedAt = ms / 1000 * 1000;
+      for (int axis = 0; axis < 2; axis++) {
+        guideEnd[axis] = ms + (int)fabs(millis[axis]);
+        int late = guideEnd[axis] - (queuedAt + (int)labs(pulseMillis[axis]));
+        if (late > worstLateMillis) {
+          worstLateMillis = late;
+        }
+      }
+      random = random * 1103515245 + 12345;
+      if ((random >> 16) % 100 < 30 || wireCount == 256) {
+        continue;
+      }
+      InFlight &reply = wire[wireCount++];
+      reply.arrives = ms + latencyMillis;
+      reply.toPlatform = false;
+      reply.ack = platform.latest;
+      reply.ackBits = platform.ackBits();
+    }
+  }
+  stats = channel.getStats();
+  missedPulses = pulses - applied;
+}
+
+void test_command_channel_loss() {
+  setLoggingEnabled(false);
+  CommandChannelStats reliable, once;
+  int reliableWrong, reliableLost, onceWrong, onceLost;
+  runCommandLossSim(true, reliable, reliableWrong, reliableLost);
+  runCommandLossSim(false, once, onceWrong, onceLost);
+  setLoggingEnabled(true);
+
+  log("30%% loss, 40 bursts of axis rates: wrong final rate %d of 80 with "
+      "acks, %d without. Parks lost %d vs %d",
+      reliableWrong, onceWrong, reliableLost, onceLost);
+  log("  %u sent, %u resent, %u superseded, %u expired, %u in flight at most",
+      reliable.sent, reliable.retransmitted, reliable.superseded,
+      reliable.expired, reliable.maxInFlight);
+  TEST_ASSERT_EQUAL_INT(0, reliableWrong);
+  TEST_ASSERT_EQUAL_INT(0, reliableLost);
+  TEST_ASSERT_TRUE(onceWrong > 0);
+  // pipelined, not one at a time
+  TEST_ASSERT_TRUE(reliable.maxInFlight > 1);
+  TEST_ASSERT_TRUE(reliable.retransmitted > 0);
+  TEST_ASSERT_EQUAL_UINT32(0, reliable.expired);
+
+  // timed commands: a resend only carries what's left of the pulse
+  CommandChannelStats pulses;
+  int worstLate, missed;
+  setLoggingEnabled(false);
+  runPulseLossSim(pulses, worstLate, missed);
+  setLoggingEnabled(true);
+  log("30%% loss, 40 pulse guides: ran on past the end by %dms at most, "
+      "%d missed, %u resent, %u lapsed",
+      worstLate, missed, pulses.retransmitted, pulses.lapsed);
+  TEST_ASSERT_TRUE(pulses.retransmitted > 0);
+  // no later than the link's latency
+  TEST_ASSERT_TRUE(worstLate <= 25);
+  TEST_ASSERT_TRUE(missed < 10);
+}
+
+struct TestCatalogueObject {
+  std::string name;
+  uint8_t type;
+  double raHours;
+  double decDegrees;
+  double magnitude;
+  int size;
+};
+
+static void appendU16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(value & 0xff);
+  out.push_back(value >> 8);
+}
+
+static void appendU32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((value >> (8 * i)) & 0xff);
+  }
+}
+
+// Same layout as tools/build_catalogue.py writes
+static std::vector<uint8_t>
+buildTestCatalogue(std::vector<TestCatalogueObject> objects, int bandCount) {
+  const double turn = 4294967296.0;
+  auto band = [bandCount](double dec) {
+    int b = (int)((dec + 90) * bandCount / 180);
+    return b < bandCount ? b : bandCount - 1;
+  };
+  auto raUnits = [turn](double ra) { return (uint32_t)(uint64_t)(ra / 24 * turn); };
+  std::sort(objects.begin(), objects.end(),
+            [&](const TestCatalogueObject &a, const TestCatalogueObject &b) {
+              if (band(a.decDegrees) != band(b.decDegrees)) {
+                return band(a.decDegrees) < band(b.decDegrees);
+              }
+              return raUnits(a.raHours) < raUnits(b.raHours);
+            });
+  std::vector<uint8_t> records;
+  std::vector<uint8_t> names;
+  std::vector<uint32_t> bands(bandCount + 1, 0);
+  for (const TestCatalogueObject &object : objects) {
+    bands[band(object.decDegrees) + 1]++;
+    appendU32(records, raUnits(object.raHours));
+    appendU32(records, (uint32_t)(int32_t)lround(object.decDegrees / 360 * turn));
+    appendU16(records, (uint16_t)(int16_t)lround(object.magnitude * 100));
+    records.push_back(object.type);
+    records.push_back(object.size);
+    appendU32(records, names.size());
+    names.insert(names.end(), object.name.begin(), object.name.end());
+    names.push_back(0);
+  }
+  for (int b = 0; b < bandCount; b++) {
+    bands[b + 1] += bands[b];
+  }
+  uint32_t recordsOffset = CATALOGUE_HEADER_SIZE + 4 * (bandCount + 1);
+  std::vector<uint8_t> out(CATALOGUE_MAGIC, CATALOGUE_MAGIC + 4);
+  appendU16(out, CATALOGUE_VERSION);
+  appendU16(out, bandCount);
+  appendU32(out, objects.size());
+  appendU32(out, CATALOGUE_HEADER_SIZE);
+  appendU32(out, recordsOffset);
+  appendU32(out, recordsOffset + records.size());
+  appendU32(out, names.size());
+  appendU32(out, 0);
+  for (uint32_t b : bands) {
+    appendU32(out, b);
+  }
+  out.insert(out.end(), records.begin(), records.end());
+  out.insert(out.end(), names.begin(), names.end());
+  return out;
+}
+
+// Counts what a query reads, as a stand in for flash traffic
+class CountingCatalogueSource : public CatalogueSource {
+public:
+  CountingCatalogueSource(const std::vector<uint8_t> &data)
+      : memory(data.data(), data.size()), reads(0), bytes(0) {}
+  bool read(uint32_t offset, void *buffer, size_t length) override {
+    reads++;
+    bytes += length;
+    return memory.read(offset, buffer, length);
+  }
+  MemoryCatalogueSource memory;
+  unsigned long reads;
+  unsigned long bytes;
+};
+
+static double testAngularDistance(double ra1, double dec1, double ra2,
+                                  double dec2) {
+  double d1 = dec1 * PI / 180, d2 = dec2 * PI / 180;
+  double c = sin(d1) * sin(d2) + cos(d1) * cos(d2) * cos((ra1 - ra2) * PI / 12);
+  return acos(c > 1 ? 1 : c) * 180 / PI;
+}
+
+static std::vector<TestCatalogueObject> randomTestCatalogue(int count) {
+  std::vector<TestCatalogueObject> objects;
+  srand(37);
+  for (int i = 0; i < count; i++) {
+    TestCatalogueObject object;
+    object.name = "NGC " + std::to_string(i);
+    object.type = i % 10;
+    object.raHours = 24.0 * rand() / ((double)RAND_MAX + 1);
+    // uniform over the sphere
+    object.decDegrees = asin(2.0 * rand() / RAND_MAX - 1) * 180 / PI;
+    object.magnitude = 2 + (i % 1400) / 100.0;
+    object.size = i % 256;
+    objects.push_back(object);
+  }
+  return objects;
+}
+
+void test_catalogue_query() {
+  std::vector<TestCatalogueObject> objects = randomTestCatalogue(5000);
+  // objects on the awkward spots: the poles, either side of 0h, a band edge
+  objects.push_back({"Polaris", CATALOGUE_STAR, 2.53, 89.26, 1.98, 0});
+  objects.push_back({"South Pole", CATALOGUE_OTHER, 0, -90, 0, 0});
+  objects.push_back({"Before 0h", CATALOGUE_GALAXY, 23.99, 10, 9, 5});
+  objects.push_back({"After 0h", CATALOGUE_GALAXY, 0.01, 10, 9, 5});
+  objects.push_back({"Band edge", CATALOGUE_NEBULA, 6, 2, 5, 20});
+  std::vector<uint8_t> data = buildTestCatalogue(objects, 90);
+  MemoryCatalogueSource source(data.data(), data.size());
+  CatalogueReader reader;
+  TEST_ASSERT_TRUE(reader.open(&source));
+  TEST_ASSERT_EQUAL_UINT32(objects.size(), reader.getObjectCount());
+
+  CatalogueMatch matches[CATALOGUE_NEARBY_MAX];
+  // across 0h: both sides found, nearest first
+  size_t count = reader.findNear(0, 10, 0.5, matches, CATALOGUE_NEARBY_MAX);
+  TEST_ASSERT_TRUE(count >= 2);
+  bool before = false, after = false;
+  for (size_t i = 0; i < count; i++) {
+    before = before || strcmp(matches[i].name, "Before 0h") == 0;
+    after = after || strcmp(matches[i].name, "After 0h") == 0;
+  }
+  TEST_ASSERT_TRUE(before && after);
+
+  // across the pole (2.2 degrees away, on the far side): everything within
+  // the radius whatever the ra
+  count = reader.findNear(14.5, 88.5, 2.5, matches, CATALOGUE_NEARBY_MAX);
+  TEST_ASSERT_TRUE(count >= 1);
+  bool polaris = false;
+  for (size_t i = 0; i < count; i++) {
+    polaris = polaris || strcmp(matches[i].name, "Polaris") == 0;
+  }
+  TEST_ASSERT_TRUE(polaris);
+  count = reader.findNear(12, -89.5, 0.6, matches, CATALOGUE_NEARBY_MAX);
+  TEST_ASSERT_TRUE(count >= 1);
+  TEST_ASSERT_EQUAL_STRING("South Pole", matches[0].name);
+
+  // exact position and fields come back
+  count = reader.findNear(6, 2, 0.001, matches, CATALOGUE_NEARBY_MAX);
+  TEST_ASSERT_EQUAL_UINT32(1, count);
+  TEST_ASSERT_EQUAL_STRING("Band edge", matches[0].name);
+  TEST_ASSERT_EQUAL_UINT8(CATALOGUE_NEBULA, matches[0].type);
+  TEST_ASSERT_EQUAL_UINT8(20, matches[0].sizeArcmin);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 5, matches[0].magnitude);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 6, matches[0].raHours);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 2, matches[0].decDegrees);
+  CatalogueMatch byIndex;
+  TEST_ASSERT_TRUE(reader.readObject(matches[0].index, byIndex));
+  TEST_ASSERT_EQUAL_STRING("Band edge", byIndex.name);
+
+  // random cones against brute force
+  srand(1037);
+  for (int q = 0; q < 500; q++) {
+    double ra = 24.0 * rand() / RAND_MAX;
+    double dec = 180.0 * rand() / RAND_MAX - 90;
+    double radius = 0.5 + 9.5 * rand() / RAND_MAX;
+    std::vector<double> expected;
+    for (const TestCatalogueObject &object : objects) {
+      double distance =
+          testAngularDistance(ra, dec, object.raHours, object.decDegrees);
+      if (distance <= radius) {
+        expected.push_back(distance);
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    count = reader.findNear(ra, dec, radius, matches, CATALOGUE_NEARBY_MAX);
+    size_t wanted = expected.size() < CATALOGUE_NEARBY_MAX
+                        ? expected.size()
+                        : CATALOGUE_NEARBY_MAX;
+    // objects within float rounding of the edge can go either way
+    TEST_ASSERT_INT_WITHIN(1, wanted, count);
+    for (size_t i = 0; i < count && i < expected.size(); i++) {
+      TEST_ASSERT_FLOAT_WITHIN(1e-3, expected[i], matches[i].distanceDegrees);
+      TEST_ASSERT_FLOAT_WITHIN(
+          1e-3, matches[i].distanceDegrees,
+          testAngularDistance(ra, dec, matches[i].raHours,
+                              matches[i].decDegrees));
+    }
+  }
+
+  // not a catalogue
+  setLoggingEnabled(false);
+  data[0] = 'X';
+  CatalogueReader broken;
+  TEST_ASSERT_FALSE(broken.open(&source));
+  TEST_ASSERT_EQUAL_UINT32(0, broken.findNear(0, 0, 5, matches, 1));
+  data[0] = 'D';
+  data[CATALOGUE_HEADER_SIZE + 4 * 90] = 0xff; // band index end
+  TEST_ASSERT_FALSE(broken.open(&source));
+  setLoggingEnabled(true);
+
+  NearbyObjects nearby;
+  memset(&nearby, 0, sizeof(nearby));
+  nearby.available = true;
+  nearby.radiusDegrees = 3;
+  nearby.count = 1;
+  nearby.matches[0] = byIndex;
+  nearby.matches[0].magnitude = CATALOGUE_UNKNOWN_MAGNITUDE / 100.0f;
+  char buffer[CATALOGUE_NEARBY_BUFFER_SIZE];
+  TEST_ASSERT_TRUE(renderNearbyObjects(nearby, buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "\"name\":\"Band edge\",\"type\":\"nebula\""));
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "\"mag\":null"));
+  // fully populated still fits
+  nearby.count = CATALOGUE_NEARBY_MAX;
+  for (int i = 0; i < CATALOGUE_NEARBY_MAX; i++) {
+    nearby.matches[i] = byIndex;
+    memset(nearby.matches[i].name, 'x', CATALOGUE_NAME_SIZE - 1);
+    nearby.matches[i].name[CATALOGUE_NAME_SIZE - 1] = 0;
+  }
+  TEST_ASSERT_TRUE(renderNearbyObjects(nearby, buffer, sizeof(buffer)) > 0);
+}
+
+/**
+ * The 10Hz lookup on a catalogue the size of Messier, Caldwell, the
+ * brighter NGC and named stars (several thousand objects), read through
+ * the same paging the LittleFS source uses.
+ */
+void test_catalogue_benchmark() {
+  std::vector<uint8_t> data = buildTestCatalogue(randomTestCatalogue(10000), 90);
+  CountingCatalogueSource source(data);
+  CatalogueReader reader;
+  TEST_ASSERT_TRUE(reader.open(&source));
+
+  const int iterations = 2000;
+  CatalogueMatch matches[CATALOGUE_NEARBY_MAX];
+  unsigned long found = 0;
+  unsigned long pages = 0;
+  unsigned long worstPages = 0;
+  source.reads = 0;
+  source.bytes = 0;
+  unsigned long allocationsBefore = heapAllocations;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    // a slow sweep across the sky, as when pushing the scope around
+    double ra = fmod(i * 0.05, 24);
+    double dec = 80 * sin(i * 0.003);
+    found += reader.findNear(ra, dec, CATALOGUE_NEARBY_RADIUS_DEGREES, matches,
+                             CATALOGUE_NEARBY_MAX);
+    CatalogueQueryStats stats = reader.getLastQueryStats();
+    pages += stats.pagesRead;
+    worstPages = stats.pagesRead > worstPages ? stats.pagesRead : worstPages;
+  }
+  double ticks = (double)(metricsTicks() - startTicks) / iterations;
+  unsigned long allocations = heapAllocations - allocationsBefore;
+  double micros = ticks * metricsSecondsPerTick() * 1e6;
+  log("Catalogue: %lu objects, %lu byte file. Query %.1fus, %.1f found, "
+      "%.1f pages (worst %lu), %.0f bytes read. RAM: reader %u bytes, "
+      "published result %u bytes",
+      (unsigned long)reader.getObjectCount(), (unsigned long)data.size(),
+      micros, (double)found / iterations, (double)pages / iterations,
+      worstPages, (double)source.bytes / iterations,
+      (unsigned)sizeof(CatalogueReader), (unsigned)sizeof(NearbyObjects));
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+  TEST_ASSERT_TRUE(found > 0);
+  // a 3 degree cone touches a handful of the file's pages
+  unsigned long filePages =
+      (reader.getObjectCount() + CATALOGUE_PAGE_RECORDS - 1) /
+      CATALOGUE_PAGE_RECORDS;
+  TEST_ASSERT_TRUE(worstPages < filePages / 8);
+  TEST_ASSERT_TRUE(sizeof(CatalogueReader) < 2048);
+  // 10Hz leaves plenty of room even unoptimised
+  TEST_ASSERT_TRUE(micros < 5000);
+}
+
+static double testAltitude(const PlannerTarget &target, double latitude,
+                           double longitude, TimePoint time) {
+  return equatorialToHorizontalAtSiderealTime(
+             EqCoord(target.raHours * 15, target.decDegrees),
+             localSiderealTime(time, longitude), latitude)
+      .altInDegrees;
+}
+
+void test_visibility_planner() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  // 6pm to 6am local (UTC+10)
+  TimePoint start = createTimePoint(2, 9, 2023, 8, 0, 0);
+  TimePoint end = addSecondsToTime(start, 12 * 3600);
+  NightConstants night = prepareNight(latitude, longitude,
+                                      VISIBILITY_HORIZON_DEGREES, start, end);
+  TEST_ASSERT_TRUE(night.valid);
+
+  PlannerTarget targets[] = {{18.6156f, 38.7836f, 0},   // vega
+                             {22.9608f, -29.6222f, 1},  // fomalhaut
+                             {19.8464f, 8.8683f, 2},    // altair
+                             {22.1372f, -46.9611f, 3},  // alnair
+                             {6.7525f, -16.7161f, 4},   // sirius
+                             {1.6286f, -57.2367f, 5},   // achernar
+                             {12.4433f, -63.0992f, 6},  // acrux
+                             {2.5303f, 89.2641f, 7}};   // polaris
+  const size_t count = sizeof(targets) / sizeof(targets[0]);
+  Visibility visibility[count];
+  TEST_ASSERT_TRUE(planVisibility(night, targets, count, visibility));
+
+  // rise and set agree with Ephemeris (which works from 0h UT of the date)
+  Ephemeris::setLocationOnEarth(latitude, longitude);
+  Ephemeris::flipLongitude(false);
+  Ephemeris::setAltitude(0);
+  TimePoint midnight = createTimePoint(2, 9, 2023, 0, 0, 0);
+  const double siderealDaySeconds = 86164.0905;
+  for (size_t i = 0; i < count; i++) {
+    EquatorialCoordinates coord;
+    coord.ra = targets[i].raHours;
+    coord.dec = targets[i].decDegrees;
+    FLOAT rise, set;
+    RiseAndSetState state =
+        Ephemeris::riseAndSetForEquatorialCoordinatesAtDateAndTime(
+            coord, &rise, &set, 2, 9, 2023, 0, 0, 0);
+    if (state == ObjectAlwaysInSky) {
+      TEST_ASSERT_EQUAL_INT(VISIBILITY_ALWAYS_UP, visibility[i].state);
+      continue;
+    }
+    if (state == ObjectNeverInSky) {
+      TEST_ASSERT_EQUAL_INT(VISIBILITY_NEVER_UP, visibility[i].state);
+      continue;
+    }
+    TEST_ASSERT_EQUAL_INT(VISIBILITY_RISES_AND_SETS, visibility[i].state);
+    double offset = differenceInSeconds(midnight, start);
+    double riseError =
+        fmod(visibility[i].riseSeconds + offset - rise * 3600, siderealDaySeconds);
+    double setError =
+        fmod(visibility[i].setSeconds + offset - set * 3600, siderealDaySeconds);
+    riseError = riseError > siderealDaySeconds / 2 ? riseError - siderealDaySeconds
+                : riseError < -siderealDaySeconds / 2 ? riseError + siderealDaySeconds
+                                                      : riseError;
+    setError = setError > siderealDaySeconds / 2 ? setError - siderealDaySeconds
+               : setError < -siderealDaySeconds / 2 ? setError + siderealDaySeconds
+                                                    : setError;
+    TEST_ASSERT_FLOAT_WITHIN(5, 0, riseError);
+    TEST_ASSERT_FLOAT_WITHIN(5, 0, setError);
+  }
+  TEST_ASSERT_EQUAL_INT(VISIBILITY_ALWAYS_UP, visibility[6].state); // acrux
+  TEST_ASSERT_EQUAL_INT(VISIBILITY_NEVER_UP, visibility[7].state);  // polaris
+  TEST_ASSERT_EQUAL_FLOAT(12 * 3600, visibility[6].observableSeconds);
+  TEST_ASSERT_EQUAL_FLOAT(0, visibility[7].observableSeconds);
+
+  // against sampling the altitude through the night, for a spread of
+  // targets and a higher minimum altitude
+  night = prepareNight(latitude, longitude, 20, start, end);
+  srand(38);
+  const int sampleSeconds = 30;
+  for (int i = 0; i < 300; i++) {
+    PlannerTarget target = {24.0f * rand() / RAND_MAX,
+                            (float)(asin(2.0 * rand() / RAND_MAX - 1) * 180 / PI),
+                            (uint32_t)i};
+    Visibility plan;
+    planVisibility(night, &target, 1, &plan);
+    double highest = -90;
+    double highestAt = 0;
+    double up = 0;
+    for (int s = 0; s <= 12 * 3600; s += sampleSeconds) {
+      double altitude =
+          testAltitude(target, latitude, longitude, addSecondsToTime(start, s));
+      if (altitude > highest) {
+        highest = altitude;
+        highestAt = s;
+      }
+      up += altitude >= 20 && s < 12 * 3600 ? sampleSeconds : 0;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.05, highest, plan.maxAltitudeDegrees);
+    TEST_ASSERT_FLOAT_WITHIN(2 * sampleSeconds, up, plan.observableSeconds);
+    if (plan.bestSeconds > 0 && plan.bestSeconds < 12 * 3600) {
+      // transit: flat at the top, so only roughly
+      TEST_ASSERT_FLOAT_WITHIN(600, highestAt, plan.bestSeconds);
+    }
+    if (plan.state == VISIBILITY_RISES_AND_SETS) {
+      TEST_ASSERT_FLOAT_WITHIN(
+          0.05, 20,
+          testAltitude(target, latitude, longitude,
+                       addSecondsToTime(start, plan.riseSeconds)));
+      TEST_ASSERT_FLOAT_WITHIN(
+          0.05, 20,
+          testAltitude(target, latitude, longitude,
+                       addSecondsToTime(start, plan.setSeconds)));
+    }
+  }
+
+  // sorting: longest up first, then highest
+  night = prepareNight(latitude, longitude, VISIBILITY_HORIZON_DEGREES, start,
+                       end);
+  planVisibility(night, targets, count, visibility);
+  sortByObservability(visibility, count);
+  // fomalhaut, alnair, achernar and acrux are up all night; fomalhaut
+  // passes nearly overhead
+  TEST_ASSERT_EQUAL_UINT32(1, visibility[0].id);
+  TEST_ASSERT_EQUAL_FLOAT(12 * 3600, visibility[3].observableSeconds);
+  TEST_ASSERT_TRUE(visibility[0].maxAltitudeDegrees >
+                   visibility[1].maxAltitudeDegrees);
+  TEST_ASSERT_EQUAL_UINT32(7, visibility[count - 1].id);
+  for (size_t i = 1; i < count; i++) {
+    TEST_ASSERT_TRUE(visibility[i - 1].observableSeconds >=
+                     visibility[i].observableSeconds);
+  }
+
+  // windows the planner won't take
+  TEST_ASSERT_FALSE(prepareNight(latitude, longitude, 0, end, start).valid);
+  TEST_ASSERT_FALSE(prepareNight(latitude, longitude, 0, start,
+                                 addSecondsToTime(start, 25 * 3600))
+                        .valid);
+  TEST_ASSERT_FALSE(planVisibility(
+      prepareNight(latitude, longitude, 0, end, start), targets, 1, visibility));
+}
+
+void test_visibility_planner_benchmark() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  const int count = 5000;
+  std::vector<PlannerTarget> targets(count);
+  srand(1038);
+  for (int i = 0; i < count; i++) {
+    targets[i].raHours = 24.0f * rand() / RAND_MAX;
+    targets[i].decDegrees = (float)(asin(2.0 * rand() / RAND_MAX - 1) * 180 / PI);
+    targets[i].id = i;
+  }
+  std::vector<Visibility> visibility(count);
+  TimePoint start = createTimePoint(2, 9, 2023, 8, 0, 0);
+  TimePoint end = addSecondsToTime(start, 10 * 3600);
+
+  const int rounds = 20;
+  unsigned long allocationsBefore = heapAllocations;
+  uint32_t startTicks = metricsTicks();
+  for (int r = 0; r < rounds; r++) {
+    NightConstants night =
+        prepareNight(latitude, longitude, 20, start, end);
+    planVisibility(night, targets.data(), count, visibility.data());
+  }
+  double planTicks = (double)(metricsTicks() - startTicks) / rounds;
+  startTicks = metricsTicks();
+  sortByObservability(visibility.data(), count);
+  double sortTicks = metricsTicks() - startTicks;
+  unsigned long allocations = heapAllocations - allocationsBefore;
+
+  // one at a time through Ephemeris, as before
+  Ephemeris::setLocationOnEarth(latitude, longitude);
+  Ephemeris::flipLongitude(false);
+  startTicks = metricsTicks();
+  FLOAT sum = 0;
+  for (int i = 0; i < count; i++) {
+    EquatorialCoordinates coord;
+    coord.ra = targets[i].raHours;
+    coord.dec = targets[i].decDegrees;
+    FLOAT rise = 0, set = 0;
+    Ephemeris::riseAndSetForEquatorialCoordinatesAtDateAndTime(
+        coord, &rise, &set, 2, 9, 2023, 8, 0, 0);
+    sum += isnan(rise) ? 0 : rise;
+  }
+  double ephemerisTicks = metricsTicks() - startTicks;
+
+  double secondsPerTick = metricsSecondsPerTick();
+  log("Visibility planner: %d targets in %.2fms (%.0fns each), sorted in "
+      "%.2fms. Ephemeris one at a time (rise/set only): %.2fms (checksum %.0f)",
+      count, planTicks * secondsPerTick * 1e3,
+      planTicks * secondsPerTick * 1e9 / count, sortTicks * secondsPerTick * 1e3,
+      ephemerisTicks * secondsPerTick * 1e3, (double)sum);
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+  for (int i = 1; i < count; i++) {
+    TEST_ASSERT_TRUE(visibility[i - 1].observableSeconds >=
+                     visibility[i].observableSeconds);
+  }
+  TEST_ASSERT_TRUE(planTicks * secondsPerTick < 0.1);
+}
+
+static double testSeparationArcsec(const EquatorialPosition &a,
+                                   const EquatorialPosition &b) {
+  double ra1 = a.raHours * PI / 12, dec1 = a.decDegrees * PI / 180;
+  double ra2 = b.raHours * PI / 12, dec2 = b.decDegrees * PI / 180;
+  double s = sin((dec2 - dec1) / 2);
+  double t = sin((ra2 - ra1) / 2);
+  double h = s * s + cos(dec1) * cos(dec2) * t * t;
+  return 2 * asin(sqrt(h)) * 180 / PI * 3600;
+}
+
+void test_epoch_transform() {
+  EpochTransform epoch;
+  TEST_ASSERT_FALSE(epoch.isBuilt());
+  EquatorialPosition unchanged = epoch.j2000ToJNow({5.5, -5.4});
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, 5.5, unchanged.raHours);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, -5.4, unchanged.decDegrees);
+
+  // Meeus example 23.a: theta Persei at 2028 November 13.19, with its
+  // proper motion applied to the J2000 position first
+  TimePoint when = createTimePoint(13, 11, 2028, 4, 33, 36);
+  epoch.build(when);
+  TEST_ASSERT_TRUE(epoch.isBuilt());
+  double years = 28.86705;
+  EquatorialPosition thetaPersei = {
+      (2 + 44.0 / 60 + (11.986 + 0.03425 * years) / 3600),
+      49 + 13.0 / 60 + (42.48 - 0.0895 * years) / 3600};
+  EquatorialPosition apparent = epoch.j2000ToJNow(thetaPersei);
+  EquatorialPosition meeus = {2 + 46.0 / 60 + 14.390 / 3600,
+                              49 + 21.0 / 60 + 7.45 / 3600};
+  log("theta Persei: %.6fh %.6f, %.2f\" from Meeus", apparent.raHours,
+      apparent.decDegrees, testSeparationArcsec(apparent, meeus));
+  TEST_ASSERT_TRUE(testSeparationArcsec(apparent, meeus) < 2);
+
+  // and back again
+  EquatorialPosition back = epoch.jNowToJ2000(apparent);
+  TEST_ASSERT_TRUE(testSeparationArcsec(back, thetaPersei) < 0.01);
+
+  // rebuilt once a minute
+  TEST_ASSERT_FALSE(epoch.needsRebuild(addSecondsToTime(when, 30)));
+  TEST_ASSERT_TRUE(
+      epoch.needsRebuild(addSecondsToTime(when, EPOCH_REFRESH_SECONDS)));
+
+  // agrees with the Ephemeris path, which precesses by whole years in
+  // float, to within its own accuracy, all over the sky
+  when = createTimePoint(2, 9, 2023, 12, 0, 0);
+  epoch.build(when);
+  srand(39);
+  double worst = 0;
+  double worstRoundTrip = 0;
+  for (int i = 0; i < 200; i++) {
+    EquatorialPosition j2000 = {
+        24.0 * rand() / RAND_MAX,
+        asin(0.99 * (2.0 * rand() / RAND_MAX - 1)) * 180 / PI};
+    EquatorialCoordinates coord;
+    coord.ra = j2000.raHours;
+    coord.dec = j2000.decDegrees;
+    EquatorialCoordinates jNow =
+        Ephemeris::equatorialEquinoxToEquatorialJNowAtDateAndTime(
+            coord, 2000, 2, 9, 2023, 12, 0, 0);
+    EquatorialPosition ephemeris = {jNow.ra, jNow.dec};
+    EquatorialPosition ours = epoch.j2000ToJNow(j2000);
+    double error = testSeparationArcsec(ours, ephemeris);
+    worst = error > worst ? error : worst;
+    double roundTrip = testSeparationArcsec(epoch.jNowToJ2000(ours), j2000);
+    worstRoundTrip = roundTrip > worstRoundTrip ? roundTrip : worstRoundTrip;
+  }
+  log("EpochTransform vs Ephemeris: worst %.1f\", round trip %.4f\"", worst,
+      worstRoundTrip);
+  TEST_ASSERT_TRUE(worst < 60);
+  TEST_ASSERT_TRUE(worstRoundTrip < 0.01);
+
+  // batch matches one at a time, in place too
+  EquatorialPosition list[3] = {{0, 0}, {12, 89.9}, {23.99, -60}};
+  EquatorialPosition converted[3];
+  epoch.j2000ToJNow(list, converted, 3);
+  epoch.j2000ToJNow(list, list, 3);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(converted[i].raHours >= 0 && converted[i].raHours < 24);
+    TEST_ASSERT_FLOAT_WITHIN(1e-12, converted[i].raHours, list[i].raHours);
+    TEST_ASSERT_FLOAT_WITHIN(1e-12, converted[i].decDegrees,
+                             list[i].decDegrees);
+  }
+  epoch.jNowToJ2000(list, list, 3);
+  TEST_ASSERT_TRUE(testSeparationArcsec(list[1], {12, 89.9}) < 0.01);
+}
+
+void test_epoch_transform_benchmark() {
+  const int count = 2000;
+  std::vector<EquatorialPosition> positions(count);
+  std::vector<EquatorialPosition> converted(count);
+  srand(1039);
+  for (int i = 0; i < count; i++) {
+    positions[i].raHours = 24.0 * rand() / RAND_MAX;
+    positions[i].decDegrees = asin(2.0 * rand() / RAND_MAX - 1) * 180 / PI;
+  }
+  TimePoint when = createTimePoint(2, 9, 2023, 12, 0, 0);
+
+  unsigned long allocationsBefore = heapAllocations;
+  uint32_t startTicks = metricsTicks();
+  EpochTransform epoch;
+  epoch.build(when);
+  double buildTicks = metricsTicks() - startTicks;
+  startTicks = metricsTicks();
+  epoch.j2000ToJNow(positions.data(), converted.data(), count);
+  double batchTicks = metricsTicks() - startTicks;
+  unsigned long allocations = heapAllocations - allocationsBefore;
+
+  // the old way, everything recomputed for every coordinate
+  startTicks = metricsTicks();
+  FLOAT sum = 0;
+  for (int i = 0; i < count; i++) {
+    EquatorialCoordinates coord;
+    coord.ra = positions[i].raHours;
+    coord.dec = positions[i].decDegrees;
+    sum += Ephemeris::equatorialEquinoxToEquatorialJNowAtDateAndTime(
+               coord, 2000, 2, 9, 2023, 12, 0, 0)
+               .ra;
+  }
+  double ephemerisTicks = metricsTicks() - startTicks;
+
+  double secondsPerTick = metricsSecondsPerTick();
+  log("EpochTransform: build %.1fus, %d positions in %.3fms (%.0fns each). "
+      "Ephemeris one at a time: %.3fms (checksum %.0f)",
+      buildTicks * secondsPerTick * 1e6, count,
+      batchTicks * secondsPerTick * 1e3,
+      batchTicks * secondsPerTick * 1e9 / count,
+      ephemerisTicks * secondsPerTick * 1e3, (double)sum);
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+  TEST_ASSERT_TRUE(batchTicks < ephemerisTicks);
+}
+
+void test_refraction_table() {
+  RefractionTable table;
+  TEST_ASSERT_EQUAL_FLOAT(REFRACTION_STANDARD_TEMPERATURE,
+                          table.getTemperature());
+  // Meeus: about 34' at the horizon, nothing at the zenith
+  TEST_ASSERT_FLOAT_WITHIN(1.0 / 60, 34.5 / 60, table.refractionAt(0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 0, table.refractionAt(90));
+  TEST_ASSERT_FLOAT_WITHIN(0.1 / 60, 1.0 / 60, table.refractionAt(45));
+
+  // interpolation against the formula, and the two directions agree
+  double worst = 0;
+  double worstRoundTrip = 0;
+  for (double altitude = -1; altitude <= 90; altitude += 0.0371) {
+    double error = fabs(table.refractionAt(altitude) -
+                        bennettRefraction(altitude,
+                                          REFRACTION_STANDARD_TEMPERATURE,
+                                          REFRACTION_STANDARD_PRESSURE));
+    worst = error > worst ? error : worst;
+    double roundTrip =
+        fabs(table.trueToApparent(table.apparentToTrue(altitude)) - altitude);
+    worstRoundTrip = roundTrip > worstRoundTrip ? roundTrip : worstRoundTrip;
+  }
+  log("Refraction table: worst interpolation error %.2f\", round trip %.5f\"",
+      worst * 3600, worstRoundTrip * 3600);
+  TEST_ASSERT_TRUE(worst * 3600 < 5);
+  TEST_ASSERT_TRUE(worstRoundTrip * 3600 < 0.01);
+
+  // cold, high pressure air bends more
+  double standard = table.refractionAt(10);
+  table.setConditions(-10, 1030);
+  TEST_ASSERT_EQUAL_FLOAT(-10, table.getTemperature());
+  TEST_ASSERT_EQUAL_FLOAT(1030, table.getPressure());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, standard * (1030 / 1010.0) * (283.0 / 263),
+                           table.refractionAt(10));
+  // up a mountain, less
+  table.setConditions(10, 700);
+  TEST_ASSERT_TRUE(table.refractionAt(10) < standard * 0.7);
+
+  // below the table it holds its last value
+  TEST_ASSERT_EQUAL_FLOAT(table.refractionAt(-2), table.refractionAt(-10));
+}
+
+/**
+ * Pointing near the horizon with and without refraction, against the
+ * simulated real (refracted) sky. Both models sync on the same two stars
+ * well up; the difference shows lower down.
+ */
+void test_refraction_low_altitude_pointing() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  const double azOffset = 37;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EqCoord syncStars[] = {EqCoord(344.7353, -29.4966),  // fomalhaut
+                         EqCoord(297.979, 8.9274)};    // altair
+
+  TelescopeModel refracting;
+  TelescopeModel geometric;
+  geometric.setDoesRefraction(false);
+  TelescopeModel *models[] = {&refracting, &geometric};
+  PlatformState centred;
+  setLoggingEnabled(false);
+  for (TelescopeModel *model : models) {
+    model->setLatitude(latitude);
+    model->setLongitude(longitude);
+    model->setAltEncoderStepsPerRevolution(360000);
+    model->setAzEncoderStepsPerRevolution(360000);
+    for (int i = 0; i < 2; i++) {
+      TimePoint now = addSecondsToTime(start, i * 30);
+      long altEncoder, azEncoder;
+      simulatePlatformEncoders(syncStars[i], now, centred, latitude, longitude,
+                               azOffset, altEncoder, azEncoder);
+      model->setEncoderValues(altEncoder, azEncoder);
+      model->setPlatformState(centred);
+      model->syncPositionRaDec(syncStars[i].getRAInHours(),
+                               syncStars[i].getDecInDegrees(), now);
+    }
+  }
+
+  // targets all round the sky between 3 and 20 degrees up
+  TimePoint now = addSecondsToTime(start, 120);
+  double siderealTime = localSiderealTime(now, longitude);
+  double maxError[2] = {0, 0};
+  int samples = 0;
+  for (int az = 0; az < 360; az += 15) {
+    for (double alt = 3; alt <= 20; alt += 4.25) {
+      EqCoord target = horizontalToEquatorialAtSiderealTime(
+          HorizCoord(alt, az), siderealTime, latitude);
+      long altEncoder, azEncoder;
+      simulatePlatformEncoders(target, now, centred, latitude, longitude,
+                               azOffset, altEncoder, azEncoder);
+      for (int m = 0; m < 2; m++) {
+        models[m]->setEncoderValues(altEncoder, azEncoder);
+        models[m]->setPlatformState(centred);
+        models[m]->calculateCurrentPosition(now);
+        double error =
+            models[m]->currentEqPosition.calculateDistanceInDegrees(target);
+        maxError[m] = error > maxError[m] ? error : maxError[m];
+      }
+      samples++;
+    }
+  }
+
+  // what it costs per position
+  const int iterations = 20000;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    refracting.setEncoderValues(i, 10000 + i);
+    refracting.calculateCurrentPosition(now);
+  }
+  double refractingTicks = (double)(metricsTicks() - startTicks) / iterations;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    geometric.setEncoderValues(i, 10000 + i);
+    geometric.calculateCurrentPosition(now);
+  }
+  double geometricTicks = (double)(metricsTicks() - startTicks) / iterations;
+  startTicks = metricsTicks();
+  RefractionTable table;
+  double sum = 0;
+  for (int i = 0; i < iterations; i++) {
+    sum += table.refractionAt(i * 0.0045);
+  }
+  double tableTicks = (double)(metricsTicks() - startTicks) / iterations;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sum += bennettRefraction(i * 0.0045, 10, 1010);
+  }
+  double formulaTicks = (double)(metricsTicks() - startTicks) / iterations;
+  setLoggingEnabled(true);
+
+  double secondsPerTick = metricsSecondsPerTick();
+  log("Pointing 3-20 degrees up over %d samples, max error (degrees): "
+      "refraction %lf, none %lf",
+      samples, maxError[0], maxError[1]);
+  log("Position query %.0fns with refraction, %.0fns without. Table lookup "
+      "%.0fns, formula %.0fns (checksum %.0f)",
+      refractingTicks * secondsPerTick * 1e9,
+      geometricTicks * secondsPerTick * 1e9, tableTicks * secondsPerTick * 1e9,
+      formulaTicks * secondsPerTick * 1e9, sum);
+  TEST_ASSERT_TRUE(maxError[0] < 0.01);
+  // 3 degrees up is ~14' of refraction, most of which the geometric
+  // model gets wrong
+  TEST_ASSERT_TRUE(maxError[1] > 0.1);
+  TEST_ASSERT_TRUE(tableTicks < formulaTicks);
+}
+
+/**
+ * Switching refraction, or changing its conditions, after syncing gives
+ * the same positions as a model synced that way to begin with: the
+ * alignment is rebuilt from the syncs, including the offsets from a third.
+ */
+void test_refraction_changed_after_sync() {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EqCoord syncStars[] = {EqCoord(344.7353, -29.4966),  // fomalhaut
+                         EqCoord(297.979, 8.9274),     // altair
+                         EqCoord(279.2347, 38.7837)};  // vega
+
+  TelescopeModel toggled;
+  toggled.setDoesRefraction(false);
+  TelescopeModel refracting;
+  TelescopeModel geometric;
+  geometric.setDoesRefraction(false);
+  TelescopeModel cold;
+  cold.setRefractionConditions(-5, 1030);
+  TelescopeModel *models[] = {&toggled, &refracting, &geometric, &cold};
+  PlatformState centred;
+  setLoggingEnabled(false);
+  for (TelescopeModel *model : models) {
+    model->setLatitude(latitude);
+    model->setLongitude(longitude);
+    model->setAltEncoderStepsPerRevolution(360000);
+    model->setAzEncoderStepsPerRevolution(360000);
+    for (int i = 0; i < 3; i++) {
+      TimePoint now = addSecondsToTime(start, i * 30);
+      long altEncoder, azEncoder;
+      simulatePlatformEncoders(syncStars[i], now, centred, latitude, longitude,
+                               37, altEncoder, azEncoder);
+      // a little out on the third, so it leaves offsets
+      model->setEncoderValues(altEncoder + (i == 2 ? 300 : 0), azEncoder);
+      model->setPlatformState(centred);
+      model->syncPositionRaDec(syncStars[i].getRAInHours(),
+                               syncStars[i].getDecInDegrees(), now);
+    }
+  }
+
+  // low down, where refraction shows
+  TimePoint now = addSecondsToTime(start, 120);
+  double siderealTime = localSiderealTime(now, longitude);
+  EqCoord target = horizontalToEquatorialAtSiderealTime(HorizCoord(5, 200),
+                                                        siderealTime, latitude);
+  long altEncoder, azEncoder;
+  simulatePlatformEncoders(target, now, centred, latitude, longitude, 37,
+                           altEncoder, azEncoder);
+  EqCoord positions[4];
+  for (int m = 0; m < 4; m++) {
+    models[m]->setEncoderValues(altEncoder, azEncoder);
+    models[m]->setPlatformState(centred);
+    models[m]->calculateCurrentPosition(now);
+    positions[m] = models[m]->currentEqPosition;
+  }
+  TEST_ASSERT_TRUE(positions[0].calculateDistanceInDegrees(positions[1]) >
+                   0.05);
+
+  toggled.setDoesRefraction(true);
+  toggled.calculateCurrentPosition(now);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 0,
+                           toggled.currentEqPosition.calculateDistanceInDegrees(
+                               positions[1]));
+  toggled.setRefractionConditions(-5, 1030);
+  toggled.calculateCurrentPosition(now);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 0,
+                           toggled.currentEqPosition.calculateDistanceInDegrees(
+                               positions[3]));
+  toggled.setDoesRefraction(false);
+  toggled.calculateCurrentPosition(now);
+  setLoggingEnabled(true);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 0,
+                           toggled.currentEqPosition.calculateDistanceInDegrees(
+                               positions[2]));
+}
+
+void test_web_assets() {
+  const char manifest[] =
+      "# url file etag type size immutable\n"
+      "/ index.htm.gz \"4e9ff743120ed607\" text/html 4306 0\n"
+      "\n"
+      "/jquery3.6.0.min.80f04717.js jquery3.6.0.min.80f04717.js.gz "
+      "\"b804e98a9a3d7768\" application/javascript 30871 1\r\n";
+  WebAssetTable table;
+  TEST_ASSERT_EQUAL_INT(2, table.parseManifest(manifest, strlen(manifest)));
+  const WebAsset *index = table.find("/");
+  TEST_ASSERT_NOT_NULL(index);
+  TEST_ASSERT_EQUAL_STRING("index.htm.gz", index->file);
+  TEST_ASSERT_EQUAL_STRING("\"4e9ff743120ed607\"", index->etag);
+  TEST_ASSERT_EQUAL_STRING("text/html", index->contentType);
+  TEST_ASSERT_EQUAL_UINT32(4306, index->size);
+  TEST_ASSERT_FALSE(index->immutable);
+  const WebAsset *jquery = table.find("/jquery3.6.0.min.80f04717.js");
+  TEST_ASSERT_NOT_NULL(jquery);
+  TEST_ASSERT_TRUE(jquery->immutable);
+  TEST_ASSERT_EQUAL_STRING("application/javascript", jquery->contentType);
+  // the old unfingerprinted name isn't served any more
+  TEST_ASSERT_NULL(table.find("/jquery3.6.0.min.js"));
+  TEST_ASSERT_NULL(table.find("/catalogue.bin"));
+
+  const char broken[] = "/ index.htm.gz \"4e9f\" text/html\n";
+  TEST_ASSERT_EQUAL_INT(-1, table.parseManifest(broken, strlen(broken)));
+  TEST_ASSERT_EQUAL_INT(0, (int)table.size());
+  std::string tooMany;
+  for (int i = 0; i <= WEB_ASSET_CAPACITY; i++) {
+    tooMany += "/" + std::to_string(i) + " f \"e\" text/html 1 1\n";
+  }
+  TEST_ASSERT_EQUAL_INT(-1, table.parseManifest(tooMany.c_str(), tooMany.size()));
+
+  // If-None-Match
+  const char *etag = "\"4e9ff743120ed607\"";
+  TEST_ASSERT_TRUE(webAssetEtagMatches("\"4e9ff743120ed607\"", etag));
+  TEST_ASSERT_TRUE(webAssetEtagMatches("W/\"4e9ff743120ed607\"", etag));
+  TEST_ASSERT_TRUE(
+      webAssetEtagMatches("\"0000\", W/\"4e9ff743120ed607\"", etag));
+  TEST_ASSERT_TRUE(webAssetEtagMatches("*", etag));
+  TEST_ASSERT_FALSE(webAssetEtagMatches("\"4e9ff743120ed60\"", etag));
+  TEST_ASSERT_FALSE(webAssetEtagMatches("\"4e9ff743120ed6070\"", etag));
+  TEST_ASSERT_FALSE(webAssetEtagMatches("", etag));
+  TEST_ASSERT_FALSE(webAssetEtagMatches(nullptr, etag));
+
+  // Range
+  uint32_t start = 99, end = 99;
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_PARTIAL,
+                        parseWebAssetRange("bytes=0-99", 1000, start, end));
+  TEST_ASSERT_EQUAL_UINT32(0, start);
+  TEST_ASSERT_EQUAL_UINT32(99, end);
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_PARTIAL,
+                        parseWebAssetRange("bytes=900-", 1000, start, end));
+  TEST_ASSERT_EQUAL_UINT32(900, start);
+  TEST_ASSERT_EQUAL_UINT32(999, end);
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_PARTIAL,
+                        parseWebAssetRange("bytes=-100", 1000, start, end));
+  TEST_ASSERT_EQUAL_UINT32(900, start);
+  TEST_ASSERT_EQUAL_UINT32(999, end);
+  // past the end is cut short, a longer suffix is the whole file
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_PARTIAL,
+                        parseWebAssetRange("bytes=500-5000", 1000, start, end));
+  TEST_ASSERT_EQUAL_UINT32(999, end);
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_PARTIAL,
+                        parseWebAssetRange("bytes=-5000", 1000, start, end));
+  TEST_ASSERT_EQUAL_UINT32(0, start);
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_UNSATISFIABLE,
+                        parseWebAssetRange("bytes=1000-", 1000, start, end));
+  TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_UNSATISFIABLE,
+                        parseWebAssetRange("bytes=-0", 1000, start, end));
+  // the rest get the whole file
+  const char *ignored[] = {nullptr,          "",
+                           "items=0-1",      "bytes=0-1,5-9",
+                           "bytes=9-1",      "bytes=a-b",
+                           "bytes= 0-1",     "bytes=0-1x",
+                           "bytes=-",        "bytes=99999999999-"};
+  for (const char *header : ignored) {
+    TEST_ASSERT_EQUAL_INT(WEB_ASSET_RANGE_NONE,
+                          parseWebAssetRange(header, 1000, start, end));
+  }
+}
+
+// Keeps the recorder's files in memory, rotating like the LittleFS sink.
+class MemoryRecorderSink : public RecorderSink {
+public:
+  MemoryRecorderSink() : failing(false) {}
+  bool startFile() override {
+    if (failing) {
+      return false;
+    }
+    files.push_back(std::vector<uint8_t>());
+    if (files.size() > RECORDER_FILE_COUNT) {
+      files.erase(files.begin());
+    }
+    return true;
+  }
+  bool append(const uint8_t *data, size_t length) override {
+    if (failing || files.empty()) {
+      return false;
+    }
+    files.back().insert(files.back().end(), data, data + length);
+    return true;
+  }
+  std::vector<uint8_t> all() const {
+    std::vector<uint8_t> joined;
+    for (const std::vector<uint8_t> &file : files) {
+      joined.insert(joined.end(), file.begin(), file.end());
+    }
+    return joined;
+  }
+  std::vector<std::vector<uint8_t>> files;
+  bool failing;
+};
+
+static PositionSnapshot recorderPosition(TimePoint time, long alt, long az) {
+  PositionSnapshot position = PositionSnapshot();
+  position.time = time;
+  position.altEncoder = alt;
+  position.azEncoder = az;
+  position.raHours = 3.0 + alt / 100000.0;
+  position.decDegrees = 49.5 - az / 100000.0;
+  position.altDegrees = 40.25;
+  position.azDegrees = 270.125;
+  position.updateCount = 1;
+  return position;
+}
+
+void test_session_recorder() {
+  char name[RECORDER_FILE_NAME_SIZE];
+  uint32_t sequence = 0;
+  TEST_ASSERT_TRUE(formatRecorderFileName(12, name, sizeof(name)));
+  TEST_ASSERT_EQUAL_STRING("00000012.rec", name);
+  TEST_ASSERT_TRUE(parseRecorderFileName(name, sequence));
+  TEST_ASSERT_EQUAL_UINT32(12, sequence);
+  TEST_ASSERT_FALSE(parseRecorderFileName("../../prefs.rec", sequence));
+  TEST_ASSERT_FALSE(parseRecorderFileName("0000012.rec", sequence));
+  TEST_ASSERT_FALSE(parseRecorderFileName("00000012.bin", sequence));
+  TEST_ASSERT_FALSE(formatRecorderFileName(12, name, 12));
+
+  MemoryRecorderSink sink;
+  SessionRecorder recorder(sink);
+  TimePoint start = createTimePoint(2, 9, 2023, 21, 0, 0);
+
+  AlignmentSnapshot alignment = AlignmentSnapshot();
+  alignment.latitude = 49.4;
+  alignment.longitude = -123.25;
+  alignment.altEncoderStepsPerRevolution = -30000;
+  alignment.azEncoderStepsPerRevolution = 108531;
+  alignment.doesRefraction = true;
+  alignment.temperatureCelsius = 4.5;
+  alignment.pressureMillibars = 1013.2;
+  recorder.recordAlignment(start, alignment);
+  recorder.recordAlignment(start, alignment); // unchanged, not recorded again
+
+  PlatformTelemetry telemetry = PlatformTelemetry();
+  recorder.recordPlatform(telemetry); // no packet yet
+  telemetry.runtimeFromCenterSeconds = 1234.567;
+  telemetry.currentlyRunning = true;
+  telemetry.decAxisDegrees = -1.5;
+  telemetry.hasDecAxis = true;
+  telemetry.packetCount = 7;
+  telemetry.receivedTime = addMillisToTime(start, -400);
+  recorder.recordPlatform(telemetry);
+  recorder.recordPlatform(telemetry); // same packet
+
+  recorder.recordPosition(recorderPosition(start, 100, -200));
+  // too soon, then not moved, then moved
+  recorder.recordPosition(recorderPosition(addMillisToTime(start, 50), 101, -200));
+  recorder.recordPosition(recorderPosition(addMillisToTime(start, 150), 100, -200));
+  recorder.recordPosition(recorderPosition(addMillisToTime(start, 250), 150, -180));
+  recorder.recordQuery(addMillisToTime(start, 300), RECORDER_QUERY_RA, 3.0015);
+  recorder.recordQuery(addMillisToTime(start, 400), RECORDER_QUERY_RA, 3.0015);
+  recorder.recordQuery(addMillisToTime(start, 400), RECORDER_QUERY_DEC, 49.4982);
+  recorder.recordSync(addMillisToTime(start, 500), 5.5, -20.25, 150, -180,
+                      PlatformState(1.25, -1.5, -SIDEREAL_DEGREES_PER_SECOND));
+  alignment.baseAlignmentSynchPoints.push_back(SynchPoint());
+  recorder.recordAlignment(addMillisToTime(start, 600), alignment);
+  recorder.recordPosition(recorderPosition(addMillisToTime(start, 1100), 150, -180));
+  TEST_ASSERT_EQUAL_UINT32(1, recorder.getStats().suppressedQueries);
+  TEST_ASSERT_EQUAL_UINT32(0, recorder.getStats().flashWrites);
+
+  // nothing goes to flash until the buffer has waited long enough
+  recorder.service(addMillisToTime(start, 2000));
+  TEST_ASSERT_EQUAL_UINT32(0, recorder.getStats().flashWrites);
+  recorder.service(addSecondsToTime(start, RECORDER_FLUSH_SECONDS + 1));
+  TEST_ASSERT_EQUAL_UINT32(1, recorder.getStats().flashWrites);
+  TEST_ASSERT_EQUAL_UINT32(0, recorder.getStats().bufferedBytes);
+  TEST_ASSERT_EQUAL_INT(1, (int)sink.files.size());
+
+  std::vector<uint8_t> data = sink.all();
+  SessionReader reader(data.data(), data.size());
+  SessionRecord r;
+  RecordType expected[] = {RECORD_FILE_START, RECORD_SETTINGS,
+                           RECORD_PLATFORM,   RECORD_ENCODERS,
+                           RECORD_MODEL,      RECORD_ENCODERS,
+                           RECORD_QUERY,      RECORD_QUERY,
+                           RECORD_SYNC,       RECORD_SETTINGS,
+                           RECORD_MODEL};
+  std::vector<SessionRecord> records;
+  while (reader.next(r)) {
+    records.push_back(r);
+  }
+  TEST_ASSERT_FALSE(reader.hasError());
+  TEST_ASSERT_EQUAL_INT(sizeof(expected) / sizeof(expected[0]),
+                        (int)records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    TEST_ASSERT_EQUAL_INT(expected[i], records[i].type);
+  }
+  int64_t startMillis = recorderMillis(start);
+  TEST_ASSERT_EQUAL_INT64(startMillis, records[0].timeMillis);
+  TEST_ASSERT_EQUAL_FLOAT(49.4, records[1].latitude);
+  TEST_ASSERT_EQUAL_FLOAT(-123.25, records[1].longitude);
+  TEST_ASSERT_EQUAL_INT(-30000, records[1].altStepsPerRevolution);
+  TEST_ASSERT_EQUAL_INT(108531, records[1].azStepsPerRevolution);
+  TEST_ASSERT_TRUE(records[1].doesRefraction);
+  TEST_ASSERT_EQUAL_FLOAT(4.5, records[1].temperatureCelsius);
+  TEST_ASSERT_EQUAL_FLOAT(1013.2, records[1].pressureMillibars);
+  TEST_ASSERT_EQUAL_UINT32(0, records[1].syncPoints);
+  TEST_ASSERT_EQUAL_INT64(startMillis - 400, records[2].timeMillis);
+  TEST_ASSERT_DOUBLE_WITHIN(0.001, 1234.567, records[2].runtimeFromCenterSeconds);
+  TEST_ASSERT_EQUAL_FLOAT(-1.5, records[2].decAxisDegrees);
+  TEST_ASSERT_TRUE(records[2].platformRunning);
+  TEST_ASSERT_FALSE(records[2].platformSlewing);
+  TEST_ASSERT_TRUE(records[2].hasDecAxis);
+  TEST_ASSERT_EQUAL_UINT32(7, records[2].packetCount);
+  TEST_ASSERT_EQUAL_INT(100, records[3].altEncoder);
+  TEST_ASSERT_EQUAL_INT(-200, records[3].azEncoder);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-7, 3.001, records[4].raHours);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 49.502, records[4].decDegrees);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 40.25, records[4].altDegrees);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 270.125, records[4].azDegrees);
+  TEST_ASSERT_EQUAL_INT64(startMillis + 250, records[5].timeMillis);
+  TEST_ASSERT_EQUAL_INT(150, records[5].altEncoder);
+  TEST_ASSERT_EQUAL_INT(-180, records[5].azEncoder);
+  TEST_ASSERT_EQUAL_INT(RECORDER_QUERY_RA, records[6].query);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-7, 3.0015, records[6].value);
+  TEST_ASSERT_EQUAL_INT(RECORDER_QUERY_DEC, records[7].query);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 49.4982, records[7].value);
+  TEST_ASSERT_EQUAL_INT64(startMillis + 500, records[8].timeMillis);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-7, 5.5, records[8].raHours);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, -20.25, records[8].decDegrees);
+  TEST_ASSERT_EQUAL_INT(150, records[8].altEncoder);
+  TEST_ASSERT_EQUAL_INT(-180, records[8].azEncoder);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, 1.25, records[8].platform.raAxisDegrees);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, -1.5, records[8].platform.decAxisDegrees);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-6, -SIDEREAL_DEGREES_PER_SECOND,
+                            records[8].platform.raAxisDegreesPerSecond);
+  TEST_ASSERT_EQUAL_UINT32(1, records[9].syncPoints);
+  TEST_ASSERT_EQUAL_INT64(startMillis + 1100, records[10].timeMillis);
+  // the first of each kind are absolute, so bigger than they will be
+  log("Session recorder: %d records in %d bytes", (int)records.size(),
+      (int)data.size());
+  TEST_ASSERT_LESS_THAN(160, (int)data.size());
+
+  // a cut off file reads up to the damage
+  SessionReader truncated(data.data(), data.size() - 2);
+  int count = 0;
+  while (truncated.next(r)) {
+    count++;
+  }
+  TEST_ASSERT_TRUE(truncated.hasError());
+  TEST_ASSERT_EQUAL_INT((int)records.size() - 1, count);
+
+  // a failing sink loses what was buffered, then starts over in a new
+  // file once it works again
+  sink.failing = true;
+  recorder.recordPosition(recorderPosition(addSecondsToTime(start, 40), 300, 0));
+  TEST_ASSERT_FALSE(recorder.flush());
+  TEST_ASSERT_EQUAL_UINT32(1, recorder.getStats().failures);
+  recorder.recordPosition(recorderPosition(addSecondsToTime(start, 50), 400, 0));
+  sink.failing = false;
+  recorder.recordPosition(recorderPosition(addSecondsToTime(start, 60), 500, 10));
+  TEST_ASSERT_TRUE(recorder.flush());
+  TEST_ASSERT_EQUAL_INT(2, (int)sink.files.size());
+  SessionReader second(sink.files[1].data(), sink.files[1].size());
+  records.clear();
+  while (second.next(r)) {
+    records.push_back(r);
+  }
+  TEST_ASSERT_FALSE(second.hasError());
+  // the new file repeats the settings, platform and encoders
+  TEST_ASSERT_EQUAL_INT(RECORD_FILE_START, records[0].type);
+  TEST_ASSERT_EQUAL_INT(RECORD_SETTINGS, records[1].type);
+  TEST_ASSERT_EQUAL_UINT32(1, records[1].syncPoints);
+  TEST_ASSERT_EQUAL_INT(RECORD_PLATFORM, records[2].type);
+  TEST_ASSERT_EQUAL_UINT32(7, records[2].packetCount);
+  TEST_ASSERT_EQUAL_INT(RECORD_ENCODERS, records[3].type);
+  TEST_ASSERT_EQUAL_INT(400, records[3].altEncoder);
+  TEST_ASSERT_EQUAL_INT(RECORD_ENCODERS, records[4].type);
+  TEST_ASSERT_EQUAL_INT(500, records[4].altEncoder);
+  TEST_ASSERT_EQUAL_INT(10, records[4].azEncoder);
+  TEST_ASSERT_EQUAL_INT(RECORD_MODEL, records[5].type);
+
+  // encoders after a sync taken elsewhere still decode from the last
+  // encoder record, not from the sync's
+  recorder.recordPosition(recorderPosition(addSecondsToTime(start, 70), 600,
+                                           20));
+  recorder.recordSync(addSecondsToTime(start, 71), 6.5, -10.5, 5000, -5000,
+                      PlatformState());
+  recorder.recordPosition(recorderPosition(addSecondsToTime(start, 72), 650,
+                                           40));
+  TEST_ASSERT_TRUE(recorder.flush());
+  SessionReader afterSync(sink.files[1].data(), sink.files[1].size());
+  records.clear();
+  while (afterSync.next(r)) {
+    records.push_back(r);
+  }
+  TEST_ASSERT_FALSE(afterSync.hasError());
+  size_t sync = records.size();
+  for (size_t i = 0; i < records.size(); i++) {
+    if (records[i].type == RECORD_SYNC) {
+      sync = i;
+    }
+  }
+  TEST_ASSERT_TRUE(sync + 1 < records.size());
+  TEST_ASSERT_EQUAL_INT(5000, records[sync].altEncoder);
+  TEST_ASSERT_EQUAL_INT(-5000, records[sync].azEncoder);
+  TEST_ASSERT_EQUAL_INT(RECORD_ENCODERS, records[sync + 1].type);
+  TEST_ASSERT_EQUAL_INT(650, records[sync + 1].altEncoder);
+  TEST_ASSERT_EQUAL_INT(40, records[sync + 1].azEncoder);
+
+  // rotation: files stay under RECORDER_FILE_BYTES, only the newest
+  // RECORDER_FILE_COUNT are kept and each decodes on its own
+  TimePoint t = addSecondsToTime(start, 100);
+  for (int i = 0; i < 200000; i++) {
+    t = addMillisToTime(t, RECORDER_ENCODER_PERIOD_MS);
+    recorder.recordPosition(recorderPosition(t, i * 37, -i * 91));
+    recorder.service(t);
+  }
+  recorder.flush();
+  TEST_ASSERT_GREATER_THAN(RECORDER_FILE_COUNT, (int)recorder.getStats().files);
+  TEST_ASSERT_EQUAL_INT(RECORDER_FILE_COUNT, (int)sink.files.size());
+  for (const std::vector<uint8_t> &file : sink.files) {
+    TEST_ASSERT_LESS_OR_EQUAL(RECORDER_FILE_BYTES, (int)file.size());
+    SessionReader one(file.data(), file.size());
+    TEST_ASSERT_TRUE(one.next(r));
+    TEST_ASSERT_EQUAL_INT(RECORD_FILE_START, r.type);
+    long lastAlt = -1;
+    while (one.next(r)) {
+      if (r.type == RECORD_ENCODERS) {
+        TEST_ASSERT_EQUAL_INT(0, r.altEncoder % 37);
+        TEST_ASSERT_EQUAL_INT(-r.altEncoder / 37 * 91, r.azEncoder);
+        TEST_ASSERT_TRUE(r.altEncoder > lastAlt);
+        lastAlt = r.altEncoder;
+      }
+    }
+    TEST_ASSERT_FALSE(one.hasError());
+  }
+}
+
+// Counts what would go to flash, without keeping it
+class CountingRecorderSink : public RecorderSink {
+public:
+  CountingRecorderSink() : bytes(0), writes(0), files(0) {}
+  bool startFile() override {
+    files++;
+    return true;
+  }
+  bool append(const uint8_t *data, size_t length) override {
+    bytes += length;
+    writes++;
+    return true;
+  }
+  uint64_t bytes;
+  uint32_t writes;
+  uint32_t files;
+};
+
+/**
+ * An hour of the housekeeping task (every 50ms) with platform packets
+ * every second, a client polling ra/dec and a sync every ten minutes.
+ * Typical: the scope moves a fifth of the time. Worst: it never stops and
+ * the client polls all four positions at 10Hz.
+ */
+static RecorderStats simulateRecordedHour(bool worstCase) {
+  CountingRecorderSink sink;
+  SessionRecorder recorder(sink);
+  TimePoint start = createTimePoint(2, 9, 2023, 21, 0, 0);
+  AlignmentSnapshot alignment = AlignmentSnapshot();
+  PlatformTelemetry telemetry = PlatformTelemetry();
+  long alt = 1000;
+  long az = -5000;
+  const int stepMillis = 50;
+  for (int millis = 0; millis < 3600000; millis += stepMillis) {
+    TimePoint now = addMillisToTime(start, millis);
+    bool moving = worstCase || (millis / 60000) % 5 == 0;
+    if (moving) {
+      alt += 23 + millis % 7; // a few degrees a second
+      az -= 61 + millis % 5;
+    }
+    if (millis % 1000 == 0) {
+      telemetry.packetCount++;
+      telemetry.receivedTime = now;
+      telemetry.runtimeFromCenterSeconds = 1800 - millis / 1000.0;
+      telemetry.currentlyRunning = true;
+    }
+    if (millis % 600000 == 0) {
+      recorder.recordSync(now, 3 + millis / 3.6e6, 20, alt, az,
+                          PlatformState(millis / 1e4, 0, -0.004));
+      alignment.baseAlignmentSynchPoints.clear();
+      for (int i = 0; i <= millis / 600000 % 3; i++) {
+        alignment.baseAlignmentSynchPoints.push_back(SynchPoint());
+      }
+    }
+    PositionSnapshot position = recorderPosition(now, alt, az);
+    position.raHours = 3 + alt / 1e6;
+    position.decDegrees = 20 + az / 1e6;
+    position.altDegrees = 40 + alt / 1e4;
+    position.azDegrees = 180 + az / 1e4;
+    int pollMillis = worstCase ? 100 : 500;
+    if (millis % pollMillis == 0) {
+      recorder.recordQuery(now, RECORDER_QUERY_RA, position.raHours);
+      recorder.recordQuery(now, RECORDER_QUERY_DEC, position.decDegrees);
+      if (worstCase) {
+        recorder.recordQuery(now, RECORDER_QUERY_ALTITUDE, position.altDegrees);
+        recorder.recordQuery(now, RECORDER_QUERY_AZIMUTH, position.azDegrees);
+      }
+    }
+    recorder.recordPlatform(telemetry);
+    recorder.recordAlignment(now, alignment);
+    recorder.recordPosition(position);
+    recorder.service(now);
+  }
+  recorder.flush();
+  TEST_ASSERT_EQUAL_UINT64(sink.bytes, recorder.getStats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(sink.writes, recorder.getStats().flashWrites);
+  return recorder.getStats();
+}
+
+void test_session_recorder_overhead() {
+  unsigned long allocationsBefore = heapAllocations;
+  RecorderStats typical = simulateRecordedHour(false);
+  RecorderStats worst = simulateRecordedHour(true);
+  unsigned long allocations = heapAllocations - allocationsBefore;
+
+  double secondsPerTick = metricsSecondsPerTick();
+  const RecorderStats *runs[] = {&typical, &worst};
+  const char *labels[] = {"typical", "worst case"};
+  for (int i = 0; i < 2; i++) {
+    const RecorderStats &stats = *runs[i];
+    double hours = stats.hours();
+    log("Session recorder, %s hour: %lu records, %.1fKB, %lu flash writes, "
+        "%lu files, %lu queries rate limited, %.1fms encoding + %.1fms "
+        "writing (%.0fns a record)",
+        labels[i], (unsigned long)stats.records, stats.bytes / 1024.0 / hours,
+        (unsigned long)(stats.flashWrites / hours),
+        (unsigned long)stats.files, (unsigned long)stats.suppressedQueries,
+        stats.recordTicks * secondsPerTick * 1e3 / hours,
+        stats.flushTicks * secondsPerTick * 1e3 / hours,
+        stats.recordTicks * secondsPerTick * 1e9 / stats.records);
+    TEST_ASSERT_DOUBLE_WITHIN(0.01, 1.0, hours);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failures);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.droppedBytes);
+    // the budget in SessionRecorder.h
+    TEST_ASSERT_LESS_THAN(400 * 1024, (double)stats.bytes / hours);
+    // a write per full buffer or per RECORDER_FLUSH_SECONDS, whichever
+    // comes first
+    TEST_ASSERT_LESS_OR_EQUAL(3600 / RECORDER_FLUSH_SECONDS +
+                                  stats.bytes / RECORDER_BUFFER_BYTES + 2,
+                              (double)stats.flashWrites);
+  }
+  // what we actually expect: a whole night in the files kept
+  TEST_ASSERT_LESS_THAN(RECORDER_FILE_COUNT * RECORDER_FILE_BYTES,
+                        (double)typical.bytes / typical.hours() * 6);
+  TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+/**
+ * Records a simulated night the way the device does: a ModelRunner with
+ * the given az steps, synced on a star every five minutes for two hours
+ * (a dob at true 360000 steps a revolution on both axes, see
+ * simulatePlatformEncoders), with the housekeeping task's sampling.
+ */
+static std::vector<uint8_t> recordSimulatedSession(long azSteps) {
+  const double latitude = -34.0493;
+  const double longitude = 151.0494;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EqCoord stars[] = {EqCoord(279.432, 38.8026),    // vega
+                     EqCoord(344.7353, -29.4966),  // fomalhaut
+                     EqCoord(297.979, 8.9274),     // altair
+                     EqCoord(332.4273, -46.8462)}; // alnair
+
+  TelescopeModel model;
+  ModelRunner runner(model);
+  MemoryRecorderSink sink;
+  SessionRecorder recorder(sink);
+  runner.requestLatitude(latitude);
+  runner.requestLongitude(longitude);
+  runner.requestAltEncoderStepsPerRevolution(360000);
+  runner.requestAzEncoderStepsPerRevolution(azSteps);
+  runner.requestDoesRefraction(true);
+  runner.requestRefractionConditions(REFRACTION_STANDARD_TEMPERATURE,
+                                     REFRACTION_STANDARD_PRESSURE);
+  uint32_t alignmentVersion = UINT32_MAX;
+  long altEncoder = 0;
+  long azEncoder = 0;
+  runner.tick(altEncoder, azEncoder, PlatformState(), start); // booted
+  alignmentVersion = runner.getAlignmentVersion();
+  recorder.recordAlignment(start, runner.getAlignment());
+  for (int second = 0; second < 7200; second += 10) {
+    TimePoint now = addSecondsToTime(start, second);
+    if (second % 300 == 0) {
+      const EqCoord &star = stars[(second / 300) % 4];
+      simulatePlatformEncoders(star, now, PlatformState(), latitude,
+                               longitude, 37, altEncoder, azEncoder);
+      runner.requestSync(star.getRAInHours(), star.getDecInDegrees(),
+                         altEncoder, azEncoder, now, PlatformState());
+      recorder.recordSync(now, star.getRAInHours(), star.getDecInDegrees(),
+                          altEncoder, azEncoder, PlatformState());
+    }
+    runner.tick(altEncoder, azEncoder, PlatformState(), now);
+    if (runner.getAlignmentVersion() != alignmentVersion) {
+      alignmentVersion = runner.getAlignmentVersion();
+      recorder.recordAlignment(now, runner.getAlignment());
+    }
+    recorder.recordPosition(runner.getPosition());
+    recorder.service(now);
+  }
+  recorder.flush();
+  return sink.all();
+}
+
+/**
+ * Replay of a recorded session: what the device did is reproduced, the
+ * same numbers come out every time and on any number of threads, and a
+ * sweep finds the az steps the session was really recorded at.
+ */
+void test_session_replay() {
+  setLoggingEnabled(false);
+  // recorded with az steps 1% out
+  std::vector<uint8_t> recorded = recordSimulatedSession(356400);
+  ReplaySession session;
+  TEST_ASSERT_TRUE(loadSessionFile(recorded.data(), recorded.size(), session));
+  TEST_ASSERT_FALSE(session.truncated);
+  TEST_ASSERT_EQUAL(24, session.syncs);
+  TEST_ASSERT_TRUE(session.hasSettings);
+  TEST_ASSERT_EQUAL(356400, session.lastSettings.azStepsPerRevolution);
+
+  ReplayResult asRecorded = replaySession(session, ReplayConfig(), true);
+  TEST_ASSERT_EQUAL(24, asRecorded.syncs);
+  TEST_ASSERT_EQUAL(24 - REPLAY_WARMUP_SYNCS, asRecorded.predictions);
+  TEST_ASSERT_TRUE(asRecorded.modelSamples > 700);
+  // the scope didn't move between samples, so it's all the recorder's
+  // rounding
+  TEST_ASSERT_TRUE(asRecorded.maxModelDivergenceDegrees < 0.0001);
+  ReplayResult again = replaySession(session, ReplayConfig(), true);
+  TEST_ASSERT_TRUE(again.rmsErrorDegrees == asRecorded.rmsErrorDegrees);
+  TEST_ASSERT_TRUE(again.maxModelDivergenceDegrees ==
+                   asRecorded.maxModelDivergenceDegrees);
+
+  ReplayRange ranges[2];
+  TEST_ASSERT_TRUE(parseReplayRange("azSteps=354000:366000:1200", ranges[0]));
+  TEST_ASSERT_TRUE(parseReplayRange("refraction=0:1:1", ranges[1]));
+  ReplayRange bad;
+  TEST_ASSERT_FALSE(parseReplayRange("focus=1:2:1", bad));
+  TEST_ASSERT_FALSE(parseReplayRange("azSteps=1:2", bad));
+  TEST_ASSERT_TRUE(parseReplayRange("latitude=-34.5", bad));
+  TEST_ASSERT_EQUAL(REPLAY_LATITUDE, bad.parameter);
+  TEST_ASSERT_EQUAL_FLOAT(-34.5, bad.stop);
+  std::vector<ReplayConfig> configs;
+  bad.stop = -35;
+  bad.step = 0.1;
+  TEST_ASSERT_FALSE(buildReplayGrid(&bad, 1, ReplayConfig(), configs));
+  TEST_ASSERT_TRUE(buildReplayGrid(ranges, 2, ReplayConfig(), configs));
+  TEST_ASSERT_EQUAL(22, configs.size());
+  TEST_ASSERT_EQUAL_FLOAT(354000, configs[1].value[REPLAY_AZ_STEPS]);
+  TEST_ASSERT_EQUAL_FLOAT(1, configs[1].value[REPLAY_REFRACTION]);
+  TEST_ASSERT_EQUAL_FLOAT(366000, configs[21].value[REPLAY_AZ_STEPS]);
+
+  std::vector<ReplayResult> serial;
+  std::vector<ReplayResult> parallel;
+  runReplaySweep(session, configs, 1, serial);
+  uint32_t startTicks = metricsTicks();
+  runReplaySweep(session, configs, 4, parallel);
+  double seconds = (metricsTicks() - startTicks) * metricsSecondsPerTick();
+  setLoggingEnabled(true);
+  for (size_t i = 0; i < configs.size(); i++) {
+    TEST_ASSERT_TRUE(serial[i].rmsErrorDegrees == parallel[i].rmsErrorDegrees);
+    TEST_ASSERT_TRUE(serial[i].maxErrorDegrees == parallel[i].maxErrorDegrees);
+  }
+  int best = bestReplayResult(parallel);
+  TEST_ASSERT_TRUE(best >= 0);
+  log("Replay: %d syncs, rms %.3f degrees as recorded, %.4f at the best of "
+      "%u configs (az steps %ld, refraction %s), %.0f replays/s on 4 threads",
+      asRecorded.syncs, asRecorded.rmsErrorDegrees,
+      parallel[best].rmsErrorDegrees, (unsigned)configs.size(),
+      parallel[best].finalSettings.azStepsPerRevolution,
+      parallel[best].finalSettings.doesRefraction ? "on" : "off",
+      configs.size() / seconds);
+  TEST_ASSERT_EQUAL(360000, parallel[best].finalSettings.azStepsPerRevolution);
+  TEST_ASSERT_TRUE(parallel[best].finalSettings.doesRefraction);
+  TEST_ASSERT_TRUE(parallel[best].rmsErrorDegrees <
+                   asRecorded.rmsErrorDegrees / 5);
+
+  char csv[512];
+  TEST_ASSERT_TRUE(formatPreferencesCsv(parallel[best].finalSettings, csv,
+                                        sizeof(csv)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(csv, "key,type,encoding,value\nDSC,namespace,,\n"));
+  TEST_ASSERT_NOT_NULL(strstr(csv, "\nAzStepsKey,data,i32,360000\n"));
+  TEST_ASSERT_NOT_NULL(strstr(csv, "\nRefractionKey,data,i32,1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(csv, "\nTempKey,data,i32,100\n"));
+  TEST_ASSERT_NOT_NULL(strstr(csv, "\nPressureKey,data,i32,10100\n"));
+  TEST_ASSERT_EQUAL(0, formatPreferencesCsv(parallel[best].finalSettings, csv,
+                                            64));
+}
+
+/**
+ * A scripted push of the scope in azimuth: speeds up to peak degrees a
+ * second over rampSeconds, holds it for coastSeconds, slows to a stop over
+ * rampSeconds again. Where it is (degrees from the start) at t seconds.
+ */
+struct MotionProfile {
+  double startSeconds;
+  double rampSeconds;
+  double coastSeconds;
+  double peakDegreesPerSecond;
+
+  double degreesAt(double t) const {
+    double ramp = peakDegreesPerSecond / rampSeconds; // degrees/s/s
+    double rampDegrees = ramp * rampSeconds * rampSeconds / 2;
+    t -= startSeconds;
+    if (t <= 0) {
+      return 0;
+    }
+    if (t < rampSeconds) {
+      return ramp * t * t / 2;
+    }
+    t -= rampSeconds;
+    if (t < coastSeconds) {
+      return rampDegrees + peakDegreesPerSecond * t;
+    }
+    t -= coastSeconds;
+    double coastDegrees = peakDegreesPerSecond * coastSeconds;
+    if (t < rampSeconds) {
+      return rampDegrees + coastDegrees + peakDegreesPerSecond * t -
+             ramp * t * t / 2;
+    }
+    return 2 * rampDegrees + coastDegrees;
+  }
+};
+
+#define TEST_AZ_STEPS 108531
+#define TEST_ALT_STEPS 30000
+#define TEST_SAMPLE_SECONDS 0.01
+
+struct MotionRun {
+  double worstLeadError;   // degrees, extrapolated vs where it really went
+  double worstNaiveError;  // degrees, last sample vs where it really went
+  double sumLeadError;
+  double sumNaiveError;
+  int samples;             // while moving
+  double firstMovingSeconds;
+  double lastMovingSeconds;
+  int movingSamples;
+  double peakSpeed;        // estimated, degrees/s
+  double midSpeed;         // estimated, half way through the run
+};
+
+/**
+ * Runs profile through EncoderMotion at the model task's rate, with the
+ * alt axis sat on an encoder edge (flickering between two counts) and
+ * az counts quantised. Scores the extrapolation leadSeconds ahead against
+ * the profile, for every sample the scope was reported moving.
+ */
+static MotionRun runMotionProfile(const MotionProfile &profile,
+                                  double leadSeconds, double seconds) {
+  MotionRun run = MotionRun();
+  run.firstMovingSeconds = -1;
+  EncoderMotion motion;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  const double countsPerDegree = TEST_AZ_STEPS / 360.0;
+  int steps = lround(seconds / TEST_SAMPLE_SECONDS);
+  for (int i = 0; i <= steps; i++) {
+    double t = i * TEST_SAMPLE_SECONDS;
+    long az = lround(profile.degreesAt(t) * countsPerDegree);
+    long alt = 5000 + (i * 7919 % 3 == 0 ? 1 : 0);
+    motion.update(alt, az, addSecondsToTime(start, t), TEST_ALT_STEPS,
+                  TEST_AZ_STEPS);
+    run.peakSpeed = fmax(run.peakSpeed, fabs(motion.getAzDegreesPerSecond()));
+    if (i == steps / 2) {
+      run.midSpeed = motion.getAzDegreesPerSecond();
+    }
+    if (!motion.isMoving()) {
+      continue;
+    }
+    if (run.firstMovingSeconds < 0) {
+      run.firstMovingSeconds = t;
+    }
+    run.lastMovingSeconds = t;
+    run.movingSamples++;
+    EncoderCount leadAlt;
+    EncoderCount leadAz;
+    motion.predict(leadSeconds, leadAlt, leadAz);
+    double truth = profile.degreesAt(t + leadSeconds);
+    double leadError = fabs(leadAz / countsPerDegree - truth);
+    double naiveError = fabs(az / countsPerDegree - truth);
+    run.worstLeadError = fmax(run.worstLeadError, leadError);
+    run.worstNaiveError = fmax(run.worstNaiveError, naiveError);
+    run.sumLeadError += leadError;
+    run.sumNaiveError += naiveError;
+    run.samples++;
+    TEST_ASSERT_TRUE(abs(leadAlt - 5000) <= 1);
+  }
+  return run;
+}
+
+/**
+ * Scripted pushes of the scope: a still scope with a flickering encoder
+ * never counts as moving, a steady slew's speed is picked up, and during a
+ * nudge the position extrapolated for a client's latency is much closer to
+ * where the scope really is when the client draws it than the last
+ * reading.
+ */
+void test_encoder_motion() {
+  // still, encoder flickering
+  MotionProfile still = {0, 1, 0, 0};
+  MotionRun run = runMotionProfile(still, 0.2, 5);
+  TEST_ASSERT_EQUAL_INT(0, run.movingSamples);
+  TEST_ASSERT_TRUE(run.peakSpeed < MOTION_START_DEGREES_PER_SECOND);
+
+  // steady 1 degree a second slew, 2s long
+  MotionProfile slew = {0.5, 0.05, 2, 1.0};
+  run = runMotionProfile(slew, 0.2, 4);
+  TEST_ASSERT_TRUE(run.firstMovingSeconds > 0.5);
+  TEST_ASSERT_TRUE(run.firstMovingSeconds < 0.6);
+  // stopping dead takes the filter a couple of tenths to settle
+  TEST_ASSERT_TRUE(run.lastMovingSeconds < 2.55 + 0.25 + MOTION_SETTLE_SECONDS);
+  TEST_ASSERT_FLOAT_WITHIN(0.05, 1.0, run.midSpeed);
+  log("Slew: moving %.2fs to %.2fs, 200ms lead error mean %.3f max %.3f "
+      "degrees, unextrapolated mean %.3f max %.3f",
+      run.firstMovingSeconds, run.lastMovingSeconds,
+      run.sumLeadError / run.samples, run.worstLeadError,
+      run.sumNaiveError / run.samples, run.worstNaiveError);
+  TEST_ASSERT_TRUE(run.sumLeadError < run.sumNaiveError / 4);
+
+  // a nudge: up to 3 degrees a second in 0.2s, hold 0.3s, stop in 0.2s
+  MotionProfile nudge = {0.5, 0.2, 0.3, 3.0};
+  run = runMotionProfile(nudge, 0.2, 3);
+  log("Nudge: moving %.2fs to %.2fs, 200ms lead error mean %.3f max %.3f "
+      "degrees, unextrapolated mean %.3f max %.3f",
+      run.firstMovingSeconds, run.lastMovingSeconds,
+      run.sumLeadError / run.samples, run.worstLeadError,
+      run.sumNaiveError / run.samples, run.worstNaiveError);
+  TEST_ASSERT_TRUE(run.firstMovingSeconds < 0.6);
+  TEST_ASSERT_TRUE(run.lastMovingSeconds < 1.2 + MOTION_SETTLE_SECONDS + 0.2);
+  TEST_ASSERT_TRUE(run.sumLeadError < run.sumNaiveError / 2);
+
+  // no lead, or still: the last sample exactly
+  EncoderMotion motion;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EncoderCount alt;
+  EncoderCount az;
+  for (int i = 0; i < 100; i++) {
+    motion.update(100, i * 50, addSecondsToTime(start, i * 0.01),
+                  TEST_ALT_STEPS, TEST_AZ_STEPS);
+  }
+  TEST_ASSERT_TRUE(motion.isMoving());
+  motion.predict(0, alt, az);
+  TEST_ASSERT_EQUAL_INT(4950, az);
+  motion.predict(5, alt, az); // capped at MOTION_MAX_LEAD_SECONDS
+  TEST_ASSERT_INT_WITHIN(200, 4950 + 5000 * MOTION_MAX_LEAD_SECONDS, az);
+  // a long gap starts again
+  motion.update(100, 2000, addSecondsToTime(start, 2), TEST_ALT_STEPS,
+                TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(motion.isMoving());
+  motion.predict(0.2, alt, az);
+  TEST_ASSERT_EQUAL_INT(2000, az);
+
+  // cost of a sample, on the model task every tick
+  const int iterations = 100000;
+  long sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    motion.update(100, 2000 + i % 7, addSecondsToTime(start, 2 + i * 0.01),
+                  TEST_ALT_STEPS, TEST_AZ_STEPS);
+    motion.predict(0.1, alt, az);
+    sink += az;
+  }
+  double ticks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Encoder motion update and predict %.0fns (checksum %ld)",
+      ticks * metricsSecondsPerTick() * 1e9, sink);
+}
+
+/**
+ * Client latency: fixed when set, else half the round trip the WebUI
+ * measures plus half the client's poll interval.
+ */
+void test_client_latency() {
+  ClientLatency latency;
+  TEST_ASSERT_TRUE(latency.isAutomatic());
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, CLIENT_LATENCY_DEFAULT_SECONDS,
+                           latency.getSeconds());
+
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  for (int i = 0; i < 100; i++) {
+    latency.addRoundTrip(0.08);
+    latency.addPoll(addSecondsToTime(start, i * 0.5));
+  }
+  latency.addRoundTrip(30);                         // nonsense, ignored
+  latency.addPoll(addSecondsToTime(start, 500));    // a pause, not a poll
+  latency.addPoll(addSecondsToTime(start, 500.5));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.08, latency.getRoundTripSeconds());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.5, latency.getPollSeconds());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.04 + 0.25, latency.getSeconds());
+
+  latency.setFixed(0.15);
+  TEST_ASSERT_FALSE(latency.isAutomatic());
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.15, latency.getSeconds());
+  latency.setFixed(5);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, MOTION_MAX_LEAD_SECONDS,
+                           latency.getSeconds());
+  latency.setFixed(-1);
+  TEST_ASSERT_TRUE(latency.isAutomatic());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.29, latency.getSeconds());
+}
+
+/**
+ * The model task publishes where a moving scope will be pointing when the
+ * client draws it: the same as a model fed the encoders from that time.
+ */
+void test_model_runner_lead() {
+  TelescopeModel model;
+  ModelRunner runner(model);
+  TelescopeModel laterModel;
+  ModelRunner later(laterModel);
+  ModelRunner *runners[] = {&runner, &later};
+  TimePoint start = createTimePoint(16, 9, 2023, 10, 39, 0);
+  setLoggingEnabled(false);
+  for (ModelRunner *r : runners) {
+    r->requestLatitude(-34.0493);
+    r->requestLongitude(151.0494);
+    r->requestAltEncoderStepsPerRevolution(TEST_ALT_STEPS);
+    r->requestAzEncoderStepsPerRevolution(TEST_AZ_STEPS);
+    r->requestClientLatency(0.2);
+    r->requestSync(18.6156, 38.78, 10000, 20000, start, PlatformState());
+    r->tick(10000, 20000, PlatformState(), start);
+  }
+  TEST_ASSERT_FALSE(runner.getPosition().moving);
+  TEST_ASSERT_TRUE(runner.getPosition().leadRaHours ==
+                   runner.getPosition().raHours);
+
+  // az at 1000 counts a second (3.3 degrees/s)
+  for (int i = 1; i <= 50; i++) {
+    TimePoint now = addSecondsToTime(start, i * 0.01);
+    runner.tick(10000, 20000 + i * 10, PlatformState(), now);
+  }
+  PositionSnapshot position = runner.getPosition();
+  TimePoint leadTime = addSecondsToTime(start, 0.7);
+  later.tick(10000, 20000 + 700, PlatformState(), leadTime);
+  PositionSnapshot truth = later.getPosition();
+  setLoggingEnabled(true);
+
+  TEST_ASSERT_TRUE(position.moving);
+  TEST_ASSERT_FLOAT_WITHIN(0.1, 1000 * 360.0 / TEST_AZ_STEPS,
+                           position.azDegreesPerSecond);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0, position.altDegreesPerSecond);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.2, position.leadSeconds);
+  // a few counts out at most, against 200 counts of travel
+  TEST_ASSERT_FLOAT_WITHIN(0.05 / 15, truth.raHours, position.leadRaHours);
+  TEST_ASSERT_FLOAT_WITHIN(0.05, truth.decDegrees, position.leadDecDegrees);
+  EqCoord now(position.raHours * 15, position.decDegrees);
+  EqCoord expected(truth.raHours * 15, truth.decDegrees);
+  TEST_ASSERT_TRUE(now.calculateDistanceInDegrees(expected) > 0.3);
+}
+
+/**
+ * Encoder history: one sample an interval, the window's mean and spread,
+ * and nothing from before what's kept.
+ */
+void test_encoder_history() {
+  EncoderHistory history;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  EncoderWindow window;
+  TEST_ASSERT_FALSE(history.summarise(start, addSecondsToTime(start, 1),
+                                      window));
+
+  // 10 seconds of ticks: still at 1000 then moving 100 counts a second
+  for (int i = 0; i < 1000; i++) {
+    double t = i * 0.01;
+    long az = t < 5 ? 1000 : lround(1000 + (t - 5) * 100);
+    history.add(500, az, addSecondsToTime(start, t));
+  }
+  TEST_ASSERT_TRUE(history.summarise(addSecondsToTime(start, 1),
+                                     addSecondsToTime(start, 4), window));
+  TEST_ASSERT_EQUAL_INT(31, window.samples);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1000, window.azEncoder);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 500, window.altEncoder);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0, window.azSpread);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 3, window.coveredSeconds);
+
+  // 6 to 8s: 21 samples 10 counts apart from 1100 to 1300
+  TEST_ASSERT_TRUE(history.summarise(addSecondsToTime(start, 6),
+                                     addSecondsToTime(start, 8), window));
+  TEST_ASSERT_EQUAL_INT(21, window.samples);
+  TEST_ASSERT_FLOAT_WITHIN(0.5, 1200, window.azEncoder);
+  TEST_ASSERT_FLOAT_WITHIN(0.5, 10 * sqrt((21 * 21 - 1) / 12.0),
+                           window.azSpread);
+
+  // a 10ms exposure still finds the sample before it
+  TEST_ASSERT_TRUE(history.summarise(addSecondsToTime(start, 2.05),
+                                     addSecondsToTime(start, 2.06), window));
+  TEST_ASSERT_EQUAL_INT(1, window.samples);
+
+  // after wrapping, the first seconds are gone
+  for (int i = 1000; i < 6000; i++) {
+    history.add(500, 1500, addSecondsToTime(start, i * 0.01));
+  }
+  TEST_ASSERT_FALSE(history.summarise(addSecondsToTime(start, 1),
+                                      addSecondsToTime(start, 4), window));
+  TEST_ASSERT_TRUE(history.summarise(addSecondsToTime(start, 50),
+                                     addSecondsToTime(start, 55), window));
+  TEST_ASSERT_EQUAL_INT(51, window.samples);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1500, window.azEncoder);
+}
+
+/**
+ * Sync gating: a plate solve of a still exposure gets the encoders from
+ * then, even though the scope has moved on since; one of an exposure the
+ * scope moved during is refused, as is a sync while it's being pushed.
+ */
+void test_sync_gate() {
+  EncoderHistory history;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  // still for 10s, a 3 second push, still again, encoder flickering
+  for (int i = 0; i < 2000; i++) {
+    double t = i * 0.01;
+    long az = 20000;
+    if (t > 13) {
+      az += 600;
+    } else if (t > 10) {
+      az += lround((t - 10) * 200);
+    }
+    history.add(10000 + i % 2, az, addSecondsToTime(start, t));
+  }
+  TimePoint now = addSecondsToTime(start, 19.99);
+
+  // 4 second exposure while still, solved after the push
+  SyncAssessment sync =
+      assessExposureSync(history, addSecondsToTime(start, 5),
+                         addSecondsToTime(start, 9), TEST_ALT_STEPS,
+                         TEST_AZ_STEPS);
+  TEST_ASSERT_TRUE(sync.accepted);
+  TEST_ASSERT_NULL(sync.reason);
+  TEST_ASSERT_EQUAL_INT(20000, sync.azEncoder);
+  TEST_ASSERT_INT_WITHIN(1, 10000, sync.altEncoder);
+  // a count of flicker costs a little
+  TEST_ASSERT_TRUE(sync.quality > 0.8);
+  TEST_ASSERT_TRUE(differenceInSeconds(addSecondsToTime(start, 7), sync.time) <
+                   0.001);
+
+  // exposure over the start of the push
+  sync = assessExposureSync(history, addSecondsToTime(start, 9),
+                            addSecondsToTime(start, 11), TEST_ALT_STEPS,
+                            TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted);
+  TEST_ASSERT_TRUE(sync.spreadDegrees > SYNC_MAX_SPREAD_DEGREES);
+  TEST_ASSERT_EQUAL_FLOAT(0, sync.quality);
+
+  // longer ago than the history, backwards, and not yet
+  sync = assessExposureSync(history, addSecondsToTime(start, -30),
+                            addSecondsToTime(start, -20), TEST_ALT_STEPS,
+                            TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted);
+  sync = assessExposureSync(history, addSecondsToTime(start, -30),
+                            addSecondsToTime(start, 0.5), TEST_ALT_STEPS,
+                            TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted); // only the last half second's there
+  TEST_ASSERT_TRUE(sync.coverage < SYNC_MIN_COVERAGE);
+  sync = assessExposureSync(history, addSecondsToTime(start, 9),
+                            addSecondsToTime(start, 5), TEST_ALT_STEPS,
+                            TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted);
+  sync = assessExposureSync(history, addSecondsToTime(start, 30),
+                            addSecondsToTime(start, 31), TEST_ALT_STEPS,
+                            TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted);
+
+  // no exposure: counts as it arrives, if still
+  sync = assessSync(history, 10001, 20600, now, TEST_ALT_STEPS,
+                    TEST_AZ_STEPS);
+  TEST_ASSERT_TRUE(sync.accepted);
+  TEST_ASSERT_EQUAL_INT(20600, sync.azEncoder);
+  TEST_ASSERT_TRUE(sync.time == now);
+  sync = assessSync(history, 10001, 20300, addSecondsToTime(start, 11.5),
+                    TEST_ALT_STEPS, TEST_AZ_STEPS);
+  TEST_ASSERT_FALSE(sync.accepted);
+  // nothing to check against yet
+  EncoderHistory empty;
+  sync = assessSync(empty, 1, 2, now, TEST_ALT_STEPS, TEST_AZ_STEPS);
+  TEST_ASSERT_TRUE(sync.accepted);
+  TEST_ASSERT_EQUAL_FLOAT(0, sync.quality);
+
+  TimePoint parsed;
+  TEST_ASSERT_TRUE(parseUtcTime("2023-09-02T10:00:05.25Z", parsed));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 5.25, differenceInSeconds(start, parsed));
+  TEST_ASSERT_TRUE(parseUtcTime("2023-09-02T10:00:05Z", parsed));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 5, differenceInSeconds(start, parsed));
+  TEST_ASSERT_FALSE(parseUtcTime("2023-09-02T10:00:05", parsed));
+  TEST_ASSERT_FALSE(parseUtcTime("2023-13-02T10:00:05Z", parsed));
+  TEST_ASSERT_FALSE(parseUtcTime("", parsed));
+
+  // cost of the check, on the web handler for each sync
+  const int iterations = 10000;
+  double sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink += assessExposureSync(history, addSecondsToTime(start, 5),
+                               addSecondsToTime(start, 9), TEST_ALT_STEPS,
+                               TEST_AZ_STEPS)
+                .quality;
+  }
+  double ticks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Sync gate over a 4s exposure %.0fns (checksum %.0f)",
+      ticks * metricsSecondsPerTick() * 1e9, sink);
+}
+
+/**
+ * The history is read by the web handlers while the model task writes it:
+ * a reader never sees a sample from outside the window it asked for, or a
+ * torn one.
+ */
+void test_encoder_history_threads() {
+  EncoderHistory *history = new EncoderHistory();
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  std::atomic<bool> done(false);
+  std::atomic<int> writes(0);
+  std::thread writer([history, &done, &writes, start]() {
+    // counts follow time, so a torn sample would show
+    for (int i = 0; i < 200000; i++) {
+      history->add(i, -i, addSecondsToTime(start, i * 0.25));
+      writes.store(i, std::memory_order_release);
+    }
+    done = true;
+  });
+  int bad = 0;
+  int reads = 0;
+  while (!done) {
+    int latest = writes.load(std::memory_order_acquire);
+    if (latest < 100) {
+      continue;
+    }
+    EncoderWindow window;
+    TimePoint end = addSecondsToTime(start, (latest - 10) * 0.25);
+    if (history->summarise(addSecondsToTime(end, -5), end, window)) {
+      reads++;
+      if (fabs(window.altEncoder + window.azEncoder) > 0.001 ||
+          window.altEncoder > latest - 10 + 0.001 ||
+          window.altEncoder < latest - 60 - 0.001) {
+        bad++;
+      }
+    }
+  }
+  writer.join();
+  delete history;
+  TEST_ASSERT_TRUE(reads > 0);
+  TEST_ASSERT_EQUAL_INT(0, bad);
+}
+
+/**
+ * Encoder counts to angles: exact where the resolution allows, the same
+ * in any turn however far the count has run (past 32 bits included), and
+ * either direction.
+ */
+void test_encoder_scale() {
+  EncoderScale scale;
+  // not set yet
+  TEST_ASSERT_EQUAL_FLOAT(0, scale.toDegrees(12345));
+
+  scale.setStepsPerRevolution(360000);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, scale.toDegrees(0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 90, scale.toDegrees(90000));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 270, scale.toDegrees(-90000));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, -90, scale.toSignedDegrees(-90000));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.001, scale.toDegrees(1));
+
+  // the same place in the first turn and after many, up past 2^40 counts
+  scale.setStepsPerRevolution(TEST_AZ_STEPS);
+  EncoderCount within = 27133;
+  double expected = within * 360.0 / TEST_AZ_STEPS;
+  const int64_t turns[] = {1, 5, 1000, 19800, 20000, -3, -20000};
+  for (size_t i = 0; i < sizeof(turns) / sizeof(turns[0]); i++) {
+    EncoderCount counts = turns[i] * TEST_AZ_STEPS + within;
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, expected, scale.toDegrees(counts));
+  }
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-4, expected,
+      scale.toDegrees((EncoderCount)20000000 * TEST_AZ_STEPS + within));
+
+  // counting down
+  scale.setStepsPerRevolution(-TEST_ALT_STEPS);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 90, scale.toSignedDegrees(-7500));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, -45, scale.toSignedDegrees(3750));
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-6, 90,
+      scale.toSignedDegrees(-7500 - (EncoderCount)100000 * TEST_ALT_STEPS));
+
+  // cost against the float divide it replaces, once per tick per axis
+  const int iterations = 100000;
+  scale.setStepsPerRevolution(TEST_AZ_STEPS);
+  volatile double sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + scale.toDegrees(i * 7919);
+  }
+  double fixedTicks = (double)(metricsTicks() - startTicks) / iterations;
+  volatile long steps = TEST_AZ_STEPS;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + 360.0 * ((float)(i * 7919)) / (float)steps;
+  }
+  double floatTicks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Encoder counts to degrees: fixed point %.1fns, float divide %.1fns",
+      fixedTicks * metricsSecondsPerTick() * 1e9,
+      floatTicks * metricsSecondsPerTick() * 1e9);
+}
+
+/**
+ * After turning round and round, an azimuth count many revolutions on
+ * gives the same position as its equivalent in the first.
+ */
+void test_model_many_turns() {
+  TelescopeModel model;
+  model.setAltEncoderStepsPerRevolution(-TEST_ALT_STEPS);
+  model.setAzEncoderStepsPerRevolution(TEST_AZ_STEPS);
+  model.setLatitude(-34.0493);
+  model.setLongitude(151.0494);
+  TimePoint time = createTimePoint(2, 9, 2023, 10, 0, 0);
+  model.setEncoderValues(0, 0);
+  model.syncPositionRaDec(14.28644, 18.9795, time);
+
+  model.setEncoderValues(-2000, 12345);
+  model.calculateCurrentPosition(time);
+  double ra = model.getRACoord();
+  double dec = model.getDecCoord();
+  const int64_t turns[] = {5, -5, 40000};
+  for (size_t i = 0; i < sizeof(turns) / sizeof(turns[0]); i++) {
+    model.setEncoderValues(-2000, 12345 + turns[i] * TEST_AZ_STEPS);
+    model.calculateCurrentPosition(time);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, ra, model.getRACoord());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, dec, model.getDecCoord());
+  }
+}
+
+typedef EncoderAxis<25, 26, -1, TEST_AZ_STEPS> TestAzAxis;
+typedef EncoderAxis<27, 14, -1, -TEST_ALT_STEPS> TestAltAxis;
+
+/**
+ * A compiled in axis: known at compile time, and converting exactly as
+ * the model's run time EncoderScale does at the same resolution.
+ */
+void test_encoder_axis() {
+  static_assert(TestAzAxis::resolution == TEST_AZ_STEPS, "az resolution");
+  static_assert(TestAltAxis::resolution == TEST_ALT_STEPS, "alt resolution");
+  static_assert(TestAltAxis::sample(5) == -5, "alt direction");
+  static_assert(TestAltAxis::toTurns(-7500) == 0x40000000u, "quarter turn");
+  TEST_ASSERT_EQUAL_INT(25, TestAzAxis::pinA);
+  TEST_ASSERT_EQUAL_INT(14, TestAltAxis::pinB);
+
+  EncoderScale alt;
+  alt.setStepsPerRevolution(TestAltAxis::stepsPerRevolution);
+  EncoderScale az;
+  az.setStepsPerRevolution(TestAzAxis::stepsPerRevolution);
+  const EncoderCount counts[] = {0, 1, -1, 7919, -54321, 108530, INT32_MAX,
+                                 INT32_MIN, (EncoderCount)1 << 40,
+                                 -((EncoderCount)1 << 40) + 3};
+  for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    TEST_ASSERT_EQUAL_UINT32(az.toTurns(counts[i]),
+                             TestAzAxis::toTurns(counts[i]));
+    TEST_ASSERT_EQUAL_UINT32(alt.toTurns(counts[i]),
+                             TestAltAxis::toTurns(counts[i]));
+  }
+
+  // the model's run time scale against the compiled in one
+  const int iterations = 100000;
+  volatile double sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + az.toDegrees(TestAzAxis::sample(i * 7919));
+  }
+  double runTimeTicks = (double)(metricsTicks() - startTicks) / iterations;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + TestAzAxis::toDegrees(TestAzAxis::sample(i * 7919));
+  }
+  double compiledTicks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Encoder sample to degrees: run time scale %.1fns, compiled in %.1fns",
+      runTimeTicks * metricsSecondsPerTick() * 1e9,
+      compiledTicks * metricsSecondsPerTick() * 1e9);
+}
+
+/**
+ * Each hemisphere's TakiHorizCoord conversion matches the one that
+ * branches on it, over the top and round the back included.
+ */
+void test_taki_hemisphere() {
+  for (double alt = -100; alt < 190; alt += 7.3) {
+    for (double az = -30; az < 400; az += 13.7) {
+      HorizCoord h(alt, az);
+      TakiHorizCoord north = TakiHorizCoord::from<true>(h);
+      TakiHorizCoord branchyNorth(h, true);
+      TEST_ASSERT_EQUAL_FLOAT(branchyNorth.altAngle, north.altAngle);
+      TEST_ASSERT_EQUAL_FLOAT(branchyNorth.aziAngle, north.aziAngle);
+      TakiHorizCoord south = TakiHorizCoord::from<false>(h);
+      TakiHorizCoord branchySouth(h, false);
+      TEST_ASSERT_EQUAL_FLOAT(branchySouth.altAngle, south.altAngle);
+      TEST_ASSERT_EQUAL_FLOAT(branchySouth.aziAngle, south.aziAngle);
+      TEST_ASSERT_TRUE(south.altAngle >= -90 && south.altAngle <= 90);
+      TEST_ASSERT_TRUE(south.aziAngle >= 0 && south.aziAngle < 360);
+    }
+  }
+  HorizCoord h(30, 100);
+  TEST_ASSERT_EQUAL_FLOAT(260, TakiHorizCoord::from<true>(h).aziAngle);
+  TEST_ASSERT_EQUAL_FLOAT(-30, TakiHorizCoord::from<false>(h).altAngle);
+
+  // branching for every conversion against picking one up front
+  const int iterations = 100000;
+  volatile bool northern = false;
+  volatile double sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + TakiHorizCoord(HorizCoord(i % 90, i % 360), northern)
+                      .aziAngle;
+  }
+  double branchyTicks = (double)(metricsTicks() - startTicks) / iterations;
+  TakiConversion toTaki = northern ? TakiHorizCoord::from<true>
+                                   : TakiHorizCoord::from<false>;
+  startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink = sink + toTaki(HorizCoord(i % 90, i % 360)).aziAngle;
+  }
+  double pickedTicks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Alt/az to Taki: branching %.1fns, picked at setup %.1fns",
+      branchyTicks * metricsSecondsPerTick() * 1e9,
+      pickedTicks * metricsSecondsPerTick() * 1e9);
+}
+
+static int64_t fakeMonotonicMicros = 0;
+static int64_t readFakeMonotonicMicros() { return fakeMonotonicMicros; }
+
+/**
+ * The time service on a fake clock: set by the first client, fraction of
+ * a second included; after that a client's time is slewed in rather than
+ * stepped, and it never goes backwards.
+ */
+void test_time_service() {
+  fakeMonotonicMicros = 1000000;
+  TimeService service(readFakeMonotonicMicros);
+  TEST_ASSERT_FALSE(service.getStats().set);
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+
+  TEST_ASSERT_EQUAL_INT(TIME_UPDATE_SET,
+                        service.update(addSecondsToTime(start, 0.25)));
+  TEST_ASSERT_TRUE(service.getStats().set);
+  TEST_ASSERT_TRUE(service.getStats().lastUpdated ==
+                   addSecondsToTime(start, 0.25));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.25,
+                           differenceInSeconds(start, service.now()));
+  fakeMonotonicMicros += 1500000;
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 1.75,
+                           differenceInSeconds(start, service.now()));
+
+  // a client a second behind: half of it slewed in, never going back
+  TEST_ASSERT_EQUAL_INT(TIME_UPDATE_SLEWED,
+                        service.update(addSecondsToTime(start, 0.75)));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, -1, service.getStats().lastOffsetSeconds);
+  TimePoint last = service.now();
+  int backwards = 0;
+  for (int i = 0; i < 3000; i++) {
+    fakeMonotonicMicros += 10000;
+    TimePoint now = service.now();
+    if (now < last) {
+      backwards++;
+    }
+    last = now;
+  }
+  TEST_ASSERT_EQUAL_INT(0, backwards);
+  // 30s on, less the half second, less a little for the drift it thinks
+  // that was
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 31.25, differenceInSeconds(start, last));
+  TEST_ASSERT_TRUE(fabs(service.getStats().rateCorrection) <= TIME_MAX_DRIFT);
+
+  // far behind is refused, far ahead is stepped to
+  TimePoint ours = service.now();
+  TEST_ASSERT_EQUAL_INT(TIME_UPDATE_REFUSED,
+                        service.update(addSecondsToTime(ours, -10)));
+  TEST_ASSERT_TRUE(service.now() == ours);
+  TEST_ASSERT_EQUAL_INT(TIME_UPDATE_SET,
+                        service.update(addSecondsToTime(ours, 10)));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 10, differenceInSeconds(ours, service.now()));
+  TimeServiceStats stats = service.getStats();
+  TEST_ASSERT_EQUAL_INT(4, stats.updates);
+  TEST_ASSERT_EQUAL_INT(2, stats.steps);
+  TEST_ASSERT_EQUAL_INT(1, stats.refused);
+
+  // readers from before an update carry on from it, not before it
+  TEST_ASSERT_TRUE(service.at(fakeMonotonicMicros - 5000000) ==
+                   service.now());
+
+  // cost, as every tick and handler pays it
+  const int iterations = 100000;
+  TimeService real;
+  int64_t sink = 0;
+  uint32_t startTicks = metricsTicks();
+  for (int i = 0; i < iterations; i++) {
+    sink += real.now().time_since_epoch().count();
+  }
+  double ticks = (double)(metricsTicks() - startTicks) / iterations;
+  log("Time service now %.0fns (checksum %lld)",
+      ticks * metricsSecondsPerTick() * 1e9, (long long)(sink & 0xff));
+}
+
+/**
+ * A monotonic clock 100ppm fast, set by a client every 10 minutes: the
+ * drift is learned, so the time between updates stays good.
+ */
+void test_time_service_drift() {
+  const double fast = 100e-6;
+  fakeMonotonicMicros = 0;
+  TimeService service(readFakeMonotonicMicros);
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  double worst = 0;
+  for (int update = 0; update < 30; update++) {
+    for (int second = 0; second < 600; second++) {
+      double t = update * 600 + second;
+      fakeMonotonicMicros = llround(t * (1 + fast) * 1e6);
+      if (second == 0) {
+        service.update(addSecondsToTime(start, t));
+      } else if (update >= 20) {
+        double error =
+            differenceInSeconds(addSecondsToTime(start, t), service.now());
+        worst = fmax(worst, fabs(error));
+      }
+    }
+  }
+  TEST_ASSERT_FLOAT_WITHIN(10e-6, -fast, service.getStats().rateCorrection);
+  log("Time service 100ppm drift: worst error %.2fms after 20 updates",
+      worst * 1000);
+  TEST_ASSERT_TRUE(worst < 0.005);
+}
+
+/**
+ * UTC dates come out the same whatever the time zone, and whatever its
+ * daylight saving is doing.
+ */
+void test_create_time_point_utc() {
+  const char *zone = getenv("TZ");
+  std::string saved = zone ? zone : "";
+  const char *zones[] = {"UTC0", "EST5EDT,M3.2.0,M11.1.0",
+                         "AEST-10AEDT,M10.1.0,M4.1.0/3"};
+  for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++) {
+    setenv("TZ", zones[i], 1);
+    tzset();
+    TEST_ASSERT_EQUAL_INT64(
+        1693648800, Clock::to_time_t(createTimePoint(2, 9, 2023, 10, 0, 0)));
+    // the hour New York's clocks skip
+    TEST_ASSERT_EQUAL_INT64(
+        1710055800, Clock::to_time_t(createTimePoint(10, 3, 2024, 7, 30, 0)));
+  }
+  if (zone) {
+    setenv("TZ", saved.c_str(), 1);
+  } else {
+    unsetenv("TZ");
+  }
+  tzset();
+}
+
+/**
+ * SNTP client and server over an in-memory loopback: the server's clock
+ * 1.2345s ahead, WiFi taking 1 to 30ms each way with the odd packet
+ * queued for longer. The filter finds the offset to within a few ms.
+ */
+void test_sntp_loopback() {
+  // timestamps, either side of the 2036 wrap
+  TimePoint times[] = {createTimePoint(2, 9, 2023, 10, 0, 0),
+                       createTimePoint(1, 1, 2040, 0, 0, 0)};
+  for (int i = 0; i < 2; i++) {
+    TimePoint t = addSecondsToTime(times[i], 0.123456);
+    TEST_ASSERT_TRUE(fromNtpTimestamp(toNtpTimestamp(t)) == t);
+  }
+  TEST_ASSERT_EQUAL_INT64(3902637600ULL,
+                          toNtpTimestamp(times[0]) >> 32);
+
+  const double serverAhead = 1.2345;
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  SntpFilter filter;
+  SntpSample best;
+  TEST_ASSERT_FALSE(filter.getBest(best));
+  uint32_t seed = 12345;
+  int refused = 0;
+  for (int i = 0; i < 32; i++) {
+    // the client's clock is the true one here
+    TimePoint sent = addSecondsToTime(start, i * 16);
+    double out = 0.001 + (seed = seed * 1103515245 + 12345) % 29000 / 1e6;
+    double back = 0.001 + (seed = seed * 1103515245 + 12345) % 29000 / 1e6;
+    if (i % 5 == 0) {
+      back += 0.2; // sat in a queue
+    }
+    uint8_t request[SNTP_PACKET_SIZE];
+    sntpClientRequest(sent, request);
+    uint8_t reply[SNTP_PACKET_SIZE];
+    TimePoint serverReceived = addSecondsToTime(sent, out + serverAhead);
+    TEST_ASSERT_TRUE(sntpServerReply(request, sizeof(request), serverReceived,
+                                     addSecondsToTime(serverReceived, 0.0005),
+                                     true, start, reply));
+    TimePoint arrived = addSecondsToTime(sent, out + 0.0005 + back);
+    SntpSample sample;
+    TEST_ASSERT_TRUE(
+        sntpParseReply(reply, sizeof(reply), sent, arrived, sample));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, out + back, sample.delaySeconds);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, serverAhead + (out - back) / 2,
+                             sample.offsetSeconds);
+    if (!filter.add(sample)) {
+      refused++;
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(7, refused);
+  TEST_ASSERT_EQUAL_INT(SNTP_FILTER_SIZE, filter.getCount());
+  TEST_ASSERT_TRUE(filter.getBest(best));
+  TEST_ASSERT_FLOAT_WITHIN(0.005, serverAhead, best.offsetSeconds);
+  log("SNTP loopback: offset out by %.2fms, delay %.2fms",
+      (best.offsetSeconds - serverAhead) * 1000, best.delaySeconds * 1000);
+
+  // what isn't a reply to us, or a request for the server
+  uint8_t request[SNTP_PACKET_SIZE];
+  uint8_t reply[SNTP_PACKET_SIZE];
+  SntpSample sample;
+  sntpClientRequest(start, request);
+  TEST_ASSERT_TRUE(
+      sntpServerReply(request, sizeof(request), start, start, true, start,
+                      reply));
+  TEST_ASSERT_EQUAL_INT(SNTP_STRATUM, reply[1]);
+  TEST_ASSERT_FALSE(sntpParseReply(reply, sizeof(reply),
+                                   addSecondsToTime(start, 1), start, sample));
+  TEST_ASSERT_FALSE(sntpParseReply(reply, 40, start, start, sample));
+  reply[1] = 0; // kiss of death
+  TEST_ASSERT_FALSE(
+      sntpParseReply(reply, sizeof(reply), start, start, sample));
+  TEST_ASSERT_FALSE(
+      sntpServerReply(request, 40, start, start, true, start, reply));
+  request[0] = (4 << 3) | 4; // a server's packet
+  TEST_ASSERT_FALSE(
+      sntpServerReply(request, sizeof(request), start, start, true, start,
+                      reply));
+}
+
+/**
+ * Before any client has set the DSC's clock its replies say it's
+ * unsynchronised (alarm, stratum 16, no reference time), though our own
+ * clients still take them. After, they carry when it was last set.
+ */
+void test_sntp_synchronised() {
+  TimePoint start = createTimePoint(2, 9, 2023, 10, 0, 0);
+  TimePoint set = addSecondsToTime(start, -30.5);
+  uint8_t request[SNTP_PACKET_SIZE];
+  uint8_t reply[SNTP_PACKET_SIZE];
+  SntpSample sample;
+  sntpClientRequest(start, request);
+
+  TEST_ASSERT_TRUE(sntpServerReply(request, sizeof(request), start, start,
+                                   false, set, reply));
+  TEST_ASSERT_EQUAL_INT(SNTP_LEAP_UNSYNCHRONISED, reply[0] >> 6);
+  TEST_ASSERT_EQUAL_INT(SNTP_STRATUM_UNSYNCHRONISED, reply[1]);
+  for (int i = 16; i < 24; i++) {
+    TEST_ASSERT_EQUAL_INT(0, reply[i]);
+  }
+  TEST_ASSERT_TRUE(
+      sntpParseReply(reply, sizeof(reply), start, start, sample));
+
+  TEST_ASSERT_TRUE(sntpServerReply(request, sizeof(request), start, start,
+                                   true, set, reply));
+  TEST_ASSERT_EQUAL_INT(0, reply[0] >> 6);
+  TEST_ASSERT_EQUAL_INT(4, (reply[0] >> 3) & 7);
+  TEST_ASSERT_EQUAL_INT(SNTP_STRATUM, reply[1]);
+  uint64_t reference = 0;
+  for (int i = 16; i < 24; i++) {
+    reference = (reference << 8) | reply[i];
+  }
+  TEST_ASSERT_TRUE(fromNtpTimestamp(reference) == set);
+}
+
+/**
+ * A platform's own timestamp is used when it's on our clock, and ignored
+ * when it isn't yet.
+ */
+void test_platform_packet_time() {
+  TimePoint arrived = createTimePoint(2, 9, 2023, 10, 0, 0);
+  double arrivedSeconds = (double)Clock::to_time_t(arrived);
+  TEST_ASSERT_TRUE(platformPacketTime(0, arrived) == arrived);
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-5, -0.03,
+      differenceInSeconds(arrived,
+                          platformPacketTime(arrivedSeconds - 0.03, arrived)));
+  TEST_ASSERT_TRUE(platformPacketTime(arrivedSeconds - 5, arrived) == arrived);
+  TEST_ASSERT_TRUE(platformPacketTime(1000, arrived) == arrived);
+}
+
+/**
+ * A status packet with every key a platform can send (a dec axis, acks
+ * and its own timestamp) parses whole, and one without the optional keys
+ * leaves them unset.
+ */
+void test_platform_packet() {
+  TimePoint arrived = createTimePoint(2, 9, 2023, 10, 0, 0);
+  double utc = (double)Clock::to_time_t(arrived) - 0.025;
+  char full[400];
+  snprintf(full, sizeof(full),
+           "DSC:{\"timeToCenter\":-1234.567891,\"timeToEnd\":2345.678912,"
+           "\"axisMoveRateMax\":0.51234567,\"axisMoveRateMin\":0.00123456,"
+           "\"guideMoveRate\":0.00208912,\"trackingRate\":0.00417807,"
+           "\"slewing\":false,\"isTracking\":true,"
+           "\"decAxisAngle\":-2.34567891,\"ack\":4294967295,"
+           "\"ackBits\":4294967295,\"utc\":%.3f}",
+           utc);
+  PlatformPacket packet;
+  TEST_ASSERT_TRUE(parsePlatformPacket((const uint8_t *)full, strlen(full),
+                                       arrived, packet));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, -1234.567891,
+                           packet.telemetry.runtimeFromCenterSeconds);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 2345.678912, packet.telemetry.timeToEnd);
+  TEST_ASSERT_TRUE(packet.telemetry.currentlyRunning);
+  TEST_ASSERT_FALSE(packet.telemetry.slewing);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, 0.00208912, packet.telemetry.pulseGuideRate);
+  TEST_ASSERT_TRUE(packet.telemetry.hasDecAxis);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, -2.34567891,
+                           packet.telemetry.decAxisDegrees);
+  TEST_ASSERT_TRUE(packet.acks);
+  TEST_ASSERT_EQUAL_UINT32(4294967295UL, packet.ack);
+  TEST_ASSERT_EQUAL_UINT32(4294967295UL, packet.ackBits);
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-3, -0.025, differenceInSeconds(arrived, packet.telemetry.receivedTime));
+
+  const char *plain =
+      "DSC:{\"timeToCenter\":10,\"timeToEnd\":20,\"axisMoveRateMax\":0.5,"
+      "\"axisMoveRateMin\":0.001,\"guideMoveRate\":0.002,"
+      "\"trackingRate\":0.004,\"slewing\":true,\"isTracking\":false}";
+  TEST_ASSERT_TRUE(parsePlatformPacket((const uint8_t *)plain, strlen(plain),
+                                       arrived, packet));
+  TEST_ASSERT_TRUE(packet.telemetry.slewing);
+  TEST_ASSERT_FALSE(packet.telemetry.hasDecAxis);
+  TEST_ASSERT_FALSE(packet.acks);
+  TEST_ASSERT_TRUE(packet.telemetry.receivedTime == arrived);
+
+  // not ours, not JSON, not all there
+  TEST_ASSERT_FALSE(parsePlatformPacket((const uint8_t *)"EQ:{}", 5, arrived,
+                                        packet));
+  TEST_ASSERT_FALSE(parsePlatformPacket((const uint8_t *)"DSC:{", 5, arrived,
+                                        packet));
+  const char *partial = "DSC:{\"timeToCenter\":10}";
+  TEST_ASSERT_FALSE(parsePlatformPacket((const uint8_t *)partial,
+                                        strlen(partial), arrived, packet));
+}
+
+/**
+ * Phases marked out of order, and more than once, come out in the order
+ * they happened, and complete once the last one is in.
+ */
+void test_boot_timeline() {
+  BootTimeline timeline;
+  char buffer[512];
+  TEST_ASSERT_EQUAL_INT(0, timeline.render(buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_STRING("", buffer);
+
+  TEST_ASSERT_FALSE(timeline.mark(BOOT_SERIAL, 0));
+  TEST_ASSERT_TRUE(timeline.isMarked(BOOT_SERIAL));
+  TEST_ASSERT_FALSE(timeline.isMarked(BOOT_PREFERENCES));
+  TEST_ASSERT_FALSE(timeline.mark(BOOT_WIFI_CONNECTED, 900000));
+  TEST_ASSERT_FALSE(timeline.mark(BOOT_PREFERENCES, 12000));
+  TEST_ASSERT_FALSE(timeline.mark(BOOT_PREFERENCES, 50000));
+  TEST_ASSERT_EQUAL_UINT32(12000, timeline.getMicros(BOOT_PREFERENCES));
+  timeline.render(buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_STRING("serial 0.0ms (+0.0), preferences 12.0ms "
+                           "(+12.0), wifi 900.0ms (+888.0)",
+                           buffer);
+
+  BootPhase rest[] = {BOOT_FILESYSTEM, BOOT_ENCODERS, BOOT_SERVERS,
+                      BOOT_TASKS, BOOT_FIRST_POSITION};
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_FALSE(timeline.isComplete());
+    TEST_ASSERT_EQUAL(i == 4, timeline.mark(rest[i], 100000 * (i + 1)));
+  }
+  TEST_ASSERT_TRUE(timeline.isComplete());
+  // already marked, so it didn't complete it
+  TEST_ASSERT_FALSE(timeline.mark(BOOT_SERIAL, 5));
+
+  // whole phases only
+  size_t written = timeline.render(buffer, 30);
+  TEST_ASSERT_EQUAL_STRING("serial 0.0ms (+0.0)", buffer);
+  TEST_ASSERT_EQUAL_INT(strlen(buffer), written);
+  written = timeline.render(buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(strlen(buffer), written);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "tasks 400.0ms (+100.0), first "
+                                      "position 500.0ms (+100.0), wifi"));
+}
+
 void setup() {
 
   // test_telescope_model();
@@ -1734,6 +5875,65 @@ void setup() {
   RUN_TEST(test_eq_coord_distance);
 
   RUN_TEST(test_time_difference);
+  RUN_TEST(test_model_hot_path_does_not_allocate);
+  RUN_TEST(test_histogram_buckets);
+  RUN_TEST(test_histogram_percentiles);
+  RUN_TEST(test_histogram_prometheus);
+  RUN_TEST(test_metrics_scope_overhead);
+  RUN_TEST(test_metrics_unpinned_scope);
+  RUN_TEST(test_spsc_queue_threads);
+  RUN_TEST(test_seqlock_threads);
+  RUN_TEST(test_model_runner_threads);
+  RUN_TEST(test_platform_state);
+  RUN_TEST(test_platform_telemetry_threads);
+  RUN_TEST(test_alpaca_cache_render);
+  RUN_TEST(test_alpaca_cache_versions);
+  RUN_TEST(test_alpaca_cache_polling_load);
+  RUN_TEST(test_sidereal_time);
+  RUN_TEST(test_alt_az_at_sidereal_time);
+  RUN_TEST(test_mount_state_render);
+  RUN_TEST(test_mount_state_request_count);
+  RUN_TEST(test_platform_kinematics_rotation);
+  RUN_TEST(test_platform_kinematics_run);
+  RUN_TEST(test_push_to_track);
+  RUN_TEST(test_push_to_runner);
+  RUN_TEST(test_slew_controller_sim);
+  RUN_TEST(test_slew_controller_stops);
+  RUN_TEST(test_pulse_guide_merging);
+  RUN_TEST(test_pulse_guide_phd2_sim);
+  RUN_TEST(test_command_channel_acks);
+  RUN_TEST(test_command_channel_loss);
+  RUN_TEST(test_catalogue_query);
+  RUN_TEST(test_catalogue_benchmark);
+  RUN_TEST(test_visibility_planner);
+  RUN_TEST(test_visibility_planner_benchmark);
+  RUN_TEST(test_epoch_transform);
+  RUN_TEST(test_epoch_transform_benchmark);
+  RUN_TEST(test_refraction_table);
+  RUN_TEST(test_refraction_low_altitude_pointing);
+  RUN_TEST(test_refraction_changed_after_sync);
+  RUN_TEST(test_web_assets);
+  RUN_TEST(test_session_recorder);
+  RUN_TEST(test_session_recorder_overhead);
+  RUN_TEST(test_session_replay);
+  RUN_TEST(test_encoder_motion);
+  RUN_TEST(test_client_latency);
+  RUN_TEST(test_model_runner_lead);
+  RUN_TEST(test_encoder_history);
+  RUN_TEST(test_sync_gate);
+  RUN_TEST(test_encoder_history_threads);
+  RUN_TEST(test_encoder_scale);
+  RUN_TEST(test_model_many_turns);
+  RUN_TEST(test_encoder_axis);
+  RUN_TEST(test_taki_hemisphere);
+  RUN_TEST(test_time_service);
+  RUN_TEST(test_time_service_drift);
+  RUN_TEST(test_create_time_point_utc);
+  RUN_TEST(test_sntp_loopback);
+  RUN_TEST(test_sntp_synchronised);
+  RUN_TEST(test_platform_packet_time);
+  RUN_TEST(test_platform_packet);
+  RUN_TEST(test_boot_timeline);
   //====
   //   RUN_TEST(test_continuity);
 
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Builds the on-device catalogue (data/catalogue.bin) from a csv.
+
+    python3 tools/build_catalogue.py tools/catalogue.csv data/catalogue.bin
+
+Each csv line is name,type,ra,dec,magnitude,size: ra in hours and dec in
+degrees, either decimal or h:m:s / d:m:s, J2000; magnitude may be empty;
+size in arcmin. Lines starting with # are comments. The file layout is
+described in lib/Catalogue/src/Catalogue.h; keep the two in step.
+"""
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = b"DSCC"
+VERSION = 1
+HEADER_SIZE = 32
+NAME_SIZE = 32  # including the nul
+UNKNOWN_MAGNITUDE = 9999
+TURN = 1 << 32
+
+TYPES = {
+    "star": 0,
+    "double": 1,
+    "galaxy": 2,
+    "open": 3,
+    "globular": 4,
+    "planetary": 5,
+    "nebula": 6,
+    "snr": 7,
+    "asterism": 8,
+    "other": 9,
+}
+
+
+def sexagesimal(text):
+    text = text.strip()
+    if ":" not in text:
+        return float(text)
+    sign = -1 if text.startswith("-") else 1
+    parts = [abs(float(p)) for p in text.lstrip("+-").split(":")]
+    while len(parts) < 3:
+        parts.append(0)
+    return sign * (parts[0] + parts[1] / 60 + parts[2] / 3600)
+
+
+def parse(path):
+    objects = []
+    with open(path, newline="") as f:
+        for number, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].startswith("#"):
+                continue
+            where = "%s:%d" % (path, number)
+            if len(row) != 6:
+                sys.exit("%s: expected 6 fields" % where)
+            name, kind, ra, dec, magnitude, size = (field.strip() for field in row)
+            if len(name.encode()) >= NAME_SIZE or '"' in name or "\\" in name:
+                sys.exit("%s: name too long or has quotes" % where)
+            if kind not in TYPES:
+                sys.exit("%s: unknown type %s" % (where, kind))
+            ra = sexagesimal(ra) % 24
+            dec = sexagesimal(dec)
+            if not -90 <= dec <= 90:
+                sys.exit("%s: dec out of range" % where)
+            magnitude = (
+                round(float(magnitude) * 100) if magnitude else UNKNOWN_MAGNITUDE
+            )
+            size = min(255, max(0, round(float(size or 0))))
+            objects.append((name, TYPES[kind], ra, dec, magnitude, size))
+    return objects
+
+
+def build(objects, band_count):
+    def band(dec):
+        return min(band_count - 1, int((dec + 90) * band_count / 180))
+
+    def ra_units(ra):
+        return int(ra / 24 * TURN) % TURN
+
+    objects.sort(key=lambda o: (band(o[3]), ra_units(o[2])))
+
+    names = bytearray()
+    records = bytearray()
+    bands = [0] * (band_count + 1)
+    for name, kind, ra, dec, magnitude, size in objects:
+        bands[band(dec) + 1] += 1
+        dec_units = int(round(dec / 360 * TURN))
+        dec_units = max(-(1 << 30), min(1 << 30, dec_units))
+        records += struct.pack(
+            "<IihBBI", ra_units(ra), dec_units, magnitude, kind, size, len(names)
+        )
+        names += name.encode() + b"\0"
+    for b in range(band_count):
+        bands[b + 1] += bands[b]
+
+    bands_offset = HEADER_SIZE
+    records_offset = bands_offset + 4 * (band_count + 1)
+    names_offset = records_offset + len(records)
+    header = struct.pack(
+        "<4sHHIIIIII",
+        MAGIC,
+        VERSION,
+        band_count,
+        len(objects),
+        bands_offset,
+        records_offset,
+        names_offset,
+        len(names),
+        0,
+    )
+    return header + struct.pack("<%dI" % len(bands), *bands) + records + names
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("csv")
+    parser.add_argument("output")
+    parser.add_argument(
+        "--bands", type=int, default=90, help="declination bands (default 2 degrees)"
+    )
+    args = parser.parse_args()
+    if not 1 <= args.bands <= 180:
+        sys.exit("--bands must be 1 to 180")
+    objects = parse(args.csv)
+    data = build(objects, args.bands)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("%d objects, %d bytes" % (len(objects), len(data)))
+
+
+if __name__ == "__main__":
+    main()
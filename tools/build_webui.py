@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Builds the compressed, fingerprinted WebUI (data/www) from webui/.
+
+    python3 tools/build_webui.py webui data/www
+
+Run it after changing anything in webui/, then upload the filesystem
+image as usual. Every file is gzipped (level 9, no timestamp, so the
+output only changes when the input does). Everything apart from the entry
+page gets a content hash in its name and the references to it in the
+entry page are rewritten to match, so browsers can cache it for good.
+The entry page keeps its url and is revalidated with its ETag.
+
+manifest.txt lists what the device serves; the format is described in
+lib/WebAssets/src/WebAssets.h, keep the two in step.
+
+--report prints the bytes and an estimate of the time a first and a
+repeat page load take over a slow link, before and after.
+"""
+import argparse
+import gzip
+import hashlib
+import os
+import sys
+
+ENTRY_PAGE = "index.htm"
+CAPACITY = 8  # WEB_ASSET_CAPACITY
+MAX_NAME = 47  # WEB_ASSET_URL_SIZE / WEB_ASSET_FILE_SIZE less the nul
+
+TYPES = {
+    ".htm": "text/html",
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".json": "application/json",
+}
+
+# Throttled link for --report: a weak phone hotspot
+LINK_BITS_PER_SECOND = 400_000
+LINK_ROUND_TRIP_SECONDS = 0.3
+HEADER_BYTES = 250  # request and response headers, roughly
+
+
+def digest(data):
+    return hashlib.sha256(data).hexdigest()[:16]
+
+
+def fingerprinted(name, data):
+    stem, ext = os.path.splitext(name)
+    return "%s.%s%s" % (stem, digest(data)[:8], ext)
+
+
+def load_time(responses):
+    """One request after another: the page has to arrive before it asks
+    for anything else."""
+    total = 0
+    for size in responses:
+        total += LINK_ROUND_TRIP_SECONDS + (size + HEADER_BYTES) * 8 / LINK_BITS_PER_SECOND
+    return total
+
+
+def build(source, output, report):
+    names = sorted(n for n in os.listdir(source)
+                   if os.path.isfile(os.path.join(source, n)))
+    if ENTRY_PAGE not in names:
+        sys.exit("no %s in %s" % (ENTRY_PAGE, source))
+    if len(names) > CAPACITY:
+        sys.exit("%d files, the device table holds %d" % (len(names), CAPACITY))
+    contents = {}
+    for name in names:
+        ext = os.path.splitext(name)[1]
+        if ext not in TYPES:
+            sys.exit("don't know the content type of %s" % name)
+        with open(os.path.join(source, name), "rb") as f:
+            contents[name] = f.read()
+
+    # only the entry page refers to the others, so the assets' hashes can
+    # be taken as they are
+    renamed = {n: fingerprinted(n, contents[n]) for n in names if n != ENTRY_PAGE}
+    for old, new in renamed.items():
+        contents[ENTRY_PAGE] = contents[ENTRY_PAGE].replace(
+            ("/" + old).encode(), ("/" + new).encode())
+
+    os.makedirs(output, exist_ok=True)
+    for stale in os.listdir(output):
+        os.remove(os.path.join(output, stale))
+
+    lines = ["# url file etag type size immutable"]
+    plain = []
+    compressed = []
+    for name in names:
+        data = gzip.compress(contents[name], 9, mtime=0)
+        served = renamed.get(name, name)
+        url = "/" if name == ENTRY_PAGE else "/" + served
+        file = served + ".gz"
+        if len(url) > MAX_NAME or len(file) > MAX_NAME:
+            sys.exit("name too long for the device table: %s" % file)
+        with open(os.path.join(output, file), "wb") as f:
+            f.write(data)
+        lines.append("%s %s \"%s\" %s %d %d" % (
+            url, file, digest(data), TYPES[os.path.splitext(name)[1]],
+            len(data), 0 if name == ENTRY_PAGE else 1))
+        plain.append(len(contents[name]))
+        compressed.append(len(data))
+    with open(os.path.join(output, "manifest.txt"), "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+    print("%d files, %d bytes, %d compressed" % (
+        len(names), sum(plain), sum(compressed)))
+    if report:
+        # before: everything uncompressed and uncached on every load.
+        # after: first load compressed; repeat loads revalidate the
+        # entry page (a 304, headers only) and take the rest from cache
+        print("%-28s %10s %10s" % ("", "bytes", "seconds"))
+        for label, sizes in (("before, every load", plain),
+                             ("after, first load", compressed),
+                             ("after, repeat load", [0])):
+            print("%-28s %10d %10.2f" % (label, sum(sizes) + HEADER_BYTES * len(sizes),
+                                         load_time(sizes)))
+        print("(%d kbit/s, %d ms round trip)" % (
+            LINK_BITS_PER_SECOND / 1000, LINK_ROUND_TRIP_SECONDS * 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="directory of WebUI files")
+    parser.add_argument("output", help="directory for the LittleFS image")
+    parser.add_argument("--report", action="store_true",
+                        help="estimate page load bytes and time")
+    args = parser.parse_args()
+    build(args.source, args.output, args.report)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Decodes session recorder files (downloaded from /sessionFiles) to CSV.
+
+    python3 tools/decode_session.py 00000012.rec 00000013.rec > night.csv
+    python3 tools/decode_session.py --summary 00000012.rec
+
+Files are read in the order given (oldest first is the usual), one CSV row
+per record, with the deltas undone: time (UTC, ISO 8601), type, then the
+fields of that type by name. A file cut off by a reset decodes up to the
+damage, with a warning.
+
+The format is described in lib/Recorder/src/SessionRecorder.h, keep the
+two in step.
+"""
+import argparse
+import csv
+import datetime
+import sys
+
+MAGIC = b"EQRC"
+VERSION = 1
+RA_UNITS_PER_HOUR = 36000000.0
+ANGLE_UNITS_PER_DEGREE = 3600000.0
+TENTHS = 10.0
+
+PLATFORM_RUNNING = 1
+PLATFORM_SLEWING = 2
+PLATFORM_HAS_DEC_AXIS = 4
+SETTINGS_REFRACTION = 1
+
+QUERIES = ["ra", "dec", "alt", "az"]
+TYPES = {1: "encoders", 2: "model", 3: "platform", 4: "sync", 5: "query",
+         6: "settings"}
+FIELDS = ["time", "type", "altEncoder", "azEncoder", "raHours", "decDegrees",
+          "altDegrees", "azDegrees", "runtimeFromCenterSeconds",
+          "decAxisDegrees", "running", "slewing", "hasDecAxis", "packetCount",
+          "platformRaAxisDegrees", "platformDecAxisDegrees",
+          "platformRaAxisDegreesPerSecond", "query", "value", "latitude",
+          "longitude", "altStepsPerRevolution", "azStepsPerRevolution",
+          "refraction", "temperatureCelsius", "pressureMillibars",
+          "syncPoints"]
+
+
+class DecodeError(Exception):
+    pass
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.offset = 0
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            if self.offset >= len(self.data):
+                raise DecodeError("cut off at byte %d" % self.offset)
+            byte = self.data[self.offset]
+            self.offset += 1
+            value |= (byte & 0x7f) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+            if shift >= 64:
+                raise DecodeError("bad varint at byte %d" % self.offset)
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+
+def records(data):
+    """Yields a dict per record, RECORD_FILE_START included as "file"."""
+    reader = Reader(data)
+    state = None
+    while reader.offset < len(data):
+        start = reader.offset
+        if data[start:start + len(MAGIC)] == MAGIC:
+            reader.offset += len(MAGIC)
+            if reader.offset >= len(data) or data[reader.offset] != VERSION:
+                raise DecodeError("unknown version at byte %d" % reader.offset)
+            reader.offset += 1
+            state = {"time": reader.signed(), "altEncoder": 0, "azEncoder": 0,
+                     "ra": 0, "dec": 0, "alt": 0, "az": 0, "runtime": 0,
+                     "decAxis": 0, "packetCount": 0}
+            yield {"time": state["time"], "type": "file"}
+            continue
+        if state is None:
+            raise DecodeError("no header")
+        kind = reader.varint()
+        if kind not in TYPES:
+            raise DecodeError("unknown record type %d at byte %d" % (kind, start))
+        state["time"] += reader.signed()
+        record = {"time": state["time"], "type": TYPES[kind]}
+        if kind == 1:
+            state["altEncoder"] += reader.signed()
+            state["azEncoder"] += reader.signed()
+            record.update(altEncoder=state["altEncoder"],
+                          azEncoder=state["azEncoder"])
+        elif kind == 2:
+            for key in ("ra", "dec", "alt", "az"):
+                state[key] += reader.signed()
+            record.update(raHours=state["ra"] / RA_UNITS_PER_HOUR,
+                          decDegrees=state["dec"] / ANGLE_UNITS_PER_DEGREE,
+                          altDegrees=state["alt"] / ANGLE_UNITS_PER_DEGREE,
+                          azDegrees=state["az"] / ANGLE_UNITS_PER_DEGREE)
+        elif kind == 3:
+            state["runtime"] += reader.signed()
+            state["decAxis"] += reader.signed()
+            flags = reader.varint()
+            state["packetCount"] = (state["packetCount"] + reader.varint()) & 0xffffffff
+            record.update(runtimeFromCenterSeconds=state["runtime"] / 1000.0,
+                          decAxisDegrees=state["decAxis"] / ANGLE_UNITS_PER_DEGREE,
+                          running=int(bool(flags & PLATFORM_RUNNING)),
+                          slewing=int(bool(flags & PLATFORM_SLEWING)),
+                          hasDecAxis=int(bool(flags & PLATFORM_HAS_DEC_AXIS)),
+                          packetCount=state["packetCount"])
+        elif kind == 4:
+            values = [reader.signed() for _ in range(7)]
+            record.update(raHours=values[0] / RA_UNITS_PER_HOUR,
+                          decDegrees=values[1] / ANGLE_UNITS_PER_DEGREE,
+                          altEncoder=values[2], azEncoder=values[3],
+                          platformRaAxisDegrees=values[4] / ANGLE_UNITS_PER_DEGREE,
+                          platformDecAxisDegrees=values[5] / ANGLE_UNITS_PER_DEGREE,
+                          platformRaAxisDegreesPerSecond=values[6] / ANGLE_UNITS_PER_DEGREE)
+        elif kind == 5:
+            query = reader.varint()
+            if query >= len(QUERIES):
+                raise DecodeError("unknown query %d at byte %d" % (query, start))
+            # a delta from the latest model value of the same thing
+            units = state[QUERIES[query]] + reader.signed()
+            record.update(query=QUERIES[query],
+                          value=units / (RA_UNITS_PER_HOUR if query == 0
+                                         else ANGLE_UNITS_PER_DEGREE))
+        elif kind == 6:
+            latitude = reader.signed()
+            longitude = reader.signed()
+            alt_steps = reader.signed()
+            az_steps = reader.signed()
+            flags = reader.varint()
+            temperature = reader.signed()
+            pressure = reader.signed()
+            record.update(latitude=latitude / ANGLE_UNITS_PER_DEGREE,
+                          longitude=longitude / ANGLE_UNITS_PER_DEGREE,
+                          altStepsPerRevolution=alt_steps,
+                          azStepsPerRevolution=az_steps,
+                          refraction=int(bool(flags & SETTINGS_REFRACTION)),
+                          temperatureCelsius=temperature / TENTHS,
+                          pressureMillibars=pressure / TENTHS,
+                          syncPoints=reader.varint())
+        yield record
+
+
+def iso(millis):
+    when = datetime.datetime(1970, 1, 1) + datetime.timedelta(milliseconds=millis)
+    return when.isoformat(timespec="milliseconds") + "Z"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="+", help="recorder files, oldest first")
+    parser.add_argument("--summary", action="store_true",
+                        help="count records and bytes instead of listing them")
+    args = parser.parse_args()
+
+    writer = None if args.summary else csv.DictWriter(sys.stdout, FIELDS)
+    if writer:
+        writer.writeheader()
+    counts = {}
+    total_bytes = 0
+    first = last = None
+    for name in args.files:
+        with open(name, "rb") as f:
+            data = f.read()
+        total_bytes += len(data)
+        try:
+            for record in records(data):
+                counts[record["type"]] = counts.get(record["type"], 0) + 1
+                if record["type"] != "file":
+                    first = record["time"] if first is None else min(first, record["time"])
+                    last = record["time"] if last is None else max(last, record["time"])
+                if writer:
+                    record["time"] = iso(record["time"])
+                    writer.writerow(record)
+        except DecodeError as error:
+            print("%s: %s" % (name, error), file=sys.stderr)
+
+    if args.summary:
+        for kind in ["file"] + list(TYPES.values()):
+            print("%-10s %8d" % (kind, counts.get(kind, 0)))
+        total = sum(counts.values())
+        print("%d records in %d bytes (%.1f bytes each)" % (
+            total, total_bytes, total_bytes / max(total, 1)))
+        if first is not None:
+            hours = (last - first) / 3600000.0
+            print("%s to %s, %.2f hours%s" % (
+                iso(first), iso(last), hours,
+                ", %.1fKB an hour" % (total_bytes / 1024.0 / hours) if hours > 0 else ""))
+
+
+if __name__ == "__main__":
+    main()
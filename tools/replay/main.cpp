@@ -0,0 +1,251 @@
+/**
+ * Replays recorded sessions (downloaded from /sessionFiles) through the
+ * model on the host, and sweeps settings to find the ones that would have
+ * pointed best. See lib/Replay.
+ *
+ *   pio run -e replay
+ *   .pio/build/replay/program 00000012.rec 00000013.rec
+ *   .pio/build/replay/program --trace 00000012.rec
+ *   .pio/build/replay/program --sweep azSteps=107000:110000:10 \
+ *       --sweep refraction=0:1:1 --export best.csv 00000012.rec
+ *
+ * Files are replayed in the order given, oldest first. --set replays with
+ * a setting changed throughout; --sweep tries every combination of the
+ * ranges on all cores (--threads to change that) and lists the best
+ * --top. Parameters: altSteps, azSteps, latitude, longitude, refraction,
+ * temperature, pressure.
+ *
+ * --export writes the best fit (or the --set settings) in the device's
+ * Preferences keys as an NVS partition CSV:
+ *
+ *   nvs_partition_gen.py generate best.csv nvs.bin 0x5000
+ *
+ * An image made from it holds only these keys, so flashing it over the
+ * nvs partition loses the rest (wifi credentials included): add those
+ * first, or just type the values into the WebUI.
+ */
+#include "Logging.h"
+#include "SessionReplay.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#define MAX_RANGES REPLAY_PARAMETER_COUNT
+#define PREFERENCES_CSV_SIZE 512
+
+static void usage() {
+  fprintf(stderr,
+          "usage: replay [--trace] [--set name=value]... "
+          "[--sweep name=start:stop:step]...\n"
+          "              [--threads n] [--top n] [--export prefs.csv] "
+          "file.rec...\n"
+          "parameters: altSteps azSteps latitude longitude refraction "
+          "temperature pressure\n");
+}
+
+static bool loadFile(const char *name, ReplaySession &session) {
+  FILE *file = fopen(name, "rb");
+  if (!file) {
+    fprintf(stderr, "%s: can't open\n", name);
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(file);
+  bool wasTruncated = session.truncated;
+  session.truncated = false;
+  if (!loadSessionFile(data.data(), data.size(), session)) {
+    fprintf(stderr, "%s: not a session recording\n", name);
+    return false;
+  }
+  if (session.truncated) {
+    fprintf(stderr, "%s: cut short, replaying up to the damage\n", name);
+  }
+  session.truncated = session.truncated || wasTruncated;
+  return true;
+}
+
+static void printSettings(const ReplaySettings &settings) {
+  printf("  alt steps %ld, az steps %ld, latitude %.4f, longitude %.4f,\n"
+         "  refraction %s at %.1fC %.1fmb\n",
+         settings.altStepsPerRevolution, settings.azStepsPerRevolution,
+         settings.latitude, settings.longitude,
+         settings.doesRefraction ? "on" : "off", settings.temperatureCelsius,
+         settings.pressureMillibars);
+}
+
+// pointing error in arcminutes, which is what an eyepiece field is in
+static void printErrors(const ReplayResult &result) {
+  if (result.predictions == 0) {
+    printf("  no syncs to score (%d syncs, the first %d build the "
+           "alignment)\n",
+           result.syncs, REPLAY_WARMUP_SYNCS);
+    return;
+  }
+  printf("  pointing error over %d of %d syncs (arcmin): rms %.2f mean %.2f "
+         "median %.2f p90 %.2f max %.2f\n",
+         result.predictions, result.syncs, result.rmsErrorDegrees * 60,
+         result.meanErrorDegrees * 60, result.medianErrorDegrees * 60,
+         result.p90ErrorDegrees * 60, result.maxErrorDegrees * 60);
+}
+
+static bool writeExport(const char *name, const ReplaySettings &settings) {
+  char csv[PREFERENCES_CSV_SIZE];
+  size_t length = formatPreferencesCsv(settings, csv, sizeof(csv));
+  FILE *file = fopen(name, "w");
+  if (length == 0 || !file) {
+    fprintf(stderr, "%s: can't write\n", name);
+    if (file) {
+      fclose(file);
+    }
+    return false;
+  }
+  bool written = fwrite(csv, 1, length, file) == length;
+  return fclose(file) == 0 && written;
+}
+
+int main(int argc, char **argv) {
+  ReplayConfig base;
+  ReplayRange ranges[MAX_RANGES];
+  size_t rangeCount = 0;
+  unsigned threads = std::thread::hardware_concurrency();
+  int top = 10;
+  bool trace = false;
+  bool changed = false; // any --set
+  const char *exportName = nullptr;
+  std::vector<const char *> files;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--trace") == 0) {
+      trace = true;
+    } else if (strcmp(arg, "--set") == 0 && hasValue) {
+      ReplayRange range;
+      if (!parseReplayRange(argv[++i], range) || range.step != 0) {
+        fprintf(stderr, "bad --set %s\n", argv[i]);
+        return 2;
+      }
+      base.set(range.parameter, range.start);
+      changed = true;
+    } else if (strcmp(arg, "--sweep") == 0 && hasValue) {
+      if (rangeCount == MAX_RANGES ||
+          !parseReplayRange(argv[++i], ranges[rangeCount])) {
+        fprintf(stderr, "bad --sweep %s\n", argv[i]);
+        return 2;
+      }
+      rangeCount++;
+    } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(arg, "--top") == 0 && hasValue) {
+      top = atoi(argv[++i]);
+    } else if (strcmp(arg, "--export") == 0 && hasValue) {
+      exportName = argv[++i];
+    } else if (arg[0] == '-') {
+      usage();
+      return 2;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    usage();
+    return 2;
+  }
+
+  ReplaySession session;
+  for (const char *name : files) {
+    if (!loadFile(name, session)) {
+      return 1;
+    }
+  }
+  if (!session.hasSettings) {
+    fprintf(stderr, "no settings recorded, nothing to replay\n");
+    return 1;
+  }
+  printf("%u records, %u syncs\n", (unsigned)session.records.size(),
+         (unsigned)session.syncs);
+
+  // the model logs every sync, which would swamp the output
+  setLoggingEnabled(false);
+  ReplayResult recorded = replaySession(session, base, trace);
+  printf("%s:\n", changed ? "With --set" : "As recorded");
+  printSettings(recorded.finalSettings);
+  printErrors(recorded);
+  if (trace) {
+    printf("  replayed vs recorded position over %d samples (arcsec): mean "
+           "%.3f max %.3f\n",
+           recorded.modelSamples, recorded.meanModelDivergenceDegrees * 3600,
+           recorded.maxModelDivergenceDegrees * 3600);
+  }
+
+  ReplaySettings best = recorded.finalSettings;
+  if (rangeCount > 0) {
+    std::vector<ReplayConfig> configs;
+    if (!buildReplayGrid(ranges, rangeCount, base, configs)) {
+      fprintf(stderr, "sweep is backwards or over %d configs\n",
+              REPLAY_MAX_CONFIGS);
+      return 2;
+    }
+    std::vector<ReplayResult> results;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    runReplaySweep(session, configs, threads, results);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    printf("Swept %u configs on %u threads in %.2fs (%.0f replays/s)\n",
+           (unsigned)configs.size(), threads, seconds,
+           configs.size() / (seconds > 0 ? seconds : 1));
+
+    int winner = bestReplayResult(results);
+    if (winner < 0) {
+      printf("  no config scored any syncs\n");
+      return 1;
+    }
+    // best first, the earliest on a tie like bestReplayResult
+    std::vector<size_t> order;
+    for (size_t i = 0; i < results.size(); i++) {
+      if (results[i].predictions == results[winner].predictions) {
+        order.push_back(i);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return results[a].rmsErrorDegrees < results[b].rmsErrorDegrees;
+    });
+    printf("  rms'   max'  ");
+    for (size_t r = 0; r < rangeCount; r++) {
+      printf(" %12s", replayParameterName(ranges[r].parameter));
+    }
+    printf("\n");
+    for (size_t k = 0; k < order.size() && (int)k < top; k++) {
+      const ReplayResult &result = results[order[k]];
+      printf("%6.2f %6.2f  ", result.rmsErrorDegrees * 60,
+             result.maxErrorDegrees * 60);
+      for (size_t r = 0; r < rangeCount; r++) {
+        printf(" %12g", configs[order[k]].value[ranges[r].parameter]);
+      }
+      printf("\n");
+    }
+    best = results[winner].finalSettings;
+    printf("Best fit:\n");
+    printSettings(best);
+    printErrors(results[winner]);
+  }
+
+  if (exportName) {
+    if (!writeExport(exportName, best)) {
+      return 1;
+    }
+    printf("Wrote %s\n", exportName);
+  }
+  return 0;
+}